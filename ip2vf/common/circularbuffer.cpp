@@ -4,6 +4,12 @@
 #include <cmath>
 #include <algorithm>    // for std::fill_n
 #include <chrono>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 
 #include "common.h"
@@ -12,52 +18,152 @@
 #include "rtpframe.h"
 #include "circularbuffer.h"
 
+/**********************************************************************************************
+*
+* CRcvNotifier
+*
+***********************************************************************************************/
+
+/*!
+* \fn notify
+* \brief wake the reader, if it waits for packets
+*/
+void CRcvNotifier::notify() {
+
+    if (_waiting.load()) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _cv.notify_one();
+    }
+}
+
+/*!
+* \fn wait
+* \brief wait for packets received after lastEvents
+*
+* \param lastEvents value of getEvents() when the reader found no packet
+* \param timeoutMs max time to wait, in ms
+*/
+void CRcvNotifier::wait(unsigned int lastEvents, int timeoutMs) {
+
+    std::unique_lock<std::mutex> lock(_mtx);
+    _waiting.store(true);
+    _cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] { return _events.load() != lastEvents; });
+    _waiting.store(false);
+}
+
+/**********************************************************************************************
+*
+* CCircularRcvBuffer
+*
+***********************************************************************************************/
+
 CCircularRcvBuffer::CCircularRcvBuffer() {
     _index    = -1;
     _bInit    = false;
     _buffer   = NULL;
     _seqArray = NULL;
+    _lenArray = NULL;
+    _timeArray = NULL;
+    _stampArray = NULL;
     _nbElmt   = -1;
+    _mask     = 0;
     _closed   = true;
-    _size     = 0;
-    _q        = NULL;
+    _notifier = NULL;
+    _peer     = NULL;
+    _offlineUs = 20000;
     _samplesize = -1;
+    _lastRcvSeq = -1;
+    _lastRcvTime = 0;
+    _lateUs   = 0;
+    _groupSize = 1;
+    _steering = UDP_REUSEPORT_STEER_HASH;
+    _seqStride = 1;
+    _cpu      = -1;
+    _timestampMode = UDP_TIMESTAMP_NONE;
+    _udpSock  = NULL;
 };
 
 CCircularRcvBuffer::~CCircularRcvBuffer() {
     close();
+    delete _udpSock;
 };
 
-int CCircularRcvBuffer::init(CQueue<int>* q, const char* remote_addr, const char* local_addr, int port, int nbElmt, int index) {
+long long CCircularRcvBuffer::getTimeInUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int CCircularRcvBuffer::init(CRcvNotifier* notifier, const char* remote_addr, const char* local_addr, int port, int nbElmt, int index, int batchSize, const char* ifname) {
 
     LOG_INFO("[%d] --> (port=%d, nbElmt=%d)", index, port, nbElmt);
 
-    if (nbElmt <= 0 || port <= 0)
+    if (nbElmt <= 0 || port <= 0 || notifier == NULL)
         return VMI_E_INVALID_PARAMETER;
 
     close();
 
-    _q        = q;
+    // The slot of a packet is its seq number modulo the size: use a power of 2
+    int size = 1;
+    while (size < nbElmt && size < RCV_RING_MAX_SIZE)
+        size *= 2;
+
+    _notifier = notifier;
     _index    = index;
     _closed   = false;
-    _nbElmt   = nbElmt;
+    _nbElmt   = size;
+    _mask     = size - 1;
     _buffer   = new char[_nbElmt*RTP_PACKET_SIZE];
-    _seqArray = new int[_nbElmt];
-    _wr_idx   = -1;
-    _rd_idx   = -1;
-    std::fill(_seqArray, _seqArray+_nbElmt, -1);
+    _seqArray = new std::atomic<int>[_nbElmt];
+    _lenArray = new int[_nbElmt];
+    _timeArray = new std::atomic<long long>[_nbElmt];
+    _stampArray = new std::atomic<long long>[_nbElmt];
+    for (int i = 0; i < _nbElmt; i++) {
+        _seqArray[i] = -1;
+        _lenArray[i] = 0;
+        _timeArray[i] = 0;
+        _stampArray[i] = 0;
+    }
+    _lastRcvSeq = -1;
+    _lastRcvTime = 0;
+    _lateUs = 0;
 
-    if (!_udpSock.isValid())
-        int result = _udpSock.openSocket(remote_addr, local_addr, port, true);
+    // The interface name selects the socket, see UDP::createReceiver()
+    if (_udpSock == NULL)
+        _udpSock = UDP::createReceiver(ifname);
+    // _receive() takes the packets from the batch received by the socket
+    _udpSock->setBatchSize(batchSize);
+    if (_groupSize > 1)
+        _udpSock->setReusePort(_groupSize, index, _steering);
+    if (!_udpSock->isValid())
+        int result = _udpSock->openSocket(remote_addr, local_addr, port, true);
+    if (_udpSock->isValid() && _timestampMode != UDP_TIMESTAMP_NONE)
+        _udpSock->setTimestampMode(_timestampMode, ifname);
 
     _th_rcv = std::thread([this] { _rcv_thread(); });
 
     _bInit = true;
 
-    LOG_INFO("[%d] <--", _index);
+    LOG_INFO("[%d] <-- (ring of %d packets)", _index, _nbElmt);
     return VMI_E_OK;
 };
 
+/*!
+* \fn setReusePort
+* \brief receive with one socket of a group sharing the port, see UDP::setReusePort(). Must be
+* called before init(), the index of the socket in the group is the index of the buffer.
+*
+* \param groupSize nb of sockets in the group
+* \param steering UDP_REUSEPORT_STEER_xxx
+* \param cpu if >= 0, the receive thread is bound to this CPU
+*/
+void CCircularRcvBuffer::setReusePort(int groupSize, int steering, int cpu) {
+
+    _groupSize = (groupSize < 1 ? 1 : groupSize);
+    _steering = steering;
+    // With the seq steering, the next packet of this socket is the seq number + group size
+    _seqStride = (_groupSize > 1 && steering == UDP_REUSEPORT_STEER_SEQ ? _groupSize : 1);
+    _cpu = cpu;
+}
+
 int CCircularRcvBuffer::close() {
 
     if (!_bInit)
@@ -66,8 +172,8 @@ int CCircularRcvBuffer::close() {
     _closed = true;
 
     // Unlock any blocking readSocket()
-    if (_udpSock.isValid())
-        _udpSock.closeSocket();
+    if (_udpSock && _udpSock->isValid())
+        _udpSock->closeSocket();
 
     // wait for _th_sec closing
     LOG_INFO("[%d] wait for end of thread", _index);
@@ -82,6 +188,16 @@ int CCircularRcvBuffer::close() {
     if (_seqArray)
         delete[] _seqArray;
     _seqArray = NULL;
+    if (_lenArray)
+        delete[] _lenArray;
+    _lenArray = NULL;
+    if (_timeArray)
+        delete[] _timeArray;
+    _timeArray = NULL;
+    if (_stampArray)
+        delete[] _stampArray;
+    _stampArray = NULL;
+    _bInit = false;
 
     return VMI_E_OK;
 };
@@ -89,8 +205,19 @@ int CCircularRcvBuffer::close() {
 void* CCircularRcvBuffer::_rcv_thread() {
 
     LOG_INFO("[%d] -->", _index);
+    if (_cpu >= 0) {
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << _cpu);
+#else
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(_cpu, &cpuset);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+        if (ret != 0)
+            LOG_ERROR("[%d] can't bind to cpu %d: %s", _index, _cpu, strerror(ret));
+#endif
+    }
     int seq = 0;
-    CRTPFrame rtpframe;
     while (!_closed) {
 //#define _DEBUG
 #ifdef _DEBUG
@@ -111,157 +238,149 @@ void* CCircularRcvBuffer::_rcv_thread() {
             }
         }
 #endif
-        seq = write();
-        if (seq < 0) {
-            //LOG_ERROR("[%d] error when reading RTP frame: seq=%d", _index, seq);
-            //abort();
-            //break;
-        }
-        else {
-            // No error, push the packet to the datasourceSPSRTP
-            int p = (_index << 16) + (seq & 0xFFFF);
-            _q->push(p);
-            _lastRcvSeq = seq;
+        seq = _receive();
+        if (seq >= 0) {
+            // Wake the reader once per batch of packets, not for each one
+            _notifier->onPacket();
+            if (!_udpSock->hasBatchedPackets())
+                _notifier->notify();
         }
         if (_closed) {
             LOG_INFO("[%d] closing...", _index);
             break;
         }
-
-        //if( result%1000==0) LOG_INFO("Rcv packet #%d", result);
-        //std::this_thread::yield();
     }
     LOG_INFO("[%d] <--", _index);
     return 0;
 }
-#include <iostream>
-int CCircularRcvBuffer::write() {
-    int result = -1;
+
+/*!
+* \fn _receive
+* \brief receive one packet and store it in the slot of its seq number. The packet is received in
+* the slot of the next packet in sequence for this socket, and moved only if it's another one.
+*
+* \return seq number of the received packet, -1 if error
+*/
+int CCircularRcvBuffer::_receive() {
     int len = RTP_PACKET_SIZE;
 
-    std::unique_lock<std::mutex> lock(_mtx);
-
     if (_buffer == NULL || _seqArray == NULL)
-        return result;
-        
-    //inc the write pointer for next packet to read
-    int old_wr_idx = _wr_idx;
-    _wr_idx = (_wr_idx + 1) % _nbElmt;
+        return -1;
 
-    if (_wr_idx > 0 && _rd_idx < 0) _rd_idx = 0;
-    if (_wr_idx == _rd_idx) {
-        // We don't read fast enough... 
-        // For master, wait for free slot: i.e. don't inc the write pointer, and return (do nothing)
-        // For secundary, delete oldest RTP packet: i.e. inc the read pointer
-        if (_isMaster) {
-            //LOG_INFO("[%d] we don't read fast enough..., _rd_idx=%d, _wr_idx=%d, q=%d", _index, _rd_idx, _wr_idx, _q->size());
-            _wr_idx = old_wr_idx;
-            return -1;
-        }
-        else
-            _rd_idx = (_wr_idx + 1) % _nbElmt;
-    }
-    _seqArray[_wr_idx] = -1;
+    int last = _lastRcvSeq.load(std::memory_order_relaxed);
+    int slot = _getSlot(last + _seqStride);
+    _seqArray[slot].store(-1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
 
-    // Read one packet from RTP stream and write it on the buffer at correct place
-    char* wr_ptr = _buffer + (_wr_idx * RTP_PACKET_SIZE);
-    result = _udpSock.readSocket(wr_ptr, &len);
+    char* wr_ptr = _buffer + (slot * RTP_PACKET_SIZE);
+    int result = _udpSock->readSocket(wr_ptr, &len);
     if (result <= 0) {
         if( !_closed)
             LOG_ERROR("[%d] error when reading RTP frame: result=%d", _index, result);
-        result = -1; // Be carefull, result==0 is an "error", but return value is -1 if error. If return 0, it's a packet seq nb.
-        return result;
+        return -1; // Be carefull, result==0 is an "error", but return value is -1 if error. If return 0, it's a packet seq nb.
     }
     if (_samplesize == -1)
         _samplesize = result;
 
-    // Get seq number of this RTP packet, and update the seq array
+    // Get seq number of this RTP packet
     CRTPFrame rtpframe;
     rtpframe.setBuffer((unsigned char*)wr_ptr, len);
     rtpframe.readHeader();
-    _seqArray[_wr_idx] = rtpframe._seq;
-    result = rtpframe._seq;
-    _size = (_wr_idx > _rd_idx) ? (_wr_idx - _rd_idx) : (65536-(_rd_idx- _wr_idx));
-    _writed++;
+    int seq = rtpframe._seq;
+    long long now = getTimeInUs();
 
-    //if (rtpframe._seq % 1000 == 0) LOG_INFO("[%d] write packet#%d at pos %d [%d..%d]", _index, _seqArray[_wr_idx], _wr_idx, _seqArray[_rd_idx<0?0: _rd_idx], _seqArray[_wr_idx]);
-   // if ((rtpframe._seq % 1000 == 0) && _index == 1) LOG_INFO("[%d] write packet#%d at pos %d [%d..%d], _size=%d", _index, _seqArray[_wr_idx], _wr_idx, _rd_idx, _wr_idx, _size);
+    // Back after an interruption: the stored packets are too old to be used, and the sender may
+    // have restarted with a lower seq number. Restart on this packet.
+    long long lastTime = _lastRcvTime.load(std::memory_order_relaxed);
+    if (lastTime != 0 && now - lastTime > _offlineUs) {
+        for (int i = 0; i < _nbElmt; i++)
+            _seqArray[i].store(-1, std::memory_order_relaxed);
+        last = -1;
+        _lastRcvSeq.store(-1);
+    }
 
-    return result;
+    int dest = _getSlot(seq);
+    if (dest != slot) {
+        _seqArray[dest].store(-1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(_buffer + (dest * RTP_PACKET_SIZE), wr_ptr, len);
+    }
+    _lenArray[dest] = len;
+    _timeArray[dest].store(now, std::memory_order_relaxed);
+    _stampArray[dest].store(_udpSock->getLastTimestamp(), std::memory_order_relaxed);
+    _seqArray[dest].store(seq, std::memory_order_release);
+
+    // Path skew: the packet has already been received on the other path, smoothed on 8 packets
+    if (_peer != NULL) {
+        long long peerTime = _peer->getArrivalTime(seq);
+        if (peerTime > 0) {
+            long long late = _lateUs.load(std::memory_order_relaxed);
+            _lateUs.store(late > 0 ? (7 * late + (now - peerTime)) / 8 : (now - peerTime));
+            _peer->_lateUs.store(0);
+        }
+    }
+
+    if (last < 0 || ((seq - last) & 0xFFFF) < 32768)
+        _lastRcvSeq.store(seq);
+    _lastRcvTime.store(now);
+
+    return seq;
 };
 
-int CCircularRcvBuffer::read(int wantedSeq, char* buffer, int buflen) {
-    int result = -1;
-
-    std::unique_lock<std::mutex> lock(_mtx);
+/*!
+* \fn read
+* \brief copy a packet from its seq number
+*
+* \param wantedSeq seq number of the packet
+* \param buffer output buffer
+* \param buflen size of buffer
+* \param timestamp if not NULL, receive time taken by the socket in ns, 0 if unknown
+* \return size of the packet, -1 if not received
+*/
+int CCircularRcvBuffer::read(int wantedSeq, char* buffer, int buflen, long long* timestamp) {
 
     if (_buffer == NULL || _seqArray == NULL)
-        return result;
+        return -1;
 
-    _rd_idx = (_rd_idx + 1) % _nbElmt;
-    int lastseq = _seqArray[_rd_idx];
-    if (lastseq == wantedSeq) {
-        char* rd_ptr = _buffer + _rd_idx*RTP_PACKET_SIZE;
-        memcpy(buffer, rd_ptr, RTP_PACKET_SIZE);
-        result = lastseq;
-        _seqArray[_rd_idx] = -1;
-        _readed++;
-        //if(_index == 1) LOG_INFO("[%d]  found pck#%d at pos %d, _readed=%d, _writed=%d", _index, wantedSeq, _rd_idx, _readed, _writed);
-    }
-    lock.unlock();
-
-    if(result==-1){
-        LOG("[%d] want packet#%d but find %d#, rd=%d, wr=%d , val=[%d..%d]", _index, wantedSeq, lastseq, _rd_idx, _wr_idx, _seqArray[_rd_idx], _seqArray[_wr_idx]);
-        //LOG_ERROR("[%d] want %d, find %d at pos %d", _index, wantedSeq, lastseq, _rd_idx);
-        result = searchFor(wantedSeq, buffer, buflen);
-    }
-
-    return result;
+    int slot = _getSlot(wantedSeq);
+    if (_seqArray[slot].load(std::memory_order_acquire) != wantedSeq)
+        return -1;
+    int len = MIN(_lenArray[slot], buflen);
+    memcpy(buffer, _buffer + (slot * RTP_PACKET_SIZE), len);
+    long long stamp = _stampArray[slot].load(std::memory_order_relaxed);
+    // Rewritten during the copy?
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_seqArray[slot].load(std::memory_order_relaxed) != wantedSeq)
+        return -1;
+    if (timestamp != NULL)
+        *timestamp = stamp;
+    return len;
 }
 
-int CCircularRcvBuffer::searchFor(int wantedSeq, char* buffer, int buflen) {
-
-    int result = -1;
-
-    if (_buffer == NULL || _seqArray == NULL)
-        return result;
-
-    std::unique_lock<std::mutex> lock(_mtx);
-
-    for (int i = 0; i < _nbElmt; i++) {
-        //if (_seqArray[_rd_idx] == -1)
-        //    continue;
-        //if (min == -1 || min > _seqArray[_rd_idx]) min = _seqArray[_rd_idx];
-        //if (max == -1 || max < _seqArray[_rd_idx]) max = _seqArray[_rd_idx];
-        if (wantedSeq == _seqArray[i]) {
-            // Found!!!
-            char* rd_ptr = _buffer + (i * RTP_PACKET_SIZE);
-            memcpy(buffer, rd_ptr, RTP_PACKET_SIZE);
-            result = i;
-            _rd_idx = i;
-            LOG("[%d] found pck#%d at pos %d", _index, wantedSeq, i);
-            return result;
-        }
-    }
-#define _DEBUG
-#ifdef _DEBUG
-    _dump();
-#endif
-    LOG_ERROR("[%d] can't find wanted pck#%d", _index, wantedSeq);
+bool CCircularRcvBuffer::contains(int seq) {
 
-    return result;
+    if (_seqArray == NULL)
+        return false;
+    return _seqArray[_getSlot(seq)].load(std::memory_order_acquire) == seq;
 }
 
-void  CCircularRcvBuffer::_dump() {
-
-    if (_rd_idx<_wr_idx)
-        LOG_INFO("[%d] struct [0   r=%d...w=%d   %d]", _index, _rd_idx, _wr_idx, _nbElmt);
-    else 
-        LOG_INFO("[%d] struct [0...w=%d   r=%d...%d]", _index, _wr_idx, _rd_idx, _nbElmt);
-    
-    if(_seqArray[_rd_idx]<_seqArray[_wr_idx])
-        LOG_INFO("[%d] stored packets# [%d...%d]", _index, _seqArray[_rd_idx], _seqArray[_wr_idx]);
-    else
-        LOG_INFO("[%d] stored packets# [%d...65535][0...%d]", _index, _seqArray[_rd_idx], _seqArray[_wr_idx]);
+/*!
+* \fn getArrivalTime
+* \brief arrival time of a packet, see getTimeInUs()
+*
+* \param seq seq number of the packet
+* \return time in us, -1 if not received
+*/
+long long CCircularRcvBuffer::getArrivalTime(int seq) {
 
+    if (_seqArray == NULL)
+        return -1;
+    int slot = _getSlot(seq);
+    if (_seqArray[slot].load(std::memory_order_acquire) != seq)
+        return -1;
+    long long t = _timeArray[slot].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_seqArray[slot].load(std::memory_order_relaxed) != seq)
+        return -1;
+    return t;
 }
@@ -3,47 +3,97 @@
 
 #include <mutex>
 #include <thread>
-#include "queue.h"
+#include <atomic>
+#include <condition_variable>
 #include "tcp_basic.h"
 
+#define RCV_RING_MAX_SIZE       65536   /* the ring is indexed by RTP seq number: its size divides 65536 */
+
+/**********************************************************************************************
+*
+* CRcvNotifier
+*
+* Wake the reader of several CCircularRcvBuffer when packets are received. The receive threads
+* only notify at the end of a batch of packets, and only if the reader waits.
+*
+***********************************************************************************************/
+class CRcvNotifier
+{
+    std::mutex                  _mtx;
+    std::condition_variable     _cv;
+    std::atomic<bool>           _waiting;
+    std::atomic<unsigned int>   _events;    /* incremented for each received packet */
+
+public:
+    CRcvNotifier() : _waiting(false), _events(0) {};
+
+    unsigned int getEvents() { return _events.load(); };
+    void onPacket() { _events++; };
+    void notify();
+    void wait(unsigned int lastEvents, int timeoutMs);
+};
+
+/**********************************************************************************************
+*
+* CCircularRcvBuffer
+*
+* Receive the RTP packets of one path of a ST 2022-7 stream in a ring indexed by the RTP sequence
+* number (seq & mask). The receive thread is the only writer; the reader gets a packet from its
+* sequence number in O(1), without lock. A slot is invalidated before being rewritten, and the
+* reader checks it has not been rewritten while copied.
+*
+***********************************************************************************************/
 class CCircularRcvBuffer {
 
     int         _index;
     int         _nbElmt;
-    UDP         _udpSock;
+    int         _mask;
+    UDP*        _udpSock;
     char*       _buffer;
-    int*        _seqArray;
-    int         _wr_idx;
-    int         _rd_idx;
-    int         _lastRcvSeq;
-    std::mutex  _mtx;
+    std::atomic<int>*       _seqArray;      /* seq of the packet in each slot, -1 if none */
+    int*                    _lenArray;
+    std::atomic<long long>* _timeArray;     /* arrival time of the packet in each slot, in us */
+    std::atomic<long long>* _stampArray;    /* receive time taken by the socket, in ns, see setTimestampMode() */
+    std::atomic<int>        _lastRcvSeq;
+    std::atomic<long long>  _lastRcvTime;
+    std::atomic<long long>  _lateUs;        /* delay of this path on the other one, 0 if it's the first */
+    CCircularRcvBuffer*     _peer;
+    CRcvNotifier*           _notifier;
+    long long   _offlineUs;
     bool        _bInit;
-    bool        _closed;
+    std::atomic<bool> _closed;
     std::thread _th_rcv;
-    int         _size;
-    int         _readed;
-    int         _writed;
-    CQueue<int>* _q;
-    bool        _isMaster;
     int         _samplesize;
+    int         _groupSize;     /* nb of sockets sharing the port, see setReusePort() */
+    int         _steering;
+    int         _seqStride;     /* seq number difference between two packets of this socket */
+    int         _cpu;           /* cpu of the receive thread, -1: no affinity */
+    int         _timestampMode; /* UDP_TIMESTAMP_xxx */
 
     void* _rcv_thread();
-
-    void  _dump();
+    int   _receive();
+    int   _getSlot(int seq) { return seq & _mask; };
 
 public:
     CCircularRcvBuffer();
     ~CCircularRcvBuffer();
 
-    int  init(CQueue<int>* q, const char* remote_addr, const char* local_addr, int port, int nbElmt, int index);
+    static long long getTimeInUs();
+
+    int  init(CRcvNotifier* notifier, const char* remote_addr, const char* local_addr, int port, int nbElmt, int index, int batchSize = 1, const char* ifname = NULL);
     int  close();
-    int  write();
-    int  read(int wantedSeq, char* buffer, int buflen);
-    int  searchFor(int wantedSeq, char* buffer, int buflen);
-    int  getLastRecvSeq() { return _lastRcvSeq;  };
+    void setReusePort(int groupSize, int steering, int cpu);
+    void setTimestampMode(int mode) { _timestampMode = mode; };
+    void setPeer(CCircularRcvBuffer* peer) { _peer = peer; };
+    void setOfflineThreshold(long long us) { _offlineUs = us; };
+    int  read(int wantedSeq, char* buffer, int buflen, long long* timestamp = NULL);
+    bool contains(int seq);
+    long long getArrivalTime(int seq);
+    int  getLastRecvSeq() { return _lastRcvSeq.load(); };
+    long long getLastRecvTime() { return _lastRcvTime.load(); };
+    long long getLateness() { return _lateUs.load(); };
     int  getIndex() { return _index; };
-    bool isMaster() { return _isMaster; };
-    void setMaster(bool flag) { _isMaster = flag; };
+    int  getSize() { return _nbElmt; };
     int  getSampleSize() { return _samplesize; };
 };
 
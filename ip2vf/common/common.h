@@ -61,15 +61,25 @@ enum INTERLACED_MODE {
     INTERLACED = 1
 };
 
+#define DMUX_2022_7_NB_SOURCES  2
+
+/* Statistics of a ST 2022-7 merge of two paths */
+struct S2022_7Stats {
+    long long recovered[DMUX_2022_7_NB_SOURCES];    // packets lost on the other path, taken from this one
+    bool      online[DMUX_2022_7_NB_SOURCES];
+    long long unrecoverablePackets;                 // lost on both paths, or too late
+    long long unrecoverableGaps;
+    long long pathSkewUs;                           // delay of the path 1 on the path 0
+    long long maxPathSkewUs;                        // max absolute skew since init
+    int       windowMs;
+};
+
 #define MSG_PREFIX_INIT     "init:"
 #define MSG_PREFIX_START    "start:"
 #define MSG_PREFIX_STOP     "stop:"
 #define MSG_PREFIX_QUIT     "quit:"
 
 
-#define VMI_MEM_MSG_LEN     64
-#define VMI_MEM_MSG_FORMAT  "GO:%d:%d:%lld"
-
 
 
 /*
@@ -19,6 +19,8 @@ void CFrameCounter::tick(const std::string &msg)
         if (_zmq_logger) {
             _zmq_logger->setFPS(fps,_pinId);
             _zmq_logger->setFrameCounter(_total_frame_count, _pinId);
+            _zmq_logger->setCRCErrors(_crcErrors, _pinId);
+            _zmq_logger->set2022_7Stats(_has2022_7Stats ? &_2022_7Stats : NULL, _pinId);
             _zmq_logger->tick();
         }
         _time  = currentTime;
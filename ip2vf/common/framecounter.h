@@ -14,6 +14,9 @@ public:
     int         _frame_count;
     int         _total_frame_count;
     int         _pinId;
+    long long   _crcErrors;     // of the pin, -1 if not checked
+    bool        _has2022_7Stats;
+    S2022_7Stats _2022_7Stats;  // of the pin, if it merges two ST 2022-7 paths
     MetricsCollector*  _zmq_logger;     // A reference to the zmq_logger of the module.
 public:
     CFrameCounter() { 
@@ -21,6 +24,8 @@ public:
         _frame_count = 0;
         _total_frame_count = 0;
         _pinId = -1;
+        _crcErrors = -1;
+        _has2022_7Stats = false;
         _zmq_logger = NULL;
     };
     ~CFrameCounter() { 
@@ -36,6 +41,16 @@ public:
         _pinId = pinId;
     };
 
+    inline void setCRCErrorsNb(long long nb) {
+        _crcErrors = nb;
+    };
+
+    inline void set2022_7Stats(const S2022_7Stats* stats) {
+        _has2022_7Stats = (stats != NULL);
+        if (stats != NULL)
+            _2022_7Stats = *stats;
+    };
+
     inline int getCount() { 
         return _total_frame_count; 
     };
@@ -27,10 +27,10 @@
 #define MEDIA_HEADER_OFFSET     COMMON_HEADER_LENGTH 
 #define MEDIA_HEADER_LENGTH     12       // in bytes
 #define EXT_HEADER_OFFSET       MEDIA_HEADER_OFFSET+MEDIA_HEADER_LENGTH  
-#define EXT_HEADER_LENGTH       16      // in bytes
+#define EXT_HEADER_LENGTH       32      // in bytes
 
 #define EXTRACT_INTEGER(p, i)   ((p[i+0] << 24) + (p[i+1] << 16) + (p[i+2] << 8) + p[i+3])
-#define EXTRACT_LONG_LONG(p, i) (((unsigned long long)p[i+0] << 56) + ((unsigned long long)p[i+1] << 48) + ((unsigned long long)p[i+2] << 40) + ((unsigned long long)p[i+3] << 32) + (p[i+4] << 24) + (p[i+5] << 16) + (p[i+6] << 8) + p[i+7])
+#define EXTRACT_LONG_LONG(p, i) (((unsigned long long)p[i+0] << 56) + ((unsigned long long)p[i+1] << 48) + ((unsigned long long)p[i+2] << 40) + ((unsigned long long)p[i+3] << 32) + ((unsigned int)p[i+4] << 24) + (p[i+5] << 16) + (p[i+6] << 8) + p[i+7])
 
 
 CFrameHeaders::CFrameHeaders() {
@@ -64,6 +64,8 @@ CFrameHeaders::CFrameHeaders() {
     //ext
     _inputtimestamp = 0;
     _outputtimestamp= 0;
+    _firstpackettimestamp = 0;
+    _lastpackettimestamp  = 0;
 };
 
 /*!
@@ -101,6 +103,8 @@ void CFrameHeaders::CopyHeaders(const CFrameHeaders* from) {
     // Ext part
     _inputtimestamp = from->_inputtimestamp;
     _outputtimestamp= from->_outputtimestamp;
+    _firstpackettimestamp = from->_firstpackettimestamp;
+    _lastpackettimestamp  = from->_lastpackettimestamp;
 }
 
 int CFrameHeaders::WriteHeaders(unsigned char* buffer, int frame_nb) {
@@ -203,6 +207,26 @@ int CFrameHeaders::WriteHeaders(unsigned char* buffer, int frame_nb) {
     buffer[EXT_HEADER_OFFSET + 14] = (_outputtimestamp >> 8) & 0b11111111;
     buffer[EXT_HEADER_OFFSET + 15] = _outputtimestamp & 0b11111111;
 
+    buffer[EXT_HEADER_OFFSET + 16] = (_firstpackettimestamp >> 56) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 17] = (_firstpackettimestamp >> 48) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 18] = (_firstpackettimestamp >> 40) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 19] = (_firstpackettimestamp >> 32) & 0b11111111;
+
+    buffer[EXT_HEADER_OFFSET + 20] = (_firstpackettimestamp >> 24) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 21] = (_firstpackettimestamp >> 16) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 22] = (_firstpackettimestamp >> 8) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 23] = _firstpackettimestamp & 0b11111111;
+
+    buffer[EXT_HEADER_OFFSET + 24] = (_lastpackettimestamp >> 56) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 25] = (_lastpackettimestamp >> 48) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 26] = (_lastpackettimestamp >> 40) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 27] = (_lastpackettimestamp >> 32) & 0b11111111;
+
+    buffer[EXT_HEADER_OFFSET + 28] = (_lastpackettimestamp >> 24) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 29] = (_lastpackettimestamp >> 16) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 30] = (_lastpackettimestamp >> 8) & 0b11111111;
+    buffer[EXT_HEADER_OFFSET + 31] = _lastpackettimestamp & 0b11111111;
+
     return VMI_E_OK;
 }
 
@@ -264,6 +288,8 @@ int CFrameHeaders::ReadHeaders(unsigned char* buffer) {
     p = (unsigned char*)buffer + EXT_HEADER_OFFSET;
     _inputtimestamp  = EXTRACT_LONG_LONG(p, 0);
     _outputtimestamp = EXTRACT_LONG_LONG(p, 8);
+    _firstpackettimestamp = EXTRACT_LONG_LONG(p, 16);
+    _lastpackettimestamp  = EXTRACT_LONG_LONG(p, 24);
 
     return VMI_E_OK;
 }
@@ -312,6 +338,8 @@ void CFrameHeaders::DumpHeaders(unsigned char* frame)
         LOG_INFO("_samplerate = %d", _samplerate);
         LOG_INFO("_packettime = %d", _packettime);
     }
+    LOG_INFO("_firstpackettimestamp = %llu", _firstpackettimestamp);
+    LOG_INFO("_lastpackettimestamp = %llu", _lastpackettimestamp);
 }
 
 void CFrameHeaders::InitVideoHeadersFromSMPTE(int w, int h, SAMPLINGFMT samplingfmt, bool interlaced)
@@ -385,6 +413,20 @@ void CFrameHeaders::InitVideoHeadersFromProfile(CSMPTPProfile* smpteProfile) {
     _smpteframeCode = smpteProfile->getFRAMEcode();
 }
 
+/*!
+* \fn GetFramerate
+* \brief frame rate of the video, from its SMPTE framerate code
+*
+* \return frame rate in Hz, 0 if unknown
+*/
+float CFrameHeaders::GetFramerate() {
+    for (int i = 0; i < g_FRATE_len; i++) {
+        if (_framerateCode == g_FRATE[i].code)
+            return g_FRATE[i].frame_rate_in_hz;
+    }
+    return 0.0f;
+}
+
 CSMPTPProfile CFrameHeaders::GetProfile() {
     CSMPTPProfile profile;
     profile.initProfileFromIP2VF(this);
@@ -60,6 +60,8 @@ private:
 
     unsigned long long _inputtimestamp;
     unsigned long long _outputtimestamp;
+    unsigned long long _firstpackettimestamp;   // receive time of the first/last packet of the frame, in ns
+    unsigned long long _lastpackettimestamp;
 
 public:
     CFrameHeaders() ;
@@ -131,6 +133,7 @@ public:
     void SetDepth(int depth) { _depth = depth; };
     int  GetFramerateCode() { return _framerateCode; };
     void SetFramerateCode(int code) { _framerateCode = code; };
+    float GetFramerate();
     int  GetSmpteframeCode() { return _smpteframeCode; };
     void SetSmpteframeCode(int code) { _smpteframeCode = code; };
 
@@ -149,6 +152,10 @@ public:
     void SetInputTimestamp(unsigned long long timestamp) { _inputtimestamp = timestamp; };
     unsigned long long GetOutputTimestamp() { return _outputtimestamp; };
     void SetOutputTimestamp(unsigned long long timestamp) { _outputtimestamp = timestamp; };
+    unsigned long long GetFirstPacketTimestamp() { return _firstpackettimestamp; };
+    void SetFirstPacketTimestamp(unsigned long long timestamp) { _firstpackettimestamp = timestamp; };
+    unsigned long long GetLastPacketTimestamp() { return _lastpackettimestamp; };
+    void SetLastPacketTimestamp(unsigned long long timestamp) { _lastpackettimestamp = timestamp; };
 };
 
 #endif //_FRAMEHEADER_H
@@ -8,6 +8,7 @@
 #include "error.h"
 #include "log.h"
 #include "tools.h"
+#include "pacer.h"
 #include "hbrmppacketizer.h"
 
 using namespace std;
@@ -34,6 +35,18 @@ void CHBRMPPacketizer::setProfile(CSMPTPProfile*  profile) {
         _profile.setProfile(profile->getProfileName().c_str());
 }
 
+/*!
+* \fn send
+* \brief send a SMPTE frame in RTP/HBRMP packets. The headers of the packets are built in a header array
+* and sent with their slice of the frame in place, without copy: the frame must stay unchanged until the
+* end of the send, i.e. until sock->waitSendCompletions() if the socket uses zero copy.
+*
+* \param sock socket to send to
+* \param mediabuffer SMPTE frame
+* \param mediabuffersize size of the frame
+* \param payloadtype RTP payload type
+* \return VMI_E_OK, or an error code
+*/
 int CHBRMPPacketizer::send(UDP* sock, char* mediabuffer, int mediabuffersize, int payloadtype) {
 
     if (_profile.getStandard() == SMPTE_NOT_DEFINED) {
@@ -45,8 +58,8 @@ int CHBRMPPacketizer::send(UDP* sock, char* mediabuffer, int mediabuffersize, in
 
     if (sock && sock->isValid())
     {
-        CRTPFrame rtpFrame((unsigned char*)_RTPframe, _RTPPacketSize);
-        CHBRMPFrame hbrmpFrame((unsigned char*)_RTPframe + RTP_HEADERS_LENGTH, _RTPPacketSize - RTP_HEADERS_LENGTH);
+        CRTPFrame rtpFrame;
+        CHBRMPFrame hbrmpFrame;
         hbrmpFrame.initFixedHBRMPValuesFromProfile(&_profile);
 
         int bEndOfFrame = false;
@@ -59,50 +72,62 @@ int CHBRMPPacketizer::send(UDP* sock, char* mediabuffer, int mediabuffersize, in
         unsigned int oldPixelSent = 0;
         unsigned int nbPacketToSkip = 0;
         char* p = mediabuffer;
-        char* packetPayloadPtr = _RTPframe + RTP_HEADERS_LENGTH + HBRMP_HEADERS_LENGTH;
+        int ret = VMI_E_OK;
+        int nbPackets = (mediabuffersize + _HBRMPPayloadSize - 1) / _HBRMPPayloadSize;
+        int headerLen = RTP_HEADERS_LENGTH + HBRMP_HEADERS_LENGTH;
+
+        // With zero copy, the kernel may still send the headers of the previous frame: don't
+        // rewrite them, drop this frame
+        if (sock->waitSendCompletions() != E_OK)
+            return VMI_E_FAILED_TO_SND_SOCKET;
+        if ((int)_headers.size() < nbPackets * headerLen)
+            _headers.resize(nbPackets * headerLen);
+
+        // Spread the packets of the frame over the frame period, if the socket is paced
+        sock->startFrame(nbPackets, _profile.getFramerate(), CPacer::getActiveRatio(_profile.getActiveHeight()));
 
         while (remainingLen>0) {
 
-            int result, len, marker = 0;
+            int result, marker = 0;
             int oldTimestamp = _hbrmpTimestamp;
             oldPayloadSent = payloadSent;
 
-            // First, copy payload on the packet
+            // The headers of the packet are built in the header array, the payload is sent in place
+            char* header = &_headers[packetSentNb * headerLen];
+            char* payload = p;
+            rtpFrame.setBuffer((unsigned char*)header, headerLen);
+            hbrmpFrame.setBuffer((unsigned char*)header + RTP_HEADERS_LENGTH, HBRMP_HEADERS_LENGTH);
+
             int payloadLen = MIN(remainingLen, (unsigned)_HBRMPPayloadSize);
-            memcpy(packetPayloadPtr, p, payloadLen);
             remainingLen -= payloadLen;
             p += payloadLen;
             if (remainingLen == 0)
                 marker = 1;
 
-            // Manage end of frame stuffing
+            // Manage end of frame stuffing: the socket pads the packet with zeros
             if (payloadLen < _HBRMPPayloadSize)
-            {
                 LOG("padding payload=%d", _HBRMPPayloadSize - payloadLen);
-                memset( packetPayloadPtr + payloadLen, 0, _HBRMPPayloadSize - payloadLen);
-            }
 
             // Write correct headers for this packet
             _seq = (_seq + 1) % 65536;
             rtpFrame.writeHeader(_seq, marker, payloadtype);
             hbrmpFrame.writeHeader(_frameCount, _hbrmpTimestamp);
 
-            // Then send UDP packet
-            len = _RTPPacketSize;
-            result = sock->writeSocket((char*)_RTPframe, &len);
-            if (result != -1)
+            // Then queue the UDP packet, the batch is sent when full or at the end of the frame
+            result = sock->queueSendPacket(header, headerLen, payload, payloadLen, _RTPPacketSize);
+            if (result != -1 && (remainingLen > 0 || sock->flushSendBuffer() != -1))
             {
-                LOG("write (size=%d) to socket, result=%d, RTP packet #%d, frame #%d, payloadlen=%d, remaining=%d",
-                    len, result, rtpFrame._seq, _frameCount, payloadLen,
+                LOG("write (size=%d) to socket, RTP packet #%d, frame #%d, payloadlen=%d, remaining=%d",
+                    _RTPPacketSize, rtpFrame._seq, _frameCount, payloadLen,
                     remainingLen);
-                sentLen += result;
+                sentLen += _RTPPacketSize;
             }
             else
             {
-                LOG_ERROR("error writing (size=%d) to socket, result=%d, RTP packet #%d, frame #%d, payloadlen=%d, remaining=%d",
-                    len, result, rtpFrame._seq, _frameCount, payloadLen,
+                LOG_ERROR("error writing (size=%d) to socket, RTP packet #%d, frame #%d, payloadlen=%d, remaining=%d",
+                    _RTPPacketSize, rtpFrame._seq, _frameCount, payloadLen,
                     remainingLen);
-                //ret = -1;
+                ret = VMI_E_FAILED_TO_SND_SOCKET;
             }
             packetSentNb++;
 
@@ -120,6 +145,7 @@ int CHBRMPPacketizer::send(UDP* sock, char* mediabuffer, int mediabuffersize, in
             oldPixelSent = pixelSent;
         }
         _frameCount = (_frameCount + 1) % 256;
+        return ret;
     }
     return VMI_E_OK;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 #include "common.h"
 #include "tcp_basic.h"
@@ -22,7 +23,6 @@
 class CHBRMPPacketizer
 {
 protected:
-    char    _RTPframe[RTP_MAX_FRAME_LENGTH];
     int     _RTPPacketSize;
     int     _HBRMPPacketSize;
     int     _HBRMPPayloadSize;
@@ -30,6 +30,7 @@ protected:
     CSMPTPProfile  _profile;
     unsigned int _hbrmpTimestamp;
     unsigned int _frameCount;
+    std::vector<char> _headers;     // RTP+HBRMP headers of the packets of a frame, sent with the payload in place
 
 public:
     CHBRMPPacketizer();
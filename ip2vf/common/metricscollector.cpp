@@ -56,6 +56,30 @@ void MetricsCollector::setFrameCounter(unsigned int frames, int pinId)
         }
     }
 }
+void MetricsCollector::setCRCErrors(long long errors, int pinId)
+{
+    for (auto && pinInfo : this->_pinsVec)
+    {
+        if (pinInfo._id == pinId)
+        {
+            pinInfo._crcErrors = errors;
+            return;
+        }
+    }
+}
+void MetricsCollector::set2022_7Stats(const S2022_7Stats* stats, int pinId)
+{
+    for (auto && pinInfo : this->_pinsVec)
+    {
+        if (pinInfo._id == pinId)
+        {
+            pinInfo._has2022_7Stats = (stats != NULL);
+            if (stats != NULL)
+                pinInfo._2022_7Stats = *stats;
+            return;
+        }
+    }
+}
 void MetricsCollector::setStaticInfo(int id, std::string &name, int mtn_port)
 {
     _id = id;
@@ -113,6 +137,48 @@ void MetricsCollector::tick()
         res << (pi._direction == DIRECTION_INPUT ? "i" : "o") << pi._id << ": " << DISPFORMAT_BEGIN << tools::to_string_with_precision(pi._fps, 2) << DISPFORMAT_CLOSE << ", ";
     }
     LOG_INFO(res.str().c_str());
+    for (auto && pi : _pinsVec)
+    {
+        if (pi._crcErrors < 0)
+            continue;
+        _frame->setType("crcerrors");
+        _frame->setTypeInstance(
+                ((pi._direction == DIRECTION_INPUT ? "i" : "o")
+                        + std::to_string(pi._id)).c_str());
+        long long errors = pi._crcErrors;
+        _frame->addRecord(COLLECTD_DATACODE_DERIVE, (void *)&errors);
+    }
+    for (auto && pi : _pinsVec)
+    {
+        if (!pi._has2022_7Stats)
+            continue;
+        // Per path: recovered packets and online state, "i<pin>-<path>"
+        std::string instance = (pi._direction == DIRECTION_INPUT ? "i" : "o") + std::to_string(pi._id);
+        for (int i = 0; i < DMUX_2022_7_NB_SOURCES; i++)
+        {
+            std::string pathInstance = instance + "-" + std::to_string(i);
+            _frame->setTypeInstance(pathInstance.c_str());
+            _frame->setType("recovered");
+            long long recovered = pi._2022_7Stats.recovered[i];
+            _frame->addRecord(COLLECTD_DATACODE_DERIVE, (void *)&recovered);
+            _frame->setType("online");
+            double online = (pi._2022_7Stats.online[i] ? 1.0 : 0.0);
+            _frame->addRecord(COLLECTD_DATACODE_GAUGE, (void *)&online);
+        }
+        _frame->setTypeInstance(instance.c_str());
+        _frame->setType("unrecoverable");
+        long long unrecoverable = pi._2022_7Stats.unrecoverablePackets;
+        _frame->addRecord(COLLECTD_DATACODE_DERIVE, (void *)&unrecoverable);
+        _frame->setType("unrecoverablegaps");
+        long long gaps = pi._2022_7Stats.unrecoverableGaps;
+        _frame->addRecord(COLLECTD_DATACODE_DERIVE, (void *)&gaps);
+        _frame->setType("pathskew");
+        double skew = (double)pi._2022_7Stats.pathSkewUs;
+        _frame->addRecord(COLLECTD_DATACODE_GAUGE, (void *)&skew);
+        _frame->setType("maxpathskew");
+        double maxSkew = (double)pi._2022_7Stats.maxPathSkewUs;
+        _frame->addRecord(COLLECTD_DATACODE_GAUGE, (void *)&maxSkew);
+    }
     if (_collectdSocket.isValid())
     {
         int len = _frame->getLen();
@@ -17,6 +17,9 @@ struct PinInfo {
     int          _vidfrmsize;   // Frame size for this pin
     double       _fps;
     unsigned int  _frames;
+    long long     _crcErrors;   // scanlines received with a wrong CRC, -1 if not checked
+    bool          _has2022_7Stats;
+    S2022_7Stats  _2022_7Stats; // merge of two ST 2022-7 paths
 
     PinInfo() {
         _id = -1;
@@ -25,6 +28,8 @@ struct PinInfo {
         _vidfrmsize = 0;
         _fps = 0.0f;
         _frames = 0;
+        _crcErrors = -1;
+        _has2022_7Stats = false;
     };
 };
 
@@ -41,6 +46,8 @@ public:
     // To set stats (change each frame)
     void setFPS(double fps, int pinId);
     void setFrameCounter(unsigned int frames, int pinId);
+    void setCRCErrors(long long errors, int pinId);
+    void set2022_7Stats(const S2022_7Stats* stats, int pinId);
 
     // Send periodic data to supervisor
     void tick();
@@ -0,0 +1,241 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include "log.h"
+#include "pacer.h"
+
+/**********************************************************************************************
+*
+* CPacer
+*
+***********************************************************************************************/
+
+CPacer::CPacer()
+{
+    _model = PACING_NONE;
+    _useTxTime = false;
+    _frameStart = 0;
+    _trs = 0;
+    _packetIdx = 0;
+    _lastSent = 0;
+    _lastLaunch = 0;
+    _nbGaps = 0;
+    _sumGapDeviation = 0.0;
+    _sumGapDeviation2 = 0.0;
+    _maxGapDeviation = 0;
+    _nbLate = 0;
+    _lastDump = 0;
+}
+
+/*!
+* \fn getModelFromName
+* \brief convert a pacing model name ("none", "linear" or "gapped") to PACING_xxx
+*
+* \param name pacing model name
+* \return pacing model, PACING_NONE if unknown
+*/
+int CPacer::getModelFromName(const char* name)
+{
+    if (name == NULL || name[0] == '\0' || strcmp(name, "none") == 0)
+        return PACING_NONE;
+    if (strcmp(name, "linear") == 0)
+        return PACING_LINEAR;
+    if (strcmp(name, "gapped") == 0)
+        return PACING_GAPPED;
+    LOG_ERROR("unknown pacing '%s', available models are none, linear and gapped. No pacing", name);
+    return PACING_NONE;
+}
+
+/*!
+* \fn getActiveRatio
+* \brief give the ratio of the frame period used by the active lines (ST 2110-21 RACTIVE), for the
+* gapped model
+*
+* \param activeLines number of active lines of the frame
+* \return active ratio, 1.0 if the format is unknown
+*/
+float CPacer::getActiveRatio(int activeLines)
+{
+    switch (activeLines) {
+    case 1080:  return 1080.0f / 1125.0f;
+    case 720:   return 720.0f / 750.0f;
+    case 576:   return 576.0f / 625.0f;
+    case 486:   return 486.0f / 525.0f;
+    case 2160:  return 2160.0f / 2250.0f;
+    default:    return 1.0f;
+    }
+}
+
+/*!
+* \fn init
+* \brief set the pacing model
+*
+* \param model PACING_xxx
+* \param useTxTime true if the launch times are given to the kernel (SO_TXTIME) instead of waited by the sender
+*/
+void CPacer::init(int model, bool useTxTime)
+{
+    _model = model;
+    _useTxTime = (model != PACING_NONE && useTxTime);
+#ifdef _WIN32
+    _useTxTime = false;
+#endif
+    _frameStart = 0;
+    _lastSent = 0;
+    LOG_INFO("pacing model=%d, %s", _model, (_useTxTime ? "launch time given to the kernel" : "timer loop"));
+}
+
+void CPacer::disableTxTime()
+{
+    // The clock changes: restart the schedule
+    _useTxTime = false;
+    _frameStart = 0;
+    _lastSent = 0;
+}
+
+/*!
+* \fn getTime
+* \brief current time in ns, on the clock of the launch times (CLOCK_TAI with SO_TXTIME, monotonic otherwise)
+*/
+long long CPacer::getTime()
+{
+#ifdef _WIN32
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    struct timespec ts;
+    clock_gettime(_useTxTime ? CLOCK_TAI : CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+/*!
+* \fn startFrame
+* \brief schedule the packets of a new frame. The frames are sent one frame period apart; if the
+* sender is late, the schedule restarts from now. Wait if the sender is more than one frame ahead.
+*
+* \param nbPackets number of packets of the frame
+* \param frameRate frame rate in Hz, 0 if unknown (no pacing for this frame)
+* \param activeRatio part of the frame period used by the packets in the gapped model
+*/
+void CPacer::startFrame(int nbPackets, float frameRate, float activeRatio)
+{
+    long long now = getTime();
+    if (_useTxTime)
+        now += PACER_TXTIME_DELAY_NS;
+
+    _packetIdx = 0;
+    if (_model == PACING_NONE || frameRate <= 0.0f || nbPackets <= 0) {
+        _frameStart = now;
+        _trs = 0;
+        return;
+    }
+    long long period = (long long)(1000000000.0 / frameRate);
+    long long next = _frameStart + period;
+    if (_useTxTime && _frameStart != 0 && next - now > period && next - now <= 2 * period) {
+        // The kernel waits for the launch times: don't queue more than one frame ahead
+        waitUntil(next - period - PACER_TXTIME_DELAY_NS);
+        now = getTime() + PACER_TXTIME_DELAY_NS;
+    }
+    if (_frameStart == 0 || next < now || next > now + 2 * period)
+        next = now;
+    _frameStart = next;
+    long long active = (_model == PACING_GAPPED ? (long long)(period * activeRatio) : period);
+    _trs = active / nbPackets;
+
+    if (_lastDump == 0)
+        _lastDump = now;
+    else if (now - _lastDump > PACER_STATS_PERIOD_NS) {
+        dumpStats();
+        _lastDump = now;
+    }
+}
+
+/*!
+* \fn getNextPacketTime
+* \brief launch time of the next packet of the current frame
+*
+* \return launch time in ns, see getTime()
+*/
+long long CPacer::getNextPacketTime()
+{
+    return _frameStart + _trs * _packetIdx++;
+}
+
+/*!
+* \fn waitUntil
+* \brief wait for a launch time: sleep as long as possible, then spin for precision
+*
+* \param launchTime launch time in ns, see getTime()
+*/
+void CPacer::waitUntil(long long launchTime)
+{
+    long long now = getTime();
+    while (launchTime - now > PACER_SLEEP_THRESHOLD_NS) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(launchTime - now - PACER_SLEEP_THRESHOLD_NS));
+        now = getTime();
+    }
+    while (now < launchTime)
+        now = getTime();
+}
+
+/*!
+* \fn onPacketSent
+* \brief account a sent packet: deviation of the gap with the previous packet from the scheduled gap, and
+* late packets (sent after their launch time with SO_TXTIME, more than one packet period late otherwise)
+*
+* \param launchTime scheduled launch time of the packet
+* \param sentTime time the packet was given to the kernel
+*/
+void CPacer::onPacketSent(long long launchTime, long long sentTime)
+{
+    if (_useTxTime) {
+        // The kernel sends the packet at its launch time, unless it gets it too late
+        if (sentTime > launchTime)
+            _nbLate++;
+        sentTime = launchTime;
+    }
+    else if (sentTime - launchTime > _trs)
+        _nbLate++;
+
+    if (_lastSent != 0) {
+        long long deviation = (sentTime - _lastSent) - (launchTime - _lastLaunch);
+        _nbGaps++;
+        _sumGapDeviation += (double)deviation;
+        _sumGapDeviation2 += (double)deviation * (double)deviation;
+        if (std::llabs(deviation) > _maxGapDeviation)
+            _maxGapDeviation = std::llabs(deviation);
+    }
+    _lastSent = sentTime;
+    _lastLaunch = launchTime;
+}
+
+/*!
+* \fn getGapJitter
+* \brief standard deviation of the gap between two packets from the scheduled gap, in ns
+*/
+double CPacer::getGapJitter()
+{
+    if (_nbGaps == 0)
+        return 0.0;
+    double mean = _sumGapDeviation / _nbGaps;
+    double variance = _sumGapDeviation2 / _nbGaps - mean * mean;
+    return (variance > 0.0 ? sqrt(variance) : 0.0);
+}
+
+void CPacer::dumpStats()
+{
+    LOG_INFO("pacing: packet period=%lld ns, gap jitter=%.0f ns, max gap deviation=%lld ns, %lld late packets",
+        _trs, getGapJitter(), _maxGapDeviation, _nbLate);
+    _nbGaps = 0;
+    _sumGapDeviation = 0.0;
+    _sumGapDeviation2 = 0.0;
+    _maxGapDeviation = 0;
+    _nbLate = 0;
+}
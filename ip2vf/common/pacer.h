@@ -0,0 +1,64 @@
+#ifndef _PACER_H
+#define _PACER_H
+
+#define PACING_NONE                 0   /* packets sent as fast as possible */
+#define PACING_LINEAR               1   /* packets spread evenly on the whole frame period (ST 2110-21 linear) */
+#define PACING_GAPPED               2   /* packets spread evenly on the active part of the frame period (ST 2110-21 gapped) */
+
+#define PACER_SLEEP_THRESHOLD_NS    100000LL    /* below this delay, spin instead of sleep */
+#define PACER_TXTIME_DELAY_NS       500000LL    /* advance given to the kernel when the launch time is set with SO_TXTIME */
+#define PACER_STATS_PERIOD_NS       10000000000LL /* log the achieved pacing each 10s */
+
+/**********************************************************************************************
+*
+* CPacer
+*
+* Give the launch time of each packet of a frame, so that the packets are spread over the
+* frame period instead of sent in a single burst. The sender waits for the launch time
+* (timer loop), or let the kernel wait for it (SO_TXTIME, with the ETF qdisc).
+*
+***********************************************************************************************/
+class CPacer
+{
+    int         _model;
+    bool        _useTxTime;
+    long long   _frameStart;    /* launch time of the first packet of the current frame, in ns */
+    long long   _trs;           /* time between two packets of the current frame, in ns */
+    int         _packetIdx;     /* index of the next packet in the current frame */
+
+    // Achieved pacing, since the last dump
+    long long   _lastSent;
+    long long   _lastLaunch;
+    long long   _nbGaps;
+    double      _sumGapDeviation;
+    double      _sumGapDeviation2;
+    long long   _maxGapDeviation;
+    long long   _nbLate;
+    long long   _lastDump;
+
+public:
+    CPacer();
+    ~CPacer() {};
+
+public:
+    static int   getModelFromName(const char* name);
+    static float getActiveRatio(int activeLines);
+
+    void init(int model, bool useTxTime);
+    int  getModel() { return _model; };
+    bool useTxTime() { return _useTxTime; };
+    void disableTxTime();
+    long long getTime();
+
+    void startFrame(int nbPackets, float frameRate, float activeRatio);
+    long long getNextPacketTime();
+    void waitUntil(long long launchTime);
+    void onPacketSent(long long launchTime, long long sentTime);
+
+    double getGapJitter();
+    long long getMaxGapDeviation() { return _maxGapDeviation; };
+    long long getLatePacketsNb() { return _nbLate; };
+    void dumpStats();
+};
+
+#endif //_PACER_H
@@ -30,6 +30,8 @@ CInAES67::CInAES67(CModuleConfiguration *pMainCfg, int nIndex) :
     PROPERTY_REGISTER_MANDATORY("port", _port, -1);
     PROPERTY_REGISTER_OPTIONAL("mcastgroup", _zmqip, "");
     PROPERTY_REGISTER_OPTIONAL("ip", _ip, "");
+    PROPERTY_REGISTER_OPTIONAL("batch", _batchSize, UDP_BATCH_DEFAULT_SIZE);
+    _udpSock->setBatchSize(_batchSize);
 }
 
 CInAES67::~CInAES67()
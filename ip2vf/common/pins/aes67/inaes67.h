@@ -20,6 +20,7 @@ protected:
     int _lastTimestamp;
     bool _audioParametersDetected;
     int _port;
+    int _batchSize;     // nb of packets received per system call
     const char* _zmqip;
     const char* _ip;
     CFrameHeaders       _headers;
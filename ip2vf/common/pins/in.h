@@ -6,11 +6,15 @@
 #include <iostream>
 #include <fstream>
 #include <thread>
+#include <atomic>
 #include <vector>
+#include <memory>
 
 #include <pins/st2022/smpteframe.h>
 #include <pins/st2022/datasource.h>
+#include <pins/shmem/shmring.h>
 #include "rtpframe.h"
+#include "ringqueue.h"
 #include "common.h"
 #include "tcp_basic.h"
 #include "frameheaders.h"
@@ -58,6 +62,12 @@ public:
     // Interface to implement
     virtual int  read(CvMIFrame* frame) = 0;
     virtual void reset() = 0;
+
+    // Nb of scanlines received with a wrong CRC, -1 if not checked
+    virtual long long getCRCErrorsNb() { return -1; };
+
+    // Statistics of the merge of two ST 2022-7 paths, false if the pin doesn't receive two paths
+    virtual bool get2022_7Stats(S2022_7Stats* stats) { return false; };
 };
 
 /**********************************************************************************************
@@ -101,6 +111,7 @@ public:
     const char* _ip;
     const char* _mcastgroup;
     int _port;
+    int _batchSize;     // nb of packets received per system call
     int _w;
     int _h;
 public:
@@ -127,24 +138,31 @@ public:
     HANDLE _shm_id;
 #endif
     int    _shm_size;       /* size to be passed to shmget() */
-    int    _shm_key;        /* key to be passed to shmget()  */ 
+    int    _shm_key;        /* key to be passed to shmget(), derived from _port */
     char*  _shm_data;
-    int    _shm_nbseg;      /* number of segments */
-    UDP    _udpSock;
-    int    _port;           /* port to use to receive notification that a new frame is available */
-    //int    _shm_wr_pt;
-    const char* _interface;
+    int    _port;           /* control port, identify the channel with the sender */
+    const char* _policy;    /* "drop": the sender overwrite the frames we are too slow to read, "block": the sender waits for us */
+    bool   _useEventFd;     /* if true, wait on an eventfd signaled by the sender instead of the futex doorbell */
+    int    _eventfd;        /* our eventfd, -1 if not used */
+    int    _reader;         /* our index in the readers of the ring */
     long long _sessionId;
+    unsigned int _rdSeq;    /* number of doorbell events read */
+    unsigned int _nbMissed; /* nb of frames published by the sender, but missed (overwritten before read) */
+    std::shared_ptr<CShmRing> _ring;    /* keep the segment attached while frames reference it (zero-copy) */
 public:
     CInMem(CModuleConfiguration* pMainCfg, int nIndex);
     virtual ~CInMem();
 private:
-    void _checkMemorySegment(int shmkey, long long sessionId);
+    bool _checkMemorySegment();
+    void _detachMemorySegment();
+    bool _waitForEvent(int timeoutInMs);
+    int  _readSlot(CvMIFrame* frame, const tShmRingEvent& event, bool shared);
 public:
     int  read(CvMIFrame* frame);
     void reset() {};
     void start();
     void stop();
+    int  getEventFd() { return _eventfd; };
 };
 
 /**********************************************************************************************
@@ -178,9 +196,15 @@ public:
 ***********************************************************************************************/
 #include <mutex>
 #include <thread>
+#include "workerpool.h"
 struct SmpteFrameBuffer {
     CSMPTPFrame   _frame;
     std::mutex    _lock;
+};
+struct SmpteEarlyPacket {
+    std::vector<char> _data;        // copy of the packet: the source buffer is only valid until the next read
+    int           _seq;
+    long long     _rcvTime;
 };
 class CInSMPTE : public CIn
 {
@@ -190,22 +214,35 @@ private:
     SmpteFrameBuffer* _currentFrame;
     bool            _firstFrame;
     int             _fmt;
-    CQueue<int>     _q;
+    CSpscQueue<int> _q;                 // buffers received, from the receive thread to the reader
+    std::vector<SmpteEarlyPacket> _early;   // packets of the next frame received before the current one is closed
+    int             _nbEarly;
     std::thread     _t;
     int             _nbSMPTEFrameToQueue;
     SMPTE_STANDARD_SUITE _streamType;
+    CWorkerPool     _demuxPool;         // shared by the frames, for the 425M level B dual link demux
+    int             _nbDemuxThreads;
+    int             _demuxCpu;
+    const char*     _reassembly;        // sequential or direct
+    int             _maxLostPackets;    // with direct placement, frames with more missing packets are dropped
+    bool            _checkCRC;          // check the line CRCs of the complete frames, configuration
+    std::atomic<bool> _crcChecked;      // false when the stream has no CRC to check, set by the receive thread
+    std::atomic<long long> _nbCRCErrors;
 
 public:
     CInSMPTE(CModuleConfiguration* pMainCfg, int nIndex);
     virtual ~CInSMPTE();
 private:
     int _rcv_process();
+    void _keepEarlyPacket(const char* packet, int len, int seq, long long rcvTime);
     SmpteFrameBuffer*  _get_next_frame();
 public:
     int  read(CvMIFrame* frame);
     void reset() {};
     void start();
     void stop();
+    long long getCRCErrorsNb() { return (_crcChecked.load() ? _nbCRCErrors.load() : -1); };
+    bool get2022_7Stats(S2022_7Stats* stats) { return (_source != NULL && _source->get2022_7Stats(stats)); };
 };
 
 
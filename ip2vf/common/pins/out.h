@@ -5,13 +5,18 @@
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <memory>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include <pins/st2022/smpteframe.h>
+#include <pins/shmem/shmring.h>
 #include "common.h"
 #include "tcp_basic.h"
+#include "pacer.h"
 #include "frameheaders.h"
 #include "framecounter.h"
 #include "rtpframe.h"
@@ -92,6 +97,11 @@ class COutRTP : public COut
     const char* _interface;
     const char* _mcastgroup;
     int _port;
+    const char* _sendMode;  // single, mmsg or gso
+    int _batchSize;     // nb of packets sent per system call
+    const char* _pacing;    // none, linear or gapped
+    bool _useTxTime;    // pacing with SO_TXTIME instead of a timer loop
+    CPacer _pacer;
 
     unsigned int  _seq;
     unsigned int  _frameCount;
@@ -109,7 +119,7 @@ public:
 * COutMem
 *
 ***********************************************************************************************/
-class COutMem : public COut
+class COutMem : public COut, public CFrameBufferProvider
 {
 public:
 #ifndef _WIN32
@@ -117,22 +127,25 @@ public:
 #else
     HANDLE _shm_id;
 #endif
-    int    _shm_key;        /* key to be passed to shmget()  */
+    int    _shm_key;        /* key to be passed to shmget(), derived from _port */
     int    _shm_size;       /* size to be passed to shmget() */
     char*  _shm_data;
-    int    _shm_nbseg;
-    int    _shm_wr_pt;
-    UDP    _udpSock;
-    const char*  _ip ;      /* ip to use to notify receiver that a new frame is available   */
-    int    _port ;          /* port to use to notify receiver that a new frame is available */
-    const char* _interface;
+    int    _shm_nbseg;      /* number of slots on the ring */
+    bool   _zeroCopy;       /* if true, the receiver reference the slots in place, and the frames are built in the slots (see shmring.h) */
+    int    _backpressure;   /* max time in ms to wait for the readers with "block" policy before overwrite/drop */
+    std::shared_ptr<CShmRing> _ring;    /* keep the segment attached while frames are built in its slots (zero-copy) */
+    std::mutex _ringLock;   /* protect _ring, the slots are lent from the threads which create the frames */
+    int    _port;           /* control port, identify the channel between this pin and the receiver */
     long long _sessionId;
 public:
     COutMem(CModuleConfiguration* pMainCfg, int nIndex);
     ~COutMem();
+private:
+    void _deleteMemorySegment();
 public:
     int  send(CvMIFrame* frame);
     bool isConnected();
+    unsigned char* lendFrameBuffer(int size, int& bufferSize, std::function<void()>& release);
 };
 
 /**********************************************************************************************
@@ -175,7 +188,34 @@ class COutThumbSocket : public COut, public CFrameCounter
     int _h;
     int _depth;
     int _ratio;
+    int _thumbW;        // thumbnail size, 0: source size / ratio
+    int _thumbH;
+    int _maxRows;       // max source rows averaged per thumbnail row, 0: all
+    int _matrix;        // 601 or 709
+    bool _fullRange;
     float _fps;
+    const char* _codec; // "raw" or "qoi"
+    int _maxKbps;       // max output rate of the encoded thumbnails, 0: no limit
+
+    // Encoded thumbnails: the pin thread gives the last thumbnail to the encoding thread, which
+    // encodes and sends it. A thumbnail not yet taken is replaced by the next one (dropped).
+    std::thread _th_enc;
+    std::mutex _encLock;
+    std::condition_variable _encCond;
+    std::vector<unsigned char> _fill;       // thumbnail + headers being converted by the pin thread
+    std::vector<unsigned char> _pending;    // thumbnail waiting for the encoding thread
+    std::vector<unsigned char> _work;       // thumbnail being encoded
+    std::vector<unsigned char> _encoded;
+    bool _hasPending;
+    bool _encStop;
+    std::atomic<bool> _connected;   // socket of the encoding thread connected
+    long long _nbDropped;
+    long long _nbSkipped;   // not sent because of the max rate
+
+    void _setThumbnailSize(int srcW, int srcH);
+    int  _openSocket();
+    void _encode_thread();
+    void _sendEncoded(double& credit, double& lastTime);
 public:
     COutThumbSocket(CModuleConfiguration* pMainCfg, int nIndex);
     ~COutThumbSocket();
@@ -235,6 +275,12 @@ class COutSMPTE: public COut
     int _port2;
     bool _useDeltacast;
     const char* _smptefmt;
+    const char* _sendMode;  // single, mmsg or gso
+    int _batchSize;     // nb of packets sent per system call
+    const char* _pacing;    // none, linear or gapped
+    bool _useTxTime;    // pacing with SO_TXTIME instead of a timer loop
+    bool _zeroCopy;     // send the packets with MSG_ZEROCOPY
+    bool _insertCRC;    // compute the line CRCs of the video inserted in the SMPTE frame
     SMPTE_STANDARD_SUITE _standard;
 
 public:
@@ -267,11 +313,15 @@ class COutTR03 : public COut
     int  _linepayloadsize; // full line size in bytes + headers
     unsigned int  _seq;
     unsigned int  _frameCount;
-    unsigned char _RTPframe[RTP_MAX_FRAME_LENGTH];
     const char* _ip;
     const char * _interface;
     const char * _mcastgroup;
     int _port;
+    const char* _sendMode;  // single, mmsg or gso
+    int _batchSize;     // nb of packets sent per system call
+    const char* _pacing;    // none, linear or gapped
+    bool _useTxTime;    // pacing with SO_TXTIME instead of a timer loop
+    CPacer _pacer;
 
 public:
     COutTR03(CModuleConfiguration* pMainCfg, int nIndex);
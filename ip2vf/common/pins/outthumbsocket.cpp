@@ -9,6 +9,7 @@
 #include "tcp_basic.h"
 #include "out.h"
 #include "yuv.h"
+#include "qoi.h"
 #include <pins/pinfactory.h>
 #include "configurable.h"
 using namespace std;
@@ -29,56 +30,92 @@ COutThumbSocket::COutThumbSocket(CModuleConfiguration* pMainCfg, int nIndex) : C
     PROPERTY_REGISTER_MANDATORY("fps", _fps, 0.0);
     PROPERTY_REGISTER_MANDATORY("port", _port, -1);
     PROPERTY_REGISTER_OPTIONAL("ratio", _ratio, 1);
+    PROPERTY_REGISTER_OPTIONAL("thumbw", _thumbW, 0);
+    PROPERTY_REGISTER_OPTIONAL("thumbh", _thumbH, 0);
+    PROPERTY_REGISTER_OPTIONAL("rows", _maxRows, 0);
+    PROPERTY_REGISTER_OPTIONAL("matrix", _matrix, 601);
+    PROPERTY_REGISTER_OPTIONAL("fullrange", _fullRange, true);
+    PROPERTY_REGISTER_OPTIONAL("codec", _codec, "raw");
+    PROPERTY_REGISTER_OPTIONAL("maxkbps", _maxKbps, 0);
     PROPERTY_REGISTER_OPTIONAL("interface", _interface, "");
     _isListen   = (_ip[0]=='\0');
     _output_fps = 25;
     _last_time  = 0.0f;
     _frame_rate = 1.0f/(float)_fps;
     _rgb_buffer = NULL;
-    _frame_w    = (int)((float)_w/ (float)_ratio);
-    _frame_h    = (int)((float)_h/ (float)_ratio);
+    _hasPending = false;
+    _encStop    = false;
+    _connected  = false;
+    _nbDropped  = 0;
+    _nbSkipped  = 0;
+    if (_ratio < 1)
+        _ratio = 1;
+    _setThumbnailSize(_w, _h);
 
     if (_depth < 3 || _depth>4) {
         LOG_ERROR("%s: ***ERROR*** invalid output pixel depth=%d. Must be 3 (rgb) or 4 (argb)", _name.c_str(), _depth);
     }
 
-    LOG_INFO("%s: ratio=%d, format=%dx%d, depth=%d", _name.c_str(), _ratio, _frame_w, _frame_h, _depth);
+    LOG_INFO("%s: ratio=%d, format=%dx%d, depth=%d, rows=%d, matrix=%d, fullrange=%d, codec=%s, maxkbps=%d", _name.c_str(), _ratio,
+        _frame_w, _frame_h, _depth, _maxRows, _matrix, _fullRange, _codec, _maxKbps);
+
+    if (strcmp(_codec, "qoi") == 0)
+        _th_enc = std::thread([this] { _encode_thread(); });
+    else if (strcmp(_codec, "raw") != 0)
+        LOG_ERROR("%s: unknown codec '%s', send raw thumbnails", _name.c_str(), _codec);
+}
+
+/*!
+* \fn _setThumbnailSize
+* \brief thumbnail size from the source size: thumbw x thumbh if set, the missing one keeping the
+* aspect ratio, else the source size / ratio
+*
+* \param srcW source width
+* \param srcH source height
+*/
+void COutThumbSocket::_setThumbnailSize(int srcW, int srcH)
+{
+    if (_thumbW > 0 && _thumbH > 0) {
+        _frame_w = _thumbW;
+        _frame_h = _thumbH;
+    }
+    else if (_thumbW > 0) {
+        _frame_w = _thumbW;
+        _frame_h = (srcW > 0 ? (int)((long long)srcH * _thumbW / srcW) : 0);
+    }
+    else if (_thumbH > 0) {
+        _frame_w = (srcH > 0 ? (int)((long long)srcW * _thumbH / srcH) : 0);
+        _frame_h = _thumbH;
+    }
+    else {
+        _frame_w = srcW / _ratio;
+        _frame_h = srcH / _ratio;
+    }
 }
 
 COutThumbSocket::~COutThumbSocket()
 {
+    if (_th_enc.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_encLock);
+            _encStop = true;
+        }
+        _encCond.notify_one();
+        _th_enc.join();
+    }
     _tcpSock.closeSocket();
     if (_rgb_buffer != NULL)
         delete[] _rgb_buffer;
 }
 
-void convertYUV8ToRGB(unsigned char* src, int src_w, int src_h, unsigned char* dest, int factor, int depth) {
-    LOG("-->");
-    int dst_w = src_w / factor;
-    int dst_h = src_h / factor;
-    int nDstFullLine = dst_w * depth;
-    int nSrcFullLine = src_w * 2;
-    //LOG_INFO("factor=%d, dst_w=%d, dst_h=%d, nDstFullLine=%d, depth=%d", factor, dst_w, dst_h, nDstFullLine, depth);
-    for (int y = 0; y < dst_h; y += 1)
-        for (int x = 0; x < dst_w; x += 1) {
-            unsigned char* out = dest + y * nDstFullLine + x * depth;
-            unsigned char* in = src + y * factor * nSrcFullLine + x * factor * 2;
-            YCbCr2RGBA((char*)out, (char*)in, 1);
-        }
-    LOG("<--");
-}
-
-void convertRGBAToRGB(unsigned char* src, int src_w, int src_h, unsigned char* dest, int factor, int depth) {
+void convertRGBAToRGB(unsigned char* src, int src_w, int src_h, unsigned char* dest, int dst_w, int dst_h, int depth) {
     LOG_INFO("-->");
-    int dst_w = src_w / factor;
-    int dst_h = src_h / factor;
     int nDstFullLine = dst_w * depth;
     int nSrcFullLine = src_w * 4;
-    //LOG_INFO("nFactorW=%d, nFactorH=%d, nRGBFullLine=%d, nYUV8FullLine=%d", nFactorW, nFactorH, nRGBFullLine, nYUV8FullLine);
     for (int y = 0; y < dst_h; y += 1)
         for (int x = 0; x < dst_w; x += 1) {
             unsigned char* out = dest + y * nDstFullLine + x * depth;
-            unsigned char* in = src + y * factor * nSrcFullLine + x * factor * 4;
+            unsigned char* in = src + (long long)y * src_h / dst_h * nSrcFullLine + (long long)x * src_w / dst_w * 4;
             memcpy(out, in, depth);
         }
     LOG_INFO("<--");
@@ -96,6 +133,7 @@ int COutThumbSocket::send(CvMIFrame* frame)
     LOG("%s: --> <--", _name.c_str());
     int result = E_OK;
     int ret = 0;
+    bool encode = _th_enc.joinable();   // the encoding thread manages the connection
 
     if (buffer == NULL) {
         LOG_WARNING("buffer <null> for thumbnail output pin");
@@ -105,23 +143,13 @@ int COutThumbSocket::send(CvMIFrame* frame)
     //
     // Manage the connection
     //
-    if( !_tcpSock.isValid() ) {
-        if( _isListen )
-            result = _tcpSock.openSocket((char*)C_INADDR_ANY, _port, _interface);
-        else 
-            result = _tcpSock.openSocket(_ip, _port, _interface);
-        if( result != E_OK )
-            LOG("%s: can't create %s TCP socket on [%s]:%d on interface '%s'", 
-                _name.c_str(), (_isListen?"listening":"connected"), (_isListen?"NULL":_ip), _port, _interface[0]=='\0'?"<default>":_interface);
-        else
-            LOG_INFO("%s: Ok to create %s TCP socket on [%s]:%d on interface '%s'", 
-                _name.c_str(), (_isListen?"listening":"connected"), (_isListen?"NULL":_ip), _port, _interface[0]=='\0'?"<default>":_interface);
-    }
+    if( !encode && !_tcpSock.isValid() )
+        _openSocket();
 
     //
     // Manage data
     //
-    if( _tcpSock.isValid() ) {
+    if( isConnected() ) {
         double currentTime = tools::getCurrentTimeInS();
         if( (currentTime - _last_time) > _frame_rate)
         {
@@ -134,48 +162,75 @@ int COutThumbSocket::send(CvMIFrame* frame)
             }
             SAMPLINGFMT fmt = headers->GetSamplingFmt();
             int depth = headers->GetDepth();
-            _frame_w = headers->GetW();
-            _frame_h = headers->GetH();
-            if (_frame_w > 4096 || _frame_h > 4096) {
-                LOG_ERROR("unsupported format readed from internal headers: w=%d, h=%d", _frame_w, _frame_h);
+            int src_w = headers->GetW();
+            int src_h = headers->GetH();
+            if (src_w > 4096 || src_h > 4096) {
+                LOG_ERROR("unsupported format readed from internal headers: w=%d, h=%d", src_w, src_h);
                 ret = -1;
             }
             else {
                 int offset = CFrameHeaders::GetHeadersLength();
-                if (_frame_w == 0 || _frame_h == 0) {
-                    LOG_ERROR("improper parameters read from ip2vf headers... frame_w=%d, frame_h=%d", _frame_w, _frame_h);
+                if (src_w == 0 || src_h == 0) {
+                    LOG_ERROR("improper parameters read from ip2vf headers... frame_w=%d, frame_h=%d", src_w, src_h);
                     LOG_ERROR("abort!");
                     exit(0);
                 }
-                LOG("Conversion from %dx%d to %dx%d, fmt=%d to RGB(A) %d bytes", _frame_w, _frame_h, (_frame_w / _ratio), (_frame_h / _ratio), fmt, _depth);
+                _setThumbnailSize(src_w, src_h);
+                LOG("Conversion from %dx%d to %dx%d, fmt=%d to RGB(A) %d bytes", src_w, src_h, _frame_w, _frame_h, fmt, _depth);
+                int mediasize = _frame_w * _frame_h * _depth;
+                if (_rgb_buffer != NULL && _rgb_buffer_len != mediasize + offset) {
+                    delete[] _rgb_buffer;
+                    _rgb_buffer = NULL;
+                }
                 if (_rgb_buffer == NULL) {
-                    int mediasize = (_frame_w / _ratio) * (_frame_h / _ratio) * _depth;
                     _rgb_buffer_len = mediasize + offset;
                     LOG_INFO("%s: allocate buffer of %d bytes for thumbnails+headers", _name.c_str(), _rgb_buffer_len);
                     _rgb_buffer = new unsigned char[_rgb_buffer_len];  // rgb buffer size + headers length
                     CFrameHeaders fh;
                     fh.CopyHeaders(headers);
-                    fh.SetW(_frame_w / _ratio);
-                    fh.SetH(_frame_h / _ratio);
+                    fh.SetW(_frame_w);
+                    fh.SetH(_frame_h);
                     fh.SetMediaSize(mediasize);
                     fh.SetMediaFormat(MEDIAFORMAT::VIDEO);
+                    // Same labels as always: the Windows player swaps the channels of BGR(A) before showing them
                     fh.SetSamplingFmt(_depth==3 ? SAMPLINGFMT::BGR : SAMPLINGFMT::BGRA);
                     fh.WriteHeaders(_rgb_buffer, 0);
                 }
-                // Extract RGB thumbnail
-                if (fmt == SAMPLINGFMT::YCbCr_4_2_2 && depth == 8)
-                    convertYUV8ToRGB(frame->getMediaBuffer(), _frame_w, _frame_h, _rgb_buffer + offset, _ratio, _depth);
+                // Extract RGB thumbnail, in the buffer given to the encoding thread if any
+                unsigned char* thumb = _rgb_buffer;
+                if (encode) {
+                    _fill.resize(_rgb_buffer_len);
+                    memcpy(_fill.data(), _rgb_buffer, offset);
+                    thumb = _fill.data();
+                }
+                if (fmt == SAMPLINGFMT::YCbCr_4_2_2 && (depth == 8 || depth == 10))
+                    UYVYDownscaleToRGB((char*)thumb + offset, _frame_w, _frame_h, (char*)frame->getMediaBuffer(), src_w, src_h,
+                        depth == 10, (_depth == 3 ? YUV_OUT_RGB24 : YUV_OUT_RGBA), (_matrix == 709 ? YUV_MATRIX_BT709 : YUV_MATRIX_BT601),
+                        (_fullRange ? YUV_RANGE_FULL : YUV_RANGE_LIMITED), _maxRows);
                 else if (fmt == SAMPLINGFMT::RGBA)
-                    convertRGBAToRGB(frame->getMediaBuffer(), _frame_w, _frame_h, _rgb_buffer + offset, _ratio, _depth);
+                    convertRGBAToRGB(frame->getMediaBuffer(), src_w, src_h, thumb + offset, _frame_w, _frame_h, _depth);
                 else
-                    LOG_ERROR("Conversion not supported: fmt=%d %dbits to RGB(A) bytes (from %dx%d to %dx%d)", fmt, _depth, _frame_w, _frame_h, (_frame_w / _ratio), (_frame_h / _ratio));
-                // Send it
-                int len = _rgb_buffer_len;
-                result = _tcpSock.writeSocket((char*)_rgb_buffer, &len);
-                LOG("%s: write %d/%d bytes to '%s:%d', result=%d", _name.c_str(), len, frame->getFrameSize(), _ip, _port, result);
-                if (result != E_OK || len == 0) {
-                    _tcpSock.closeSocket();
-                    ret = -1;
+                    LOG_ERROR("Conversion not supported: fmt=%d %dbits to RGB(A) bytes (from %dx%d to %dx%d)", fmt, depth, src_w, src_h, _frame_w, _frame_h);
+                if (encode) {
+                    // Give it to the encoding thread, replacing the previous one if not taken yet
+                    {
+                        std::lock_guard<std::mutex> lock(_encLock);
+                        std::swap(_fill, _pending);
+                        if (_hasPending)
+                            _nbDropped++;
+                        _hasPending = true;
+                    }
+                    _encCond.notify_one();
+                }
+                else {
+                    // Send it
+                    int len = _rgb_buffer_len;
+                    result = _tcpSock.writeSocket((char*)_rgb_buffer, &len);
+                    LOG("%s: write %d/%d bytes to '%s:%d', result=%d", _name.c_str(), len, frame->getFrameSize(), _ip, _port, result);
+                    if (result != E_OK || len == 0) {
+                        _tcpSock.closeSocket();
+                        ret = -1;
+                    }
                 }
             }
             _last_time = currentTime;
@@ -189,9 +244,117 @@ int COutThumbSocket::send(CvMIFrame* frame)
     return ret;
 }
 
+/*!
+* \fn _openSocket
+* \brief open the listening or connected socket. A listening socket doesn't wait for the client.
+*
+* \return E_OK if a client is connected
+*/
+int COutThumbSocket::_openSocket()
+{
+    int result;
+    if( _isListen )
+        result = _tcpSock.openSocket((char*)C_INADDR_ANY, _port, _interface);
+    else 
+        result = _tcpSock.openSocket(_ip, _port, _interface);
+    if( result != E_OK )
+        LOG("%s: can't create %s TCP socket on [%s]:%d on interface '%s'", 
+            _name.c_str(), (_isListen?"listening":"connected"), (_isListen?"NULL":_ip), _port, _interface[0]=='\0'?"<default>":_interface);
+    else
+        LOG_INFO("%s: Ok to create %s TCP socket on [%s]:%d on interface '%s'", 
+            _name.c_str(), (_isListen?"listening":"connected"), (_isListen?"NULL":_ip), _port, _interface[0]=='\0'?"<default>":_interface);
+    return result;
+}
+
+/*!
+* \fn _encode_thread
+* \brief encode and send the last thumbnail given by send(), until the pin is destroyed. The thread
+* owns the socket: while no client is connected, it retries every thumbnail period and send() gives
+* it nothing.
+*/
+void COutThumbSocket::_encode_thread()
+{
+    LOG_INFO("%s: -->", _name.c_str());
+    double credit = 0.0;
+    double lastTime = tools::getCurrentTimeInS();
+    long long nbDropped = 0;
+    while (true) {
+        if (!_connected)
+            _connected = (_openSocket() == E_OK);
+        {
+            std::unique_lock<std::mutex> lock(_encLock);
+            if (_connected)
+                _encCond.wait(lock, [this] { return _hasPending || _encStop; });
+            else
+                _encCond.wait_for(lock, std::chrono::duration<float>(_frame_rate), [this] { return _hasPending || _encStop; });
+            if (_encStop) {
+                nbDropped = _nbDropped;
+                break;
+            }
+            if (!_hasPending)
+                continue;
+            std::swap(_work, _pending);
+            _hasPending = false;
+        }
+        if (_connected)
+            _sendEncoded(credit, lastTime);
+    }
+    LOG_INFO("%s: <-- (%lld thumbnails dropped, %lld skipped for the max rate)", _name.c_str(), nbDropped, _nbSkipped);
+}
+
+/*!
+* \fn _sendEncoded
+* \brief encode the thumbnail taken by the encoding thread and send it with its headers: sampling
+* format QOI, media size = size of the image
+*
+* \param credit bytes that can be sent for the max rate, updated
+* \param lastTime time of the last credit update, in s
+*/
+void COutThumbSocket::_sendEncoded(double& credit, double& lastTime)
+{
+    CFrameHeaders fh;
+    int offset = CFrameHeaders::GetHeadersLength();
+    if (_work.size() < (size_t)offset || fh.ReadHeaders(_work.data()) != VMI_E_OK)
+        return;
+    int w = fh.GetW();
+    int h = fh.GetH();
+    int channels = (fh.GetSamplingFmt() == SAMPLINGFMT::BGR ? 3 : 4);
+    _encoded.resize(offset + qoi::getMaxSize(w, h, channels));
+    int size = qoi::encode(_work.data() + offset, w, h, channels, _encoded.data() + offset, (int)_encoded.size() - offset);
+    if (size < 0) {
+        LOG_ERROR("%s: can't encode the %dx%d thumbnail, result=%d", _name.c_str(), w, h, size);
+        return;
+    }
+
+    // Max rate: the credit grows with the time up to 1s of rate, a thumbnail is sent if it's positive
+    if (_maxKbps > 0) {
+        double now = tools::getCurrentTimeInS();
+        double rate = _maxKbps * 1000.0 / 8;
+        credit = MIN(credit + (now - lastTime) * rate, rate);
+        lastTime = now;
+        if (credit < 0) {
+            _nbSkipped++;
+            return;
+        }
+        credit -= offset + size;
+    }
+
+    fh.SetSamplingFmt(SAMPLINGFMT::QOI);
+    fh.SetMediaSize(size);
+    fh.WriteHeaders(_encoded.data(), 0);
+    int len = offset + size;
+    int result = _tcpSock.writeSocket((char*)_encoded.data(), &len);
+    LOG("%s: write %d bytes (%d raw) to '%s:%d', result=%d", _name.c_str(), len, (int)_work.size(), _ip, _port, result);
+    if (result != E_OK || len == 0) {
+        _tcpSock.closeSocket();
+        _connected = false;
+    }
+}
+
 bool COutThumbSocket::isConnected()
 {
-    return _tcpSock.isValid();
+    // The socket of the encoding thread is only read by it
+    return (_th_enc.joinable() ? _connected.load() : _tcpSock.isValid());
 }
 
 PIN_REGISTER(COutThumbSocket,"thumbnails")
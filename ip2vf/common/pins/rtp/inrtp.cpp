@@ -30,12 +30,10 @@ CInRTP::CInRTP(CModuleConfiguration* pMainCfg, int nIndex) : CIn(pMainCfg, nInde
     PROPERTY_REGISTER_OPTIONAL("mcastgroup", _mcastgroup, "");
     PROPERTY_REGISTER_OPTIONAL("interface", _interface,"");
     PROPERTY_REGISTER_OPTIONAL("ip", _ip, "");
+    PROPERTY_REGISTER_OPTIONAL("batch", _batchSize, UDP_BATCH_DEFAULT_SIZE);
     _waitForNextFrame = true;
-#ifdef USE_NETMAP
-    _udpSock = (strncmp(_interface, "netmap-", 7) == 0) ? new Netmap() : new UDP();
-#else
-    _udpSock = new UDP();
-#endif
+    _udpSock = UDP::createReceiver(_interface);
+    _udpSock->setBatchSize(_batchSize);
 
 }
 
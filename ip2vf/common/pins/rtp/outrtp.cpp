@@ -9,6 +9,7 @@
 #include "tools.h"
 #include "rtpframe.h"
 #include "tcp_basic.h"
+#include "pacer.h"
 
 using namespace std;
 
@@ -27,6 +28,10 @@ COutRTP::COutRTP(CModuleConfiguration* pMainCfg, int nIndex) : COut(pMainCfg, nI
     PROPERTY_REGISTER_OPTIONAL("interface", _interface, "");
     PROPERTY_REGISTER_OPTIONAL("mtu", _mtu, 1500);
     PROPERTY_REGISTER_OPTIONAL("mcastgroup", _mcastgroup, "");
+    PROPERTY_REGISTER_OPTIONAL("sendmode", _sendMode, "mmsg");
+    PROPERTY_REGISTER_OPTIONAL("batch", _batchSize, UDP_BATCH_DEFAULT_SIZE);
+    PROPERTY_REGISTER_OPTIONAL("pacing", _pacing, "none");
+    PROPERTY_REGISTER_OPTIONAL("txtime", _useTxTime, false);
     _isMulticast       = !!_mcastgroup[0];
     _seq            = 0;
     _frameCount     = 0;
@@ -36,11 +41,9 @@ COutRTP::COutRTP(CModuleConfiguration* pMainCfg, int nIndex) : COut(pMainCfg, nI
     if( _mtu > RTP_MAX_FRAME_LENGTH ) {
         // TODO: issue
     }
-#ifdef USE_NETMAP
-    _udpSock = (strncmp(_interface, "netmap-", 7) == 0) ? new Netmap() : new UDP();
-#else
-    _udpSock = new UDP();
-#endif
+    _udpSock = UDP::createSender(_interface);
+    _udpSock->setSendMode(UDP::getSendModeFromName(_sendMode), _batchSize);
+    _pacer.init(CPacer::getModelFromName(_pacing), _useTxTime);
 }
 
 COutRTP::~COutRTP() 
@@ -67,9 +70,11 @@ int COutRTP::send(CvMIFrame* frame)
         if( result != E_OK ) 
             LOG_ERROR("%s: can't create %s UDP socket on [%s]:%d on interface '%s'", 
                 _name.c_str(), (_isMulticast?"listening":"connected"), (_isMulticast?"NULL":_ip), _port, _interface[0]=='\0'?"<default>":_interface);
-        else
+        else {
             LOG_INFO("%s: Ok to create %s UDP socket on [%s]:%d on interface '%s'", 
                 _name.c_str(), (_isMulticast?"listening":"connected"), (_isMulticast?"NULL":_ip), _port, _interface[0]=='\0'?"<default>":_interface);
+            _udpSock->setPacer(&_pacer);
+        }
     }
 
     //
@@ -5,6 +5,10 @@
 #ifdef _WIN32
 #define _WINSOCKAPI_
 #include <windows.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #endif
 
 #include <pins/pins.h>
@@ -18,6 +22,8 @@ using namespace std;
 // > ipcs - m
 // > ipcrm shm <shm_id>  // remove a shared memory segment
 
+#define INMEM_POLL_IN_MS    100     /* max time to block, to detect stop and sender restart */
+
 
 /**********************************************************************************************
 *
@@ -34,160 +40,273 @@ CInMem::CInMem(CModuleConfiguration* pMainCfg, int nIndex)
 #endif
 {
     LOG("%s: -->", _name.c_str());
-    
+
     _nType      = PIN_TYPE_SHMEM;
     _shm_size   = 0;
     _shm_data   = NULL;
-    _shm_key    = 0;
     _firstFrame = true;
     _sessionId  = 0LL;
+    _eventfd    = -1;
+    _reader     = -1;
+    _rdSeq      = 0;
+    _nbMissed   = 0;
+    _bStarted   = false;
 
-    PROPERTY_REGISTER_MANDATORY("control",   _port,      -1);
-    PROPERTY_REGISTER_OPTIONAL( "fmt",       _shm_nbseg, 1);
-    PROPERTY_REGISTER_OPTIONAL( "interface", _interface, "");
+    PROPERTY_REGISTER_MANDATORY("control",   _port,       -1);
+    PROPERTY_REGISTER_OPTIONAL( "policy",    _policy,     "drop");
+    PROPERTY_REGISTER_OPTIONAL( "eventfd",   _useEventFd, false);
 
     if (_port <= 0) {
         LOG_ERROR("%s: ***ERROR*** invalid parameter: port=%d. aborting", _name.c_str(), _port);
         exit(1);
     }
+    _shm_key = CShmRing::getKey(_port);
+
+#ifndef _WIN32
+    if (_useEventFd) {
+        _eventfd = eventfd(0, EFD_NONBLOCK);
+        if (_eventfd == -1)
+            LOG_ERROR("%s: failed to create eventfd, errno=%s. Use the doorbell", _name.c_str(), strerror(errno));
+    }
+#endif
 
     LOG("%s: <--", _name.c_str());
 }
 
-CInMem::~CInMem() 
+CInMem::~CInMem()
 {
-    // Delete the udp connectivity 
-    _udpSock.closeSocket();
-
     // delete the memory segment
-    if(_shm_data != NULL)
-        tools::detachSHMSegment(_shm_data);
+    _detachMemorySegment();
+#ifndef _WIN32
+    if (_eventfd != -1)
+        close(_eventfd);
+#endif
 }
 
-void CInMem::_checkMemorySegment(int shmkey, long long sessionId) {
+void CInMem::_detachMemorySegment() {
 
-    if (_shm_data == NULL || shmkey != _shm_key || sessionId != _sessionId) {
+    // Don't wait for us anymore. The segment is detached, and our reader entry is freed, when the last
+    // frame which reference it is released
+    if (_ring && _ring->getSessionId() == _sessionId)
+        _ring->detachReader(_reader);
+    _ring.reset();
+    _reader = -1;
+    _shm_data = NULL;
+}
 
-        LOG_INFO("Open memory segment with key=%d", shmkey);
-        // Delete any previous seg memory segment
-        if (_shm_data != NULL)
-            tools::detachSHMSegment(_shm_data);
+/*!
+* \fn _checkMemorySegment
+* \brief attach the segment of the sender, if not already done. Re-attach it if the sender has closed
+* or re-initialized it.
+*
+* \return true if the segment is ready to be read
+*/
+bool CInMem::_checkMemorySegment() {
 
-        // First, open the segment just enough to read headers. Goal was to retreive the complete frame size...
-        _shm_key = shmkey;
-        _shm_size = CFrameHeaders::GetHeadersLength();
-        _shm_data = tools::getSHMSegment(_shm_size, _shm_key, _shm_id);
-        if (_shm_data == NULL) {
-            LOG_ERROR("%s: ***ERROR*** failed to create shared memory segment of size %d. Aborting!!.", _name.c_str(), _shm_size);
-            return;
-        }
-        CFrameHeaders headers;
-        int result = headers.ReadHeaders((unsigned char*)_shm_data);
-        if (result != VMI_E_OK) {
-            LOG_ERROR("%s: ***ERROR*** failed to read headers", _name.c_str());
-            return;
+    if (_ring) {
+        if (!_ring->isClosed() && _ring->getSessionId() == _sessionId)
+            return true;
+        LOG_INFO("%s: the sender has closed the memory segment (%u frames missed)", _name.c_str(), _nbMissed);
+        _detachMemorySegment();
+    }
+
+    // Wait for the sender to create the segment
+    if (!tools::isSHMSegmentExist(_shm_key))
+        return false;
+
+    // First, open the segment just enough to read the ring header. Goal was to retreive the complete segment size...
+    LOG_INFO("Open memory segment with key=0x%x", _shm_key);
+    _shm_size = CShmRing::getSegmentSize(0, 0);
+    _shm_data = tools::getSHMSegment(_shm_size, _shm_key, _shm_id);
+    if (_shm_data == NULL) {
+        LOG_ERROR("%s: ***ERROR*** failed to open shared memory segment of size %d.", _name.c_str(), _shm_size);
+        return false;
+    }
+    {
+        CShmRing ring(_shm_data);
+        if (!ring.isValid() || ring.isClosed()) {
+            // Not yet initialized by the sender
+            tools::detachSHMSegment(_shm_data);
+            _shm_data = NULL;
+            return false;
         }
 #ifdef _WIN32
-        _shm_size = (headers.GetMediaSize() + CFrameHeaders::GetHeadersLength());
-        LOG_INFO("Size of shmem seg=%d, size of a frame=%d", _shm_size, (headers.GetMediaSize() + CFrameHeaders::GetHeadersLength()));
+        _shm_size = CShmRing::getSegmentSize(ring.getNbSlots(), ring.getSlotSize());
 #else
-        LOG_INFO("Size of shmem seg=%d, size of a frame=%d", tools::getSHMSegmentSize(_shm_id), (headers.GetMediaSize() + CFrameHeaders::GetHeadersLength()));
-        if (tools::getSHMSegmentSize(_shm_id) < (headers.GetMediaSize() + CFrameHeaders::GetHeadersLength())) {
-            LOG_ERROR("%s: ***ERROR*** shmem size is too short for a frame...", _name.c_str());
-            return;
-        }
         _shm_size = tools::getSHMSegmentSize(_shm_id);
 #endif
-        tools::detachSHMSegment(_shm_data);
-        _shm_data = tools::getSHMSegment(_shm_size, _shm_key, _shm_id);
-        if (_shm_data == NULL) {
-            LOG_ERROR("%s: ***ERROR*** failed to create shared memory segment of size %d. Aborting!!.", _name.c_str(), _shm_size);
-            return;
+        LOG_INFO("Size of shmem seg=%d, ring of %d slots of %d bytes, %szero-copy", _shm_size, ring.getNbSlots(), ring.getSlotSize(),
+            (ring.getFlags() & VMI_SHM_RING_FLAG_ZEROCOPY) ? "" : "no ");
+    }
+    tools::detachSHMSegment(_shm_data);
+    _shm_data = tools::getSHMSegment(_shm_size, _shm_key, _shm_id);
+    if (_shm_data == NULL) {
+        LOG_ERROR("%s: ***ERROR*** failed to open shared memory segment of size %d.", _name.c_str(), _shm_size);
+        return false;
+    }
+
+    // Register as a new reader of the ring
+    char* segment = _shm_data;
+    CShmRing* ring = new CShmRing(segment);
+    int policy = (strcmp(_policy, "block") == 0 ? VMI_SHM_READER_BLOCK : VMI_SHM_READER_DROP);
+#ifdef _WIN32
+    int reader = ring->registerReader(GetCurrentProcessId(), policy, -1);
+#else
+    int reader = ring->registerReader(getpid(), policy, _eventfd);
+#endif
+    if (reader < 0) {
+        LOG_ERROR("%s: ***ERROR*** already %d receivers on this memory segment", _name.c_str(), VMI_SHM_RING_MAX_READERS);
+        delete ring;
+        tools::detachSHMSegment(segment);
+        _shm_data = NULL;
+        return false;
+    }
+    long long sessionId = ring->getSessionId();
+    _ring = std::shared_ptr<CShmRing>(ring, [segment, reader, sessionId](CShmRing* r) {
+        if (r->getSessionId() == sessionId)
+            r->unregisterReader(reader);
+        delete r;
+        tools::detachSHMSegment(segment);
+    });
+    _reader = reader;
+    _sessionId = sessionId;
+    // Start with the next published frame
+    _rdSeq = _ring->getWriteSeq();
+    LOG_INFO("%s: registered as reader %d (policy %s) of %d", _name.c_str(), _reader, _policy, _ring->getReadersNb());
+
+    LOG_INFO("Opening of memory segment with key=0x%x and size=%d completed", _shm_key, _shm_size);
+    return true;
+}
+
+/*!
+* \fn _waitForEvent
+* \brief wait for a new frame published by the sender
+*
+* \param timeoutInMs max time to wait
+* \return true if a new frame is available
+*/
+bool CInMem::_waitForEvent(int timeoutInMs) {
+
+#ifndef _WIN32
+    // The sender reset our eventfd if it can't signal it
+    if (_eventfd != -1 && _ring->getReaderEventFd(_reader) != -1) {
+        if (_ring->getWriteSeq() != _rdSeq)
+            return true;
+        struct pollfd pfd;
+        pfd.fd = _eventfd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeoutInMs) > 0) {
+            // Reset the counter. The doorbell sequence counter remains the reference.
+            unsigned long long val;
+            if (::read(_eventfd, &val, sizeof(val)) < 0)
+                LOG("%s: failed to read eventfd, errno=%s", _name.c_str(), strerror(errno));
         }
-        _sessionId = sessionId;
-        LOG_INFO("Opening of memory segment with key=%d and size=%d completed", _shm_key, _shm_size);
+        return (_ring->getWriteSeq() != _rdSeq);
     }
+#endif
+    return _ring->waitForEvent(_rdSeq, timeoutInMs);
 }
 
+/*!
+* \fn _readSlot
+* \brief create the frame from the slot published by event. In zero-copy mode, the frame is created in place
+* and the slot is given back to the sender when the frame is released. Otherwise the frame is copied
+* and the slot released immediately.
+*
+* \param frame vMI frame to create, can be NULL to drop the frame
+* \param event doorbell event
+* \param shared true if other receivers read the same slot
+* \return VMI_E_OK if Ok, error code otherwise
+*/
+int CInMem::_readSlot(CvMIFrame* frame, const tShmRingEvent& event, bool shared) {
+
+    std::shared_ptr<CShmRing> ring = _ring;
+    long long sessionId = _sessionId;
+    int reader = _reader;
+    int slot = event.slot;
+    auto release = [ring, reader, slot, sessionId]() {
+        // Don't touch a slot of a segment re-initialized by the sender meanwhile
+        if (ring->getSessionId() == sessionId)
+            ring->releaseSlot(reader, slot);
+    };
+
+    int ret = VMI_E_OK;
+    if (frame == NULL) {
+        LOG_ERROR("Drop the frame #%d", event.frameNumber);
+        release();
+    }
+    else if (ring->getFlags() & VMI_SHM_RING_FLAG_ZEROCOPY) {
+        ret = frame->createFromSharedMem(ring->getSlotBuffer(slot), ring->getSlotSize(), _nModuleId, release, shared);
+    }
+    else {
+        ret = frame->createFromMem(ring->getSlotBuffer(slot), ring->getSlotFrameSize(slot), _nModuleId);
+        release();
+    }
+    return ret;
+}
 
 int CInMem::read(CvMIFrame* frame)
 {
-    int result = VMI_E_OK;
-
-    /*if (!frame) {
-        LOG_ERROR("Error: invalid frame...");
-        return VMI_E_OK;
-    }*/
-
-    //
-    // Manage the connection
-    //
-
-    if (!_udpSock.isValid()) {
-        result = _udpSock.openSocket(NULL, NULL, _port, true ,(char *)_interface);
-        if (result != E_OK) {
-            LOG_ERROR("%s: can't create %s UDP socket on [%s]:%d on interface '%s'",
-                _name.c_str(), "listening", "ANY", _port,
-                _interface[0] == '\0' ? "<default>" : _interface);
-            return VMI_E_FAILED_TO_OPEN_SOCKET;
+    while (_bStarted) {
+
+        //
+        // Manage the connection
+        //
+
+        if (!_checkMemorySegment()) {
+            // Sender not here
+            usleep(INMEM_POLL_IN_MS * 1000);
+            continue;
         }
-        else
-            LOG_INFO("%s: Ok to create %s UDP socket on [%s]:%d on interface '%s'",
-                _name.c_str(), "listening", "ANY", _port, 
-                _interface[0] == '\0' ? "<default>" : _interface);
-    }
 
-    //
-    // Manage the data
-    //
-
-    int ret = 0;
-    char msg[VMI_MEM_MSG_LEN];
-    LOG("%s: wait for msg....", _name.c_str());
-    if (_udpSock.isValid()) {
-        int len = sizeof(msg)/sizeof(char);
-        int num = _udpSock.readSocket(msg, &len);        //int num = zmq_recv(_zmq_receiver, msg, 32, 0);
-        if (num > 0)
-        {
-            int shmkey = 0, memoffset = 0;
-            long long sessionId = 0LL;
-            msg[num] = '\0';
-            LOG("%s: recv '%d' bytes, msg='%s'", _name.c_str(), num, msg);
-            sscanf(msg, VMI_MEM_MSG_FORMAT, &shmkey, &memoffset, &sessionId);
-
-            _checkMemorySegment(shmkey, sessionId);
-            if (_shm_data != NULL && frame == NULL) {
-                CFrameHeaders headers;
-                headers.ReadHeaders((unsigned char*)_shm_data + memoffset);
-                LOG_ERROR("Drop the frame #%d", headers.GetFrameNumber());
-            }
-            else if (_shm_data != NULL) {
-                int nb; 
-                CFrameHeaders headers;
-                headers.ReadHeaders((unsigned char*)_shm_data + memoffset);
-                frame->createFromMem((unsigned char*)_shm_data + memoffset, (headers.GetMediaSize()+CFrameHeaders::GetHeadersLength()), _nModuleId);
-                frame->get_header(MEDIA_FRAME_NB, &nb);
-                if (_firstFrame) {
-                    LOG_INFO("Dump received IP2vf headers:");
-                    CFrameHeaders* headers = frame->getMediaHeaders();
-                    headers->DumpHeaders();
-                    _firstFrame = false;
-                }
-                LOG("%s: read frame number %d (size=%d) from shmem on page %d", _name.c_str(), nb, _shm_size, _shm_data);
-            }
+        //
+        // Manage the data
+        //
+
+        LOG("%s: wait for frame....", _name.c_str());
+        if (!_waitForEvent(INMEM_POLL_IN_MS))
+            continue;
+
+        unsigned int wrSeq = _ring->getWriteSeq();
+        if ((int)(wrSeq - _rdSeq) > VMI_SHM_RING_MAX_EVENTS) {
+            // Too late, the oldest events are already overwritten
+            _nbMissed += (wrSeq - _rdSeq) - VMI_SHM_RING_MAX_EVENTS;
+            _rdSeq = wrSeq - VMI_SHM_RING_MAX_EVENTS;
         }
-        else if (num < 0) {
-            LOG("%s: ***ERROR*** recv failed with errno=%s", _name.c_str(), strerror(errno));
-            ret = E_ERROR;
+        tShmRingEvent event;
+        bool shared = false;
+        bool ok = _ring->readEvent(_rdSeq, event);
+        _rdSeq++;
+        if (!ok || !_ring->takeSlot(_reader, event, shared)) {
+            // The sender has overwritten this slot before we took it
+            _nbMissed++;
+            LOG("%s: frame #%d missed (%u missed, %u taken back by the sender)", _name.c_str(), event.frameNumber, _nbMissed, _ring->getReaderDroppedNb(_reader));
+            continue;
         }
+
+        int ret = _readSlot(frame, event, shared);
+        if (ret == VMI_E_OK && frame != NULL) {
+            int nb;
+            frame->get_header(MEDIA_FRAME_NB, &nb);
+            if (_firstFrame) {
+                LOG_INFO("Dump received IP2vf headers:");
+                CFrameHeaders* headers = frame->getMediaHeaders();
+                headers->DumpHeaders();
+                _firstFrame = false;
+            }
+            LOG("%s: read frame number %d from shmem slot %d", _name.c_str(), nb, event.slot);
+        }
+        return ret;
     }
-    return ret;
+    return VMI_E_CONNECTION_CLOSED;
 }
 
 void CInMem::start()
 {
     LOG("%s: -->", _name.c_str());
 
+    _bStarted = true;
+
     // start
     CIn::start();
 
@@ -196,11 +315,18 @@ void CInMem::start()
 
 void CInMem::stop()
 {
+    _bStarted = false;
 
-    if (_udpSock.isValid())
-    {
-        _udpSock.closeSocket();
+    // Unblock a pending read
+    if (_ring)
+        _ring->wakeUpConsumers();
+#ifndef _WIN32
+    if (_eventfd != -1) {
+        unsigned long long one = 1;
+        if (write(_eventfd, &one, sizeof(one)) < 0)
+            LOG("%s: failed to signal eventfd, errno=%s", _name.c_str(), strerror(errno));
     }
+#endif
     CIn::stop();
 }
 
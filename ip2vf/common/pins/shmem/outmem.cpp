@@ -5,6 +5,8 @@
 #ifdef _WIN32
 #define _WINSOCKAPI_
 #include <windows.h>
+#else
+#include <unistd.h>
 #endif
 
 #include <pins/pins.h>
@@ -40,85 +42,142 @@ COutMem::COutMem(CModuleConfiguration* pMainCfg, int nIndex)
     _nType      = PIN_TYPE_SHMEM;
     _shm_size   = 0;
     _shm_data   = NULL;
-    _shm_key    = 5000;
     _firstFrame = true;
     _sessionId  = 0LL;
 
     // Keep parameters
-    PROPERTY_REGISTER_MANDATORY("control",   _port,      -1);
-    PROPERTY_REGISTER_OPTIONAL( "ip",        _ip,        "localhost");
-    PROPERTY_REGISTER_OPTIONAL( "interface", _interface, "");
-    PROPERTY_REGISTER_OPTIONAL( "fmt",       _shm_nbseg, 1);
+    PROPERTY_REGISTER_MANDATORY("control",      _port,         -1);
+    PROPERTY_REGISTER_OPTIONAL( "fmt",          _shm_nbseg,    1);
+    PROPERTY_REGISTER_OPTIONAL( "zerocopy",     _zeroCopy,     false);
+    PROPERTY_REGISTER_OPTIONAL( "backpressure", _backpressure, 40);
+
+    // The segment is identified by the control port, so that the receivers can find it
+    _shm_key = CShmRing::getKey(_port);
+
+    // A slot can be read by the receivers while the next one is written. In zero-copy mode, the receivers
+    // keep a slot as long as they use the frame.
+    _shm_nbseg = MAX(_shm_nbseg, (_zeroCopy ? VMI_SHM_RING_DEFAULT_SLOTS : 2));
+    _shm_nbseg = MIN(_shm_nbseg, VMI_SHM_RING_MAX_SLOTS);
+    LOG_INFO("%s: use ring of %d slots, %szero-copy, shm key=0x%x", _name.c_str(), _shm_nbseg, (_zeroCopy ? "" : "no "), _shm_key);
+
+#ifndef _WIN32
+    // In zero-copy mode, the frames are built directly in the slots. Not on Windows: the name of a segment
+    // can't be re-used while frames still reference it.
+    if (_zeroCopy && !CvMIFrame::registerBufferProvider(this))
+        LOG_WARNING("%s: the frames are already built in the slots of another output, copy them", _name.c_str());
+#endif
 
     LOG("%s: <--", _name.c_str());
 }
 
-COutMem::~COutMem() 
+COutMem::~COutMem()
 {
     LOG("%s: -->", _name.c_str());
 
-    // Delete the udp connectivity 
-    if (!_udpSock.isValid())
-        _udpSock.closeSocket();
-
-    // delete the memory segment
-    if(_shm_data!=NULL)
-        tools::deleteSHMSegment(_shm_data, _shm_id);
+    // Don't lend slots anymore, then delete the memory segment. It remains attached until the last frame
+    // built in its slots is released.
+    CvMIFrame::unregisterBufferProvider(this);
+    _deleteMemorySegment();
 
     LOG("%s: <--", _name.c_str());
 }
 
+void COutMem::_deleteMemorySegment()
+{
+    if (_ring) {
+        // Let the receivers know that they must re-open the segment
+        LOG_INFO("%s: close the ring (%u frames overwritten, %u dropped)", _name.c_str(), _ring->getOverwrittenNb(), _ring->getDroppedNb());
+        _ring->close();
+#ifndef _WIN32
+        // Frames may still be built in its slots: the key is freed now, the segment is detached with the last of them
+        tools::removeSHMSegment(_shm_id);
+#endif
+        _ring.reset();
+    }
+    _shm_data = NULL;
+}
+
+/*!
+* \fn lendFrameBuffer
+* \brief lend a free slot to a new frame (zero-copy mode), so that send only has to publish it. Don't wait
+* for the receivers: without free slot, the frame is built in its own buffer, and copied by send.
+*
+* \param size frame size
+* \param bufferSize [out] slot size
+* \param release [out] give back the slot, if not published, or once the frame is released
+* \return slot buffer, NULL if none
+*/
+unsigned char* COutMem::lendFrameBuffer(int size, int& bufferSize, std::function<void()>& release)
+{
+    std::shared_ptr<CShmRing> ring;
+    {
+        std::lock_guard<std::mutex> lock(_ringLock);
+        ring = _ring;
+    }
+    // The segment is created (or re-created larger) by the first frame sent
+    if (!ring || size > ring->getSlotSize())
+        return NULL;
+    int slot = ring->tryAcquireSlot();
+    if (slot < 0)
+        return NULL;
+    bufferSize = ring->getSlotSize();
+    release = [ring, slot]() {
+        ring->abortSlot(slot);
+    };
+    return ring->getSlotBuffer(slot);
+}
+
 /*!
 * \fn send
-* \brief Extract audio data from SMPTE frame
+* \brief write the frame on a slot of the shared memory segment, then notify the receivers through
+* the doorbell of the segment. All the registered receivers read the same slot. A frame built in a
+* slot (zero-copy mode) is published in place, the others are copied.
 *
-* \param pOutputBuffer pointer to the output buffer
-* \return size of the copied audio data
+* \param frame frame to send
+* \return VMI_E_OK
 */
 int COutMem::send(CvMIFrame* frame)
 {
     LOG("%s: --> frame=0x%x, size=%d", _name.c_str(), frame, (frame?frame->getFrameSize():-1));
-    int result = E_OK;
-    int ret = 0;
+    int ret = VMI_E_OK;
 
     //
     // Manage the shared memory segment, if needed
     //
 
-    if (_shm_data == NULL || _shm_nbseg * frame->getFrameSize() > _shm_size) {
-
-        if (_shm_data != NULL) {
-            tools::deleteSHMSegment(_shm_data, _shm_id);
-            _shm_data = NULL;
-        }
-        _shm_size = _shm_nbseg * frame->getFrameSize();
-        LOG_INFO("Get another shmem segment of size %d bytes, _shm_key=%d, nbSeg=%d. Frame size=%d", _shm_size, _shm_key, _shm_nbseg, frame->getFrameSize());
-        _shm_data = tools::createSHMSegment_ext(_shm_size, _shm_key, _shm_id, false);
-        if (_shm_data == NULL) {
-            LOG_ERROR("%s: ***ERROR*** failed to create shared memory segment. Aborting!!.", _name.c_str());
-            exit(1);
+    std::shared_ptr<CShmRing> ring;
+    {
+        std::lock_guard<std::mutex> lock(_ringLock);
+        if (!_ring || frame->getFrameSize() > _ring->getSlotSize()) {
+
+            _deleteMemorySegment();
+            _shm_size = CShmRing::getSegmentSize(_shm_nbseg, frame->getFrameSize());
+            LOG_INFO("Get another shmem segment of size %d bytes, _shm_key=0x%x, nbSeg=%d. Frame size=%d", _shm_size, _shm_key, _shm_nbseg, frame->getFrameSize());
+            _shm_data = tools::createSHMSegment(_shm_size, _shm_key, _shm_id);
+            if (_shm_data == NULL) {
+                LOG_ERROR("%s: ***ERROR*** failed to create shared memory segment. Aborting!!.", _name.c_str());
+                exit(1);
+            }
+
+            _sessionId = tools::getCurrentTimeInMilliS();
+            char* segment = _shm_data;
+#ifndef _WIN32
+            // Already removed by _deleteMemorySegment, only detach it
+            _ring = std::shared_ptr<CShmRing>(new CShmRing(segment), [segment](CShmRing* r) {
+                delete r;
+                tools::detachSHMSegment(segment);
+            });
+#else
+            HANDLE shmid = _shm_id;
+            _ring = std::shared_ptr<CShmRing>(new CShmRing(segment), [segment, shmid](CShmRing* r) {
+                delete r;
+                tools::deleteSHMSegment(segment, shmid);
+            });
+#endif
+            _ring->init(_shm_nbseg, frame->getFrameSize(), _sessionId, (_zeroCopy ? VMI_SHM_RING_FLAG_ZEROCOPY : 0));
+            LOG_INFO("%s: Ok to open shmem (key=0x%x) of size=%d", _name.c_str(), _shm_key, _shm_size);
         }
-
-        _shm_wr_pt = 0;
-        _sessionId = tools::getCurrentTimeInMilliS();
-        LOG_INFO("%s: Ok to open shmem (key=%d) of size=%d", _name.c_str(), _shm_key, _shm_size);
-    }
- 
-    //
-    // Manage the udp connection (to send notification)
-    //
-
-    if (!_udpSock.isValid()) {
-
-        result = _udpSock.openSocket((char *)_ip, NULL, _port, false, _interface);
-        if (result != E_OK)
-            LOG_ERROR("%s: can't create %s UDP socket on [%s]:%d on interface '%s'",
-                _name.c_str(), "outgoing", "ANY", _port,
-                _interface[0] == '\0' ? "<default>" : _interface);
-        else
-            LOG_INFO("%s: Ok to create %s UDP socket on [%s]:%d on interface '%s'",
-                _name.c_str(), "outgoing", "ANY", _port, 
-                _interface[0] == '\0' ? "<default>" : _interface);
+        ring = _ring;
     }
 
     // Update ModuleId
@@ -134,39 +193,30 @@ int COutMem::send(CvMIFrame* frame)
     // Propagate data
     //
 
-    if (_shm_data != NULL) {
-
-        // Copy the buffer to the SHM
-        //LOG_INFO("_shm_size=%d, size=%d to shmkey=%d", _shm_size, frame->getFrameSize(), _shm_key);
-        int memoffset = _shm_wr_pt * frame->getFrameSize();
-        frame->copyFrameToMem((unsigned char*)_shm_data + memoffset, _shm_size / _shm_nbseg);
-
-        // Some logging stuff
-        if (getLogLevel() > LOG_LEVEL_WARNING) {
-            //int n = headers->GetFrameNumber();
-            //LOG("%s: send frame %d", _name.c_str(), n);
-            //LOG("%s: payload= 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x", _name.c_str(), (unsigned char)_pData[24], (unsigned char)_pData[25], (unsigned char)_pData[26], (unsigned char)_pData[27], (unsigned char)_pData[28]);
-        }
+    int nb = 0;
+    frame->get_header(MEDIA_FRAME_NB, &nb);
+    int slot = ring->getSlotIndex(frame->getFrameBuffer());
+    if (slot >= 0 && frame->sealLentBuffer()) {
+        // Built in place: the slot is given back when the frame is released
+        ring->publishSlot(slot, frame->getFrameSize(), nb, true);
+        LOG("%s: publish frame #%d of size=%d built on slot %d", _name.c_str(), nb, frame->getFrameSize(), slot);
+        return ret;
+    }
 
-        // Notify next node via udp queue
-        if (_udpSock.isValid()) {
-            // just notify the next module
-            char msg[VMI_MEM_MSG_LEN];
-            snprintf(msg, VMI_MEM_MSG_LEN, VMI_MEM_MSG_FORMAT, _shm_key, memoffset, _sessionId);
-            int len = (int)strlen(msg);
-            int rc = _udpSock.writeSocket(msg, &len);
-            if (rc < 0)
-                LOG("%s: ***ERROR*** zmq_send failed with errno=%s", _name.c_str(), strerror(errno));    // Not an error, it can be because the recv is not here, and we already fill the queue
-            LOG("%s: write frame of size=%d on shmem", _name.c_str(), _shm_size);
-            _shm_wr_pt = (_shm_wr_pt + 1) % _shm_nbseg;
-        }
+    slot = ring->acquireSlot(_backpressure);
+    if (slot < 0) {
+        LOG_WARNING("%s: all the %d slots are used by the %d receivers, drop the frame (%u dropped)", _name.c_str(), ring->getNbSlots(), ring->getReadersNb(), ring->getDroppedNb());
+        return ret;
     }
+    frame->copyFrameToMem(ring->getSlotBuffer(slot), frame->getFrameSize());
+    ring->publishSlot(slot, frame->getFrameSize(), nb);
+    LOG("%s: write frame #%d of size=%d on slot %d", _name.c_str(), nb, frame->getFrameSize(), slot);
 
     LOG("%s: <-- ", _name.c_str());
     return ret;
 }
 
-bool COutMem::isConnected() 
+bool COutMem::isConnected()
 {
 #ifdef _WIN32
     return (_shm_id != INVALID_HANDLE_VALUE);
@@ -0,0 +1,576 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#ifdef _WIN32
+#define _WINSOCKAPI_
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "common.h"
+#include "log.h"
+#include "tools.h"
+#include "shmring.h"
+
+using namespace std;
+
+static_assert(sizeof(std::atomic<unsigned int>) == sizeof(unsigned int), "futex word must be a plain 32 bits integer");
+
+/*!
+* \fn _futexWait
+* \brief wait until *addr is different from val, or timeout. The word is in a shared segment, so
+* the futex is not private. On Windows, there is no inter-process futex: poll the value.
+*
+* \param addr futex word
+* \param val expected value
+* \param timeoutInMs max time to wait
+*/
+static void _futexWait(std::atomic<unsigned int>* addr, unsigned int val, int timeoutInMs) {
+
+#ifdef _WIN32
+    long long end = tools::getCurrentTimeInMilliS() + timeoutInMs;
+    while (addr->load() == val && tools::getCurrentTimeInMilliS() < end)
+        Sleep(1);
+#else
+    struct timespec ts;
+    ts.tv_sec = timeoutInMs / 1000;
+    ts.tv_nsec = (timeoutInMs % 1000) * 1000000L;
+    syscall(SYS_futex, (unsigned int*)addr, FUTEX_WAIT, val, &ts, NULL, 0);
+#endif
+}
+
+static void _futexWake(std::atomic<unsigned int>* addr) {
+
+#ifndef _WIN32
+    syscall(SYS_futex, (unsigned int*)addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+/**********************************************************************************************
+*
+* CShmRing
+*
+***********************************************************************************************/
+
+CShmRing::CShmRing(char* segment) {
+
+    _segment = (unsigned char*)segment;
+    _hdr = (tShmRingHeader*)segment;
+    for (int r = 0; r < VMI_SHM_RING_MAX_READERS; r++) {
+        _readerFds[r] = -1;
+        _readerGens[r] = 0;
+    }
+}
+
+CShmRing::~CShmRing() {
+
+#ifndef _WIN32
+    for (int r = 0; r < VMI_SHM_RING_MAX_READERS; r++) {
+        if (_readerFds[r] != -1)
+            ::close(_readerFds[r]);
+    }
+#endif
+}
+
+/*!
+* \fn getSegmentSize
+* \brief return the size of the shared memory segment needed for a ring
+*
+* \param nbSlots number of slots
+* \param slotSize size of a slot (i.e. max size of a vMI frame)
+* \return size in bytes
+*/
+int CShmRing::getSegmentSize(int nbSlots, int slotSize) {
+
+    int dataOffset = (sizeof(tShmRingHeader) + VMI_SHM_RING_ALIGN - 1) / VMI_SHM_RING_ALIGN * VMI_SHM_RING_ALIGN;
+    return dataOffset + nbSlots * slotSize;
+}
+
+/*!
+* \fn isRing
+* \brief check if a shared memory segment contains a valid ring
+*
+* \param segment pointer to the beginning of the segment
+* \return true if it's a ring
+*/
+bool CShmRing::isRing(char* segment) {
+
+    if (segment == NULL)
+        return false;
+    tShmRingHeader* hdr = (tShmRingHeader*)segment;
+    return (hdr->magic == VMI_SHM_RING_MAGIC && hdr->version == VMI_SHM_RING_VERSION);
+}
+
+/*!
+* \fn init
+* \brief init the ring on a new segment (producer side)
+*
+* \param nbSlots number of slots
+* \param slotSize size of a slot
+* \param sessionId id of the session, changed each time the segment is created
+* \param flags VMI_SHM_RING_FLAG_xxx
+*/
+void CShmRing::init(int nbSlots, int slotSize, long long sessionId, int flags) {
+
+    _hdr->magic = 0;
+    _hdr->version = VMI_SHM_RING_VERSION;
+    _hdr->nbSlots = MIN(nbSlots, VMI_SHM_RING_MAX_SLOTS);
+    _hdr->slotSize = slotSize;
+    _hdr->dataOffset = getSegmentSize(0, 0);
+    _hdr->flags = flags;
+    _hdr->sessionId = sessionId;
+    _hdr->closed.store(0);
+    _hdr->wrSeq.store(0);
+    _hdr->waiters.store(0);
+    _hdr->freeSeq.store(0);
+    _hdr->freeWaiters.store(0);
+    _hdr->nbOverwritten.store(0);
+    _hdr->nbDropped.store(0);
+    _hdr->readersMask.store(0);
+    for (int r = 0; r < VMI_SHM_RING_MAX_READERS; r++) {
+        _hdr->readers[r].pid.store(0);
+        _hdr->readers[r].policy = VMI_SHM_READER_DROP;
+        _hdr->readers[r].eventfd.store(-1);
+        _hdr->readers[r].gen = 0;
+        _hdr->readers[r].nbDropped.store(0);
+    }
+    for (int i = 0; i < VMI_SHM_RING_MAX_SLOTS; i++) {
+        _hdr->slots[i].owners.store(0);
+        _hdr->slots[i].frameSize = 0;
+        _hdr->slots[i].frameNumber = 0;
+    }
+    for (int i = 0; i < VMI_SHM_RING_MAX_EVENTS; i++)
+        _hdr->events[i].seq.store(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    _hdr->magic = VMI_SHM_RING_MAGIC;
+}
+
+bool CShmRing::isValid() {
+
+    return isRing((char*)_segment);
+}
+
+int CShmRing::getReadersNb() {
+
+    unsigned int mask = _hdr->readersMask.load();
+    int nb = 0;
+    for (; mask != 0; mask &= mask - 1)
+        nb++;
+    return nb;
+}
+
+/*!
+* \fn _clearSlotBits
+* \brief clear some owners bits of a slot, and notify the producer if the slot become free
+*
+* \param slot slot index
+* \param bits VMI_SHM_SLOT_xxx bits to clear
+* \return the previous owners value
+*/
+unsigned long long CShmRing::_clearSlotBits(int slot, unsigned long long bits) {
+
+    std::atomic<unsigned long long>& owners = _hdr->slots[slot].owners;
+    unsigned long long v = owners.load(std::memory_order_relaxed);
+    while (!owners.compare_exchange_weak(v, v & ~bits, std::memory_order_acq_rel, std::memory_order_relaxed));
+    if ((v & VMI_SHM_SLOT_BUSY_MASK) != 0 && (v & ~bits & VMI_SHM_SLOT_BUSY_MASK) == 0) {
+        _hdr->freeSeq.fetch_add(1);
+        if (_hdr->freeWaiters.load() > 0)
+            _futexWake(&_hdr->freeSeq);
+    }
+    return v;
+}
+
+/*!
+* \fn _reclaimSlot
+* \brief take back the oldest published slot that no reader reference, and which is pending only for
+* the given readers. These readers will miss this frame.
+*
+* \param readers mask of the readers which can be skipped
+* \return slot index, -1 if none
+*/
+int CShmRing::_reclaimSlot(unsigned int readers) {
+
+    for (int retry = 0; retry < _hdr->nbSlots; retry++) {
+        int oldest = -1;
+        unsigned long long oldestOwners = 0;
+        for (int i = 0; i < _hdr->nbSlots; i++) {
+            unsigned long long v = _hdr->slots[i].owners.load(std::memory_order_relaxed);
+            if ((v & VMI_SHM_SLOT_BUSY_MASK) == 0 || (v & (VMI_SHM_SLOT_WRITING | VMI_SHM_SLOT_HOLDING_MASK)) != 0)
+                continue;
+            if ((v & VMI_SHM_SLOT_PENDING_MASK & ~(unsigned long long)readers) != 0)
+                continue;
+            if (oldest == -1 || (int)(VMI_SHM_SLOT_SEQ(v) - VMI_SHM_SLOT_SEQ(oldestOwners)) < 0) {
+                oldest = i;
+                oldestOwners = v;
+            }
+        }
+        if (oldest == -1)
+            return -1;
+        unsigned long long v = oldestOwners;
+        if (_hdr->slots[oldest].owners.compare_exchange_strong(v, (v & ~VMI_SHM_SLOT_BUSY_MASK) | VMI_SHM_SLOT_WRITING, std::memory_order_acquire)) {
+            _hdr->nbOverwritten.fetch_add(1, std::memory_order_relaxed);
+            for (int r = 0; r < VMI_SHM_RING_MAX_READERS; r++) {
+                if (v & VMI_SHM_SLOT_PENDING(r))
+                    _hdr->readers[r].nbDropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            return oldest;
+        }
+        // A reader took it meanwhile, try another one
+    }
+    return -1;
+}
+
+/*!
+* \fn _removeDeadReaders
+* \brief unregister the readers whose process doesn't exist anymore, and give back their slots
+*
+* \return true if at least one reader has been removed
+*/
+bool CShmRing::_removeDeadReaders() {
+
+    bool removed = false;
+#ifndef _WIN32
+    for (int r = 0; r < VMI_SHM_RING_MAX_READERS; r++) {
+        int pid = _hdr->readers[r].pid.load();
+        if (pid > 0 && kill(pid, 0) == -1 && errno == ESRCH) {
+            LOG_WARNING("reader %d (pid %d) is dead, unregister it", r, pid);
+            _hdr->readersMask.fetch_and(~(1u << r));
+            for (int i = 0; i < _hdr->nbSlots; i++)
+                _clearSlotBits(i, VMI_SHM_SLOT_PENDING(r) | VMI_SHM_SLOT_HOLDING(r));
+            _hdr->readers[r].eventfd.store(-1);
+            _hdr->readers[r].pid.store(0);
+            removed = true;
+        }
+    }
+#endif
+    return removed;
+}
+
+/*!
+* \fn _signalReaders
+* \brief signal the eventfd of the readers which use one. The eventfd is duplicated once from the reader process.
+*
+* \param readers mask of the readers to signal
+*/
+void CShmRing::_signalReaders(unsigned int readers) {
+
+#if !defined(_WIN32) && defined(SYS_pidfd_open) && defined(SYS_pidfd_getfd)
+    for (int r = 0; r < VMI_SHM_RING_MAX_READERS; r++) {
+        if ((readers & (1u << r)) == 0)
+            continue;
+        int fd = _hdr->readers[r].eventfd.load();
+        if (fd < 0)
+            continue;
+        if (_readerFds[r] == -1 || _readerGens[r] != _hdr->readers[r].gen) {
+            if (_readerFds[r] != -1)
+                ::close(_readerFds[r]);
+            _readerFds[r] = -1;
+            _readerGens[r] = _hdr->readers[r].gen;
+            int pidfd = (int)syscall(SYS_pidfd_open, _hdr->readers[r].pid.load(), 0);
+            if (pidfd >= 0) {
+                _readerFds[r] = (int)syscall(SYS_pidfd_getfd, pidfd, fd, 0);
+                ::close(pidfd);
+            }
+            if (_readerFds[r] == -1) {
+                // The reader will fall back on the doorbell
+                LOG_WARNING("can't get the eventfd of reader %d (errno=%s), use the doorbell", r, strerror(errno));
+                _hdr->readers[r].eventfd.store(-1);
+                continue;
+            }
+        }
+        unsigned long long one = 1;
+        if (write(_readerFds[r], &one, sizeof(one)) < 0)
+            LOG("failed to signal eventfd of reader %d, errno=%s", r, strerror(errno));
+    }
+#endif
+}
+
+/*!
+* \fn tryAcquireSlot
+* \brief take a slot to write a new frame, without waiting. A free slot is used first. If none, the oldest
+* published slot pending only for readers with the "drop" policy is taken back.
+*
+* \return slot index, -1 if none
+*/
+int CShmRing::tryAcquireSlot() {
+
+    for (int i = 0; i < _hdr->nbSlots; i++) {
+        unsigned long long v = _hdr->slots[i].owners.load(std::memory_order_relaxed);
+        if ((v & VMI_SHM_SLOT_BUSY_MASK) == 0 &&
+            _hdr->slots[i].owners.compare_exchange_strong(v, v | VMI_SHM_SLOT_WRITING, std::memory_order_acquire))
+            return i;
+    }
+
+    // Don't wait for the readers which accept to drop frames
+    unsigned int blockReaders = 0;
+    unsigned int readersMask = _hdr->readersMask.load();
+    for (int r = 0; r < VMI_SHM_RING_MAX_READERS; r++) {
+        if ((readersMask & (1u << r)) && _hdr->readers[r].policy == VMI_SHM_READER_BLOCK)
+            blockReaders |= (1u << r);
+    }
+    return _reclaimSlot(~blockReaders);
+}
+
+/*!
+* \fn acquireSlot
+* \brief take a slot to write a new frame (see tryAcquireSlot). If none, wait up to timeoutInMs for the
+* readers with the "block" policy (backpressure), then take back the oldest slot not referenced by a reader.
+*
+* \param timeoutInMs max time to wait for a free slot, 0 to not wait
+* \return slot index, -1 if all slots are referenced by readers (the frame must be dropped)
+*/
+int CShmRing::acquireSlot(int timeoutInMs) {
+
+    long long end = tools::getCurrentTimeInMilliS() + timeoutInMs;
+    bool cleaned = false;
+    while (true) {
+        unsigned int freeSeq = _hdr->freeSeq.load();
+        int slot = tryAcquireSlot();
+        if (slot >= 0)
+            return slot;
+
+        long long remaining = end - tools::getCurrentTimeInMilliS();
+        if (remaining <= 0) {
+            // Slowest readers are too late
+            slot = _reclaimSlot(~0u);
+            if (slot >= 0)
+                return slot;
+            // Maybe they are dead...
+            if (!cleaned && _removeDeadReaders()) {
+                cleaned = true;
+                continue;
+            }
+            break;
+        }
+        _hdr->freeWaiters.fetch_add(1);
+        _futexWait(&_hdr->freeSeq, freeSeq, (int)remaining);
+        _hdr->freeWaiters.fetch_sub(1);
+    }
+    _hdr->nbDropped.fetch_add(1, std::memory_order_relaxed);
+    return -1;
+}
+
+/*!
+* \fn publishSlot
+* \brief make a slot available for the registered readers, once the frame is written, and ring the doorbell
+*
+* \param slot slot index
+* \param frameSize size of the frame written on the slot
+* \param frameNumber vMI frame number
+* \param bHold if true, the producer still reference the slot (a frame built in place), until abortSlot
+*/
+void CShmRing::publishSlot(int slot, int frameSize, int frameNumber, bool bHold) {
+
+    // Only one producer: no concurrent write on wrSeq
+    unsigned int seq = _hdr->wrSeq.load(std::memory_order_relaxed) + 1;
+    unsigned int readers = _hdr->readersMask.load();
+
+    tShmRingSlot* s = &_hdr->slots[slot];
+    s->frameSize = frameSize;
+    s->frameNumber = frameNumber;
+    // Without reader, the slot is free again immediately
+    s->owners.store(((unsigned long long)seq << 32) | readers | (bHold ? VMI_SHM_SLOT_WRITING : 0), std::memory_order_release);
+
+    // Write the event (seqlock: invalidate, write, then validate)
+    tShmRingEvent* e = &_hdr->events[(seq - 1) & (VMI_SHM_RING_MAX_EVENTS - 1)];
+    e->seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e->slot = slot;
+    e->frameNumber = frameNumber;
+    e->sessionId = _hdr->sessionId;
+    e->seq.store(seq, std::memory_order_release);
+
+    // Ring the doorbell
+    _hdr->wrSeq.store(seq);
+    if (_hdr->waiters.load() > 0)
+        _futexWake(&_hdr->wrSeq);
+    _signalReaders(readers);
+}
+
+/*!
+* \fn abortSlot
+* \brief give back a slot taken by acquireSlot, not published or published with bHold
+*
+* \param slot slot index
+*/
+void CShmRing::abortSlot(int slot) {
+
+    _clearSlotBits(slot, VMI_SHM_SLOT_WRITING);
+}
+
+/*!
+* \fn close
+* \brief producer side, notify the consumers that this segment will be deleted
+*
+*/
+void CShmRing::close() {
+
+    _hdr->closed.store(1);
+    wakeUpConsumers();
+}
+
+void CShmRing::wakeUpConsumers() {
+
+    _futexWake(&_hdr->wrSeq);
+}
+
+/*!
+* \fn registerReader
+* \brief consumer side, register a new reader: next published frames will wait for it
+*
+* \param pid pid of the reader process
+* \param policy VMI_SHM_READER_xxx
+* \param eventfd eventfd to signal at each publication, -1 to use only the doorbell
+* \return reader index, -1 if there is already VMI_SHM_RING_MAX_READERS readers
+*/
+int CShmRing::registerReader(int pid, int policy, int eventfd) {
+
+    for (int r = 0; r < VMI_SHM_RING_MAX_READERS; r++) {
+        int expected = 0;
+        if (_hdr->readers[r].pid.compare_exchange_strong(expected, pid)) {
+            _hdr->readers[r].policy = policy;
+            _hdr->readers[r].nbDropped.store(0);
+            _hdr->readers[r].eventfd.store(eventfd);
+            _hdr->readers[r].gen++;
+            _hdr->readersMask.fetch_or(1u << r);
+            return r;
+        }
+    }
+    return -1;
+}
+
+/*!
+* \fn detachReader
+* \brief consumer side, stop to read: next published frames won't wait for this reader anymore. The slots it
+* still references stay valid until released.
+*
+* \param reader reader index
+*/
+void CShmRing::detachReader(int reader) {
+
+    _hdr->readersMask.fetch_and(~(1u << reader));
+    for (int i = 0; i < _hdr->nbSlots; i++)
+        _clearSlotBits(i, VMI_SHM_SLOT_PENDING(reader));
+}
+
+/*!
+* \fn unregisterReader
+* \brief consumer side, free the reader entry, once all its slots are released
+*
+* \param reader reader index
+*/
+void CShmRing::unregisterReader(int reader) {
+
+    detachReader(reader);
+    _hdr->readers[reader].eventfd.store(-1);
+    _hdr->readers[reader].pid.store(0);
+}
+
+/*!
+* \fn waitForEvent
+* \brief consumer side, wait for a publication after rdSeq
+*
+* \param rdSeq number of events already read by the consumer
+* \param timeoutInMs max time to wait
+* \return true if an event is available
+*/
+bool CShmRing::waitForEvent(unsigned int rdSeq, int timeoutInMs) {
+
+    if (_hdr->wrSeq.load() != rdSeq)
+        return true;
+    _hdr->waiters.fetch_add(1);
+    if (_hdr->wrSeq.load() == rdSeq && !isClosed())
+        _futexWait(&_hdr->wrSeq, rdSeq, timeoutInMs);
+    _hdr->waiters.fetch_sub(1);
+    return (_hdr->wrSeq.load() != rdSeq);
+}
+
+/*!
+* \fn readEvent
+* \brief consumer side, read the event rdSeq+1
+*
+* \param rdSeq number of events already read by the consumer
+* \param event filled with the event
+* \return false if the event has been overwritten meanwhile (consumer too late)
+*/
+bool CShmRing::readEvent(unsigned int rdSeq, tShmRingEvent& event) {
+
+    unsigned int seq = rdSeq + 1;
+    tShmRingEvent* e = &_hdr->events[rdSeq & (VMI_SHM_RING_MAX_EVENTS - 1)];
+    if (e->seq.load(std::memory_order_acquire) != seq)
+        return false;
+    event.slot = e->slot;
+    event.frameNumber = e->frameNumber;
+    event.sessionId = e->sessionId;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (e->seq.load(std::memory_order_relaxed) != seq)
+        return false;
+    event.seq.store(seq, std::memory_order_relaxed);
+    return true;
+}
+
+/*!
+* \fn takeSlot
+* \brief consumer side, reference the slot published by an event
+*
+* \param reader reader index
+* \param event event read by readEvent()
+* \param shared set to true if other readers reference, or will reference, the same slot
+* \return false if the slot is no more the one published by this event (taken back by the producer)
+*/
+bool CShmRing::takeSlot(int reader, const tShmRingEvent& event, bool& shared) {
+
+    if (event.slot < 0 || event.slot >= _hdr->nbSlots)
+        return false;
+    std::atomic<unsigned long long>& owners = _hdr->slots[event.slot].owners;
+    unsigned long long mine = VMI_SHM_SLOT_PENDING(reader) | VMI_SHM_SLOT_HOLDING(reader);
+    unsigned long long v = owners.load(std::memory_order_relaxed);
+    do {
+        if (VMI_SHM_SLOT_SEQ(v) != event.seq.load(std::memory_order_relaxed) || (v & VMI_SHM_SLOT_PENDING(reader)) == 0)
+            return false;
+    } while (!owners.compare_exchange_weak(v, (v & ~VMI_SHM_SLOT_PENDING(reader)) | VMI_SHM_SLOT_HOLDING(reader),
+        std::memory_order_acquire, std::memory_order_relaxed));
+    // The producer may still read a frame built in place
+    shared = ((v & (VMI_SHM_SLOT_PENDING_MASK | VMI_SHM_SLOT_HOLDING_MASK | VMI_SHM_SLOT_WRITING) & ~mine) != 0);
+    return true;
+}
+
+/*!
+* \fn releaseSlot
+* \brief consumer side, release a slot previously taken. When no more referenced, the slot is free again
+*
+* \param reader reader index
+* \param slot slot index
+*/
+void CShmRing::releaseSlot(int reader, int slot) {
+
+    unsigned long long v = _clearSlotBits(slot, VMI_SHM_SLOT_HOLDING(reader));
+    if ((v & VMI_SHM_SLOT_HOLDING(reader)) == 0)
+        LOG_ERROR("Error, slot %d was not referenced by reader %d. This not be happen.", slot, reader);
+}
+
+unsigned char* CShmRing::getSlotBuffer(int slot) {
+
+    return _segment + _hdr->dataOffset + slot * _hdr->slotSize;
+}
+
+/*!
+* \fn getSlotIndex
+* \brief return the slot which begins at buffer
+*
+* \param buffer pointer on the segment
+* \return slot index, -1 if buffer is not the beginning of a slot of this ring
+*/
+int CShmRing::getSlotIndex(const unsigned char* buffer) {
+
+    long long offset = buffer - (_segment + _hdr->dataOffset);
+    if (offset < 0 || offset % _hdr->slotSize != 0 || offset / _hdr->slotSize >= _hdr->nbSlots)
+        return -1;
+    return (int)(offset / _hdr->slotSize);
+}
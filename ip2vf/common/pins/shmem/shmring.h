@@ -0,0 +1,165 @@
+#ifndef _SHMRING_H
+#define _SHMRING_H
+
+#include <atomic>
+
+#include "common.h"
+
+/*
+* Layout of a shmem pin segment:
+*
+*   +-----------------+----------+----------+-----+----------+
+*   | tShmRingHeader  |  slot 0  |  slot 1  | ... |  slot n  |
+*   +-----------------+----------+----------+-----+----------+
+*
+* Each slot contains a full vMI frame (headers + media). The producer writes a frame
+* in a free slot, publish it, then post an event on the doorbell (events array + wrSeq
+* counter, used as futex word). Up to VMI_SHM_RING_MAX_READERS consumers register in
+* the readers table, each with its own read cursor on the events. A consumer wait on the
+* doorbell, take the slot and, in zero-copy mode, reference the slot in place (no copy)
+* as long as its vMIFrame is alive. Otherwise it copies the frame and release the slot
+* immediately. In zero-copy mode, the producer also lends the free slots to its own vMIFrames, so
+* that a frame is built in place and published without copy.
+*
+* Slot owners (tShmRingSlot::owners), shared between processes:
+*   bits 63..32 : publication number of the frame in this slot
+*   bit  r      : reader r has not yet taken the slot (pending)
+*   bit  8+r    : reader r reference the slot (holding)
+*   bit  16     : slot is being written by the producer, or still referenced by the producer frame
+*                 built in place (zero-copy sender, see COutMem)
+* The slot is free when the 32 low bits are 0. When no slot is free, the producer takes
+* back the oldest slot from the readers with the "drop" policy, and waits up to its
+* backpressure timeout for the readers with the "block" policy.
+*/
+
+#define VMI_SHM_RING_MAGIC          0x52494D76      /* 'vMIR' */
+#define VMI_SHM_RING_VERSION        3
+#define VMI_SHM_RING_MAX_SLOTS      64
+#define VMI_SHM_RING_MAX_EVENTS     256             /* must be a power of 2 */
+#define VMI_SHM_RING_MAX_READERS    8
+#define VMI_SHM_RING_DEFAULT_SLOTS  4
+#define VMI_SHM_RING_ALIGN          4096
+#define VMI_SHM_RING_KEY_BASE       0x764D0000      /* shm key = base + control port */
+
+#define VMI_SHM_RING_FLAG_ZEROCOPY  0x1
+
+#define VMI_SHM_SLOT_PENDING(r)     (1ULL << (r))
+#define VMI_SHM_SLOT_HOLDING(r)     (1ULL << (8 + (r)))
+#define VMI_SHM_SLOT_PENDING_MASK   0x000000FFULL
+#define VMI_SHM_SLOT_HOLDING_MASK   0x0000FF00ULL
+#define VMI_SHM_SLOT_WRITING        0x00010000ULL
+#define VMI_SHM_SLOT_BUSY_MASK      0xFFFFFFFFULL
+#define VMI_SHM_SLOT_SEQ(o)         ((unsigned int)((o) >> 32))
+
+#define VMI_SHM_READER_DROP         0   /* the producer overwrite the frames not yet taken by this reader */
+#define VMI_SHM_READER_BLOCK        1   /* the producer wait for this reader (up to its backpressure timeout) */
+
+struct tShmRingSlot {
+    std::atomic<unsigned long long> owners; /* see above */
+    int                 frameSize;      /* size of the vMI frame (headers + media) in this slot */
+    int                 frameNumber;    /* vMI frame number of the frame in this slot */
+};
+
+struct tShmRingEvent {
+    std::atomic<unsigned int> seq;      /* publication number, written last (seqlock) */
+    int                 slot;
+    int                 frameNumber;
+    int                 reserved;
+    long long           sessionId;
+};
+
+struct tShmRingReader {
+    std::atomic<int>    pid;            /* 0 if this entry is free */
+    int                 policy;         /* VMI_SHM_READER_xxx */
+    std::atomic<int>    eventfd;        /* eventfd of the reader (in its process), -1 if not used */
+    unsigned int        gen;            /* incremented at each registration */
+    std::atomic<unsigned int> nbDropped;/* nb of frames taken back from this reader before it read them */
+};
+
+struct tShmRingHeader {
+    unsigned int        magic;
+    int                 version;
+    int                 nbSlots;
+    int                 slotSize;
+    int                 dataOffset;     /* offset of the slot 0 from the beginning of the segment */
+    int                 flags;          /* VMI_SHM_RING_FLAG_xxx */
+    long long           sessionId;
+
+    std::atomic<int>          closed;       /* set by the producer before it delete the segment */
+    std::atomic<unsigned int> wrSeq;        /* doorbell: number of published events. futex word */
+    std::atomic<int>          waiters;      /* nb of consumers waiting on wrSeq */
+    std::atomic<unsigned int> freeSeq;      /* incremented each time a slot become free. futex word (backpressure) */
+    std::atomic<int>          freeWaiters;  /* nb of producers waiting on freeSeq */
+    std::atomic<unsigned int> nbOverwritten;/* nb of published slots taken back before all the readers took them */
+    std::atomic<unsigned int> nbDropped;    /* nb of frames the producer could not publish */
+    std::atomic<unsigned int> readersMask;  /* bit r set if reader r want the next frames */
+
+    tShmRingReader      readers[VMI_SHM_RING_MAX_READERS];
+    tShmRingSlot        slots[VMI_SHM_RING_MAX_SLOTS];
+    tShmRingEvent       events[VMI_SHM_RING_MAX_EVENTS];
+};
+
+/**********************************************************************************************
+*
+* CShmRing
+*
+***********************************************************************************************/
+class CShmRing
+{
+    tShmRingHeader* _hdr;
+    unsigned char*  _segment;
+    int             _readerFds[VMI_SHM_RING_MAX_READERS];  /* producer side: local copies of the readers eventfd */
+    unsigned int    _readerGens[VMI_SHM_RING_MAX_READERS]; /* registration of the reader when its eventfd was duplicated */
+
+public:
+    CShmRing(char* segment);
+    ~CShmRing();
+
+private:
+    unsigned long long _clearSlotBits(int slot, unsigned long long bits);
+    int  _reclaimSlot(unsigned int readers);
+    bool _removeDeadReaders();
+    void _signalReaders(unsigned int readers);
+
+public:
+    static int  getSegmentSize(int nbSlots, int slotSize);
+    static bool isRing(char* segment);
+    static int  getKey(int port) { return VMI_SHM_RING_KEY_BASE + (port & 0xFFFF); };
+
+    void init(int nbSlots, int slotSize, long long sessionId, int flags);
+    bool isValid();
+    int  getNbSlots() { return _hdr->nbSlots; };
+    int  getSlotSize() { return _hdr->slotSize; };
+    int  getFlags() { return _hdr->flags; };
+    long long getSessionId() { return _hdr->sessionId; };
+    bool isClosed() { return _hdr->closed.load(std::memory_order_acquire) != 0; };
+    unsigned int getOverwrittenNb() { return _hdr->nbOverwritten.load(std::memory_order_relaxed); };
+    unsigned int getDroppedNb() { return _hdr->nbDropped.load(std::memory_order_relaxed); };
+    int  getReadersNb();
+
+    // Producer side
+    int  tryAcquireSlot();
+    int  acquireSlot(int timeoutInMs);
+    void publishSlot(int slot, int frameSize, int frameNumber, bool bHold = false);
+    void abortSlot(int slot);
+    void close();
+
+    // Consumer side
+    int  registerReader(int pid, int policy, int eventfd);
+    void detachReader(int reader);
+    void unregisterReader(int reader);
+    int  getReaderEventFd(int reader) { return _hdr->readers[reader].eventfd.load(); };
+    unsigned int getReaderDroppedNb(int reader) { return _hdr->readers[reader].nbDropped.load(std::memory_order_relaxed); };
+    unsigned int getWriteSeq() { return _hdr->wrSeq.load(std::memory_order_acquire); };
+    bool waitForEvent(unsigned int rdSeq, int timeoutInMs);
+    bool readEvent(unsigned int rdSeq, tShmRingEvent& event);
+    bool takeSlot(int reader, const tShmRingEvent& event, bool& shared);
+    void releaseSlot(int reader, int slot);
+    void wakeUpConsumers();
+
+    unsigned char* getSlotBuffer(int slot);
+    int  getSlotIndex(const unsigned char* buffer);
+    int  getSlotFrameSize(int slot) { return _hdr->slots[slot].frameSize; };
+};
+
+#endif //_SHMRING_H
@@ -22,6 +22,23 @@ using namespace std;
 CDMUXDataSource::CDMUXDataSource() : _pConfig(nullptr), _type(DataSourceType::TYPE_SOCKET){
 }
 
+/*!
+* \fn readPacket
+* \brief read the next packet, without copy if the source allows it, otherwise in an internal buffer.
+* The packet stays valid until the next read.
+*
+* \param packet output pointer to the packet
+* \param size size to read, for the sources that copy the packet
+* \return size of the packet, or the error of read()
+*/
+int CDMUXDataSource::readPacket(char** packet, int size)
+{
+    if ((int)_packet.size() < size)
+        _packet.resize(size);
+    *packet = _packet.data();
+    return read(_packet.data(), size);
+}
+
 CDMUXDataSource* CDMUXDataSource::create(PinConfiguration *pconfig)
 {
     CDMUXDataSource* source = NULL;
@@ -31,6 +48,9 @@ CDMUXDataSource* CDMUXDataSource::create(PinConfiguration *pconfig)
         int _port2;
         int _cached;
         int _rio;
+        int _queues;
+        const char * _mcastgroup;
+        const char * _interface;
         PinConfiguration *_pConfig;
         PinConfiguration * getConfiguration() {
             return _pConfig;
@@ -41,9 +61,23 @@ CDMUXDataSource* CDMUXDataSource::create(PinConfiguration *pconfig)
             PROPERTY_REGISTER_OPTIONAL("port2", _port2, -1);
             PROPERTY_REGISTER_OPTIONAL("cached", _cached, -1);
             PROPERTY_REGISTER_OPTIONAL("rio", _rio, -1);
+            PROPERTY_REGISTER_OPTIONAL("queues", _queues, 1);
+            PROPERTY_REGISTER_OPTIONAL("mcastgroup", _mcastgroup, "");
+            PROPERTY_REGISTER_OPTIONAL("interface", _interface, "");
         }
     } dsPin(pconfig);
 
+    // Several queues share the packets of a port between sockets (SO_REUSEPORT): only for unicast
+    // received by the network stack. Each socket would get a copy of the multicast packets, and a
+    // packet ring, XDP or netmap socket gets all the packets.
+    bool multiQueue = (dsPin._queues > 1);
+    if (multiQueue && (dsPin._mcastgroup[0] != '\0' || UDP::isBypassInterface(dsPin._interface))) {
+        LOG_ERROR("%d queues can't be used with %s '%s', receive on a single socket", dsPin._queues,
+            (dsPin._mcastgroup[0] != '\0' ? "the multicast group" : "the interface"),
+            (dsPin._mcastgroup[0] != '\0' ? dsPin._mcastgroup : dsPin._interface));
+        multiQueue = false;
+    }
+
     if (dsPin._filename != NULL && strlen(dsPin._filename) > 0 && dsPin._cached == 1)
         source = new CCachedFileDataSource();
     else if (dsPin._filename != NULL && strlen(dsPin._filename) > 0)
@@ -54,6 +88,8 @@ CDMUXDataSource* CDMUXDataSource::create(PinConfiguration *pconfig)
     else if (dsPin._port > -1 && dsPin._rio > -1)
         source = new CRIODataSource();
 #endif // _WIN32
+    else if (dsPin._port > -1 && multiQueue)
+        source = new CMQRTPDataSource();
     else if (dsPin._port > -1)
         source = new CRTPDataSource();
     else {
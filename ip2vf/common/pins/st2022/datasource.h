@@ -5,6 +5,8 @@
 #include <fstream>
 #include <mutex>
 #include <chrono>
+#include <deque>
+#include <vector>
 
 #include "queue.h"
 #include "circularbuffer.h"
@@ -32,6 +34,7 @@ protected:
     int         _samplesize;
     PinConfiguration *_pConfig;
     DataSourceType _type;
+    std::vector<char> _packet;  // for the default readPacket()
 
 public:
     CDMUXDataSource();
@@ -54,6 +57,15 @@ public:
     virtual int  read(char* buffer, int size) = 0;
     virtual void waitForNextFrame() = 0;
     virtual void close() = 0;
+
+    // Read without copy if the source allows it
+    virtual int  readPacket(char** packet, int size);
+
+    // Receive time of the last packet read, in ns, 0 if unknown
+    virtual long long getPacketTimestamp() { return 0; };
+
+    // Statistics of the merge of the two paths, false if the source doesn't merge ST 2022-7 paths
+    virtual bool get2022_7Stats(S2022_7Stats* stats) { return false; };
 };
 
 /**********************************************************************************************
@@ -134,6 +146,9 @@ protected:
     int         _port;
     const char* _zmqip;
     const char* _ip;
+    const char* _interface;     // "tpacket-<device>" to receive through a packet ring
+    int         _batchSize;     // nb of packets received per system call
+    const char* _timestamping;  // receive time of the packets: "none", "software" or "hardware"
     bool        _firstPacket;
 
 public:
@@ -143,6 +158,8 @@ public:
 public:
     void init(PinConfiguration *pconfig);
     int  read(char* buffer, int size);
+    int  readPacket(char** packet, int size);
+    long long getPacketTimestamp();
     void waitForNextFrame();
     void close();
 };
@@ -153,32 +170,53 @@ public:
 *
 ***********************************************************************************************/
 
-#define DMUX_2022_7_NB_SOURCES  2
+/* ST 2022-7 receiver classes: max differential delay between the paths, in ms */
+#define SPS_CLASS_A_WINDOW_MS   10
+#define SPS_CLASS_B_WINDOW_MS   50
+#define SPS_CLASS_C_WINDOW_MS   150
+
 struct SingleSource {
     CCircularRcvBuffer _in;
-    std::chrono::system_clock::time_point _lastRcvEvent;
     bool _isOnline;
+    long long _nRecovered;      // packets lost on the other path, taken from this one
 };
 class CSPSRTPDataSource : public CDMUXDataSource
 {
 protected:
     SingleSource   _src[DMUX_2022_7_NB_SOURCES];
-    SingleSource*  _master;
-    SingleSource*  _secondary;
     bool        _bInit;
-    CQueue<int> _q;
-    int         _nextSeq;
-    int         _lastSeq;
-    int         _nPacketsLost;
+    CRcvNotifier _notifier;
+    int         _nextSeq;       // seq number of the next packet to give, -1 if not started
+    long long   _nUnrecoverablePackets;
+    long long   _nUnrecoverableGaps;
+    bool        _inGap;
+    std::deque<std::pair<int, int>> _toCheck;  // (seq, source) given while missing on the other path
+    long long   _lastStatsTime;
+    long long   _lastSnapshotTime;
+    std::mutex  _statsLock;
+    S2022_7Stats _stats;        // copy of the statistics for the other threads, updated by read()
+    long long   _missingSince;  // time of the first packet received after _nextSeq, 0 if none
+    long long   _maxSkewUs;
+    const char *_class;         // ST 2022-7 class: a, b or c
+    int         _windowMs;      // max wait for a packet missing on a path, from the class if -1
+    int         _ringSize;      // nb of packets in the ring of each path, from the window if -1
     int         _port;
     int         _port2;
     const char *_mcastgroup;
     const char *_mcastgroup2;
     const char *_ip;
     const char *_ip2;
+    const char *_interface;     // "tpacket-<device>", "xdp-<device>"... to receive a path without the network stack
+    const char *_interface2;
+    int         _batchSize;     // nb of packets received per system call
     double      _offline_threshold_in_s;
 
-    void _switch_sources();
+    long long _getPathSkewUs();
+    void _updateStats();
+    void _updateOnlineState();
+    bool _isPast(int source, int seq);
+    void _checkRecovered();
+    void _dumpStats();
 
 public:
     CSPSRTPDataSource();
@@ -192,6 +230,63 @@ public:
     int  read(char* buffer, int size);
     void waitForNextFrame();
     void close();
+
+    bool get2022_7Stats(S2022_7Stats* stats);
+};
+
+/**********************************************************************************************
+*
+* CMQRTPDataSource: class for network RTP source received on several sockets sharing the port
+* (SO_REUSEPORT), each one with its own receive thread. The packets are merged back in seq
+* number order.
+*
+***********************************************************************************************/
+
+#define MQ_MAX_QUEUES           16
+#define MQ_REORDER_WINDOW_MS    2       /* max wait for a packet received later than the next ones */
+#define MQ_OFFLINE_THRESHOLD_MS 100     /* no packet during this time: restart on the next one */
+
+class CMQRTPDataSource : public CDMUXDataSource
+{
+protected:
+    CCircularRcvBuffer _in[MQ_MAX_QUEUES];
+    bool        _bInit;
+    CRcvNotifier _notifier;
+    int         _nextSeq;       // seq number of the next packet to give, -1 if not started
+    long long   _missingSince;  // time the next packet is known missing, 0 if not
+    long long   _restartAfter;  // last receive time before an interruption: restart on a later packet
+    long long   _nLostPackets;
+    int         _nbQueues;      // nb of sockets and receive threads
+    const char *_steering;      // how the packets are shared: "seq", "cpu" or "hash", see UDP_REUSEPORT_STEER_xxx
+    int         _steeringMode;
+    int         _firstCpu;      // if >= 0, the receive thread i is bound to the CPU firstCpu+i
+    int         _windowMs;      // max wait for a packet received later than the next ones
+    int         _ringSize;      // nb of packets in the ring of each socket
+    int         _port;
+    const char *_mcastgroup;
+    const char *_ip;
+    const char *_interface;     // device of the hardware timestamps, not a packet ring, XDP or netmap
+    const char *_timestamping;  // receive time of the packets: "none", "software" or "hardware"
+    long long   _lastTimestamp; // receive time of the last packet read, in ns
+    int         _batchSize;     // nb of packets received per system call
+
+    bool _isPast(int queue, int seq);
+    long long _getLastRecvTime();
+
+public:
+    CMQRTPDataSource();
+    virtual ~CMQRTPDataSource();
+
+public:
+    void init(PinConfiguration *pconfig);
+    int  read(char* buffer, int size);
+    void waitForNextFrame();
+    void close();
+
+    long long getPacketTimestamp();
+
+    int  getQueuesNb() { return _nbQueues; };
+    long long getLostPacketsNb() { return _nLostPackets; };
 };
 
 /**********************************************************************************************
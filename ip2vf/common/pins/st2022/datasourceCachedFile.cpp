@@ -88,11 +88,11 @@ void CCachedFileDataSource::init(PinConfiguration *pconfig) {
     f.read(rtp_packet, RTP_PACKET_SIZE);
     if (f.good()) {
         CRTPFrame frame((unsigned char*)rtp_packet, RTP_PACKET_SIZE);
-        CHBRMPFrame* hbrmp = frame.getHBRMPFrame();
-        if (hbrmp->getClockFrequency() == 0)
+        CHBRMPFrame hbrmp;
+        frame.getHBRMPFrame(hbrmp);
+        if (hbrmp.getClockFrequency() == 0)
             _samplesize -= 4;
         LOG_INFO("Sample size is %d", _samplesize);
-        delete hbrmp;
         f.clear();
     }
 
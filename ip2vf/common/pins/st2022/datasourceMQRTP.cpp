@@ -0,0 +1,255 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "common.h"
+#include "log.h"
+#include "tools.h"
+#include "datasource.h"
+#include "rtpframe.h"
+#include "moduleconfiguration.h"
+#include "configurable.h"
+
+using namespace std;
+
+#define WAIT_TIMEOUT_IN_MS      100
+#define DEFAULT_RING_SIZE       8192
+
+CMQRTPDataSource::CMQRTPDataSource()
+    : CDMUXDataSource()
+{
+    _bInit              = false;
+    _closed             = true;
+    _pConfig            = nullptr;
+    _nextSeq            = -1;
+    _missingSince       = 0;
+    _restartAfter       = 0;
+    _nLostPackets       = 0;
+    _lastTimestamp      = 0;
+    _nbQueues           = 1;
+    _steeringMode       = UDP_REUSEPORT_STEER_SEQ;
+    _type               = DataSourceType::TYPE_SOCKET;
+    _samplesize         = RTP_PACKET_SIZE;  // by default, will be refresh
+}
+
+CMQRTPDataSource::~CMQRTPDataSource() {
+    close();
+}
+
+void CMQRTPDataSource::init(PinConfiguration *pconfig) {
+
+    if (!_closed)
+        return;
+
+    LOG_INFO("--> ");
+    _pConfig = pconfig;
+    PROPERTY_REGISTER_MANDATORY("port", _port, -1);
+    PROPERTY_REGISTER_OPTIONAL("mcastgroup", _mcastgroup, "");
+    PROPERTY_REGISTER_OPTIONAL("ip", _ip, "");
+    PROPERTY_REGISTER_OPTIONAL("queues", _nbQueues, 1);
+    PROPERTY_REGISTER_OPTIONAL("steering", _steering, "seq");
+    PROPERTY_REGISTER_OPTIONAL("cpu", _firstCpu, -1);
+    PROPERTY_REGISTER_OPTIONAL("batch", _batchSize, UDP_BATCH_DEFAULT_SIZE);
+    PROPERTY_REGISTER_OPTIONAL("window", _windowMs, MQ_REORDER_WINDOW_MS);
+    PROPERTY_REGISTER_OPTIONAL("ringsize", _ringSize, DEFAULT_RING_SIZE);
+    PROPERTY_REGISTER_OPTIONAL("interface", _interface, "");
+    PROPERTY_REGISTER_OPTIONAL("timestamp", _timestamping, "none");
+    _bInit = false;
+
+    if (_nbQueues > MQ_MAX_QUEUES) {
+        LOG_ERROR("%d queues requested, use the max of %d", _nbQueues, MQ_MAX_QUEUES);
+        _nbQueues = MQ_MAX_QUEUES;
+    }
+    if (_nbQueues < 1)
+        _nbQueues = 1;
+    if (_windowMs < 0)
+        _windowMs = MQ_REORDER_WINDOW_MS;
+    if (_ringSize <= 0)
+        _ringSize = DEFAULT_RING_SIZE;
+    _steeringMode = UDP::getReusePortSteeringFromName(_steering);
+    int timestampMode = UDP::getTimestampModeFromName(_timestamping);
+
+    LOG_INFO("Data stream from port '%d' on %d sockets, steering=%s, first cpu=%d, ring of %d packets",
+        _port, _nbQueues, _steering, _firstCpu, _ringSize);
+
+    // The sockets join the SO_REUSEPORT group in the order of their index
+    int nbCpu = (int)std::thread::hardware_concurrency();
+    for (int i = 0; i < _nbQueues; i++) {
+        int cpu = (_firstCpu >= 0 ? (_firstCpu + i) % (nbCpu > 0 ? nbCpu : 1) : -1);
+        _in[i].setReusePort(_nbQueues, _steeringMode, cpu);
+        _in[i].setOfflineThreshold(MQ_OFFLINE_THRESHOLD_MS * 1000LL);
+        _in[i].setTimestampMode(timestampMode);
+        _in[i].init(&_notifier, _mcastgroup, _ip, _port, _ringSize, i, _batchSize, _interface);
+    }
+    _nextSeq = -1;
+    _missingSince = 0;
+    _restartAfter = 0;
+    _nLostPackets = 0;
+    _lastTimestamp = 0;
+
+    _closed = false;
+    _bInit = true;
+    LOG_INFO("<--");
+}
+
+void CMQRTPDataSource::waitForNextFrame() {
+
+    // Do nothing for this source
+}
+
+/*!
+* \fn _isPast
+* \brief tell if a socket received a later packet than a seq number
+*
+* \param queue socket index
+* \param seq seq number of the packet
+*/
+bool CMQRTPDataSource::_isPast(int queue, int seq) {
+
+    int last = _in[queue].getLastRecvSeq();
+    int diff = (last - seq) & 0xFFFF;
+    return (last >= 0 && diff != 0 && diff < 32768);
+}
+
+/*!
+* \fn _getLastRecvTime
+* \brief time of the last packet received on any socket, see CCircularRcvBuffer::getTimeInUs()
+*/
+long long CMQRTPDataSource::_getLastRecvTime() {
+
+    long long last = 0;
+    for (int i = 0; i < _nbQueues; i++)
+        last = MAX(last, _in[i].getLastRecvTime());
+    return last;
+}
+
+/*!
+* \fn read
+* \brief give the next packet in seq number order. With the seq steering, only the socket given by
+* the seq number can have it: it's lost once this socket received a later packet. Otherwise it's
+* lost when a later packet has been received for more than the window.
+*
+* \param buffer output buffer
+* \param size size of buffer
+* \return size of the packet, VMI_E_PACKET_LOST if the packet is lost, VMI_E_ERROR if closed
+*/
+int CMQRTPDataSource::read(char* buffer, int size) {
+
+    if (!_bInit)
+        return VMI_E_ERROR;
+
+    while (!_closed) {
+
+        unsigned int events = _notifier.getEvents();
+        long long now = CCircularRcvBuffer::getTimeInUs();
+
+        if (_nextSeq == -1) {
+            // Start on the last packet received on any socket, after the interruption if any
+            for (int i = 0; i < _nbQueues && _nextSeq == -1; i++) {
+                if (_in[i].getLastRecvTime() > _restartAfter)
+                    _nextSeq = _in[i].getLastRecvSeq();
+            }
+            if (_nextSeq == -1) {
+                _notifier.wait(events, WAIT_TIMEOUT_IN_MS);
+                continue;
+            }
+        }
+
+        int owner = (_steeringMode == UDP_REUSEPORT_STEER_SEQ ? _nextSeq % _nbQueues : -1);
+        for (int i = 0; i < _nbQueues; i++) {
+            if (owner >= 0 && i != owner)
+                continue;
+            int result = _in[i].read(_nextSeq, buffer, size, &_lastTimestamp);
+            if (result > 0) {
+                _nextSeq = (_nextSeq + 1) % 65536;
+                _samplesize = _in[i].getSampleSize();
+                _missingSince = 0;
+                return result;
+            }
+        }
+
+        // Too late: the packets have been overwritten in the rings
+        int ahead = 0;
+        bool later = false;
+        bool allPast = true;    // all the sockets receiving the stream got a later packet
+        for (int i = 0; i < _nbQueues; i++) {
+            if (_isPast(i, _nextSeq)) {
+                ahead = MAX(ahead, (_in[i].getLastRecvSeq() - _nextSeq) & 0xFFFF);
+                later = true;
+            }
+            else if (now - _in[i].getLastRecvTime() <= _windowMs * 1000LL)
+                allPast = false;
+        }
+        if (ahead >= _in[0].getSize() / 2) {
+            LOG_ERROR("read %d packets late, skip them", ahead);
+            _nLostPackets += ahead;
+            _nextSeq = (_nextSeq + ahead) % 65536;
+            _missingSince = 0;
+            return VMI_E_PACKET_LOST;
+        }
+
+        // A later packet is received: the missing one is lost if the socket that can receive it is
+        // past it, else it may be received later during the window. The window starts at the first
+        // missing packet and is not restarted for the next ones.
+        long long waitUs = WAIT_TIMEOUT_IN_MS * 1000LL;
+        if (later) {
+            if (_missingSince == 0)
+                _missingSince = now;
+            waitUs = _missingSince + _windowMs * 1000LL - now;
+            bool past = (owner >= 0 ? _isPast(owner, _nextSeq) : allPast);
+            if (waitUs <= 0 || past) {
+                LOG("packet #%d lost", _nextSeq);
+                _nLostPackets++;
+                _nextSeq = (_nextSeq + 1) % 65536;
+                return VMI_E_PACKET_LOST;
+            }
+            waitUs = MIN(waitUs, WAIT_TIMEOUT_IN_MS * 1000LL);
+        }
+        else {
+            // No packet for a while: restart on the first packet received
+            long long last = _getLastRecvTime();
+            if (last != 0 && now - last > MQ_OFFLINE_THRESHOLD_MS * 1000LL) {
+                _nextSeq = -1;
+                _restartAfter = last;
+                _missingSince = 0;
+            }
+        }
+
+        _notifier.wait(events, (int)MAX(1LL, (waitUs + 999) / 1000));
+    }
+
+    return VMI_E_ERROR;
+}
+
+/*!
+* \fn getPacketTimestamp
+* \brief receive time of the last packet read, taken by its socket if the "timestamp" property is set
+*
+* \return time in ns (kernel or NIC clock), 0 if unknown
+*/
+long long CMQRTPDataSource::getPacketTimestamp() {
+
+    return _lastTimestamp;
+}
+
+void CMQRTPDataSource::close() {
+
+    if (!_bInit)
+        return;
+
+    LOG_INFO("-->");
+
+    _closed = true;
+
+    for (int i = 0; i < _nbQueues; i++)
+        _in[i].close();
+
+    // unblock the reader
+    _notifier.onPacket();
+    _notifier.notify();
+
+    LOG_INFO("lost packets: %lld", _nLostPackets);
+    _bInit = false;
+    LOG_INFO("<--");
+}
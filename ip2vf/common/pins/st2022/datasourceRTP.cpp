@@ -32,18 +32,27 @@ void CRTPDataSource::init(PinConfiguration *pconfig)
     PROPERTY_REGISTER_MANDATORY("port", _port, -1);
     PROPERTY_REGISTER_OPTIONAL("mcastgroup", _zmqip, "");
     PROPERTY_REGISTER_OPTIONAL("ip", _ip, "");
+    PROPERTY_REGISTER_OPTIONAL("interface", _interface, "");
+    PROPERTY_REGISTER_OPTIONAL("batch", _batchSize, UDP_BATCH_DEFAULT_SIZE);
+    PROPERTY_REGISTER_OPTIONAL("timestamp", _timestamping, "none");
     if (_port == -1) {
         LOG_ERROR("Invalid configuration. Exit. (port=%d)", _port);
     }
 
     // This allow to setup a network RTP stream 
     LOG_INFO("data stream from port '%d'",_port);
-    if (!_udpSock)
-        _udpSock = new UDP();
+    if (!_udpSock) {
+        _udpSock = UDP::createReceiver(_interface);
+        _udpSock->setBatchSize(_batchSize);
+    }
 
     if (_udpSock && !_udpSock->isValid())
         result = _udpSock->openSocket(_zmqip, _ip, _port, true);
 
+    int timestampMode = UDP::getTimestampModeFromName(_timestamping);
+    if (_udpSock && _udpSock->isValid() && timestampMode != UDP_TIMESTAMP_NONE)
+        _udpSock->setTimestampMode(timestampMode, _interface);
+
     _firstPacket = true;
 }
 
@@ -69,6 +78,40 @@ int CRTPDataSource::read(char* buffer, int size)
     return result;
 }
 
+/*!
+* \fn readPacket
+* \brief give the next packet in place in the socket buffers (batch or packet ring)
+*/
+int CRTPDataSource::readPacket(char** packet, int size)
+{
+    int result = -1;
+
+    if (_udpSock && _udpSock->isValid()) {
+        int len = 0;
+        result = _udpSock->readPacket(packet, &len);
+        if (result>0 && _firstPacket) {
+            _samplesize = result;
+            LOG_INFO("Detect sample size=%d", _samplesize);
+            _firstPacket = false;
+        }
+    }
+
+    return result;
+}
+
+/*!
+* \fn getPacketTimestamp
+* \brief receive time of the last packet read, if the "timestamp" property is set
+*
+* \return time in ns (kernel or NIC clock), 0 if unknown
+*/
+long long CRTPDataSource::getPacketTimestamp()
+{
+    if (_udpSock == NULL)
+        return 0;
+    return _udpSock->getLastTimestamp();
+}
+
 void CRTPDataSource::close()
 {
     LOG_INFO("-->");
@@ -15,8 +15,10 @@
 
 using namespace std;
 
-#define DEFAULT_PACKET_NB       30000
-#define DEFAULT_THRESHOLD_IN_S  0.02
+#define DEFAULT_CLASS           "b"
+#define WAIT_TIMEOUT_IN_MS      100
+#define STATS_PERIOD_IN_US      10000000LL
+#define SNAPSHOT_PERIOD_IN_US   1000000LL   /* copy of the statistics given to get2022_7Stats() */
 
 CSPSRTPDataSource::CSPSRTPDataSource()
     : CDMUXDataSource() 
@@ -26,9 +28,18 @@ CSPSRTPDataSource::CSPSRTPDataSource()
     _pConfig            = nullptr;
     _nextSeq            = -1;
     _type               = DataSourceType::TYPE_SMPTE_2022_7;
-    _nPacketsLost       = 0;
+    _nUnrecoverablePackets = 0;
+    _nUnrecoverableGaps = 0;
+    _inGap              = false;
+    _lastStatsTime      = 0;
+    _lastSnapshotTime   = 0;
+    _stats              = S2022_7Stats();
+    _missingSince       = 0;
+    _maxSkewUs          = 0;
+    _windowMs           = SPS_CLASS_B_WINDOW_MS;
+    _ringSize           = -1;
     _samplesize         = RTP_PACKET_SIZE;  // by default, will be refresh 
-    _offline_threshold_in_s = DEFAULT_THRESHOLD_IN_S;
+    _offline_threshold_in_s = SPS_CLASS_B_WINDOW_MS / 1000.0;
 }
 
 CSPSRTPDataSource::~CSPSRTPDataSource() {
@@ -47,26 +58,48 @@ void CSPSRTPDataSource::init(PinConfiguration *pconfig) {
     PROPERTY_REGISTER_OPTIONAL("ip", _ip, "");
     PROPERTY_REGISTER_OPTIONAL("mcastgroup2", _mcastgroup2, _mcastgroup);
     PROPERTY_REGISTER_OPTIONAL("ip2", _ip2, _ip);
+    PROPERTY_REGISTER_OPTIONAL("interface", _interface, "");
+    PROPERTY_REGISTER_OPTIONAL("interface2", _interface2, _interface);
+    PROPERTY_REGISTER_OPTIONAL("batch", _batchSize, UDP_BATCH_DEFAULT_SIZE);
+    PROPERTY_REGISTER_OPTIONAL("class", _class, DEFAULT_CLASS);
+    PROPERTY_REGISTER_OPTIONAL("window", _windowMs, -1);
+    PROPERTY_REGISTER_OPTIONAL("ringsize", _ringSize, -1);
     _bInit = false;
 
-    // This allow to setup a network RTP stream 
-    LOG_INFO("Data stream from port '%d' and '%d' ", _port, _port2);
-
-
-    // Determine main and secundary streams. Main stream is the one with the latest packets. It will assure
-    // that when a packet missed on the main stream, the corresponding packet has been already received on
-    // the secundary stream
-    _src[0]._in.init(&_q, _mcastgroup, _ip, _port, DEFAULT_PACKET_NB, 0);
-    _src[0]._isOnline = true;
-    _src[0]._lastRcvEvent = std::chrono::system_clock::now();
-    _master = &_src[0];
-    _master->_in.setMaster(true);
+    // The class gives the max differential delay between the paths, the window can override it.
+    // The ring of each path must hold the packets received during the window: about 1350 packets
+    // per 10 ms for a 1.5G 2022-6 stream.
+    int classWindowMs = SPS_CLASS_B_WINDOW_MS;
+    if (strcmp(_class, "a") == 0 || strcmp(_class, "A") == 0)
+        classWindowMs = SPS_CLASS_A_WINDOW_MS;
+    else if (strcmp(_class, "c") == 0 || strcmp(_class, "C") == 0)
+        classWindowMs = SPS_CLASS_C_WINDOW_MS;
+    else if (strcmp(_class, "b") != 0 && strcmp(_class, "B") != 0)
+        LOG_ERROR("unknown class '%s', available classes are a, b and c. Use b", _class);
+    if (_windowMs <= 0)
+        _windowMs = classWindowMs;
+    if (_ringSize <= 0)
+        _ringSize = (_windowMs <= SPS_CLASS_A_WINDOW_MS ? 8192 : (_windowMs <= SPS_CLASS_B_WINDOW_MS ? 32768 : RCV_RING_MAX_SIZE));
+    _offline_threshold_in_s = _windowMs / 1000.0;
 
-    _src[1]._in.init(&_q, _mcastgroup2, _ip2, _port2, DEFAULT_PACKET_NB, 1);
-    _src[1]._isOnline = true;
-    _src[1]._lastRcvEvent = std::chrono::system_clock::now();
-    _secondary = &_src[1];
-    _secondary->_in.setMaster(false);
+    // This allow to setup a network RTP stream 
+    LOG_INFO("Data stream from port '%d' and '%d', window=%d ms, ring of %d packets", _port, _port2, _windowMs, _ringSize);
+
+    // Each path is received in its own ring. The packets are merged one by one: each packet is
+    // taken from the first path that has it, so no path is "main" or "secondary".
+    _src[0]._in.init(&_notifier, _mcastgroup, _ip, _port, _ringSize, 0, _batchSize, _interface);
+    _src[1]._in.init(&_notifier, _mcastgroup2, _ip2, _port2, _ringSize, 1, _batchSize, _interface2);
+    for (int i = 0; i < DMUX_2022_7_NB_SOURCES; i++) {
+        _src[i]._in.setPeer(&_src[1 - i]._in);
+        _src[i]._in.setOfflineThreshold((long long)(_offline_threshold_in_s * 1000000.0));
+        _src[i]._isOnline = false;
+        _src[i]._nRecovered = 0;
+    }
+    _nextSeq = -1;
+    _missingSince = 0;
+    _maxSkewUs = 0;
+    _toCheck.clear();
+    _updateStats();
 
     _closed = false;
     _bInit = true;
@@ -78,134 +111,229 @@ void CSPSRTPDataSource::waitForNextFrame() {
     // Do nothing for this source
 }
 
-void CSPSRTPDataSource::_switch_sources() {
+/*!
+* \fn _updateOnlineState
+* \brief a path is online if it received a packet for less than the offline threshold
+*/
+void CSPSRTPDataSource::_updateOnlineState() {
+
+    long long now = CCircularRcvBuffer::getTimeInUs();
+    long long threshold = (long long)(_offline_threshold_in_s * 1000000.0);
+    for (int i = 0; i < DMUX_2022_7_NB_SOURCES; i++) {
+        long long last = _src[i]._in.getLastRecvTime();
+        bool online = (last != 0 && now - last <= threshold);
+        if (online != _src[i]._isOnline)
+            LOG_INFO("Source [%d] is now %s", i, (online ? "online" : "offline"));
+        _src[i]._isOnline = online;
+    }
+}
+
+/*!
+* \fn _isPast
+* \brief tell if a path will not give a packet anymore: it's offline, or it received a later packet
+*
+* \param source path index
+* \param seq seq number of the packet
+*/
+bool CSPSRTPDataSource::_isPast(int source, int seq) {
+
+    if (!_src[source]._isOnline)
+        return true;
+    int last = _src[source]._in.getLastRecvSeq();
+    int diff = (last - seq) & 0xFFFF;
+    return (last >= 0 && diff != 0 && diff < 32768);
+}
 
-    LOG_INFO("Switch source [%d] <--> [%d]", _master->_in.getIndex(), _secondary->_in.getIndex());
-    SingleSource* temp = _master;
-    _master = _secondary;
-    _secondary = temp;
-    _master->_in.setMaster(true);
-    _secondary->_in.setMaster(false);
+/*!
+* \fn _checkRecovered
+* \brief count the packets given from one path and finally lost on the other one. A packet
+* missing on the other path when given may still arrive there, so the check is deferred.
+*/
+void CSPSRTPDataSource::_checkRecovered() {
+
+    while (!_toCheck.empty()) {
+        int seq = _toCheck.front().first;
+        int source = _toCheck.front().second;
+        int other = 1 - source;
+        if (_src[other]._in.contains(seq) || _src[other]._in.getLastRecvSeq() < 0)
+            _toCheck.pop_front();   // not lost, or the other path is not started
+        else if (_isPast(other, seq)) {
+            _src[source]._nRecovered++;
+            _toCheck.pop_front();
+        }
+        else
+            break;
+    }
 }
 
-int CSPSRTPDataSource::read(char* buffer, int size) {
+/*!
+* \fn _getPathSkewUs
+* \brief differential delay between the paths, measured on the packets received on both
+*
+* \return delay of the path 1 on the path 0 in us, negative if the path 0 is late
+*/
+long long CSPSRTPDataSource::_getPathSkewUs() {
 
-    int result = VMI_E_OK;
-    int len = size;
+    return _src[1]._in.getLateness() - _src[0]._in.getLateness();
+}
+
+/*!
+* \fn _updateStats
+* \brief copy the merge statistics for get2022_7Stats(), from the thread of read()
+*/
+void CSPSRTPDataSource::_updateStats() {
+
+    std::lock_guard<std::mutex> lock(_statsLock);
+    for (int i = 0; i < DMUX_2022_7_NB_SOURCES; i++) {
+        _stats.recovered[i] = _src[i]._nRecovered;
+        _stats.online[i] = _src[i]._isOnline;
+    }
+    _stats.unrecoverablePackets = _nUnrecoverablePackets;
+    _stats.unrecoverableGaps = _nUnrecoverableGaps;
+    _stats.pathSkewUs = _getPathSkewUs();
+    _stats.maxPathSkewUs = _maxSkewUs;
+    _stats.windowMs = _windowMs;
+}
+
+/*!
+* \fn get2022_7Stats
+* \brief merge statistics, updated every second by read(). Can be called from any thread.
+*
+* \param stats output statistics
+* \return true
+*/
+bool CSPSRTPDataSource::get2022_7Stats(S2022_7Stats* stats) {
+
+    std::lock_guard<std::mutex> lock(_statsLock);
+    *stats = _stats;
+    return true;
+}
+
+void CSPSRTPDataSource::_dumpStats() {
+
+    long long skew = _getPathSkewUs();
+    LOG_INFO("2022-7: recovered packets [0]=%lld [1]=%lld, unrecoverable packets=%lld in %lld gaps, path skew=%lld us (max %lld us)",
+        _src[0]._nRecovered, _src[1]._nRecovered, _nUnrecoverablePackets, _nUnrecoverableGaps, skew, _maxSkewUs);
+    if (_maxSkewUs > _windowMs * 1000LL)
+        LOG_ERROR("2022-7: path skew up to %lld us is over the window of %d ms, the late path can't recover losses. Use a larger class or window", _maxSkewUs, _windowMs);
+}
+
+/*!
+* \fn read
+* \brief give the next packet in seq number order, from the first path that has it. Wait for it while
+* a path can still give it, at most the window after the reception of a later packet; skip it if both
+* paths are past it or if the window is over.
+*
+* \param buffer output buffer
+* \param size size of buffer
+* \return size of the packet, VMI_E_PACKET_LOST if the packet is lost on both paths, VMI_E_ERROR if closed
+*/
+int CSPSRTPDataSource::read(char* buffer, int size) {
 
     //LOG_INFO("-->, _closed=%d, _bInit=%d", _closed, _bInit);
 
     if (!_bInit)
         return VMI_E_ERROR;
 
-    if (!_closed) {
-
-        //static int count = 0;
-        //if ((++count) % 10000 == 0) LOG_INFO("%d events, queue size=%d", count, _q.size());
-
-        // If we lost packets on main, try to find it on secundary 
-        if (_nPacketsLost>0) {
-            //LOG_INFO("--> _nPacketsLost=%d", _nPacketsLost);
-            if (_secondary->_isOnline) {
-                //LOG_INFO("sec is online, try to read #%d", _nextSeq);
-                result = _secondary->_in.searchFor(_nextSeq, buffer, size);
-                if (result == -1) {
-                    LOG_ERROR("can't find missing packet #%d on secondary (nbPacketLost=%d, queue size=%d)", _nextSeq, _nPacketsLost, _q.size());
-                    _nPacketsLost = 0;
-                    _nextSeq = -1;
-                    return VMI_E_ERROR;
-                }
-                else {
-                    LOG("Ok to keep packet%d (nbPacketLost=%d, queue size=%d)", _nextSeq, _nPacketsLost, _q.size());
-                    _nPacketsLost--;
-                    if (_nextSeq == _lastSeq) {
-                        LOG_INFO("_nextSeq == _lastSeq");
-                        _nPacketsLost = 0;
-                    }
-                    _nextSeq = (_nextSeq + 1) % 65536;
-                    result = size;
-                }
-                return result;
+    while (!_closed) {
+
+        unsigned int events = _notifier.getEvents();
+        _updateOnlineState();
+        _checkRecovered();
+
+        long long now = CCircularRcvBuffer::getTimeInUs();
+        long long skew = _getPathSkewUs();
+        _maxSkewUs = MAX(_maxSkewUs, (skew < 0 ? -skew : skew));
+        if (_lastStatsTime == 0)
+            _lastStatsTime = now;
+        else if (now - _lastStatsTime > STATS_PERIOD_IN_US) {
+            _dumpStats();
+            _lastStatsTime = now;
+        }
+        if (now - _lastSnapshotTime > SNAPSHOT_PERIOD_IN_US) {
+            _updateStats();
+            _lastSnapshotTime = now;
+        }
+
+        if (_nextSeq == -1) {
+            // Start on the last packet received on any path
+            for (int i = 0; i < DMUX_2022_7_NB_SOURCES && _nextSeq == -1; i++)
+                _nextSeq = _src[i]._in.getLastRecvSeq();
+            if (_nextSeq == -1) {
+                _notifier.wait(events, WAIT_TIMEOUT_IN_MS);
+                continue;
             }
-            return VMI_E_ERROR;
         }
 
-        // Wait for any rcv events from sources
-        int event = _q.pop();
-
-        // detect exit condition
-        if (event == -1 || _closed)
-            return VMI_E_ERROR;
-
-        // Keep the source index and the rtp seq number
-        int seq = event & 0xFFFF;
-        int source = event >> 16;
-        //LOG_INFO("[%d]--> receive packet=%d, size of queue=%d", source, seq, _q.size());
-
-        // If errors...
-        if (seq == -1)
-            return VMI_E_ERROR;
-        if( source <0 || source >1 )
-            return VMI_E_ERROR;
-
-        // Manage online state of "current" source (the one that produce the event)
-        _src[source]._lastRcvEvent = std::chrono::system_clock::now();
-        if( !_src[source]._isOnline )
-            LOG_INFO("Source [%d] is now online", source);
-        _src[source]._isOnline = true;
-
-        // Offline sources detection
-        auto now = std::chrono::system_clock::now();
-        bool bSwitchOccured = false;
         for (int i = 0; i < DMUX_2022_7_NB_SOURCES; i++) {
-            std::chrono::duration<double> diff = now - _src[i]._lastRcvEvent;
-            if (_src[i]._isOnline && diff.count() > _offline_threshold_in_s) {
-                LOG_INFO("Source [%d] is offline", i);
-                _src[i]._isOnline = false;
-                if (i == _master->_in.getIndex()) {
-                    // The offline source is the master source... switch between main and secundary
-                    LOG_INFO("Switch source [%d] <--> [%d]", _master->_in.getIndex(), _secondary->_in.getIndex());
-                    _switch_sources();
-                    bSwitchOccured = true;
-                }
+            int result = _src[i]._in.read(_nextSeq, buffer, size);
+            if (result > 0) {
+                // Lost on the other path? checked later, it may be late
+                if (!_src[1 - i]._in.contains(_nextSeq) && _toCheck.size() < (size_t)_src[i]._in.getSize())
+                    _toCheck.push_back(std::make_pair(_nextSeq, i));
+                _nextSeq = (_nextSeq + 1) % 65536;
+                _samplesize = _src[i]._in.getSampleSize();
+                _inGap = false;
+                _missingSince = 0;
+                return result;
             }
         }
-        if (bSwitchOccured) {
-            _nextSeq = -1;
-            return VMI_E_ERROR;
-        }
-
-        // At this state, if the source is the secundary, nothing to do
-        if (source != _master->_in.getIndex())
-            return VMI_E_NOT_PRIMARY_SRC;
 
-        if (_nextSeq == -1) {
-            _nextSeq = seq;
-            _nPacketsLost = 0;
+        // Too late: the packets have been overwritten in the rings
+        int ahead = 0;
+        for (int i = 0; i < DMUX_2022_7_NB_SOURCES; i++) {
+            int last = _src[i]._in.getLastRecvSeq();
+            if (last >= 0 && _isPast(i, _nextSeq))
+                ahead = MAX(ahead, (last - _nextSeq) & 0xFFFF);
         }
-        _lastSeq = seq;
-        if (_nextSeq != _lastSeq) {
-            _nPacketsLost = (_lastSeq - _nextSeq) > 0 ? (_lastSeq - _nextSeq) : (65536 - _nextSeq + _lastSeq);
-            _nPacketsLost++; 
-            LOG_ERROR("recv packet#%d, expected #%d, diff=%d (queue size=%d)", _lastSeq, _nextSeq, _nPacketsLost, _q.size());
+        if (ahead >= _src[0]._in.getSize() / 2) {
+            LOG_ERROR("read %d packets late, skip them", ahead);
+            _nUnrecoverablePackets += ahead;
+            _nUnrecoverableGaps++;
+            _nextSeq = (_nextSeq + ahead) % 65536;
+            _missingSince = 0;
             return VMI_E_PACKET_LOST;
         }
-        int len = size;
-        result = _master->_in.read(_nextSeq, buffer, size);
-        if (result == -1) {
-            LOG_ERROR("result=%d, len=%d, size=%d (queue size=%d)", result, len, size, _q.size());
-            return VMI_E_ERROR;
+
+        // Missing on a path that is past it: the other path may still give it, during the window
+        long long waitUs = WAIT_TIMEOUT_IN_MS * 1000LL;
+        bool windowOver = false;
+        if (_isPast(0, _nextSeq) || _isPast(1, _nextSeq)) {
+            if (_missingSince == 0) {
+                _missingSince = now;
+                for (int i = 0; i < DMUX_2022_7_NB_SOURCES; i++) {
+                    long long t = _src[i]._in.getArrivalTime((_nextSeq + 1) % 65536);
+                    if (t > 0 && t < _missingSince)
+                        _missingSince = t;
+                }
+            }
+            waitUs = _missingSince + _windowMs * 1000LL - now;
+            windowOver = (waitUs <= 0);
+            waitUs = MIN(waitUs, WAIT_TIMEOUT_IN_MS * 1000LL);
         }
-        else {
-            //LOG_INFO("--> receive packet=%d, read=%d, size of queue=%d", seq, _nextSeq, _q.size());
-            _nextSeq = (_nextSeq + 1) % 65536;
-            result = size;
-            _samplesize = _master->_in.getSampleSize();
+
+        // Lost on both paths
+        if ((_isPast(0, _nextSeq) && _isPast(1, _nextSeq)) || windowOver) {
+            if (_src[0]._isOnline || _src[1]._isOnline) {
+                LOG("packet #%d lost on both paths", _nextSeq);
+                _nUnrecoverablePackets++;
+                if (!_inGap)
+                    _nUnrecoverableGaps++;
+                _inGap = true;
+                _nextSeq = (_nextSeq + 1) % 65536;
+                _missingSince = 0;
+                return VMI_E_PACKET_LOST;
+            }
+            // Both paths offline: restart on the first packet received
+            _nextSeq = -1;
+            _missingSince = 0;
         }
+
+        _notifier.wait(events, (int)MAX(1LL, (waitUs + 999) / 1000));
     }
 
     //LOG_INFO("<--");
-    return result;
+    return VMI_E_ERROR;
 }
 
 void CSPSRTPDataSource::close() {
@@ -217,9 +345,9 @@ void CSPSRTPDataSource::close() {
     for (int i = 0; i < DMUX_2022_7_NB_SOURCES; i++)
         _src[i]._in.close();
 
-    // unblock the queue
-    _q.push(-1);
+    // unblock the reader
+    _notifier.onPacket();
+    _notifier.notify();
 
     LOG_INFO("<--");
 }
-
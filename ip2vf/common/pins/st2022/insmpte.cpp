@@ -18,6 +18,7 @@
 using namespace std;
 
 #define MAX_NB_SMPTE_FRAME  2
+#define WAIT_TIMEOUT_IN_MS  100
 
 
 /**********************************************************************************************
@@ -37,9 +38,21 @@ CInSMPTE::CInSMPTE(CModuleConfiguration* pMainCfg, int nIndex) : CIn(pMainCfg, n
     _currentFrame = NULL;
     _nbSMPTEFrameToQueue = MAX_NB_SMPTE_FRAME;
     _streamType = SMPTE_STANDARD_SUITE_NOT_DEFINED;
+    _nbCRCErrors = 0;
+    _nbEarly = 0;
 
     PROPERTY_REGISTER_OPTIONAL("fmt", _fmt, 10);
     PROPERTY_REGISTER_OPTIONAL("queuesize", _nbSMPTEFrameToQueue, MAX_NB_SMPTE_FRAME);
+    PROPERTY_REGISTER_OPTIONAL("demuxthreads", _nbDemuxThreads, 4);
+    PROPERTY_REGISTER_OPTIONAL("demuxcpu", _demuxCpu, -1);
+    PROPERTY_REGISTER_OPTIONAL("reassembly", _reassembly, "sequential");
+    PROPERTY_REGISTER_OPTIONAL("maxlost", _maxLostPackets, 0);
+    PROPERTY_REGISTER_OPTIONAL("checkcrc", _checkCRC, false);
+    _crcChecked = _checkCRC;
+    if (_fmt != 8 && _fmt != 10 && _fmt != 16) {
+        LOG_ERROR("%s: unsupported fmt %d, available depths are 8, 10 and 16. Use 10", _name.c_str(), _fmt);
+        _fmt = 10;
+    }
     
     LOG_INFO("Nb SMPTE Frame to queue=%d", _nbSMPTEFrameToQueue);
 
@@ -47,9 +60,19 @@ CInSMPTE::CInSMPTE(CModuleConfiguration* pMainCfg, int nIndex) : CIn(pMainCfg, n
     _source = CDMUXDataSource::create(_pConfig);
 
     // Create a fix number of SMPTE frame
+    int reassemblyMode = SMPTE_REASSEMBLY_SEQUENTIAL;
+    if (strcmp(_reassembly, "direct") == 0)
+        reassemblyMode = SMPTE_REASSEMBLY_DIRECT;
+    else if (strcmp(_reassembly, "sequential") != 0)
+        LOG_ERROR("%s: unknown reassembly '%s', available modes are sequential and direct. Use sequential", _name.c_str(), _reassembly);
+    _demuxPool.init(_nbDemuxThreads, _demuxCpu);
     for (int i = 0; i < _nbSMPTEFrameToQueue; i++) {
         _smpteFrameArray.push_back(new SmpteFrameBuffer());
+        _smpteFrameArray.back()->_frame.setDemuxPool(&_demuxPool);
+        _smpteFrameArray.back()->_frame.setReassemblyMode(reassemblyMode);
     }
+    _q.init(_nbSMPTEFrameToQueue);
+    _early.resize(SMPTE_REORDER_WINDOW);
 }
 
 CInSMPTE::~CInSMPTE()
@@ -68,9 +91,12 @@ CInSMPTE::~CInSMPTE()
 
 int CInSMPTE::_rcv_process() {
 
-    unsigned char   rtp_packet[RTP_PACKET_SIZE];
+    char*           rtp_packet = NULL;      // in place in the source buffers, valid until the next read
     int             lastSeq = -1, result;
     int             frameCounter = 0;
+    int             nextFirstSeq = -1;      // with direct placement, first packet of the next frame
+    bool            bPending = false;       // rtp_packet belongs to the next frame, not read yet
+    long long       rcvTime = 0;            // receive time of rtp_packet, in ns, 0 if unknown
     int             sampleSize = RTP_PACKET_SIZE;
 
     //Blocking all other signals
@@ -90,12 +116,12 @@ int CInSMPTE::_rcv_process() {
 
     // Get First packet to identify kind of stream
     sampleSize = _source->getSampleSize();
-    result = _source->read((char*)rtp_packet, sampleSize);
+    result = _source->readPacket(&rtp_packet, sampleSize);
     if (result <= 0) {
         LOG_ERROR("%s: Can't read from source, result=%d", _name.c_str(), result);
         return 0;
     }
-    CRTPFrame rtp(rtp_packet, result);
+    CRTPFrame rtp((unsigned char*)rtp_packet, result);
     if (rtp._pt == 98) {
         _streamType = SMPTE_2022_6;
         LOG_INFO("%s: RECEIVE SMPTE_2022_6 standard suite", _name.c_str());
@@ -119,13 +145,27 @@ int CInSMPTE::_rcv_process() {
         SmpteFrameBuffer* pFrame = _smpteFrameArray[framePointer];
         std::lock_guard<std::mutex> lock(pFrame->_lock);
         //LOG_INFO("%s: start to receive a SMPTE frame on buffer %d", pin->_name.c_str(), framePointer);
-        pFrame->_frame.initNewFrame();
+        pFrame->_frame.initNewFrame(nextFirstSeq);
         pFrame->_frame.setFrameNumber(frameCounter++);
 
+        // Packets of this frame received before the end of the previous one
+        for (int i = 0; i < _nbEarly; i++) {
+            CRTPFrame early((unsigned char*)_early[i]._data.data(), (int)_early[i]._data.size());
+            pFrame->_frame.addRTPPacket(&early, _early[i]._rcvTime);
+        }
+        _nbEarly = 0;
+
         while (!pFrame->_frame.isComplete()) {
 
-            // First, keep the full RTP frame from the current UDP packet
-            result = _source->read((char*)rtp_packet, sampleSize);
+            // First, keep the full RTP frame from the current UDP packet, unless the last packet
+            // received by the previous frame belongs to this one
+            bool bReplay = bPending;
+            if (bPending)
+                bPending = false;
+            else {
+                result = _source->readPacket(&rtp_packet, sampleSize);
+                rcvTime = _source->getPacketTimestamp();
+            }
 
             // Detect stop
             if (!_bStarted)
@@ -141,16 +181,20 @@ int CInSMPTE::_rcv_process() {
             else if (result != sampleSize)
                 LOG_ERROR("%s: incorrect packet size, size=%d, wanted=%d", _name.c_str(), result, sampleSize);
 
-            CRTPFrame frame(rtp_packet, result);
+            CRTPFrame frame((unsigned char*)rtp_packet, result);
 
             //LOG_INFO("read=%d, frame._seq=%d", result, frame._seq);
 
             // As soon as possible, prevent duplicated packet
-            if (lastSeq == frame._seq)
+            if (!bReplay && lastSeq == frame._seq)
                 continue;
             lastSeq = frame._seq;
 
-            pFrame->_frame.addRTPPacket(&frame);
+            int added = pFrame->_frame.addRTPPacket(&frame, rcvTime);
+            if (added == SMPTE_PACKET_NEXT_FRAME)
+                bPending = true;
+            else if (added == SMPTE_PACKET_EARLY)
+                _keepEarlyPacket(rtp_packet, result, frame._seq, rcvTime);
         }
 
         // Detect stop
@@ -160,11 +204,43 @@ int CInSMPTE::_rcv_process() {
         if (result <= 0) {
             // An error occured. This frame is lost. Retry to get a valid frame
             pFrame->_frame.abortCurrentFrame();
+            nextFirstSeq = -1;
+            bPending = false;
+            _nbEarly = 0;
             continue;
         }
 
+        // With direct placement, the frame can miss some packets: their content is the one of
+        // the last frame received in this buffer. Drop it if too many packets are missing.
+        nextFirstSeq = pFrame->_frame.getNextFirstSeq();
+        int nbMissing = pFrame->_frame.getMissingPacketsNb();
+        if (nbMissing > 0) {
+            std::vector<std::pair<int, int>> ranges = pFrame->_frame.getMissingRanges();
+            LOG_ERROR("%s: frame #%d: %d/%d packets missing in %d ranges, first at packet %d%s", _name.c_str(),
+                pFrame->_frame.getFrameNumber(), nbMissing, pFrame->_frame.getPacketsNb(), (int)ranges.size(),
+                ranges[0].first, (nbMissing > _maxLostPackets ? ", frame dropped" : ""));
+            if (nbMissing > _maxLostPackets) {
+                pFrame->_frame.dropFrame();
+                continue;
+            }
+        }
+
+        // The lines of a frame with missing packets are not checked: their errors are known
+        if (_crcChecked.load() && nbMissing == 0) {
+            int nbErrors = pFrame->_frame.checkCRC();
+            if (nbErrors > 0) {
+                _nbCRCErrors += nbErrors;
+                LOG_ERROR("%s: frame #%d: %d scanlines with a CRC error", _name.c_str(), pFrame->_frame.getFrameNumber(), nbErrors);
+            }
+            else if (nbErrors < 0) {
+                LOG_WARNING("%s: can't check the CRCs of a dual link stream", _name.c_str());
+                _crcChecked = false;
+            }
+        }
+
         //LOG_INFO("%s: SMPTE frame on buffer %d COMPLETED", pin->_name.c_str(), framePointer);
-        _q.push(framePointer);
+        if (!_q.tryPush(framePointer))
+            LOG_ERROR("%s: frame #%d dropped, the reader is %d frames late", _name.c_str(), pFrame->_frame.getFrameNumber(), _q.size());
         framePointer = (framePointer + 1) % queueSize;
     }
 
@@ -172,15 +248,41 @@ int CInSMPTE::_rcv_process() {
     return 0;
 }
 
+/*!
+* \fn _keepEarlyPacket
+* \brief keep a copy of a packet of the next frame, received while the current frame is still open,
+* to replay it in the next frame. A packet already kept is ignored.
+*
+* \param packet RTP packet
+* \param len size of the packet
+* \param seq RTP sequence number of the packet
+* \param rcvTime receive time of the packet, in ns, 0 if unknown
+*/
+void CInSMPTE::_keepEarlyPacket(const char* packet, int len, int seq, long long rcvTime) {
+
+    for (int i = 0; i < _nbEarly; i++) {
+        if (_early[i]._seq == seq)
+            return;
+    }
+    if (_nbEarly >= (int)_early.size())
+        return;
+    _early[_nbEarly]._data.assign(packet, packet + len);
+    _early[_nbEarly]._seq = seq;
+    _early[_nbEarly]._rcvTime = rcvTime;
+    _nbEarly++;
+}
+
 SmpteFrameBuffer* CInSMPTE::_get_next_frame() {
     LOG("%s: --> <--", _name.c_str());
     int ret = 0, mediasize = 0;
 
     // Wait for an available frame
     //LOG_INFO("%s: Wait for an available SMPTE frame...", _name.c_str());
-    int framePointer = _q.pop();
-    if (framePointer == -1)
-        return NULL;
+    int framePointer = -1;
+    while (!_q.pop(&framePointer, WAIT_TIMEOUT_IN_MS)) {
+        if (!_bStarted)
+            return NULL;
+    }
     //LOG_INFO("%s: A new frame is available (#%d)", _name.c_str(), framePointer);
     SmpteFrameBuffer* pFrame = _smpteFrameArray[framePointer];
     std::lock_guard<std::mutex> lock(pFrame->_lock);
@@ -219,17 +321,8 @@ int CInSMPTE::read(CvMIFrame* frame)
         MEDIAFORMAT kindOfBuffer = _currentFrame->_frame.getMediaBufferType(buf);
         switch (kindOfBuffer) {
         case MEDIAFORMAT::VIDEO:
-            frame->createVideoFromSmpteFrame(&_currentFrame->_frame, buf, _nModuleId); 
-            if (_fmt == 8) {
-                CFrameHeaders* headers = frame->getMediaHeaders();
-                int offset = CFrameHeaders::GetHeadersLength();
-                int mediasize = headers->GetMediaSize();
-                tools::convert10bitsto8bits(frame->getMediaBuffer(), mediasize, frame->getMediaBuffer());
-                mediasize = mediasize * 8 / 10;
-                headers->SetMediaSize(mediasize);
-                headers->SetDepth(8);
-                headers->WriteHeaders(frame->getFrameBuffer());
-            }
+            // Extracted directly in the wanted depth
+            frame->createVideoFromSmpteFrame(&_currentFrame->_frame, buf, _nModuleId, _fmt); 
             break;
         case MEDIAFORMAT::AUDIO:
             frame->createAudioFromSmpteFrame(&_currentFrame->_frame, buf, _nModuleId); break;
@@ -275,9 +368,10 @@ void CInSMPTE::stop()
     _bStarted = false;
     if (_source)
         _source->close();
-    _q.push(-1);    // In case of, to unblock blocking pop
+    _q.wakeUp();    // unblock the reader waiting for a frame
     _t.join();
     LOG_INFO("%s: stop thread <-- ", _name.c_str());
+    LOG_INFO("%s: frame queue: max %d/%d frames, %lld dropped when full", _name.c_str(), _q.getHighWater(), _q.getCapacity(), _q.getOverflowsNb());
 
     if (_source)
         _source->close();
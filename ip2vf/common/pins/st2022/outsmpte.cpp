@@ -40,6 +40,12 @@ COutSMPTE::COutSMPTE(CModuleConfiguration* pMainCfg, int nIndex) :
     PROPERTY_REGISTER_OPTIONAL( "mcastgroup", _mcastgroup, "");
     PROPERTY_REGISTER_OPTIONAL( "dcast",      _useDeltacast, false);
     PROPERTY_REGISTER_OPTIONAL( "fmt",        _smptefmt, OUTSMPTE_STANDARD_2022_6);
+    PROPERTY_REGISTER_OPTIONAL( "sendmode",   _sendMode, "mmsg");
+    PROPERTY_REGISTER_OPTIONAL( "batch",      _batchSize, UDP_BATCH_DEFAULT_SIZE);
+    PROPERTY_REGISTER_OPTIONAL( "pacing",     _pacing, "none");
+    PROPERTY_REGISTER_OPTIONAL( "txtime",     _useTxTime, false);
+    PROPERTY_REGISTER_OPTIONAL( "zerocopy",   _zeroCopy, false);
+    PROPERTY_REGISTER_OPTIONAL( "crc",        _insertCRC, false);
 
     streamer = NULL;
 
@@ -78,6 +84,12 @@ int COutSMPTE::send(CvMIFrame* frame) {
             streamer = new CvMIStreamerCisco2022_6(_ip, _mcastgroup, _port, _pConfig, _interface);
         else if((_standard == SMPTE_2110_20) && _useDeltacast)
             throw std::runtime_error("not supported");
+        if (streamer) {
+            streamer->setSendMode(UDP::getSendModeFromName(_sendMode), _batchSize);
+            streamer->setPacing(CPacer::getModelFromName(_pacing), _useTxTime);
+            streamer->setZeroCopy(_zeroCopy);
+            streamer->setCRCInsertion(_insertCRC);
+        }
     }
 
     if (streamer) {
@@ -13,17 +13,24 @@ using namespace std;
 
 #define get18lsb(reg)         (_crc & 0x0003FFFF)
 
-static unsigned int* crc18_lookup_table = NULL;
+#define CRC18_SLICES          4       // words of a component processed per step
+
+/*
+ The table k gives the CRC of a 10 bits word followed by k zero words: the CRC of 4 words is
+ computed with one lookup per word, the CRC register only changing the lookups of the first two.
+*/
+struct CRC18Tables {
+    unsigned int t[CRC18_SLICES][1024];
+    CRC18Tables();
+};
 
 /*!
-* \fn precomputeTable
-* \brief precompute a SMPTE CRC table
+* \fn CRC18Tables
+* \brief precompute the SMPTE CRC tables
 *
 */
-static void
-precomputeTable()
+CRC18Tables::CRC18Tables()
 {
-    crc18_lookup_table = (unsigned int*)malloc(1024 * sizeof(int));
     for (int j = 0; j < 1024; j++)
     {
         int _crc = 0;
@@ -43,15 +50,30 @@ precomputeTable()
             _crc = (_crc & ~(0x1 << 12)) | (newC12 << 12);
             word10bits >>= 1;
         }
-        crc18_lookup_table[j] = _crc;
+        t[0][j] = _crc;
     }
+    for (int k = 1; k < CRC18_SLICES; k++)
+        for (int j = 0; j < 1024; j++)
+            t[k][j] = (t[k - 1][j] >> 10) ^ t[0][t[k - 1][j] & 0x3FF];
+}
+
+static const CRC18Tables& crc18Tables()
+{
+    static CRC18Tables tables;  // thread-safe init on first use
+    return tables;
+}
+
+/* 4 packed 10 bits words, big endian: the word i is at bit 30-10*i */
+static inline unsigned long long load4Words(const unsigned char* p)
+{
+    return ((unsigned long long)p[0] << 32) | ((unsigned long long)p[1] << 24) | ((unsigned long long)p[2] << 16)
+        | ((unsigned long long)p[3] << 8) | (unsigned long long)p[4];
 }
 
 CSMPTPCrc::CSMPTPCrc()
 {
     reset();
-    if (!crc18_lookup_table)
-        precomputeTable();
+    _table = crc18Tables().t[0];
 }
 
 CSMPTPCrc::~CSMPTPCrc()
@@ -78,7 +100,7 @@ CSMPTPCrc::reset()
 inline void
 CSMPTPCrc::compute_crc18_word(unsigned int word10bits)
 {
-    _crc = (_crc >> 10) ^ crc18_lookup_table[word10bits ^ (_crc & 0x3FF)];
+    _crc = (_crc >> 10) ^ _table[word10bits ^ (_crc & 0x3FF)];
 }
 
 /*!
@@ -105,6 +127,49 @@ CSMPTPCrc::compute_crc18_scanline(unsigned char* buffer,
     return (unsigned int)get18lsb(_crc);
 }
 
+/*!
+* \fn compute_crc18_scanline_cy
+* \brief compute the C and Y CRCs of a SMPTE scanline in a single pass, as define in st0292-1-2012.pdf,
+* chap 5.4. Same result as compute_crc18_scanline() with the start positions 0 and 1 and a step of 2,
+* but the words are read 8 at a time (10 bytes) and added 4 at a time to each CRC.
+*
+* \param buffer pointer to the first word of 10bits (a C word) to start the CRC computation
+* \param nbWords10bits number of 10 bits words to compute for each component
+* \param crcC CRC of the even words, reset before
+* \param crcY CRC of the odd words, reset before
+*/
+void
+CSMPTPCrc::compute_crc18_scanline_cy(unsigned char* buffer,
+    unsigned int nbWords10bits, CSMPTPCrc* crcC, CSMPTPCrc* crcY)
+{
+    const CRC18Tables& tables = crc18Tables();
+    const unsigned int* t0 = tables.t[0];
+    const unsigned int* t1 = tables.t[1];
+    const unsigned int* t2 = tables.t[2];
+    const unsigned int* t3 = tables.t[3];
+    unsigned int c = 0;
+    unsigned int y = 0;
+    const unsigned char* p = buffer;
+    unsigned int nbBlocks = nbWords10bits / CRC18_SLICES;
+    for (unsigned int i = 0; i < nbBlocks; i++, p += 10)
+    {
+        // C Y C Y in v0, then C Y C Y in v1
+        unsigned long long v0 = load4Words(p);
+        unsigned long long v1 = load4Words(p + 5);
+        c = t3[((v0 >> 30) ^ c) & 0x3FF] ^ t2[((v0 >> 10) ^ (c >> 10)) & 0x3FF]
+            ^ t1[(v1 >> 30) & 0x3FF] ^ t0[(v1 >> 10) & 0x3FF];
+        y = t3[((v0 >> 20) ^ y) & 0x3FF] ^ t2[(v0 ^ (y >> 10)) & 0x3FF]
+            ^ t1[(v1 >> 20) & 0x3FF] ^ t0[v1 & 0x3FF];
+    }
+    crcC->_crc = c;
+    crcY->_crc = y;
+    for (unsigned int i = nbBlocks * CRC18_SLICES; i < nbWords10bits; i++)
+    {
+        crcC->compute_crc18_word(tools::get10bitsWord(buffer, 2 * i));
+        crcY->compute_crc18_word(tools::get10bitsWord(buffer, 2 * i + 1));
+    }
+}
+
 /*!
 * \fn getCRC0
 * \brief calculate the first word of the SMPTE crc as define in st0292-1-2012.pdf, page 6
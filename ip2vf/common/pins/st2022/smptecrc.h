@@ -15,6 +15,7 @@ class CSMPTPCrc
 {
 private:
     unsigned int _crc;
+    const unsigned int* _table;     // one word lookup table
 
 public:
     CSMPTPCrc();
@@ -23,6 +24,7 @@ public:
 public:
     void         compute_crc18_word(unsigned int word10bits);
     unsigned int compute_crc18_scanline(unsigned char* buffer, unsigned int nbWords10bits, int nStartPos, int nStep);
+    static void  compute_crc18_scanline_cy(unsigned char* buffer, unsigned int nbWords10bits, CSMPTPCrc* crcC, CSMPTPCrc* crcY);
     void         reset();
     unsigned int getCRC0();
     unsigned int getCRC1();
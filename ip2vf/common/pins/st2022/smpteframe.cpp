@@ -6,6 +6,7 @@
 #include <fstream>      // for file saving
 #include <iostream>     // for file saving
 #include <thread>
+#include <algorithm>
 
 #include <pins/st2022/hbrmpframe.h>
 #include "rtpframe.h"
@@ -15,11 +16,12 @@
 #include "smptecrc.h"
 #include "tools.h"
 #include "audiopacket.h"
+#include "workerpool.h"
 
 using namespace std;
 
 #define SMPTE_MEDIA_PACKET_SIZE   1375
-#define COMPUTE_CRC_FLAG          false     // Flag to enabled/disabled the CRC computation when create a SMPTE frame (remux feature) 
+#define COMPUTE_CRC_FLAG          false     // Default of the CRC computation when create a SMPTE frame (remux feature), see setCRCInsertion() 
 
                         
 int EAV_DoubleChannel[6] = { 0x3ff, 0x3ff, 0x000, 0x000, 0x000, 0x000 };
@@ -32,6 +34,12 @@ CSMPTPFrame::CSMPTPFrame() {
     _writer             = NULL; 
     _halfframe1         = NULL;
     _halfframe2         = NULL;
+    _demuxPool          = NULL;
+    _reassemblyMode     = SMPTE_REASSEMBLY_SEQUENTIAL;
+    _firstSeq           = -1;
+    _nextFirstSeq       = -1;
+    _nbPacketsPerFrame  = 0;
+    _nbReceived         = 0;
     _isDemultiplexed    = false;
     _actualframelen     = 0;
     _completeframelen   = 0;        // Frame length with padding
@@ -47,7 +55,10 @@ CSMPTPFrame::CSMPTPFrame() {
     _bIncludeAudio      = false;
     _nPadding           = 0;
     _timestamp          = 0;
+    _firstPacketTime    = 0;
+    _lastPacketTime     = 0;
     _formatDetected     = false;
+    _insertCRC          = COMPUTE_CRC_FLAG;
 
     _audioFmt           = INTERLACED_MODE::NOT_DEFINED;
 }
@@ -100,16 +111,39 @@ void CSMPTPFrame::_reset() {
     _actualframelen = 0;
     _writer         = _frame;
     _nbPacket       = 0;
+    _firstPacketTime = 0;
+    _lastPacketTime = 0;
+}
+
+/*!
+* \fn _setPacketTime
+* \brief keep the receive time of a packet added to the frame
+*
+* \param rcvTime receive time of the packet, in ns, 0 if unknown
+*/
+void CSMPTPFrame::_setPacketTime(long long rcvTime) {
+
+    if (rcvTime <= 0)
+        return;
+    if (_firstPacketTime == 0)
+        _firstPacketTime = rcvTime;
+    _lastPacketTime = rcvTime;
 }
 
 /*!
 * \fn initNewFrame
 * \brief init class parameter before receive a new frame
 *
+* \param firstSeq with direct placement, RTP sequence number of the first packet of the frame
+* (see getNextFirstSeq()), -1 if unknown: the frame starts after the next end of frame marker
 */
-void CSMPTPFrame::initNewFrame() {
+void CSMPTPFrame::initNewFrame(int firstSeq) {
 
     _reset();
+    _firstSeq = firstSeq;
+    _nextFirstSeq = -1;
+    _nbReceived = 0;
+    std::fill(_rcvBitmap.begin(), _rcvBitmap.end(), 0ULL);
 }
 
 /*!
@@ -129,15 +163,22 @@ void CSMPTPFrame::abortCurrentFrame() {
 * \brief process a new received RTP packet, part of the current frame
 *
 * \param pPacket pointer to the RTP packet
+* \param rcvTime receive time of the packet, in ns, 0 if unknown
+* \return SMPTE_PACKET_NEXT_FRAME if the packet belongs to the next frame and must be given to it,
+* SMPTE_PACKET_ADDED otherwise
 */
-void CSMPTPFrame::addRTPPacket(CRTPFrame* pPacket) {
+int CSMPTPFrame::addRTPPacket(CRTPFrame* pPacket, long long rcvTime) {
 
     // Verify packet type validity
     if (pPacket->_pt != 98) {
         LOG_ERROR("RTP packet with incorect payload type: frame._pt=%d, seq=%d", pPacket->_pt, pPacket->_seq);
-        return;
+        return SMPTE_PACKET_ADDED;
     }
 
+    // Once the frame size is known, place the payload following its sequence number
+    if (_reassemblyMode == SMPTE_REASSEMBLY_DIRECT && !_firstFrame && _nbPacketsPerFrame > 0)
+        return _addRTPPacketDirect(pPacket, rcvTime);
+
     // verify RTP sequence number continuity
     if (!_waitForNextFrame && !_firstPacket  && (_lastSeq != -1) && (pPacket->_seq != ((_lastSeq + 1) % 65536)) )
     {
@@ -158,52 +199,53 @@ void CSMPTPFrame::addRTPPacket(CRTPFrame* pPacket) {
             _waitForNextFrame = false;
             _reset();
         }
-        return;
+        return SMPTE_PACKET_ADDED;
     }
 
     // Access to HBRMP content
-    CHBRMPFrame* hbrmp = pPacket->getHBRMPFrame();
+    CHBRMPFrame hbrmp;
+    pPacket->getHBRMPFrame(hbrmp);
     //LOG_INFO("rtp timestamp=%lu", pPacket->_timestamp);
-    //LOG_INFO("hbrmp timestamp=%lu", hbrmp->_cf);
+    //LOG_INFO("hbrmp timestamp=%lu", hbrmp._cf);
     if (_firstPacket) {
         //LOG_INFO("receive first packet");
         //pPacket->dumpHeader();
-        //hbrmp->dumpHeader();
+        //hbrmp.dumpHeader();
         // If SMPTE profile is not set, try to detect it from hbrmp headers :
         // see 7289943.pdf documentation, "Transport of High Bit Rate Media Signals over IP Network (HBRMT)"
         if (_profile.getStandard() == SMPTE_NOT_DEFINED)
-            _profile.initProfileFromHBRMP(hbrmp);
+            _profile.initProfileFromHBRMP(&hbrmp);
         if (_profile.getStandard() == SMPTE_NOT_DEFINED) {
             LOG_ERROR("Error: This SMPTE format is not supported. Abort!");
             LOG_INFO("Abort.");
             exit(0);
         }
 
-        //LOG_DUMP10BITS((const char*)hbrmp->getPayload(), 32);
-        //LOG_INFO("timestanmp=%lu", hbrmp->_timestamp);
+        //LOG_DUMP10BITS((const char*)hbrmp.getPayload(), 32);
+        //LOG_INFO("timestanmp=%lu", hbrmp._timestamp);
         _firstPacket = false;
     }
-    if (_lastFc < 0) _lastFc = hbrmp->getFrameCounter();
-    if (_lastFc != hbrmp->getFrameCounter()) {
-        _lastFc = hbrmp->getFrameCounter();
+    if (_lastFc < 0) _lastFc = hbrmp.getFrameCounter();
+    if (_lastFc != hbrmp.getFrameCounter()) {
+        _lastFc = hbrmp.getFrameCounter();
     }
-    _actualframelen += hbrmp->getPayloadLen();
+    _actualframelen += hbrmp.getPayloadLen();
     _nbPacket++;
+    _setPacketTime(rcvTime);
 
     // Add payload content to the current frame
     if (!_firstFrame && _writer != 0) {
-        if (((int)(_writer - _frame) + hbrmp->getPayloadLen()) > _completeframelen) {
+        if (((int)(_writer - _frame) + hbrmp.getPayloadLen()) > _completeframelen) {
             LOG_INFO("ERROR BUFFER OVERFLOW: used size=%d/%d, _actualframelen=%d, to write=%d", 
-                (_writer - _frame), _completeframelen, _actualframelen, hbrmp->getPayloadLen());
+                (_writer - _frame), _completeframelen, _actualframelen, hbrmp.getPayloadLen());
             _waitForNextFrame = true;
-            delete hbrmp;
             _reset();
-            return;
+            return SMPTE_PACKET_ADDED;
         }
         else {
             //LOG_INFO("_writer############>");
-            memcpy(_writer, hbrmp->getPayload(), hbrmp->getPayloadLen());
-            _writer += hbrmp->getPayloadLen();
+            memcpy(_writer, hbrmp.getPayload(), hbrmp.getPayloadLen());
+            _writer += hbrmp.getPayloadLen();
         }
     }
 
@@ -213,7 +255,7 @@ void CSMPTPFrame::addRTPPacket(CRTPFrame* pPacket) {
         //LOG_INFO("Frame #%d, _nbPacket=%d, _actualframelen=%d", _frameCounter, _nbPacket, _actualframelen);
 
         // Keep hbrmptimestamp from last packet
-        _timestamp = hbrmp->getTimestamp();
+        _timestamp = hbrmp.getTimestamp();
 
         if (_firstFrame) {
             LOG_INFO("First frame initialisation --------->");
@@ -226,8 +268,7 @@ void CSMPTPFrame::addRTPPacket(CRTPFrame* pPacket) {
                 LOG_ERROR("... We received %d bytes", _actualframelen);
                 LOG_ERROR("... Profile [%s] say that frame length is %d bytes", _profile.getProfileName().c_str(), _profile.getTransportFrameSize());
                 abortCurrentFrame();
-                delete hbrmp;
-                return;
+                return SMPTE_PACKET_ADDED;
             }
             _nPadding = _actualframelen - _profile.getTransportFrameSize();
             _firstFrameInit(_actualframelen);
@@ -238,39 +279,20 @@ void CSMPTPFrame::addRTPPacket(CRTPFrame* pPacket) {
                 // we can have buffer overflow...
                 LOG_ERROR("Stream format validation failed. Abort!");
                 abortCurrentFrame();
-                delete hbrmp;
-                return;
+                return SMPTE_PACKET_ADDED;
             }
+            _initDirectPlacement();
             LOG_INFO("First frame initialisation <---------");
             _firstFrame = false;
         }
+        // The next frame starts after this one
+        _nextFirstSeq = (pPacket->_seq + 1) % 65536;
 
         if ((_actualframelen - _nPadding) == _activeframelen) {
             // The current frame seems valid, size is correct
            _bFrameComplete = true;
             //_frameCounter++;
-            _qAvailableBuffers.clear();
-            switch (_profile.getStandard())
-            {
-            case SMPTE_STANDARD::SMPTE_292M:
-            case SMPTE_STANDARD::SMPTE_425MlvlA:
-            case SMPTE_STANDARD::SMPTE_259M:
-                _qAvailableBuffers.push_front(VIDEO_BUFFER_0);
-                _qAvailableBuffers.push_front(AUDIO_BUFFER_0);
-                _qAvailableBuffers.push_front(ANC_BUFFER_0);
-                break;
-            case SMPTE_STANDARD::SMPTE_425MlvlBDL:
-                _qAvailableBuffers.push_front(VIDEO_BUFFER_1);
-                _qAvailableBuffers.push_front(AUDIO_BUFFER_1);
-                _qAvailableBuffers.push_front(ANC_BUFFER_1);
-                _qAvailableBuffers.push_front(VIDEO_BUFFER_2);
-                _qAvailableBuffers.push_front(AUDIO_BUFFER_2);
-                _qAvailableBuffers.push_front(ANC_BUFFER_2);
-                _isDemultiplexed = false;
-                break;
-            default:
-                break;
-            }
+            _setAvailableBuffers();
         }
         else {
             // Error, 
@@ -280,8 +302,185 @@ void CSMPTPFrame::addRTPPacket(CRTPFrame* pPacket) {
         }
         _nbPacket = 0;
     }
+    return SMPTE_PACKET_ADDED;
+}
 
-    delete hbrmp;
+/*!
+* \fn _setAvailableBuffers
+* \brief list the media buffers of a complete frame
+*
+*/
+void CSMPTPFrame::_setAvailableBuffers() {
+
+    _qAvailableBuffers.clear();
+    switch (_profile.getStandard())
+    {
+    case SMPTE_STANDARD::SMPTE_292M:
+    case SMPTE_STANDARD::SMPTE_425MlvlA:
+    case SMPTE_STANDARD::SMPTE_259M:
+        _qAvailableBuffers.push_front(VIDEO_BUFFER_0);
+        _qAvailableBuffers.push_front(AUDIO_BUFFER_0);
+        _qAvailableBuffers.push_front(ANC_BUFFER_0);
+        break;
+    case SMPTE_STANDARD::SMPTE_425MlvlBDL:
+        _qAvailableBuffers.push_front(VIDEO_BUFFER_1);
+        _qAvailableBuffers.push_front(AUDIO_BUFFER_1);
+        _qAvailableBuffers.push_front(ANC_BUFFER_1);
+        _qAvailableBuffers.push_front(VIDEO_BUFFER_2);
+        _qAvailableBuffers.push_front(AUDIO_BUFFER_2);
+        _qAvailableBuffers.push_front(ANC_BUFFER_2);
+        _isDemultiplexed = false;
+        break;
+    default:
+        break;
+    }
+}
+
+/*!
+* \fn _initDirectPlacement
+* \brief size the arrival bitmap once the frame size is known. All the HBRMP payloads of a frame
+* have the same length, so the position of a packet in the frame is its index times this length.
+*
+*/
+void CSMPTPFrame::_initDirectPlacement() {
+
+    if (_completeframelen % SMPTE_PACKET_LENGTH != 0) {
+        LOG_ERROR("frame length %d is not a multiple of %d bytes payloads, no direct placement", _completeframelen, SMPTE_PACKET_LENGTH);
+        _nbPacketsPerFrame = 0;
+        return;
+    }
+    _nbPacketsPerFrame = _completeframelen / SMPTE_PACKET_LENGTH;
+    _rcvBitmap.assign((_nbPacketsPerFrame + 63) / 64, 0ULL);
+    _nbReceived = 0;
+}
+
+/*!
+* \fn _addRTPPacketDirect
+* \brief write the payload of a packet at its final place in the frame, given by its sequence number
+* relative to the first packet of the frame. The packets can be received in any order; a duplicated
+* packet is ignored. The frame is complete when all its packets are received, or when a packet of
+* the next frame is received beyond SMPTE_REORDER_WINDOW packets: the missing packets are then given
+* by getMissingRanges(). The frame is kept open for the packets reordered around its end: the
+* packets of the next frame in the window are given back to the caller, which replays them in the
+* next frame.
+*
+* \param pPacket pointer to the RTP packet
+* \param rcvTime receive time of the packet, in ns, 0 if unknown
+* \return SMPTE_PACKET_NEXT_FRAME if the packet belongs to the next frame and closes this one,
+* SMPTE_PACKET_EARLY if it belongs to the next frame but this one is still open, SMPTE_PACKET_ADDED otherwise
+*/
+int CSMPTPFrame::_addRTPPacketDirect(CRTPFrame* pPacket, long long rcvTime) {
+
+    if (_firstSeq < 0) {
+        // Position unknown: the frame starts after the next end of frame
+        if (pPacket->isEndOfFrame())
+            _firstSeq = (pPacket->_seq + 1) % 65536;
+        return SMPTE_PACKET_ADDED;
+    }
+
+    int index = (pPacket->_seq - _firstSeq + 65536) % 65536;
+    if (index >= 32768) {
+        // Late packet of a previous frame
+        return SMPTE_PACKET_ADDED;
+    }
+    if (index >= _nbPacketsPerFrame) {
+        // Packet of the next frame: the missing packets of this one may still come
+        if (index < _nbPacketsPerFrame + SMPTE_REORDER_WINDOW)
+            return SMPTE_PACKET_EARLY;
+        // Too far: this one is over
+        _nextFirstSeq = (_firstSeq + _nbPacketsPerFrame) % 65536;
+        _endDirectFrame();
+        return SMPTE_PACKET_NEXT_FRAME;
+    }
+
+    CHBRMPFrame hbrmp;
+    pPacket->getHBRMPFrame(hbrmp);
+    if (!isPacketReceived(index) && hbrmp.getPayloadLen() == SMPTE_PACKET_LENGTH) {
+        memcpy(_frame + index * SMPTE_PACKET_LENGTH, hbrmp.getPayload(), SMPTE_PACKET_LENGTH);
+        _rcvBitmap[index / 64] |= (1ULL << (index % 64));
+        _nbReceived++;
+        _timestamp = hbrmp.getTimestamp();
+        _setPacketTime(rcvTime);
+    }
+
+    if (pPacket->isEndOfFrame() && index != _nbPacketsPerFrame - 1) {
+        // The frame hasn't the expected number of packets: resync on the next one
+        LOG_ERROR("end of frame on packet %d, %d packets expected. Frame dropped", index + 1, _nbPacketsPerFrame);
+        _reset();
+        _firstSeq = (pPacket->_seq + 1) % 65536;
+        _nbReceived = 0;
+        std::fill(_rcvBitmap.begin(), _rcvBitmap.end(), 0ULL);
+        return SMPTE_PACKET_ADDED;
+    }
+    if (_nbReceived == _nbPacketsPerFrame) {
+        _nextFirstSeq = (_firstSeq + _nbPacketsPerFrame) % 65536;
+        _endDirectFrame();
+    }
+    return SMPTE_PACKET_ADDED;
+}
+
+void CSMPTPFrame::_endDirectFrame() {
+
+    _bFrameComplete = true;
+    _setAvailableBuffers();
+    if (_nbReceived < _nbPacketsPerFrame)
+        LOG("frame #%d complete with %d missing packets", _frameCounter, _nbPacketsPerFrame - _nbReceived);
+}
+
+/*!
+* \fn isPacketReceived
+* \brief with direct placement, tell if a packet of the current frame has been received
+*
+* \param index index of the packet in the frame
+* \return true if received
+*/
+bool CSMPTPFrame::isPacketReceived(int index) {
+
+    if (index < 0 || index >= _nbPacketsPerFrame)
+        return false;
+    return (_rcvBitmap[index / 64] & (1ULL << (index % 64))) != 0;
+}
+
+/*!
+* \fn getMissingPacketsNb
+* \brief with direct placement, number of packets missing in the current frame
+*/
+int CSMPTPFrame::getMissingPacketsNb() {
+
+    if (_reassemblyMode != SMPTE_REASSEMBLY_DIRECT || _nbPacketsPerFrame == 0)
+        return 0;
+    return _nbPacketsPerFrame - _nbReceived;
+}
+
+/*!
+* \fn getMissingRanges
+* \brief with direct placement, ranges of packets missing in the current frame. The packet i covers
+* the bytes [i * SMPTE_PACKET_LENGTH, (i + 1) * SMPTE_PACKET_LENGTH[ of the frame.
+*
+* \return list of (first packet index, nb of packets)
+*/
+std::vector<std::pair<int, int>> CSMPTPFrame::getMissingRanges() {
+
+    std::vector<std::pair<int, int>> ranges;
+    if (getMissingPacketsNb() == 0)
+        return ranges;
+    int i = 0;
+    while (i < _nbPacketsPerFrame) {
+        // Skip the words of received packets
+        if ((i % 64) == 0 && _rcvBitmap[i / 64] == ~0ULL) {
+            i += 64;
+            continue;
+        }
+        if (isPacketReceived(i)) {
+            i++;
+            continue;
+        }
+        int first = i;
+        while (i < _nbPacketsPerFrame && !isPacketReceived(i))
+            i++;
+        ranges.push_back(std::make_pair(first, i - first));
+    }
+    return ranges;
 }
 
 /*!
@@ -588,12 +787,18 @@ void CSMPTPFrame::resetFrame() {
 * \param pOutputBuffer pointer to the buffer where to copy video media content
 * \param sizeOfOutputBuffer size of pOutputBuffer
 * \param src source buffer
+* \param depth output depth: 10 (packed, as in the SMPTE frame), 8, or 16 (one little endian word per sample)
 * \return size of the copied video data
 */
-int  CSMPTPFrame::_extractSMPTEVideoContent(char* pOutputBuffer, int sizeOfOutputBuffer, unsigned char* src) {
+int  CSMPTPFrame::_extractSMPTEVideoContent(char* pOutputBuffer, int sizeOfOutputBuffer, unsigned char* src, int depth) {
+
+    if (depth != 8 && depth != 10 && depth != 16) {
+        LOG_ERROR("Can't extract video frame, unsupported depth %d", depth);
+        return 0;
+    }
 
     // check size...
-    int mediasize = _profile.getActiveWidth() * _profile.getActiveHeight() * _profile.getComponentsNb() * _profile.getComponentsDepth() / 8;
+    int mediasize = _profile.getActiveWidth() * _profile.getActiveHeight() * _profile.getComponentsNb() * depth / 8;
     if (mediasize > sizeOfOutputBuffer) {
         LOG_ERROR("Can't extract video frame, the provided video buffer is too small... (%d bytes and need %d bytes)", sizeOfOutputBuffer, mediasize);
         return 0;
@@ -601,8 +806,10 @@ int  CSMPTPFrame::_extractSMPTEVideoContent(char* pOutputBuffer, int sizeOfOutpu
     if (src == NULL)
         return 0;
 
+    // Each active line is converted while it is copied: a single pass on the frame
     int nTotalCopied = 0;
     int nActiveLineSize = _profile.getActiveWidth() * _profile.getComponentsNb() * _profile.getComponentsDepth() / 8;
+    int nOutputLineSize = _profile.getActiveWidth() * _profile.getComponentsNb() * depth / 8;
     char* dest = pOutputBuffer;
     //LOG_INFO("copy from 0x%x to 0x%x, activelinesize=%d", p, _frame, nActiveLineSize);
     for (int i = 0; i < _profile.getActiveHeight(); i++) {
@@ -614,9 +821,15 @@ int  CSMPTPFrame::_extractSMPTEVideoContent(char* pOutputBuffer, int sizeOfOutpu
                 line = i / 2 + _profile.getYOffsetF2();
         }
         //LOG_INFO("...copy line=%d, p=%d, src=%d", line, p- pOutputBuffer, (line * _profile.getScanlineSize()) + _profile.getXOffset());
-        memcpy(dest, src + (line * _profile.getScanlineSize()) + _profile.getXOffset(), nActiveLineSize);
-        dest += nActiveLineSize;
-        nTotalCopied += nActiveLineSize;
+        unsigned char* in = src + (line * _profile.getScanlineSize()) + _profile.getXOffset();
+        if (depth == 8)
+            tools::convert10bitsto8bits(in, nActiveLineSize, (unsigned char*)dest);
+        else if (depth == 16)
+            tools::convert10bitsto16bits(in, nActiveLineSize, (unsigned char*)dest);
+        else
+            memcpy(dest, in, nActiveLineSize);
+        dest += nOutputLineSize;
+        nTotalCopied += nOutputLineSize;
     }
     //LOG_INFO("nTotalActiveCol=%d/%d, nTotalCopied=%d", nTotalActiveCol, _nTotalLineSize, nTotalCopied);
     return nTotalCopied;
@@ -624,40 +837,44 @@ int  CSMPTPFrame::_extractSMPTEVideoContent(char* pOutputBuffer, int sizeOfOutpu
 
 /*!
 * \fn _demux_process
-* \brief job that demux a part of a SMPTE424M frame
+* \brief job that demux a band of lines of a SMPTE425M level B dual link frame. Each group of 10 bytes
+* (8 words) of the frame gives one group of 5 bytes (4 words) to each half frame: the words are moved
+* by 20 bits blocks, without per word read-modify-write.
 *
 * \param frame CSMPTPFrame object
-* \param in offset on the input buffer
-* \param out offset on the output buffer
-* \param count nb of 10bits words to process
+* \param firstLine first line of the half frames to process
+* \param nbLines nb of lines to process
 * \return 
 */
-void CSMPTPFrame::_demux_process(CSMPTPFrame* frame, int in, int out, int count) {
-
-    int w[4];
-    unsigned char* src = frame->_frame;
-    unsigned char* dest1 = frame->_halfframe1;
-    unsigned char* dest2 = frame->_halfframe2;
-    //LOG_INFO("####### into workers thread [%d], in=%d, out=%d, nbToPrcoceed=%d", index, in, out, nbToPrcoceed);
-    for (int i = 0; i < count; i++) {
-        w[0] = ((src[in + 0]) << 2) + ((src[in + 1] & 0b11000000) >> 6);
-        w[1] = ((src[in + 1] & 0b00111111) << 4) + ((src[in + 2] & 0b11110000) >> 4);
-        w[2] = ((src[in + 2] & 0b00001111) << 6) + ((src[in + 3] & 0b11111100) >> 2);
-        w[3] = ((src[in + 3] & 0b00000011) << 8) + ((src[in + 4]));
-
-        in += 5;
-        tools::set10bitsWord(dest1, out, w[0]);
-        tools::set10bitsWord(dest1, out + 1, w[1]);
-        tools::set10bitsWord(dest2, out, w[2]);
-        tools::set10bitsWord(dest2, out + 1, w[3]);
-        out += 2;
+void CSMPTPFrame::_demux_process(CSMPTPFrame* frame, int firstLine, int nbLines) {
+
+    int lineSize = frame->_profile.getScanlineSize();
+    int nbGroups = nbLines * lineSize / 5;
+    const unsigned char* src = frame->_frame + 2 * firstLine * lineSize;
+    unsigned char* dest1 = frame->_halfframe1 + firstLine * lineSize;
+    unsigned char* dest2 = frame->_halfframe2 + firstLine * lineSize;
+    for (int i = 0; i < nbGroups; i++) {
+        // w0 w1 w2 w3 | w4 w5 w6 w7 -> w0 w1 w4 w5 on the first half frame, w2 w3 w6 w7 on the second
+        unsigned long long hi = ((unsigned long long)src[0] << 32) | ((unsigned long long)src[1] << 24) |
+            ((unsigned long long)src[2] << 16) | ((unsigned long long)src[3] << 8) | src[4];
+        unsigned long long lo = ((unsigned long long)src[5] << 32) | ((unsigned long long)src[6] << 24) |
+            ((unsigned long long)src[7] << 16) | ((unsigned long long)src[8] << 8) | src[9];
+        unsigned long long h1 = (hi & 0xFFFFF00000ULL) | (lo >> 20);
+        unsigned long long h2 = ((hi & 0xFFFFFULL) << 20) | (lo & 0xFFFFFULL);
+        for (int k = 0; k < 5; k++) {
+            dest1[k] = (unsigned char)(h1 >> (32 - 8 * k));
+            dest2[k] = (unsigned char)(h2 >> (32 - 8 * k));
+        }
+        src += 10;
+        dest1 += 5;
+        dest2 += 5;
     }
 }
 
-#define USE_THREADS_POOL
 /*!
 * \fn _demuxSMPTE424MFrame
-* \brief demux the current frame, if it's a SMPTE425M Dual link frame, on two SMPTE292M frame
+* \brief demux the current frame, if it's a SMPTE425M Dual link frame, on two SMPTE292M frame. The
+* frame is split in bands of lines, demultiplexed by the threads of the demux pool if any.
 *
 * \return VMI_E_OK if Ok, error code otherwise
 */
@@ -684,41 +901,17 @@ int CSMPTPFrame::_demuxSMPTE425MBDLFrame() {
     //LOG_INFO("_completeframelen=%d, _activeframelen=%d", _completeframelen, _activeframelen);
 
     //LOG_INFO("Extract new SMPTE frame");
-    long long t1 = tools::getCurrentTimeInMilliS();
-#ifdef USE_THREADS_POOL
-    int nbThread = 10;
-    for (int i = 0; i < nbThread; i++) {
-        int nbWordsToProcess = nbWords10bits / nbThread;
-        int in = i * nbWordsToProcess * 5 / 2;
-        int out = i * nbWordsToProcess * 2 / 2;
-        _workers.push_back(std::thread(_demux_process, this, in, out, nbWordsToProcess / 2));
-    }
-    for (std::thread &t : _workers) {
-        if (t.joinable()) {
-            t.join();
-        }
-    }
-    _workers.clear();
-#else
-    int in = 0; int out = 0, w[4];
-    //LOG_DUMP10BITS((const char*)_frame, 16);
-    while (out < nbWords10bits) {
-        // Read 4 10bits words, the two first seems to contain first frame, the two last for last frame
-
-        w[0] = ((_frame[in + 0]) << 2) + ((_frame[in + 1] & 0b11000000) >> 6);
-        w[1] = ((_frame[in + 1] & 0b00111111) << 4) + ((_frame[in + 2] & 0b11110000) >> 4);
-        w[2] = ((_frame[in + 2] & 0b00001111) << 6) + ((_frame[in + 3] & 0b11111100) >> 2);
-        w[3] = ((_frame[in + 3] & 0b00000011) << 8) + ((_frame[in + 4]));
-
-        in += 5;
-        tools::set10bitsWord(_halfframe1, out, w[0]);
-        tools::set10bitsWord(_halfframe1, out + 1, w[1]);
-        out += 2;
+    int nbLines = nHalfFrameSize / _profile.getScanlineSize();
+    if (_demuxPool != NULL) {
+        _demuxPool->run([this, nbLines](int index, int count) {
+            int first = index * nbLines / count;
+            int last = (index + 1) * nbLines / count;
+            _demux_process(this, first, last - first);
+        });
     }
-#endif
+    else
+        _demux_process(this, 0, nbLines);
     _isDemultiplexed = true;
-    long long t2 = tools::getCurrentTimeInMilliS();
-    //LOG_INFO("Process take %d ms", (int)(t2 - t1));
 
     return VMI_E_OK;
 }
@@ -918,7 +1111,7 @@ void CSMPTPFrame::insertVideoContentToSMPTEFrame(char* buffer)
     }
 
     // Now new video content is inserted, need to compute again CRC
-    if ( COMPUTE_CRC_FLAG )
+    if (_insertCRC)
         _computeCRC();
 
     //_analyse();
@@ -930,26 +1123,55 @@ void CSMPTPFrame::_computeCRC() {
     CSMPTPCrc crcY;
     unsigned char* p;
 
-    for (int i = 0; i < _profile.getScanlinesNb(); i++) {
+    // The CRC of the last line would be in the next frame
+    for (int i = 0; i < _profile.getScanlinesNb() - 1; i++) {
         //
-        // Calculate CRC for the current scanline, both for Luminance and Chrominance
+        // Calculate CRC for the current scanline, both for Luminance and Chrominance: from the
+        // active video to the EAV+LN of the next scanline
         //
         p = (unsigned char*)_frame + i*_profile.getScanlineSize();
-        crcC.compute_crc18_scanline(p + _profile.getXOffset(), _profile.getActiveWidth() + 6, 0, 2);
-        crcY.compute_crc18_scanline(p + _profile.getXOffset(), _profile.getActiveWidth() + 6, 1, 2);
+        CSMPTPCrc::compute_crc18_scanline_cy(p + _profile.getXOffset(), _profile.getActiveWidth() + 6, &crcC, &crcY);
         //
-        // Then insert the CRC after EAV+LN of the next scanline, except for last line
+        // Then insert the CRC after EAV+LN of the next scanline
         //
         //LOG_INFO("line=%d,6              %x %x %x %x", i, crcC.getCRC0(), crcC.getCRC1(), crcY.getCRC0(), crcY.getCRC1());
-        if (i < _profile.getScanlinesNb() - 1) {
-            p = (unsigned char*)_frame + (i + 1)*_profile.getScanlineSize();
-            int j = 12;
-            tools::set10bitsWord(p, j++, crcC.getCRC0());
-            tools::set10bitsWord(p, j++, crcY.getCRC0());
-            tools::set10bitsWord(p, j++, crcC.getCRC1());
-            tools::set10bitsWord(p, j++, crcY.getCRC1());
+        p = (unsigned char*)_frame + (i + 1)*_profile.getScanlineSize();
+        int j = 12;
+        tools::set10bitsWord(p, j++, crcC.getCRC0());
+        tools::set10bitsWord(p, j++, crcY.getCRC0());
+        tools::set10bitsWord(p, j++, crcC.getCRC1());
+        tools::set10bitsWord(p, j++, crcY.getCRC1());
+    }
+}
+
+/*!
+* \fn checkCRC
+* \brief check the C and Y CRCs received after the EAV+LN of each scanline (see st0292-1-2012.pdf, p6).
+* The CRCs of the first scanline are the ones of the last scanline of the previous frame: not checked.
+*
+* \return number of scanlines with a wrong CRC, -1 if the frame is not a single link one
+*/
+int CSMPTPFrame::checkCRC() {
+    CSMPTPCrc crcC;
+    CSMPTPCrc crcY;
+    unsigned char* p;
+    int nbErrors = 0;
+
+    if (_frame == NULL || _profile.isMultiplexed())
+        return -1;
+
+    for (int i = 0; i < _profile.getScanlinesNb() - 1; i++) {
+        p = (unsigned char*)_frame + i*_profile.getScanlineSize();
+        CSMPTPCrc::compute_crc18_scanline_cy(p + _profile.getXOffset(), _profile.getActiveWidth() + 6, &crcC, &crcY);
+        p = (unsigned char*)_frame + (i + 1)*_profile.getScanlineSize();
+        if (tools::get10bitsWord(p, 12) != (int)crcC.getCRC0() || tools::get10bitsWord(p, 13) != (int)crcY.getCRC0()
+            || tools::get10bitsWord(p, 14) != (int)crcC.getCRC1() || tools::get10bitsWord(p, 15) != (int)crcY.getCRC1()) {
+            if (nbErrors == 0)
+                LOG("frame #%d: first CRC error on scanline %d", _frameCounter, i);
+            nbErrors++;
         }
     }
+    return nbErrors;
 }
 
 /*!
@@ -1076,7 +1298,6 @@ static int g_oldCRC[4];
 void CSMPTPFrame::_analyse()
 {
     CSMPTPCrc ccrc, ycrc;
-    unsigned int result;
     unsigned char* p;
     int nbActiveLine = 0;
 
@@ -1101,8 +1322,7 @@ void CSMPTPFrame::_analyse()
             if (v == 0) 
             {
                 // Analyse CRC number
-                result = ccrc.compute_crc18_scanline(p + _profile.getXOffset(), _profile.getActiveWidth() + 6, 0, 2);
-                result = ycrc.compute_crc18_scanline(p + _profile.getXOffset(), _profile.getActiveWidth() + 6, 1, 2);
+                CSMPTPCrc::compute_crc18_scanline_cy(p + _profile.getXOffset(), _profile.getActiveWidth() + 6, &ccrc, &ycrc);
                 LOG_INFO("line=                  %x %x %x %x", ccrc.getCRC0(), ycrc.getCRC0(), ccrc.getCRC1(), ycrc.getCRC1());
                 //LOG_DUMP10BITS((const char*)p, 16);
                 for (int k = 0; k < 4; k++) g_oldCRC[k] = tools::get10bitsWord(p, 12 + k);
@@ -1348,9 +1568,10 @@ MEDIAFORMAT CSMPTPFrame::getMediaBufferType(SMPTEFRAME_BUFFERS buffer) {
 * \param buffer src buffer, must be a SMPTEFRAME_BUFFERS
 * \param pOutputBuffer output buffer
 * \param sizeOfOutputBuffer size of pOutputBuffer
+* \param depth depth of the extracted video samples: 10, 8 or 16 bits
 * \return int size of copied content
 */
-int  CSMPTPFrame::extractMediaContent(SMPTEFRAME_BUFFERS buffer, char* pOutputBuffer, int sizeOfOutputBuffer) {
+int  CSMPTPFrame::extractMediaContent(SMPTEFRAME_BUFFERS buffer, char* pOutputBuffer, int sizeOfOutputBuffer, int depth) {
 
     // In case of 424M Dual link/dual stream, need to demux first
     if ((_profile.getStandard() == SMPTE_STANDARD::SMPTE_425MlvlBDL) && !_isDemultiplexed)
@@ -1359,11 +1580,11 @@ int  CSMPTPFrame::extractMediaContent(SMPTEFRAME_BUFFERS buffer, char* pOutputBu
     // Then extract wanted buffer
     switch (buffer) {
     case VIDEO_BUFFER_0:
-        return _extractSMPTEVideoContent(pOutputBuffer, sizeOfOutputBuffer, _frame); break;
+        return _extractSMPTEVideoContent(pOutputBuffer, sizeOfOutputBuffer, _frame, depth); break;
     case VIDEO_BUFFER_1:
-        return _extractSMPTEVideoContent(pOutputBuffer, sizeOfOutputBuffer, _halfframe1); break;
+        return _extractSMPTEVideoContent(pOutputBuffer, sizeOfOutputBuffer, _halfframe1, depth); break;
     case VIDEO_BUFFER_2:
-        return _extractSMPTEVideoContent(pOutputBuffer, sizeOfOutputBuffer, _halfframe2); break;
+        return _extractSMPTEVideoContent(pOutputBuffer, sizeOfOutputBuffer, _halfframe2, depth); break;
     case AUDIO_BUFFER_0:
         return _extractSMPTEAudioContent(pOutputBuffer, sizeOfOutputBuffer, _frame); break;
     case AUDIO_BUFFER_1:
@@ -2,6 +2,15 @@
 #define _SMPTEFRAME_H
 
 #define SMPTE_PACKET_LENGTH    1376   // in case of Jumbo frames
+
+#define SMPTE_REASSEMBLY_SEQUENTIAL 0   // payloads appended in arrival order, the frame is dropped on a loss
+#define SMPTE_REASSEMBLY_DIRECT     1   // payloads placed following their sequence number, losses tracked
+
+#define SMPTE_PACKET_ADDED          0
+#define SMPTE_PACKET_NEXT_FRAME     1   // the packet belongs to the next frame, it was not used
+#define SMPTE_PACKET_EARLY          2   // the packet belongs to the next frame, but the current one is still open: keep it for the next one
+
+#define SMPTE_REORDER_WINDOW        32  // with direct placement, packets of the next frame received before the current one is closed
 
 #include <vector>
 #include <thread>
@@ -26,6 +35,7 @@ enum SMPTEFRAME_BUFFERS {
 };
 
 class CRTPFrame;
+class CWorkerPool;
 
 class CSMPTPFrame
 {
@@ -47,6 +57,9 @@ private:
     bool    _bIncludeAudio;
     int     _nPadding;
     unsigned int    _timestamp;
+    long long       _firstPacketTime;   // receive time of the first/last packet of the frame, in ns, 0 if unknown
+    long long       _lastPacketTime;
+    bool            _insertCRC;         // compute the line CRCs when the video is inserted
     INTERLACED_MODE _audioFmt;
     CSMPTPProfile   _profile;
     CQueue<int>     _q;
@@ -55,16 +68,24 @@ private:
     bool           _isDemultiplexed;
     unsigned char* _halfframe1;
     unsigned char* _halfframe2;
-    std::vector<std::thread> _workers;
+    CWorkerPool*   _demuxPool;       // not owned, NULL: demux on the calling thread
+
+    // Direct placement reassembly
+    int     _reassemblyMode;
+    int     _firstSeq;          // RTP sequence number of the first packet of the frame, -1 if unknown
+    int     _nextFirstSeq;      // RTP sequence number of the first packet of the next frame, -1 if unknown
+    int     _nbPacketsPerFrame;
+    int     _nbReceived;
+    std::vector<unsigned long long> _rcvBitmap;    // one bit per packet of the frame
 
 public:
     CSMPTPFrame();
     ~CSMPTPFrame();
 
 public:
-    void initNewFrame();
+    void initNewFrame(int firstSeq = -1);
     void resetFrame();
-    void addRTPPacket(CRTPFrame* pPacket);
+    int  addRTPPacket(CRTPFrame* pPacket, long long rcvTime = 0);
     void abortCurrentFrame();
     void insertAudioContentToSMPTEFrame(unsigned char* buffer, int size);
     void insertVideoContentToSMPTEFrame(char* buffer);
@@ -87,6 +108,12 @@ public:
     unsigned int getTimestamp() {
         return _timestamp;
     };
+    long long getFirstPacketTime() {
+        return _firstPacketTime;
+    };
+    long long getLastPacketTime() {
+        return _lastPacketTime;
+    };
     unsigned char* getBuffer() {
         return _frame;
     };
@@ -105,6 +132,15 @@ public:
     SMPTE_STANDARD getStandard() { return _profile.getStandard(); };
     SMPTE_STANDARD setProfile(const char* format);
     SMPTE_STANDARD setProfile(CSMPTPProfile profile);
+    void    setDemuxPool(CWorkerPool* pool) { _demuxPool = pool; };
+    void    setReassemblyMode(int mode) { _reassemblyMode = mode; };
+    void    setCRCInsertion(bool enable) { _insertCRC = enable; };
+    int     checkCRC();
+    int     getNextFirstSeq() { return _nextFirstSeq; };
+    int     getPacketsNb() { return _nbPacketsPerFrame; };
+    bool    isPacketReceived(int index);
+    int     getMissingPacketsNb();
+    std::vector<std::pair<int, int>> getMissingRanges();
     CSMPTPProfile* getProfile() { return &_profile; };
 
     void    dumpVideoBuffer(char* filename);
@@ -116,7 +152,7 @@ public:
     int     getNbOfMediaBuffer() { return (int)_qAvailableBuffers.size();  };
     SMPTEFRAME_BUFFERS getNextAvailableMediaBuffer();
     static MEDIAFORMAT getMediaBufferType(SMPTEFRAME_BUFFERS buffer);
-    int  extractMediaContent(SMPTEFRAME_BUFFERS buffer, char* pOutputBuffer, int sizeOfOutputBuffer);
+    int  extractMediaContent(SMPTEFRAME_BUFFERS buffer, char* pOutputBuffer, int sizeOfOutputBuffer, int depth = 10);
 
     CSMPTPFrame& operator=(const CSMPTPFrame& other);
 
@@ -128,15 +164,20 @@ private:
     int  _detectEAV10bits(unsigned char* buffer, int size8bits);
     int  _extractChannelValue(unsigned char* buffer, int startpos10bits);
     bool _detectFormat();
-    int  _extractSMPTEVideoContent(char* pOutputBuffer, int sizeOfOutputBuffer, unsigned char* src);
+    int  _extractSMPTEVideoContent(char* pOutputBuffer, int sizeOfOutputBuffer, unsigned char* src, int depth);
     int  _extractSMPTEAudioContent(char* pOutputBuffer, int sizeOfOutputBuffer, unsigned char* src);
     int  _demuxSMPTE425MBDLFrame();
+    void _setAvailableBuffers();
+    void _initDirectPlacement();
+    int  _addRTPPacketDirect(CRTPFrame* pPacket, long long rcvTime);
+    void _setPacketTime(long long rcvTime);
+    void _endDirectFrame();
     bool _checkAndValidate(int fullFrameLen);
     void _analyse();
     void _computeCRC();
     int  _getXYZ(bool isEAV, int lineIdx);
 
-    static void _demux_process(CSMPTPFrame* frame, int in, int out, int count);
+    static void _demux_process(CSMPTPFrame* frame, int firstLine, int nbLines);
 };
 
 #endif //_SMPTEFRAME_H
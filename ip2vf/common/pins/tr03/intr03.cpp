@@ -22,13 +22,10 @@ CInTR03::CInTR03(CModuleConfiguration* pMainCfg, int nIndex) :
     PROPERTY_REGISTER_OPTIONAL("mcastgroup", _zmqip, "");
     PROPERTY_REGISTER_OPTIONAL("ip", _ip, "");
     PROPERTY_REGISTER_OPTIONAL("interface", _interface, "");
-#ifdef USE_NETMAP
-    _udpSock =
-            (strncmp(_interface, "netmap-", 7) == 0) ?
-                    new Netmap() : new UDP();
-#else
-    _udpSock = new UDP();
-#endif
+    PROPERTY_REGISTER_OPTIONAL("batch", _batchSize, UDP_BATCH_DEFAULT_SIZE);
+    PROPERTY_REGISTER_OPTIONAL("timestamp", _timestamping, "none");
+    _udpSock = UDP::createReceiver(_interface);
+    _udpSock->setBatchSize(_batchSize);
 
     /**********************************************************
      if (_pConfig->_fmt == 1)
@@ -83,11 +80,15 @@ int CInTR03::read(CvMIFrame* vmiFrame)
                     "%s: can't create %s UDP socket on [%s]:%d on interface '%s'",
                     _name.c_str(), (_isListen ? "listening" : "connected"), (_isListen ? "NULL" : _ip), _port,
                     _interface[0] == '\0' ? "<default>" : _interface);
-        else
+        else {
             LOG_INFO(
                     "%s: ok to create %s UDP socket on [%s]:%d on interface '%s'",
                     _name.c_str(), (_isListen ? "listening" : "connected"), (_isListen ? "NULL" : _ip), _port,
                     _interface[0] == '\0' ? "<default>" : _interface);
+            int timestampMode = UDP::getTimestampModeFromName(_timestamping);
+            if (timestampMode != UDP_TIMESTAMP_NONE)
+                _udpSock->setTimestampMode(timestampMode, _interface);
+        }
     }
 
     //
@@ -97,22 +98,27 @@ int CInTR03::read(CvMIFrame* vmiFrame)
     if (_udpSock->isValid()) {
 
         bool doneParsingFrame = false;
+        long long firstRcvTime = 0, rcvTime = 0;    // receive time of the first/last packet of the frame, in ns
         _tr03FrameParser->resetFrame();
 
         while (!doneParsingFrame)
         {
             int len, result;
+            char* packet = NULL;
 
-            // First, keep the full RTP frame from the current UDP packet
-            len = RTP_MAX_FRAME_LENGTH;
-            result = _udpSock->readSocket((char*) _RTPframe, &len);
-            if (result == -1)
+            // First, keep the full RTP frame from the current UDP packet, in place in the socket buffers
+            len = 0;
+            result = _udpSock->readPacket(&packet, &len);
+            if (result <= 0)
             {
                 LOG_ERROR(
                         "%s: error when read RTP frame: size readed=%d, result=%d",
                         _name.c_str(), len, result);
+                if (!_udpSock->isValid())
+                    return VMI_E_CONNECTION_CLOSED;
+                continue;
             }
-            CRTPFrame frame(_RTPframe, len);
+            CRTPFrame frame((unsigned char*)packet, len);
 
             LOG("%s: read=%d, frame._seq=%d", _name.c_str(), result, frame._seq);
             // As soon as possible, prevent duplicate packet
@@ -125,6 +131,9 @@ int CInTR03::read(CvMIFrame* vmiFrame)
             }
 
             _lastSeq = frame._seq;
+            rcvTime = _udpSock->getLastTimestamp();
+            if (firstRcvTime == 0)
+                firstRcvTime = rcvTime;
 
             // called all rtp packets have been collected into a tr03 frame
             auto onCompleteFrameParsed =
@@ -165,6 +174,8 @@ int CInTR03::read(CvMIFrame* vmiFrame)
                         }
                         //add propiatary header to buffer:
                         SetMediaTimestamp(frame._timestamp);
+                        SetFirstPacketTimestamp(firstRcvTime);
+                        SetLastPacketTimestamp(rcvTime);
                         WriteHeaders((unsigned char*)vmiFrame->getFrameBuffer(), _frameNb++);
                         vmiFrame->refreshHeaders();
                         //read loop should be terminated after frame is parsed:
@@ -173,7 +184,8 @@ int CInTR03::read(CvMIFrame* vmiFrame)
 
                     };
             //parse an incomming rtp packet:
-            _tr03FrameParser->addRtpFrame(&frame, onCompleteFrameParsed);
+            if (_tr03FrameParser->addRtpFrame(&frame))
+                onCompleteFrameParsed();
 
         }
     }
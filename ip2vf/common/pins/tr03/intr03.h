@@ -39,6 +39,8 @@ public:
     unsigned char _RTPframe[RTP_MAX_FRAME_LENGTH];
 
     int _port;
+    int _batchSize;     // nb of packets received per system call
+    const char* _timestamping;  // receive time of the packets: "none", "software" or "hardware"
     int _w;
     int _h;
     int _fmt;
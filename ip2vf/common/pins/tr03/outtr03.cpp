@@ -10,6 +10,7 @@
 #include "rtpframe.h"
 #include "tr03frame.h"
 #include "tcp_basic.h"
+#include "pacer.h"
 
 using namespace std;
 
@@ -33,6 +34,10 @@ COutTR03::COutTR03(CModuleConfiguration* pMainCfg, int nIndex) : COut(pMainCfg,
     //PROPERTY_REGISTER_OPTIONAL("fmt", _depth, 20);
     PROPERTY_REGISTER_OPTIONAL("interface", _interface, "");
     PROPERTY_REGISTER_OPTIONAL("mcastgroup", _mcastgroup, "");
+    PROPERTY_REGISTER_OPTIONAL("sendmode", _sendMode, "mmsg");
+    PROPERTY_REGISTER_OPTIONAL("batch", _batchSize, UDP_BATCH_DEFAULT_SIZE);
+    PROPERTY_REGISTER_OPTIONAL("pacing", _pacing, "none");
+    PROPERTY_REGISTER_OPTIONAL("txtime", _useTxTime, false);
     _isMulticast = !!_mcastgroup[0];
     //_linesize       = _w * _depth / 8;
     //_linepayloadsize = _linesize + TRO3_LINE_HEADERS_LENGTH;
@@ -46,11 +51,9 @@ COutTR03::COutTR03(CModuleConfiguration* pMainCfg, int nIndex) : COut(pMainCfg,
     if( _mtu > RTP_MAX_FRAME_LENGTH ) {
         // TODO: issue
     }
-#ifdef USE_NETMAP
-    _udpSock = (strncmp(_interface, "netmap-", 7) == 0) ? new Netmap() : new UDP();
-#else
-    _udpSock = new UDP();
-#endif
+    _udpSock = UDP::createSender(_interface);
+    _udpSock->setSendMode(UDP::getSendModeFromName(_sendMode), _batchSize);
+    _pacer.init(CPacer::getModelFromName(_pacing), _useTxTime);
 }
 
 COutTR03::~COutTR03()
@@ -82,9 +85,11 @@ int COutTR03::send(CvMIFrame* vmiFrame)
         if( result != E_OK ) 
             LOG_ERROR("%s: can't create %s UDP socket on [%s]:%d on interface '%s'", 
                 _name.c_str(), (_isMulticast?"listening":"connected"), (_isMulticast?"NULL":_ip), _port, _interface[0]=='\0'?"<default>":_interface);
-        else
+        else {
             LOG_INFO("%s: Ok to create %s UDP socket on [%s]:%d on interface '%s'", 
                 _name.c_str(), (_isMulticast?"listening":"connected"), (_isMulticast?"NULL":_ip), _port, _interface[0]=='\0'?"<default>":_interface);
+            _udpSock->setPacer(&_pacer);
+        }
     }
 
     //
@@ -101,9 +106,23 @@ int COutTR03::send(CvMIFrame* vmiFrame)
         _pgroup = tools::getPPCM(headers->GetDepth(), 8);
 
         // Create frames (RTP and TR03) that will be used to transfer this video frame
-        CRTPFrame frame(_RTPframe, _RTPPacketSize);
-        CTR03Frame* pTR03frame = frame.getTR03Frame();
-        pTR03frame->setFormat(headers->GetW(), headers->GetH(), headers->GetDepth() / 8);
+        CRTPFrame frame;
+        CTR03Frame tr03frame;
+        tr03frame.setFormat(headers->GetW(), headers->GetH(), headers->GetDepth() / 8);
+
+        // Spread the packets of the frame over the frame period, if the socket is paced. The number of
+        // packets depends on how the scanlines are split between the packets.
+        if (_pacer.getModel() != PACING_NONE) {
+            frame.setBuffer((unsigned char*)_udpSock->getSendBuffer(), _RTPPacketSize);
+            frame.getTR03Frame(tr03frame);
+            int nbPackets = 0;
+            int rest = 0;
+            for (int lines = headers->GetH(); lines > 0; nbPackets++) {
+                rest = tr03frame.prepare(rest, _linesize, lines);
+                lines -= tr03frame.getScanLineNb() - (rest > 0 ? 1 : 0);
+            }
+            _udpSock->startFrame(nbPackets, headers->GetFramerate(), CPacer::getActiveRatio(headers->GetH()));
+        }
 
         // Iterate to each scanline to encapsulate on TR03 packet
         int bEndOfFrame = false;
@@ -111,15 +130,19 @@ int COutTR03::send(CvMIFrame* vmiFrame)
         int scanlinerest = 0;
         int scanlinetoprocess = headers->GetH();
         while (scanlinetoprocess > 0) {
-            int len, marker = 0;
+            int marker = 0;
+
+            // The packet is built directly in the send batch of the socket
+            frame.setBuffer((unsigned char*)_udpSock->getSendBuffer(), _RTPPacketSize);
+            frame.getTR03Frame(tr03frame);
 
             // Prepare this TR03 frame (analyse how much scanlines or part of scanlines can be stored on this packet)
             // This step is needed to prevent lot of memcpy
-            scanlinerest = pTR03frame->prepare(scanlinerest, _linesize, scanlinetoprocess);
+            scanlinerest = tr03frame.prepare(scanlinerest, _linesize, scanlinetoprocess);
 
             // Add scanline on the packet
-            for (int i = 0; i < pTR03frame->getScanLineNb(); i++) {
-                bool isComplete = pTR03frame->addScanLine(p, lineNo, _linesize);
+            for (int i = 0; i < tr03frame.getScanLineNb(); i++) {
+                bool isComplete = tr03frame.addScanLine(p, lineNo, _linesize);
                 if (isComplete) {
                     scanlinetoprocess--;
                     lineNo++;
@@ -130,20 +153,19 @@ int COutTR03::send(CvMIFrame* vmiFrame)
             // write RTP packet header. Not that the TR03 headers part has been updated when addScanLine
             if (scanlinetoprocess == 0)
                 marker = 1;
-            pTR03frame->writeHeader(_seq);
+            tr03frame.writeHeader(_seq);
             frame.writeHeader(_seq, marker, 98);
-            //pTR03frame->dumpHeader();
-
-            // Send the packet
-            len = _RTPPacketSize;
-            result = _udpSock->writeSocket((char*)_RTPframe, &len);
-            if (result != -1) {
-                LOG("%s: write (size=%d) to socket, result=%d, RTP packet #%d, frame #%d, scanlinetoprocess=%d",
-                    _name.c_str(), len, result, frame._seq, _frameCount, scanlinetoprocess);
+            //tr03frame.dumpHeader();
+
+            // Queue the packet, the batch is sent when full or at the end of the frame
+            result = _udpSock->queueSendBuffer(_RTPPacketSize);
+            if (result != -1 && (scanlinetoprocess > 0 || _udpSock->flushSendBuffer() != -1)) {
+                LOG("%s: write (size=%d) to socket, RTP packet #%d, frame #%d, scanlinetoprocess=%d",
+                    _name.c_str(), _RTPPacketSize, frame._seq, _frameCount, scanlinetoprocess);
             }
             else {
-                LOG_ERROR("%s: error write (size=%d) to socket, result=%d, RTP packet #%d, frame #%d, scanlinetoprocess=%d",
-                    _name.c_str(), len, result, frame._seq, _frameCount, scanlinetoprocess);
+                LOG_ERROR("%s: error write (size=%d) to socket, RTP packet #%d, frame #%d, scanlinetoprocess=%d",
+                    _name.c_str(), _RTPPacketSize, frame._seq, _frameCount, scanlinetoprocess);
                 ret = -1;
             }
 
@@ -35,12 +35,12 @@ void CTR03FrameParser::copyFrameContents(void *destinationAddress){
 
     }
 
-void CTR03FrameParser::addRtpFrame(CRTPFrame* rtpFrame, const std::function<void() > onFrameParsed) {
+bool CTR03FrameParser::addRtpFrame(CRTPFrame* rtpFrame) {
      unsigned char *rtpData = rtpFrame->getData();
      auto GLOBAL_HEADER_LENGTH = 14;
      auto SUB_HEADER_LENGTH = 6;
-     //utility function to iterate over all the headers:
-     auto forEachSubHeader = [&](std::function<bool (unsigned char* subheader) > callback) {
+     //utility function to iterate over all the headers (generic lambda: no std::function allocation per packet):
+     auto forEachSubHeader = [&](auto callback) {
          if (_discardThisFrame) {
              return;
          }
@@ -130,8 +130,12 @@ void CTR03FrameParser::addRtpFrame(CRTPFrame* rtpFrame, const std::function<void
      //check if this is the last packet for the frame:
      //RTP marker bit (m) signals that the frame is complete
      if ((rtpFrame->_m != 0) && (!_interlaced || lastLineInSecondField)) {
-         onEndOfFrame( onFrameParsed);
+         if (!_discardThisFrame)
+             return true;
+         //clear all frame state:
+         resetFrame();
      }
+     return false;
  }
 
 void CTR03FrameParser::resetFrame()
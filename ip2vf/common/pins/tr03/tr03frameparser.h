@@ -28,14 +28,6 @@ class CTR03FrameParser {
     std::shared_ptr<unsigned char> _frameBuffer;
     //the size in bytes of the frame buffer
     const unsigned int _frameBufferLength;
-protected:
-    void onEndOfFrame(const std::function<void()>& onFrameParsed) {
-        if ((!_discardThisFrame)) {
-            onFrameParsed();
-        }
-        //clear all frame state:
-        resetFrame();
-    }
 public:
 
     CTR03FrameParser(
@@ -81,10 +73,9 @@ public:
     /**
      * Accumulate more bytes from the bitStream, eventually building a frame in the process
      * @param rtpFrame New RTP packet to ingest and parse accumulate into pixels
-     * @param onEndOfFrame callback called when the frame is ready to be parsed
-     * @return true if a frame is ready to be read
+     * @return true if a frame is ready to be read. It stays in the frame buffer until resetFrame() is called
      */
-    void addRtpFrame(CRTPFrame* rtpFrame, const std::function<void() > onFrameParsed);
+    bool addRtpFrame(CRTPFrame* rtpFrame);
 
     unsigned int inline PARSE_BIG_ENDIAN_UINT16(unsigned char *buffer) {
         return ((unsigned int) (buffer[0] << 8) +(unsigned char) (buffer[1]));
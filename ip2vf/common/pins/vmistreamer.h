@@ -8,6 +8,7 @@
 
 #include "common.h"
 #include "tcp_basic.h"
+#include "pacer.h"
 #include "frameheaders.h"
 #include "vmiframe.h"
 #include "rtpframe.h"
@@ -54,6 +55,10 @@ public:
     // Interface to implement
     virtual int  send(CvMIFrame* frame) = 0;
     virtual bool isConnected() = 0;
+    virtual void setSendMode(int mode, int batchSize) {};
+    virtual void setPacing(int model, bool useTxTime) {};
+    virtual void setZeroCopy(bool enable) {};
+    virtual void setCRCInsertion(bool enable) {};
 
 };
 
@@ -75,7 +80,8 @@ protected:
         CSMPTPFrame* frame;
         bool complete;
     };
-    UDP     _udpSock;
+    UDP*    _udpSock;
+    CPacer  _pacer;
     bool    _isMulticast;
     unsigned int _frameCount;
     unsigned int _hbrmpTimestamp;
@@ -83,6 +89,7 @@ protected:
     bool    _firstCompletedFrame;
     struct tFrameStruc _frame;
     int     _curFrameNb;
+    bool    _zeroCopy;      // the frame is sent with MSG_ZEROCOPY: wait for the kernel before rewriting it
 
 public:
     CvMIStreamerCisco2022_6(const char* ip, const char* mcastgroup, int port, PinConfiguration *pconfig, const char* ifname = NULL);
@@ -92,6 +99,10 @@ public:
     // Interface to implement
     int  send(CvMIFrame* frame);
     bool isConnected();
+    void setSendMode(int mode, int batchSize) { _udpSock->setSendMode(mode, batchSize); };
+    void setPacing(int model, bool useTxTime) { _pacer.init(model, useTxTime); };
+    void setZeroCopy(bool enable) { _zeroCopy = enable; };
+    void setCRCInsertion(bool enable) { _frame.frame->setCRCInsertion(enable); };
 };
 
 
@@ -27,37 +27,44 @@ CvMIStreamerCisco2022_6::CvMIStreamerCisco2022_6(const char* ip, const char* mca
     _firstCompletedFrame = false;
     _frame.frame = new CSMPTPFrame();
     _curFrameNb = 0;
+    _zeroCopy = false;
+    _udpSock = UDP::createSender(_ifname);
 }
 
 CvMIStreamerCisco2022_6::~CvMIStreamerCisco2022_6() {
 
     delete _frame.frame;
-    if (_udpSock.isValid()) {
-        _udpSock.closeSocket();
+    if (_udpSock->isValid()) {
+        _udpSock->closeSocket();
     }
+    delete _udpSock;
 }
 
 int CvMIStreamerCisco2022_6::send(CvMIFrame* frame) {
 
     // Manage the connection
-    if (!_udpSock.isValid())
+    if (!_udpSock->isValid())
     {
         const char* nic = _ifname;
         int result = -1;
         if (_isMulticast)
         {
-            result = _udpSock.openSocket(_mcastgroup, _ip, _port, false, nic);
+            result = _udpSock->openSocket(_mcastgroup, _ip, _port, false, nic);
         }
         else
         {
-            result = _udpSock.openSocket((char*)_ip, NULL, _port, false, nic);
+            result = _udpSock->openSocket((char*)_ip, NULL, _port, false, nic);
         }
         if (result != E_OK)
             LOG_ERROR("can't create %s main UDP socket on [%s]:%d on interface '%s'",
                 "connected", _ip, _port, nic[0] == '\0' ? "<default>" : nic);
-        else
+        else {
             LOG_INFO("Ok to create %s main UDP socket on [%s]:%d on interface '%s'",
                 "connected", _ip, _port, nic[0] == '\0' ? "<default>" : nic);
+            _udpSock->setPacer(&_pacer);
+            if (_zeroCopy)
+                _udpSock->setZeroCopy(true);
+        }
     }
 
     // Verify data
@@ -92,6 +99,13 @@ int CvMIStreamerCisco2022_6::send(CvMIFrame* frame) {
         return VMI_E_OK;
     }
 
+    // The SMPTE frame is sent in place: with zero copy, the kernel may still send the previous one.
+    // If it still does, this frame is dropped rather than written over the packets being sent.
+    if (_udpSock->waitSendCompletions() != E_OK) {
+        LOG_ERROR("the previous SMPTE frame is still being sent, drop frame #%d", headers->GetFrameNumber());
+        return VMI_E_FAILED_TO_SND_SOCKET;
+    }
+
     // Current implementation is video as master
     if (headers->GetMediaFormat() == MEDIAFORMAT::VIDEO)
     {
@@ -100,7 +114,7 @@ int CvMIStreamerCisco2022_6::send(CvMIFrame* frame) {
         _curFrameNb = headers->GetFrameNumber();
         _frame.frame->resetFrame();
         _frame.frame->insertVideoContentToSMPTEFrame((char*)srcBuffer);
-        _packetizer.send(&_udpSock, (char*)_frame.frame->getBuffer(), _frame.frame->getBufferSize(), 98);
+        _packetizer.send(_udpSock, (char*)_frame.frame->getBuffer(), _frame.frame->getBufferSize(), 98);
     }
     else if (headers->GetMediaFormat() == MEDIAFORMAT::AUDIO)
     {
@@ -112,6 +126,6 @@ int CvMIStreamerCisco2022_6::send(CvMIFrame* frame) {
 
 bool CvMIStreamerCisco2022_6::isConnected() {
 
-    return _udpSock.isValid();
+    return _udpSock->isValid();
 }
 
@@ -0,0 +1,230 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "common.h"
+#include "log.h"
+#include "qoi.h"
+
+#define QOI_OP_INDEX    0x00    /* 00xxxxxx */
+#define QOI_OP_DIFF     0x40    /* 01xxxxxx */
+#define QOI_OP_LUMA     0x80    /* 10xxxxxx */
+#define QOI_OP_RUN      0xC0    /* 11xxxxxx */
+#define QOI_OP_RGB      0xFE
+#define QOI_OP_RGBA     0xFF
+#define QOI_MASK_2      0xC0
+#define QOI_MAX_RUN     62
+
+static const unsigned char g_padding[QOI_PADDING_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+struct tQOIPixel {
+    unsigned char r, g, b, a;
+
+    bool operator==(const tQOIPixel& p) const { return r == p.r && g == p.g && b == p.b && a == p.a; };
+    int  hash() const { return (r * 3 + g * 5 + b * 7 + a * 11) % 64; };
+};
+
+static void write32(unsigned char* p, unsigned int v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static unsigned int read32(const unsigned char* p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+/*!
+* \fn getMaxSize
+* \brief max size of an encoded image: 1 byte more per pixel, the header and the end marker
+*
+* \param w width
+* \param h height
+* \param channels 3 (RGB) or 4 (RGBA)
+* \return size in bytes
+*/
+int qoi::getMaxSize(int w, int h, int channels)
+{
+    return w * h * (channels + 1) + QOI_HEADER_SIZE + QOI_PADDING_SIZE;
+}
+
+/*!
+* \fn encode
+* \brief encode RGB or RGBA pixels
+*
+* \param pixels w*h pixels, without padding between the lines
+* \param w width
+* \param h height
+* \param channels 3 (RGB) or 4 (RGBA)
+* \param out encoded image
+* \param out_size size of out, see getMaxSize()
+* \return size of the encoded image, VMI_E_INVALID_PARAMETER if the parameters or the output size are invalid
+*/
+int qoi::encode(const unsigned char* pixels, int w, int h, int channels, unsigned char* out, int out_size)
+{
+    if (pixels == NULL || out == NULL || w <= 0 || h <= 0 || (channels != 3 && channels != 4)
+        || out_size < getMaxSize(w, h, channels))
+        return VMI_E_INVALID_PARAMETER;
+
+    memcpy(out, "qoif", 4);
+    write32(out + 4, (unsigned int)w);
+    write32(out + 8, (unsigned int)h);
+    out[12] = (unsigned char)channels;
+    out[13] = 0;    /* sRGB */
+    int pos = QOI_HEADER_SIZE;
+
+    tQOIPixel index[64];
+    memset(index, 0, sizeof(index));
+    tQOIPixel prev = { 0, 0, 0, 255 };
+    tQOIPixel px = prev;
+    int run = 0;
+    int size = w * h * channels;
+
+    for (int i = 0; i < size; i += channels) {
+        px.r = pixels[i];
+        px.g = pixels[i + 1];
+        px.b = pixels[i + 2];
+        if (channels == 4)
+            px.a = pixels[i + 3];
+
+        if (px == prev) {
+            run++;
+            if (run == QOI_MAX_RUN || i + channels == size) {
+                out[pos++] = (unsigned char)(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out[pos++] = (unsigned char)(QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        int idx = px.hash();
+        if (index[idx] == px) {
+            out[pos++] = (unsigned char)(QOI_OP_INDEX | idx);
+        }
+        else {
+            index[idx] = px;
+            if (px.a == prev.a) {
+                signed char vr = (signed char)(px.r - prev.r);
+                signed char vg = (signed char)(px.g - prev.g);
+                signed char vb = (signed char)(px.b - prev.b);
+                signed char vgr = (signed char)(vr - vg);
+                signed char vgb = (signed char)(vb - vg);
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    out[pos++] = (unsigned char)(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+                }
+                else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                    out[pos++] = (unsigned char)(QOI_OP_LUMA | (vg + 32));
+                    out[pos++] = (unsigned char)(((vgr + 8) << 4) | (vgb + 8));
+                }
+                else {
+                    out[pos++] = QOI_OP_RGB;
+                    out[pos++] = px.r;
+                    out[pos++] = px.g;
+                    out[pos++] = px.b;
+                }
+            }
+            else {
+                out[pos++] = QOI_OP_RGBA;
+                out[pos++] = px.r;
+                out[pos++] = px.g;
+                out[pos++] = px.b;
+                out[pos++] = px.a;
+            }
+        }
+        prev = px;
+    }
+
+    memcpy(out + pos, g_padding, QOI_PADDING_SIZE);
+    return pos + QOI_PADDING_SIZE;
+}
+
+/*!
+* \fn decode
+* \brief decode an image to RGB or RGBA pixels
+*
+* \param in encoded image
+* \param in_size size of in
+* \param pixels decoded pixels
+* \param pixels_size size of pixels, at least w*h*channels
+* \param channels 3 (RGB) or 4 (RGBA), whatever the channels of the encoded image
+* \param w width of the image
+* \param h height of the image
+* \return size of the decoded pixels, VMI_E_INVALID_PARAMETER if the image is invalid or too large
+*/
+int qoi::decode(const unsigned char* in, int in_size, unsigned char* pixels, int pixels_size, int channels, int* w, int* h)
+{
+    if (in == NULL || pixels == NULL || w == NULL || h == NULL || (channels != 3 && channels != 4)
+        || in_size < QOI_HEADER_SIZE + QOI_PADDING_SIZE || memcmp(in, "qoif", 4) != 0)
+        return VMI_E_INVALID_PARAMETER;
+
+    unsigned int width = read32(in + 4);
+    unsigned int height = read32(in + 8);
+    if (width == 0 || height == 0 || (long long)width * height * channels > pixels_size) {
+        LOG_ERROR("invalid image size %ux%u for a buffer of %d bytes", width, height, pixels_size);
+        return VMI_E_INVALID_PARAMETER;
+    }
+    *w = (int)width;
+    *h = (int)height;
+
+    tQOIPixel index[64];
+    memset(index, 0, sizeof(index));
+    tQOIPixel px = { 0, 0, 0, 255 };
+    int run = 0;
+    int pos = QOI_HEADER_SIZE;
+    int end = in_size - QOI_PADDING_SIZE;
+    int size = (int)(width * height) * channels;
+
+    for (int i = 0; i < size; i += channels) {
+        if (run > 0) {
+            run--;
+        }
+        else if (pos < end) {
+            int b1 = in[pos++];
+            if (b1 == QOI_OP_RGB) {
+                px.r = in[pos];
+                px.g = in[pos + 1];
+                px.b = in[pos + 2];
+                pos += 3;
+            }
+            else if (b1 == QOI_OP_RGBA) {
+                px.r = in[pos];
+                px.g = in[pos + 1];
+                px.b = in[pos + 2];
+                px.a = in[pos + 3];
+                pos += 4;
+            }
+            else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                px = index[b1];
+            }
+            else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                px.r += ((b1 >> 4) & 0x03) - 2;
+                px.g += ((b1 >> 2) & 0x03) - 2;
+                px.b += (b1 & 0x03) - 2;
+            }
+            else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                int b2 = in[pos++];
+                int vg = (b1 & 0x3F) - 32;
+                px.r += vg - 8 + ((b2 >> 4) & 0x0F);
+                px.g += vg;
+                px.b += vg - 8 + (b2 & 0x0F);
+            }
+            else {
+                run = (b1 & 0x3F);
+            }
+            index[px.hash()] = px;
+        }
+
+        pixels[i] = px.r;
+        pixels[i + 1] = px.g;
+        pixels[i + 2] = px.b;
+        if (channels == 4)
+            pixels[i + 3] = px.a;
+    }
+    return size;
+}
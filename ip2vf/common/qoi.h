@@ -0,0 +1,31 @@
+#ifndef _QOI_H
+#define _QOI_H
+
+#ifdef _WIN32
+
+#ifdef VMILIBRARY_EXPORTS
+#define VMILIBRARY_API_QOI __declspec(dllexport)
+#else
+#define VMILIBRARY_API_QOI __declspec(dllimport)
+#endif
+
+#else
+#define VMILIBRARY_API_QOI
+#endif
+
+#define QOI_HEADER_SIZE     14
+#define QOI_PADDING_SIZE    8
+
+/*
+* QOI image format ("Quite OK Image", https://qoiformat.org): lossless RGB/RGBA compression in a
+* single pass, with a 64 entries table of the previous pixels, small differences and runs.
+*/
+namespace qoi
+{
+    // Max size of the encoded image, the size of the buffer to give to encode()
+    VMILIBRARY_API_QOI int  getMaxSize(int w, int h, int channels);
+    VMILIBRARY_API_QOI int  encode(const unsigned char* pixels, int w, int h, int channels, unsigned char* out, int out_size);
+    VMILIBRARY_API_QOI int  decode(const unsigned char* in, int in_size, unsigned char* pixels, int pixels_size, int channels, int* w, int* h);
+}
+
+#endif //_QOI_H
@@ -0,0 +1,70 @@
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#ifndef _WIN32
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "ringqueue.h"
+
+static_assert(sizeof(std::atomic<unsigned int>) == sizeof(unsigned int), "futex word must be a plain 32 bits integer");
+
+/**********************************************************************************************
+*
+* CQueueWaiter
+*
+***********************************************************************************************/
+
+/*!
+* \fn prepareWait
+* \brief register the consumer as a waiter, before it checks the queue a last time
+*
+* \return key to give to wait(), or cancelWait() if the queue is not empty anymore
+*/
+unsigned int CQueueWaiter::prepareWait() {
+
+    _nbWaiters++;
+    // Seen by the producers before the consumer checks the queue, see notify()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return _seq.load();
+}
+
+/*!
+* \fn wait
+* \brief wait for a notify() after prepareWait(), or timeout
+*
+* \param key value returned by prepareWait()
+* \param timeoutInMs max time to wait
+*/
+void CQueueWaiter::wait(unsigned int key, int timeoutInMs) {
+
+#ifdef _WIN32
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        _cv.wait_for(lock, std::chrono::milliseconds(timeoutInMs), [&] { return _seq.load() != key; });
+    }
+#else
+    struct timespec ts;
+    ts.tv_sec = timeoutInMs / 1000;
+    ts.tv_nsec = (timeoutInMs % 1000) * 1000000L;
+    syscall(SYS_futex, (unsigned int*)&_seq, FUTEX_WAIT_PRIVATE, key, &ts, NULL, 0);
+#endif
+    _nbWaiters--;
+}
+
+void CQueueWaiter::_wake() {
+
+#ifdef _WIN32
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _seq++;
+    }
+    _cv.notify_all();
+#else
+    _seq++;
+    syscall(SYS_futex, (unsigned int*)&_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
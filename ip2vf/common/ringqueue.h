@@ -0,0 +1,325 @@
+#ifndef _RINGQUEUE_H
+#define _RINGQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <utility>
+#ifdef _WIN32
+#include <mutex>
+#include <condition_variable>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>  // _mm_pause
+#endif
+
+#define RING_QUEUE_DEFAULT_SIZE 64
+#define RING_QUEUE_MIN_SPIN     16      /* tries of pop() before sleeping, adapted between min and max */
+#define RING_QUEUE_MAX_SPIN     4096
+
+/**********************************************************************************************
+*
+* CQueueWaiter
+*
+* Event count the consumer of a ring queue sleeps on when the queue is empty. The consumer takes
+* a key with prepareWait(), checks the queue again, then waits for the count to change. The
+* producers only make a system call if the consumer sleeps. On Linux the wait is a private futex
+* on the count.
+*
+***********************************************************************************************/
+class CQueueWaiter
+{
+    std::atomic<unsigned int>   _seq;
+    std::atomic<int>            _nbWaiters;
+#ifdef _WIN32
+    std::mutex                  _mtx;
+    std::condition_variable     _cv;
+#endif
+
+    void _wake();
+
+public:
+    CQueueWaiter() : _seq(0), _nbWaiters(0) {};
+
+    unsigned int prepareWait();
+    void cancelWait() { _nbWaiters--; };
+    void wait(unsigned int key, int timeoutInMs);
+    void notify() {
+        // The item is published before the waiters are checked, see prepareWait()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_nbWaiters.load(std::memory_order_relaxed) > 0)
+            _wake();
+    };
+    void wakeUp() { _wake(); };
+};
+
+/**********************************************************************************************
+*
+* CRingQueueBase
+*
+* Capacity, counters and wait of the bounded ring queues below. The capacity is rounded up to a
+* power of 2. A push on a full queue fails and is counted as an overflow: the producer decides
+* what to drop, the queue never grows. The high water is the max number of items seen queued.
+*
+***********************************************************************************************/
+class CRingQueueBase
+{
+protected:
+    unsigned int            _capacity;
+    unsigned int            _mask;
+    std::atomic<int>        _highWater;
+    std::atomic<long long>  _nbOverflows;
+    CQueueWaiter            _waiter;
+    int                     _spin;          /* current tries of pop() before sleeping */
+
+    CRingQueueBase() : _capacity(0), _mask(0), _highWater(0), _nbOverflows(0), _spin(RING_QUEUE_MIN_SPIN) {};
+
+    static unsigned int _roundCapacity(int capacity) {
+        unsigned int size = 1;
+        while (size < (unsigned int)capacity && size < (1u << 30))
+            size *= 2;
+        return size;
+    };
+
+    static void _cpuRelax() {
+#if defined(__SSE2__) || defined(_M_X64)
+        _mm_pause();
+#endif
+    };
+
+    void _onPush(unsigned int used) {
+        int high = _highWater.load(std::memory_order_relaxed);
+        while ((int)used > high && !_highWater.compare_exchange_weak(high, (int)used, std::memory_order_relaxed))
+            ;
+        _waiter.notify();
+    };
+
+    void _onOverflow() { _nbOverflows.fetch_add(1, std::memory_order_relaxed); };
+
+    /*!
+    * \fn _pop
+    * \brief try, spin, then sleep until an item is pushed. The spin is doubled when it gets an
+    * item and halved when the consumer has to sleep, so a queue fed at packet rate is not
+    * slept on, and a queue fed at frame rate does not burn the CPU.
+    *
+    * \param tryPop non blocking pop of the derived queue
+    * \param timeoutInMs max time to sleep
+    * \return true if an item has been popped
+    */
+    template <class F>
+    bool _pop(F tryPop, int timeoutInMs) {
+        for (int i = 0; i < _spin; i++) {
+            if (tryPop()) {
+                if (i > 0 && _spin < RING_QUEUE_MAX_SPIN)
+                    _spin *= 2;
+                return true;
+            }
+            _cpuRelax();
+        }
+        if (_spin > RING_QUEUE_MIN_SPIN)
+            _spin /= 2;
+        unsigned int key = _waiter.prepareWait();
+        if (tryPop()) {
+            _waiter.cancelWait();
+            return true;
+        }
+        _waiter.wait(key, timeoutInMs);
+        return tryPop();
+    };
+
+public:
+    int  getCapacity() { return (int)_capacity; };
+    int  getHighWater() { return _highWater.load(); };
+    long long getOverflowsNb() { return _nbOverflows.load(); };
+    void resetCounters() { _highWater = 0; _nbOverflows = 0; };
+
+    /*!
+    * \fn wakeUp
+    * \brief make a sleeping pop() return, i.e. to stop its thread
+    */
+    void wakeUp() { _waiter.wakeUp(); };
+};
+
+/**********************************************************************************************
+*
+* CSpscQueue
+*
+* Bounded queue with one producer thread and one consumer thread, without lock: each side only
+* writes its own index. init() is not thread safe, call it before the threads use the queue.
+*
+***********************************************************************************************/
+template <typename T>
+class CSpscQueue : public CRingQueueBase
+{
+    std::vector<T>              _items;
+    char                        _pad0[64];
+    std::atomic<unsigned int>   _head;      /* next written, by the producer */
+    char                        _pad1[64];
+    std::atomic<unsigned int>   _tail;      /* next read, by the consumer */
+
+public:
+    CSpscQueue(int capacity = RING_QUEUE_DEFAULT_SIZE) : _head(0), _tail(0) { init(capacity); };
+
+    void init(int capacity) {
+        _capacity = _roundCapacity(capacity);
+        _mask = _capacity - 1;
+        _items.assign(_capacity, T());
+        _head = 0;
+        _tail = 0;
+        resetCounters();
+    };
+
+    int size() {
+        unsigned int used = _head.load() - _tail.load();
+        return (int)(used > _capacity ? _capacity : used);
+    };
+
+    bool tryPush(const T& value) {
+        unsigned int head = _head.load(std::memory_order_relaxed);
+        unsigned int used = head - _tail.load(std::memory_order_acquire);
+        if (used >= _capacity) {
+            _onOverflow();
+            return false;
+        }
+        _items[head & _mask] = value;
+        _head.store(head + 1, std::memory_order_release);
+        _onPush(used + 1);
+        return true;
+    };
+
+    bool tryPop(T* value) {
+        unsigned int tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+            return false;
+        *value = std::move(_items[tail & _mask]);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    };
+
+    /*!
+    * \fn tryPopBatch
+    * \brief pop up to maxItems items, with one update of the read index
+    *
+    * \return nb of items popped
+    */
+    int tryPopBatch(T* values, int maxItems) {
+        unsigned int tail = _tail.load(std::memory_order_relaxed);
+        unsigned int used = _head.load(std::memory_order_acquire) - tail;
+        int count = (int)(used < (unsigned int)maxItems ? used : (unsigned int)maxItems);
+        for (int i = 0; i < count; i++)
+            values[i] = std::move(_items[(tail + i) & _mask]);
+        if (count > 0)
+            _tail.store(tail + count, std::memory_order_release);
+        return count;
+    };
+
+    /*!
+    * \fn pop
+    * \brief pop an item, wait for it if the queue is empty
+    *
+    * \param value popped item
+    * \param timeoutInMs max time to wait. The wait can end earlier, see wakeUp()
+    * \return true if an item has been popped
+    */
+    bool pop(T* value, int timeoutInMs) {
+        return _pop([=] { return tryPop(value); }, timeoutInMs);
+    };
+};
+
+/**********************************************************************************************
+*
+* CMpscQueue
+*
+* Bounded queue with several producer threads and one consumer thread, without lock. Each slot
+* has a sequence number telling if it can be written or read for the current turn of the ring:
+* the producers take a slot by incrementing the write index with a CAS, and the consumer waits
+* for the slot to be published.
+*
+***********************************************************************************************/
+template <typename T>
+class CMpscQueue : public CRingQueueBase
+{
+    struct tCell {
+        std::atomic<unsigned int>   seq;
+        T                           value;
+    };
+    tCell*                      _cells;
+    char                        _pad0[64];
+    std::atomic<unsigned int>   _head;      /* next written, by the producers */
+    char                        _pad1[64];
+    std::atomic<unsigned int>   _tail;      /* next read, by the consumer */
+
+    CMpscQueue(const CMpscQueue&);
+    CMpscQueue& operator=(const CMpscQueue&);
+
+public:
+    CMpscQueue(int capacity = RING_QUEUE_DEFAULT_SIZE) : _cells(NULL), _head(0), _tail(0) { init(capacity); };
+    ~CMpscQueue() { delete[] _cells; };
+
+    void init(int capacity) {
+        delete[] _cells;
+        _capacity = _roundCapacity(capacity);
+        _mask = _capacity - 1;
+        _cells = new tCell[_capacity];
+        for (unsigned int i = 0; i < _capacity; i++)
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        _head = 0;
+        _tail = 0;
+        resetCounters();
+    };
+
+    int size() {
+        unsigned int used = _head.load() - _tail.load();
+        return (int)(used > _capacity ? _capacity : used);
+    };
+
+    bool tryPush(const T& value) {
+        unsigned int pos = _head.load(std::memory_order_relaxed);
+        tCell* cell;
+        while (true) {
+            cell = &_cells[pos & _mask];
+            int diff = (int)(cell->seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) {
+                // Not read yet since the previous turn
+                _onOverflow();
+                return false;
+            }
+            else
+                pos = _head.load(std::memory_order_relaxed);
+        }
+        cell->value = value;
+        // Read before publishing the slot: the consumer can't be past it
+        unsigned int used = pos + 1 - _tail.load(std::memory_order_relaxed);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        _onPush(used);
+        return true;
+    };
+
+    bool tryPop(T* value) {
+        unsigned int pos = _tail.load(std::memory_order_relaxed);
+        tCell* cell = &_cells[pos & _mask];
+        if (cell->seq.load(std::memory_order_acquire) != pos + 1)
+            return false;
+        *value = std::move(cell->value);
+        cell->seq.store(pos + _capacity, std::memory_order_release);
+        _tail.store(pos + 1, std::memory_order_release);
+        return true;
+    };
+
+    int tryPopBatch(T* values, int maxItems) {
+        int count = 0;
+        while (count < maxItems && tryPop(&values[count]))
+            count++;
+        return count;
+    };
+
+    bool pop(T* value, int timeoutInMs) {
+        return _pop([=] { return tryPop(value); }, timeoutInMs);
+    };
+};
+
+#endif //_RINGQUEUE_H
@@ -49,11 +49,15 @@ public:
         return _m==1; 
     };
 
-    CHBRMPFrame* getHBRMPFrame() {
-        return new CHBRMPFrame((_frame + RTP_HEADERS_LENGTH), _framelen- RTP_HEADERS_LENGTH);
+    /**
+     * Give access to the payload headers, parsed in place over the packet buffer (no allocation)
+     */
+    void getHBRMPFrame(CHBRMPFrame& hbrmp) {
+        hbrmp.setBuffer((_frame + RTP_HEADERS_LENGTH), _framelen - RTP_HEADERS_LENGTH);
+        hbrmp.readHeader();
     };
-    CTR03Frame* getTR03Frame() {
-        return new CTR03Frame((_frame + RTP_HEADERS_LENGTH), _framelen - RTP_HEADERS_LENGTH);
+    void getTR03Frame(CTR03Frame& tr03) {
+        tr03.setBuffer((_frame + RTP_HEADERS_LENGTH), _framelen - RTP_HEADERS_LENGTH);
     };
 
     
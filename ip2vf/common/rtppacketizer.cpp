@@ -25,22 +25,27 @@ CRTPPacketizer::CRTPPacketizer(int mtu) : _mtu(mtu) {
     _seq = 0;
 }
 
-int CRTPPacketizer::send(UDP* sock, char* mediabuffer, int mediabuffersize, int payloadtype) {
+int CRTPPacketizer::send(UDP* sock, char* mediabuffer, int mediabuffersize, int payloadtype, float frameRate, float activeRatio) {
 
     if (sock && sock->isValid())
     {
-        CRTPFrame frame((unsigned char*)_RTPframe, _RTPPacketSize);
+        CRTPFrame frame;
         int bEndOfFrame = false;
         int remainingLen = mediabuffersize;
         char* p = mediabuffer;
 
+        // Spread the packets of the frame over the frame period, if the socket is paced
+        sock->startFrame((mediabuffersize + _RTPPayloadSize - 1) / _RTPPayloadSize, frameRate, activeRatio);
+
         while (remainingLen>0) {
 
-            int len, result, marker = 0;
+            int result, marker = 0;
 
-            // First, construct the full RTP frame
+            // First, construct the full RTP frame, directly in the send batch of the socket
+            char* packet = sock->getSendBuffer();
+            frame.setBuffer((unsigned char*)packet, _RTPPacketSize);
             int payloadLen = MIN(remainingLen, _RTPPayloadSize);
-            memcpy(_RTPframe + RTP_HEADERS_LENGTH, p, payloadLen);
+            memcpy(packet + RTP_HEADERS_LENGTH, p, payloadLen);
             remainingLen -= payloadLen;
             p += payloadLen;
             if (remainingLen == 0)
@@ -49,22 +54,19 @@ int CRTPPacketizer::send(UDP* sock, char* mediabuffer, int mediabuffersize, int
             _seq = (_seq + 1) % 65536;
             if (payloadLen < _RTPPayloadSize) {
                 LOG("padding payload=%d", _RTPPayloadSize - payloadLen);
-                ::memset(_RTPframe + RTP_HEADERS_LENGTH + payloadLen, 0, _RTPPayloadSize - payloadLen);
+                ::memset(packet + RTP_HEADERS_LENGTH + payloadLen, 0, _RTPPayloadSize - payloadLen);
             }
-            //frame.dumpHeader((char*)_RTPframe);
+            //frame.dumpHeader((char*)packet);
 
-            // Then send UDP packet
-            len = _RTPPacketSize;
-            result = sock->writeSocket(_RTPframe, &len);
-            if (result != -1) {
-                LOG("write (size=%d) to socket, result=%d, RTP packet #%d, payloadlen=%d, remaining=%d",
-                    len, result, frame._seq, payloadLen, remainingLen);
-            }
-            else {
-                LOG_ERROR("error write (size=%d) to socket, result=%d, RTP packet #%d, payloadlen=%d, remaining=%d",
-                    len, result, frame._seq, payloadLen, remainingLen);
+            // Then queue the UDP packet, the batch is sent when full or at the end of the frame
+            result = sock->queueSendBuffer(_RTPPacketSize);
+            if (result == -1 || (remainingLen == 0 && sock->flushSendBuffer() == -1)) {
+                LOG_ERROR("error write (size=%d) to socket, RTP packet #%d, payloadlen=%d, remaining=%d",
+                    _RTPPacketSize, frame._seq, payloadLen, remainingLen);
                 return VMI_E_FAILED_TO_SND_SOCKET;
             }
+            LOG("write (size=%d) to socket, RTP packet #%d, payloadlen=%d, remaining=%d",
+                _RTPPacketSize, frame._seq, payloadLen, remainingLen);
         }
     }
     return VMI_E_OK;
@@ -21,7 +21,6 @@ class CRTPPacketizer
 {
 protected:
     int     _mtu;
-    char    _RTPframe[RTP_MAX_FRAME_LENGTH];
     int     _UDPPacketSize;
     int     _RTPPacketSize;
     int     _RTPPayloadSize;
@@ -32,7 +31,7 @@ public:
     ~CRTPPacketizer() {};
 
 public:
-    int  send(UDP* sock, char* mediabuffer, int mediabuffersize, int payloadtype);
+    int  send(UDP* sock, char* mediabuffer, int mediabuffersize, int payloadtype, float frameRate = 0.0f, float activeRatio = 1.0f);
 };
 
 #endif // _RTPPACKETIZER_H
@@ -0,0 +1,563 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "log.h"
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa)    __attribute__((target(isa)))
+#endif
+#endif
+
+static int g_maxLevel = SIMD_LEVEL_AVX512;
+
+static int detectLevel()
+{
+    int level = SIMD_LEVEL_NONE;
+#if defined(SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxId = info[0];
+    __cpuid(info, 1);
+    bool ssse3 = (info[2] & (1 << 9)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    unsigned long long xcr0 = (osxsave ? _xgetbv(0) : 0);
+    bool avx2 = false, avx512 = false;
+    if (maxId >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    }
+    if (ssse3)
+        level = SIMD_LEVEL_SSSE3;
+    if (avx2)
+        level = SIMD_LEVEL_AVX2;
+    if (avx512)
+        level = SIMD_LEVEL_AVX512;
+#elif defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+        level = SIMD_LEVEL_SSSE3;
+    if (__builtin_cpu_supports("avx2"))
+        level = SIMD_LEVEL_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        level = SIMD_LEVEL_AVX512;
+#endif
+    LOG_INFO("SIMD level=%d", level);
+    return level;
+}
+
+/*!
+* \fn getLevel
+* \brief instruction set used by the kernels: the best one supported by the CPU, up to the max level
+*
+* \return SIMD_LEVEL_xxx
+*/
+int simd::getLevel()
+{
+    static const int detected = detectLevel();
+    return (detected < g_maxLevel ? detected : g_maxLevel);
+}
+
+/*!
+* \fn setMaxLevel
+* \brief limit the instruction set used by the kernels, i.e. to compare them
+*
+* \param level SIMD_LEVEL_xxx
+*/
+void simd::setMaxLevel(int level)
+{
+    g_maxLevel = level;
+}
+
+#ifdef SIMD_X86
+
+/*
+* Packed 10 bits -> 8 bits: the 8 bits sample k (0..3) of a 5 bytes group is the byte of the
+* big endian word (in[k], in[k+1]) shifted right by 8-2k. Each 16 bits lane gets its word (pshufb),
+* is shifted left by 2k (multiply) then right by 8.
+*/
+#define SHUF_10TO8      1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8
+#define MUL_10TO8       1, 4, 16, 64, 1, 4, 16, 64
+
+SIMD_TARGET("ssse3")
+static int convert10bitsto8bits_ssse3(const unsigned char* in, int in_size, unsigned char* out)
+{
+    const __m128i shuf = _mm_setr_epi8(SHUF_10TO8);
+    const __m128i mul  = _mm_setr_epi16(MUL_10TO8);
+    int done = 0;
+    // 20 bytes -> 16 samples. The loads read 6 bytes after them.
+    while (in_size - done >= 26) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in + done));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in + done + 10));
+        a = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(a, shuf), mul), 8);
+        b = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(b, shuf), mul), 8);
+        _mm_storeu_si128((__m128i*)(out + done / 5 * 4), _mm_packus_epi16(a, b));
+        done += 20;
+    }
+    return done;
+}
+
+SIMD_TARGET("avx2")
+static int convert10bitsto8bits_avx2(const unsigned char* in, int in_size, unsigned char* out)
+{
+    const __m256i shuf = _mm256_setr_epi8(SHUF_10TO8, SHUF_10TO8);
+    const __m256i mul  = _mm256_setr_epi16(MUL_10TO8, MUL_10TO8);
+    int done = 0;
+    // 40 bytes -> 32 samples, 10 bytes per 128 bits lane
+    while (in_size - done >= 46) {
+        __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + done))),
+            _mm_loadu_si128((const __m128i*)(in + done + 10)), 1);
+        __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + done + 20))),
+            _mm_loadu_si128((const __m128i*)(in + done + 30)), 1);
+        a = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(a, shuf), mul), 8);
+        b = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(b, shuf), mul), 8);
+        // packus works per lane: put the 64 bits blocks back in order
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + done / 5 * 4), r);
+        done += 40;
+    }
+    return done;
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static int convert10bitsto8bits_avx512(const unsigned char* in, int in_size, unsigned char* out)
+{
+    const __m512i shuf = _mm512_broadcast_i32x4(_mm_setr_epi8(SHUF_10TO8));
+    const __m512i mul  = _mm512_broadcast_i32x4(_mm_setr_epi16(MUL_10TO8));
+    int done = 0;
+    // 80 bytes -> 64 samples, 10 bytes per 128 bits lane
+    while (in_size - done >= 86) {
+        __m512i a = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)(in + done)));
+        a = _mm512_inserti32x4(a, _mm_loadu_si128((const __m128i*)(in + done + 10)), 1);
+        a = _mm512_inserti32x4(a, _mm_loadu_si128((const __m128i*)(in + done + 20)), 2);
+        a = _mm512_inserti32x4(a, _mm_loadu_si128((const __m128i*)(in + done + 30)), 3);
+        __m512i b = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)(in + done + 40)));
+        b = _mm512_inserti32x4(b, _mm_loadu_si128((const __m128i*)(in + done + 50)), 1);
+        b = _mm512_inserti32x4(b, _mm_loadu_si128((const __m128i*)(in + done + 60)), 2);
+        b = _mm512_inserti32x4(b, _mm_loadu_si128((const __m128i*)(in + done + 70)), 3);
+        a = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_shuffle_epi8(a, shuf), mul), 8);
+        b = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_shuffle_epi8(b, shuf), mul), 8);
+        _mm256_storeu_si256((__m256i*)(out + done / 5 * 4), _mm512_cvtepi16_epi8(a));
+        _mm256_storeu_si256((__m256i*)(out + done / 5 * 4 + 32), _mm512_cvtepi16_epi8(b));
+        done += 80;
+    }
+    return done;
+}
+
+/*
+* Packed 10 bits -> accumulators: the samples are unpacked as for the 8 bits conversion, but
+* shifted right by 6 instead of 8, then widened to 32 bits and added.
+*/
+SIMD_TARGET("ssse3")
+static int accumulate10bits_ssse3(const unsigned char* in, int in_size, unsigned int* acc)
+{
+    const __m128i shuf = _mm_setr_epi8(SHUF_10TO8);
+    const __m128i mul  = _mm_setr_epi16(MUL_10TO8);
+    const __m128i zero = _mm_setzero_si128();
+    int done = 0;
+    // 10 bytes -> 8 samples. The load reads 6 bytes after them.
+    while (in_size - done >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + done));
+        v = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(v, shuf), mul), 6);
+        __m128i* a = (__m128i*)(acc + done / 5 * 4);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+        done += 10;
+    }
+    return done;
+}
+
+SIMD_TARGET("avx2")
+static int accumulate10bits_avx2(const unsigned char* in, int in_size, unsigned int* acc)
+{
+    const __m256i shuf = _mm256_setr_epi8(SHUF_10TO8, SHUF_10TO8);
+    const __m256i mul  = _mm256_setr_epi16(MUL_10TO8, MUL_10TO8);
+    int done = 0;
+    // 20 bytes -> 16 samples, 10 bytes per 128 bits lane
+    while (in_size - done >= 26) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + done))),
+            _mm_loadu_si128((const __m128i*)(in + done + 10)), 1);
+        v = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(v, shuf), mul), 6);
+        __m256i* a = (__m256i*)(acc + done / 5 * 4);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v))));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1))));
+        done += 20;
+    }
+    return done;
+}
+
+/*
+* 8 bits -> packed 10 bits: the clipped samples are shifted to 10 bits words, the pairs of words
+* are merged in 20 bits (multiply-add), the pairs of 20 bits in 40 bits per 64 bits lane, then
+* the 5 bytes of each lane are written in big endian order (pshufb). The stores write 6 bytes
+* after the packed samples: these bytes are overwritten by the next samples, so the loops stop
+* before the last complete group of 4 samples.
+*/
+#define MAX_8TO10       (char)240, (char)235, (char)240, (char)235, (char)240, (char)235, (char)240, (char)235
+#define MUL_8TO10       1024, 1, 1024, 1, 1024, 1, 1024, 1
+#define SHUF_8TO10      4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1
+
+SIMD_TARGET("ssse3")
+static int convert8bitsto10bits_ssse3(const unsigned char* in, int in_size, unsigned char* out)
+{
+    const __m128i vmax  = _mm_setr_epi8(MAX_8TO10, MAX_8TO10);
+    const __m128i vmin  = _mm_set1_epi8(16);
+    const __m128i mul   = _mm_setr_epi16(MUL_8TO10);
+    const __m128i low32 = _mm_set_epi32(0, -1, 0, -1);
+    const __m128i shuf  = _mm_setr_epi8(SHUF_8TO10);
+    const __m128i zero  = _mm_setzero_si128();
+    int size = in_size & ~3;
+    int done = 0;
+    // 8 samples -> 10 bytes
+    while (size - done >= 16) {
+        __m128i v = _mm_loadl_epi64((const __m128i*)(in + done));
+        v = _mm_max_epu8(_mm_min_epu8(v, vmax), vmin);
+        v = _mm_madd_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(v, zero), 2), mul);
+        v = _mm_or_si128(_mm_slli_epi64(_mm_and_si128(v, low32), 20), _mm_srli_epi64(v, 32));
+        _mm_storeu_si128((__m128i*)(out + done / 4 * 5), _mm_shuffle_epi8(v, shuf));
+        done += 8;
+    }
+    return done;
+}
+
+SIMD_TARGET("avx2")
+static int convert8bitsto10bits_avx2(const unsigned char* in, int in_size, unsigned char* out)
+{
+    const __m128i vmax  = _mm_setr_epi8(MAX_8TO10, MAX_8TO10);
+    const __m128i vmin  = _mm_set1_epi8(16);
+    const __m256i mul   = _mm256_setr_epi16(MUL_8TO10, MUL_8TO10);
+    const __m256i low32 = _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1);
+    const __m256i shuf  = _mm256_setr_epi8(SHUF_8TO10, SHUF_8TO10);
+    int size = in_size & ~3;
+    int done = 0;
+    // 16 samples -> 20 bytes
+    while (size - done >= 24) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + done));
+        v = _mm_max_epu8(_mm_min_epu8(v, vmax), vmin);
+        __m256i w = _mm256_madd_epi16(_mm256_slli_epi16(_mm256_cvtepu8_epi16(v), 2), mul);
+        w = _mm256_or_si256(_mm256_slli_epi64(_mm256_and_si256(w, low32), 20), _mm256_srli_epi64(w, 32));
+        w = _mm256_shuffle_epi8(w, shuf);
+        unsigned char* o = out + done / 4 * 5;
+        _mm_storeu_si128((__m128i*)o, _mm256_castsi256_si128(w));
+        _mm_storeu_si128((__m128i*)(o + 10), _mm256_extracti128_si256(w, 1));
+        done += 16;
+    }
+    return done;
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static int convert8bitsto10bits_avx512(const unsigned char* in, int in_size, unsigned char* out)
+{
+    const __m256i vmax  = _mm256_setr_epi8(MAX_8TO10, MAX_8TO10, MAX_8TO10, MAX_8TO10);
+    const __m256i vmin  = _mm256_set1_epi8(16);
+    const __m512i mul   = _mm512_broadcast_i32x4(_mm_setr_epi16(MUL_8TO10));
+    const __m512i low32 = _mm512_set1_epi64(0xFFFFFFFFLL);
+    const __m512i shuf  = _mm512_broadcast_i32x4(_mm_setr_epi8(SHUF_8TO10));
+    int size = in_size & ~3;
+    int done = 0;
+    // 32 samples -> 40 bytes
+    while (size - done >= 40) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + done));
+        v = _mm256_max_epu8(_mm256_min_epu8(v, vmax), vmin);
+        __m512i w = _mm512_madd_epi16(_mm512_slli_epi16(_mm512_cvtepu8_epi16(v), 2), mul);
+        w = _mm512_or_si512(_mm512_slli_epi64(_mm512_and_si512(w, low32), 20), _mm512_srli_epi64(w, 32));
+        w = _mm512_shuffle_epi8(w, shuf);
+        unsigned char* o = out + done / 4 * 5;
+        _mm_storeu_si128((__m128i*)o, _mm512_castsi512_si128(w));
+        _mm_storeu_si128((__m128i*)(o + 10), _mm512_extracti32x4_epi32(w, 1));
+        _mm_storeu_si128((__m128i*)(o + 20), _mm512_extracti32x4_epi32(w, 2));
+        _mm_storeu_si128((__m128i*)(o + 30), _mm512_extracti32x4_epi32(w, 3));
+        done += 32;
+    }
+    return done;
+}
+
+/*
+* 4:2:2 -> RGB: the samples minus their offset are put in 16 bits lanes at the 8 bits scale << 7
+* (<< 5 for 10 bits), the chroma duplicated for the 2 pixels of a pair. Each term is multiplied
+* by its Q13 coefficient with pmulhrsw (result << 5, rounded), then the sums are rounded to 8 bits
+* and saturated. The scalar code of yuv.cpp does the same operations: the results are identical.
+*/
+#define SHUF_UYVY8_Y    1, -1, 3, -1, 5, -1, 7, -1, 9, -1, 11, -1, 13, -1, 15, -1
+#define SHUF_UYVY8_CB   0, -1, 0, -1, 4, -1, 4, -1, 8, -1, 8, -1, 12, -1, 12, -1
+#define SHUF_UYVY8_CR   2, -1, 2, -1, 6, -1, 6, -1, 10, -1, 10, -1, 14, -1, 14, -1
+// 10 bits samples of 4 pixels -> Y0..Y3, Cb0 Cb1, Cr0 Cr1
+#define SHUF_UYVY10     2, 3, 6, 7, 10, 11, 14, 15, 0, 1, 8, 9, 4, 5, 12, 13
+// Cb0 Cb1 Cr0 Cr1 Cb2 Cb3 Cr2 Cr3 -> chroma of the 8 pixels
+#define SHUF_UYVY10_CB  0, 1, 0, 1, 2, 3, 2, 3, 8, 9, 8, 9, 10, 11, 10, 11
+#define SHUF_UYVY10_CR  4, 5, 4, 5, 6, 7, 6, 7, 12, 13, 12, 13, 14, 15, 14, 15
+// RGBA -> RGB, 4 pixels per 128 bits lane
+#define SHUF_RGBA_RGB   0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+SIMD_TARGET("ssse3")
+static inline void storeRGB_ssse3(__m128i y, __m128i cb, __m128i cr, const __m128i* k, unsigned char* out, int depth, bool bgr)
+{
+    const __m128i round = _mm_set1_epi16(16);
+    __m128i yt = _mm_mulhrs_epi16(y, k[0]);
+    __m128i r = _mm_add_epi16(yt, _mm_mulhrs_epi16(cr, k[1]));
+    __m128i g = _mm_add_epi16(_mm_add_epi16(yt, _mm_mulhrs_epi16(cb, k[2])), _mm_mulhrs_epi16(cr, k[3]));
+    __m128i b = _mm_add_epi16(yt, _mm_mulhrs_epi16(cb, k[4]));
+    r = _mm_srai_epi16(_mm_add_epi16(r, round), 5);
+    g = _mm_srai_epi16(_mm_add_epi16(g, round), 5);
+    b = _mm_srai_epi16(_mm_add_epi16(b, round), 5);
+    if (bgr) {
+        __m128i t = r;
+        r = b;
+        b = t;
+    }
+    __m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+    __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_set1_epi8(-1));
+    __m128i lo = _mm_unpacklo_epi16(rg, ba);
+    __m128i hi = _mm_unpackhi_epi16(rg, ba);
+    if (depth == 4) {
+        _mm_storeu_si128((__m128i*)out, lo);
+        _mm_storeu_si128((__m128i*)(out + 16), hi);
+    }
+    else {
+        // 12 bytes per store: the second one writes 4 bytes after the 8 pixels
+        const __m128i shuf = _mm_setr_epi8(SHUF_RGBA_RGB);
+        _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(lo, shuf));
+        _mm_storeu_si128((__m128i*)(out + 12), _mm_shuffle_epi8(hi, shuf));
+    }
+}
+
+SIMD_TARGET("ssse3")
+static int convertUYVYtoRGB_ssse3(const unsigned char* in, int npixels, bool packed10, const simd::YCbCrCoefs& c,
+    unsigned char* out, int depth, bool bgr)
+{
+    const __m128i k[5] = { _mm_set1_epi16(c.y), _mm_set1_epi16(c.crR), _mm_set1_epi16(c.cbG),
+        _mm_set1_epi16(c.crG), _mm_set1_epi16(c.cbB) };
+    const __m128i yoff = _mm_set1_epi16(c.yOffset);
+    const __m128i coff = _mm_set1_epi16(c.cOffset);
+    int done = 0;
+    if (!packed10) {
+        const __m128i shufY  = _mm_setr_epi8(SHUF_UYVY8_Y);
+        const __m128i shufCb = _mm_setr_epi8(SHUF_UYVY8_CB);
+        const __m128i shufCr = _mm_setr_epi8(SHUF_UYVY8_CR);
+        // 16 bytes -> 8 pixels, 2 more pixels for the RGB stores
+        int need = (depth == 4 ? 8 : 10);
+        while (npixels - done >= need) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(in + done * 2));
+            __m128i y  = _mm_slli_epi16(_mm_sub_epi16(_mm_shuffle_epi8(v, shufY), yoff), 7);
+            __m128i cb = _mm_slli_epi16(_mm_sub_epi16(_mm_shuffle_epi8(v, shufCb), coff), 7);
+            __m128i cr = _mm_slli_epi16(_mm_sub_epi16(_mm_shuffle_epi8(v, shufCr), coff), 7);
+            storeRGB_ssse3(y, cb, cr, k, out + done * depth, depth, bgr);
+            done += 8;
+        }
+    }
+    else {
+        const __m128i shuf   = _mm_setr_epi8(SHUF_10TO8);
+        const __m128i mul    = _mm_setr_epi16(MUL_10TO8);
+        const __m128i shufS  = _mm_setr_epi8(SHUF_UYVY10);
+        const __m128i shufCb = _mm_setr_epi8(SHUF_UYVY10_CB);
+        const __m128i shufCr = _mm_setr_epi8(SHUF_UYVY10_CR);
+        // 20 bytes -> 8 pixels. The loads read 6 bytes after them.
+        while (npixels - done >= 12) {
+            const unsigned char* p = in + done / 2 * 5;
+            __m128i a = _mm_loadu_si128((const __m128i*)p);
+            __m128i b = _mm_loadu_si128((const __m128i*)(p + 10));
+            a = _mm_shuffle_epi8(_mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(a, shuf), mul), 6), shufS);
+            b = _mm_shuffle_epi8(_mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(b, shuf), mul), 6), shufS);
+            __m128i ch = _mm_unpackhi_epi64(a, b);
+            __m128i y  = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi64(a, b), yoff), 5);
+            __m128i cb = _mm_slli_epi16(_mm_sub_epi16(_mm_shuffle_epi8(ch, shufCb), coff), 5);
+            __m128i cr = _mm_slli_epi16(_mm_sub_epi16(_mm_shuffle_epi8(ch, shufCr), coff), 5);
+            storeRGB_ssse3(y, cb, cr, k, out + done * depth, depth, bgr);
+            done += 8;
+        }
+    }
+    return done;
+}
+
+SIMD_TARGET("avx2")
+static inline void storeRGB_avx2(__m256i y, __m256i cb, __m256i cr, const __m256i* k, unsigned char* out, int depth, bool bgr)
+{
+    const __m256i round = _mm256_set1_epi16(16);
+    __m256i yt = _mm256_mulhrs_epi16(y, k[0]);
+    __m256i r = _mm256_add_epi16(yt, _mm256_mulhrs_epi16(cr, k[1]));
+    __m256i g = _mm256_add_epi16(_mm256_add_epi16(yt, _mm256_mulhrs_epi16(cb, k[2])), _mm256_mulhrs_epi16(cr, k[3]));
+    __m256i b = _mm256_add_epi16(yt, _mm256_mulhrs_epi16(cb, k[4]));
+    r = _mm256_srai_epi16(_mm256_add_epi16(r, round), 5);
+    g = _mm256_srai_epi16(_mm256_add_epi16(g, round), 5);
+    b = _mm256_srai_epi16(_mm256_add_epi16(b, round), 5);
+    if (bgr) {
+        __m256i t = r;
+        r = b;
+        b = t;
+    }
+    // Per 128 bits lane: 8 pixels -> 4 pixels in lo, 4 in hi
+    __m256i rg = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), _mm256_packus_epi16(g, g));
+    __m256i ba = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), _mm256_set1_epi8(-1));
+    __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+    __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+    __m256i p0 = _mm256_permute2x128_si256(lo, hi, 0x20);
+    __m256i p1 = _mm256_permute2x128_si256(lo, hi, 0x31);
+    if (depth == 4) {
+        _mm256_storeu_si256((__m256i*)out, p0);
+        _mm256_storeu_si256((__m256i*)(out + 32), p1);
+    }
+    else {
+        // 12 bytes per store: the last one writes 4 bytes after the 16 pixels
+        const __m256i shuf = _mm256_setr_epi8(SHUF_RGBA_RGB, SHUF_RGBA_RGB);
+        p0 = _mm256_shuffle_epi8(p0, shuf);
+        p1 = _mm256_shuffle_epi8(p1, shuf);
+        _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(p0));
+        _mm_storeu_si128((__m128i*)(out + 12), _mm256_extracti128_si256(p0, 1));
+        _mm_storeu_si128((__m128i*)(out + 24), _mm256_castsi256_si128(p1));
+        _mm_storeu_si128((__m128i*)(out + 36), _mm256_extracti128_si256(p1, 1));
+    }
+}
+
+SIMD_TARGET("avx2")
+static int convertUYVYtoRGB_avx2(const unsigned char* in, int npixels, bool packed10, const simd::YCbCrCoefs& c,
+    unsigned char* out, int depth, bool bgr)
+{
+    const __m256i k[5] = { _mm256_set1_epi16(c.y), _mm256_set1_epi16(c.crR), _mm256_set1_epi16(c.cbG),
+        _mm256_set1_epi16(c.crG), _mm256_set1_epi16(c.cbB) };
+    const __m256i yoff = _mm256_set1_epi16(c.yOffset);
+    const __m256i coff = _mm256_set1_epi16(c.cOffset);
+    int done = 0;
+    if (!packed10) {
+        const __m256i shufY  = _mm256_setr_epi8(SHUF_UYVY8_Y, SHUF_UYVY8_Y);
+        const __m256i shufCb = _mm256_setr_epi8(SHUF_UYVY8_CB, SHUF_UYVY8_CB);
+        const __m256i shufCr = _mm256_setr_epi8(SHUF_UYVY8_CR, SHUF_UYVY8_CR);
+        // 32 bytes -> 16 pixels, 2 more pixels for the RGB stores
+        int need = (depth == 4 ? 16 : 18);
+        while (npixels - done >= need) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(in + done * 2));
+            __m256i y  = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_shuffle_epi8(v, shufY), yoff), 7);
+            __m256i cb = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_shuffle_epi8(v, shufCb), coff), 7);
+            __m256i cr = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_shuffle_epi8(v, shufCr), coff), 7);
+            storeRGB_avx2(y, cb, cr, k, out + done * depth, depth, bgr);
+            done += 16;
+        }
+    }
+    else {
+        const __m256i shuf   = _mm256_setr_epi8(SHUF_10TO8, SHUF_10TO8);
+        const __m256i mul    = _mm256_setr_epi16(MUL_10TO8, MUL_10TO8);
+        const __m256i shufS  = _mm256_setr_epi8(SHUF_UYVY10, SHUF_UYVY10);
+        const __m256i shufCb = _mm256_setr_epi8(SHUF_UYVY10_CB, SHUF_UYVY10_CB);
+        const __m256i shufCr = _mm256_setr_epi8(SHUF_UYVY10_CR, SHUF_UYVY10_CR);
+        // 40 bytes -> 16 pixels, 8 pixels per 128 bits lane. The loads read 6 bytes after them.
+        while (npixels - done >= 20) {
+            const unsigned char* p = in + done / 2 * 5;
+            __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+                _mm_loadu_si128((const __m128i*)(p + 20)), 1);
+            __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(p + 10))),
+                _mm_loadu_si128((const __m128i*)(p + 30)), 1);
+            a = _mm256_shuffle_epi8(_mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(a, shuf), mul), 6), shufS);
+            b = _mm256_shuffle_epi8(_mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(b, shuf), mul), 6), shufS);
+            __m256i ch = _mm256_unpackhi_epi64(a, b);
+            __m256i y  = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_unpacklo_epi64(a, b), yoff), 5);
+            __m256i cb = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_shuffle_epi8(ch, shufCb), coff), 5);
+            __m256i cr = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_shuffle_epi8(ch, shufCr), coff), 5);
+            storeRGB_avx2(y, cb, cr, k, out + done * depth, depth, bgr);
+            done += 16;
+        }
+    }
+    return done;
+}
+
+#endif // SIMD_X86
+
+/*!
+* \fn convert10bitsto8bits
+* \brief convert the beginning of a packed 10 bits buffer to 8 bits, with the best kernel available
+*
+* \param in packed 10 bits samples
+* \param in_size size of in, in bytes
+* \param out 8 bits samples, can be in
+* \return number of bytes of in converted (multiple of 5), 0 if no kernel is available
+*/
+int simd::convert10bitsto8bits(const unsigned char* in, int in_size, unsigned char* out)
+{
+#ifdef SIMD_X86
+    switch (getLevel()) {
+    case SIMD_LEVEL_AVX512: return convert10bitsto8bits_avx512(in, in_size, out);
+    case SIMD_LEVEL_AVX2:   return convert10bitsto8bits_avx2(in, in_size, out);
+    case SIMD_LEVEL_SSSE3:  return convert10bitsto8bits_ssse3(in, in_size, out);
+    default: break;
+    }
+#endif
+    return 0;
+}
+
+/*!
+* \fn convert8bitsto10bits
+* \brief convert the beginning of a 8 bits buffer to packed 10 bits, with the best kernel available
+*
+* \param in 8 bits samples
+* \param in_size number of samples
+* \param out packed 10 bits samples
+* \return number of samples converted (multiple of 4), 0 if no kernel is available
+*/
+int simd::convert8bitsto10bits(const unsigned char* in, int in_size, unsigned char* out)
+{
+#ifdef SIMD_X86
+    switch (getLevel()) {
+    case SIMD_LEVEL_AVX512: return convert8bitsto10bits_avx512(in, in_size, out);
+    case SIMD_LEVEL_AVX2:   return convert8bitsto10bits_avx2(in, in_size, out);
+    case SIMD_LEVEL_SSSE3:  return convert8bitsto10bits_ssse3(in, in_size, out);
+    default: break;
+    }
+#endif
+    return 0;
+}
+
+/*!
+* \fn accumulate10bits
+* \brief add the samples of the beginning of a packed 10 bits buffer to accumulators, with the best
+* kernel available
+*
+* \param in packed 10 bits samples
+* \param in_size size of in, in bytes
+* \param acc accumulators, one per sample
+* \return number of bytes of in processed (multiple of 5), 0 if no kernel is available
+*/
+int simd::accumulate10bits(const unsigned char* in, int in_size, unsigned int* acc)
+{
+#ifdef SIMD_X86
+    switch (getLevel()) {
+    case SIMD_LEVEL_AVX512:
+    case SIMD_LEVEL_AVX2:   return accumulate10bits_avx2(in, in_size, acc);
+    case SIMD_LEVEL_SSSE3:  return accumulate10bits_ssse3(in, in_size, acc);
+    default: break;
+    }
+#endif
+    return 0;
+}
+
+/*!
+* \fn convertUYVYtoRGB
+* \brief convert the beginning of a 4:2:2 interleaved buffer to RGB, with the best kernel available
+*
+* \param in Cb Y Cr Y samples, 8 bits or packed 10 bits
+* \param npixels number of pixels of in
+* \param packed10 true if in is packed 10 bits
+* \param k fixed point coefficients of the conversion
+* \param out RGB pixels
+* \param depth 3 for RGB, 4 for RGBA (alpha=255)
+* \param bgr true for BGR/BGRA
+* \return number of pixels converted (multiple of 8), 0 if no kernel is available
+*/
+int simd::convertUYVYtoRGB(const unsigned char* in, int npixels, bool packed10, const YCbCrCoefs& k,
+    unsigned char* out, int depth, bool bgr)
+{
+#ifdef SIMD_X86
+    switch (getLevel()) {
+    case SIMD_LEVEL_AVX512:
+    case SIMD_LEVEL_AVX2:   return convertUYVYtoRGB_avx2(in, npixels, packed10, k, out, depth, bgr);
+    case SIMD_LEVEL_SSSE3:  return convertUYVYtoRGB_ssse3(in, npixels, packed10, k, out, depth, bgr);
+    default: break;
+    }
+#endif
+    return 0;
+}
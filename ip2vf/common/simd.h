@@ -0,0 +1,37 @@
+#ifndef _SIMD_H
+#define _SIMD_H
+
+#define SIMD_LEVEL_NONE     0
+#define SIMD_LEVEL_SSSE3    1
+#define SIMD_LEVEL_AVX2     2
+#define SIMD_LEVEL_AVX512   3   /* AVX-512 F + BW */
+
+/*
+* Vectorized kernels, selected at runtime following the instruction sets supported by the CPU.
+* Each kernel processes the largest part of the buffer it can and returns the size processed:
+* the caller completes with its scalar code.
+*/
+namespace simd
+{
+    int  getLevel();
+    void setMaxLevel(int level);
+
+    // Packed 10 bits (4 samples in 5 bytes, big endian) -> 8 bits. in and out can be the same buffer.
+    int  convert10bitsto8bits(const unsigned char* in, int in_size, unsigned char* out);
+    // 8 bits -> packed 10 bits, samples clipped to the video range ([16, 240] chroma, [16, 235] luma)
+    int  convert8bitsto10bits(const unsigned char* in, int in_size, unsigned char* out);
+
+    // Adds the packed 10 bits samples to 32 bits accumulators, one per sample
+    int  accumulate10bits(const unsigned char* in, int in_size, unsigned int* acc);
+
+    // Fixed point YCbCr -> RGB coefficients, see yuvToRGBCoefs() in yuv.cpp
+    struct YCbCrCoefs {
+        short y, crR, cbG, crG, cbB;    /* Q13 */
+        short yOffset, cOffset;         /* black and zero chroma, in the depth of the input samples */
+    };
+    // 4:2:2 interleaved Cb Y Cr Y, 8 bits or packed 10 bits -> RGB (depth 3) or RGBA/BGRA (depth 4)
+    int  convertUYVYtoRGB(const unsigned char* in, int npixels, bool packed10, const YCbCrCoefs& k,
+        unsigned char* out, int depth, bool bgr);
+}
+
+#endif //_SIMD_H
@@ -3,6 +3,7 @@
 #include <cstring>          // strcmp
 #include <cerrno>
 #include <iostream>     // cout
+#include <algorithm>    // min, max
 #include <assert.h>
 #ifdef _WIN32
 #include <winsock2.h>    
@@ -16,6 +17,7 @@
 #include <unistd.h>         // close
 #include <sys/socket.h>     // socket, shutdown, listen, bind, 
 #include <netinet/in.h>     // struct sockaddr_in
+#include <netinet/udp.h>    // UDP_SEGMENT
 #include <arpa/inet.h>      // inet_addr
 #include <netdb.h>          // gethostbyname
 #include <sys/select.h>
@@ -26,6 +28,38 @@
 #include <sys/types.h>
 #include <assert.h>
 #include <ifaddrs.h>
+#include <poll.h>
+#include <sys/mman.h>       // mmap
+#include <linux/filter.h>   // struct sock_fprog
+#include <sys/ioctl.h>
+#include <net/if.h>         // struct ifreq
+#include <linux/net_tstamp.h>   // SOF_TIMESTAMPING_xxx, struct hwtstamp_config
+#include <linux/sockios.h>  // SIOCSHWTSTAMP
+#include <linux/errqueue.h> // struct sock_extended_err
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT     103     /* linux/udp.h, kernel 4.18 */
+#endif
+#ifndef SO_TXTIME
+#define SO_TXTIME       61      /* linux/net_tstamp.h, kernel 4.19 */
+#define SCM_TXTIME      SO_TXTIME
+#endif
+struct tSockTxTime {            /* struct sock_txtime */
+    clockid_t   clockid;
+    uint32_t    flags;
+};
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY     60          /* asm-generic/socket.h, kernel 4.14 */
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY    0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY       5
+#define SO_EE_CODE_ZEROCOPY_COPIED  1
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF    51  /* asm-generic/socket.h, kernel 4.5 */
+#endif
 #endif
 
 // cat /proc/sys/net/core/rmem_max
@@ -33,6 +67,7 @@
 
 #include "log.h"
 #include "tcp_basic.h"
+#include "pacer.h"
 
 #define SOCKET_IPV6
 #define SOCKET_IPV6_BUFLEN  100
@@ -729,6 +764,33 @@ UDP::UDP()
 {
     _sock = INVALID_SOCKET;
     _TCP_timeout = v_TCP_timeout;
+    _port = 0;
+    _batchSize = 1;
+    _batchCount = 0;
+    _batchIdx = 0;
+    _batchBuffer = NULL;
+    _timestampMode = UDP_TIMESTAMP_NONE;
+    _lastTimestamp = 0;
+    _sendMode = UDP_SEND_MODE_SINGLE;
+    _sendBatchSize = 1;
+    _sendCount = 0;
+    _sendLen = 0;
+    _sendBuffer = NULL;
+    _pacer = NULL;
+    _txTimeEnabled = false;
+    _sendGathered = 0;
+    _zeroCopy = false;
+    _zcSent = 0;
+    _zcCompleted = 0;
+    _zcCopied = false;
+    _reuseGroupSize = 1;
+    _reuseIndex = 0;
+    _reuseSteering = UDP_REUSEPORT_STEER_HASH;
+#ifdef _WIN32 
+    _gatherSend = false;
+#else
+    _gatherSend = true;
+#endif
 #ifdef _WIN32 
     WSADATA init_win32; 
     int result = WSAStartup(MAKEWORD(2,2), &init_win32);
@@ -742,6 +804,10 @@ UDP::~UDP()
 {
     if( _sock != INVALID_SOCKET) 
         closeSocket();
+    if (_batchBuffer != NULL)
+        delete[] _batchBuffer;
+    if (_sendBuffer != NULL)
+        delete[] _sendBuffer;
 #ifdef _WIN32 
     int result = WSACleanup();
     if( result != 0 ) {
@@ -852,6 +918,17 @@ int UDP::configureSocket(const char* remote_addr, const char* local_addr, int po
 	optval = 1;
 	setsockopt(_sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&optval, optlen);
 
+	// Several sockets bound to the same port, see setReusePort()
+	if (_reuseGroupSize > 1)
+	{
+#ifdef _WIN32
+		LOG_WARNING("SO_REUSEPORT is not available, only one socket of the group will receive the packets");
+#else
+		if (setsockopt(_sock, SOL_SOCKET, SO_REUSEPORT, &optval, optlen) != 0)
+			LOG_ERROR("setsockopt(SO_REUSEPORT) failed, error='%s'", strerror(errno));
+#endif
+	}
+
 	// Socket receive buffer length option
 #ifdef _WIN32
 	if (getsockopt(_sock, SOL_SOCKET, SO_RCVBUF, (char*)&optval, &optlen) != 0)
@@ -925,6 +1002,8 @@ int UDP::configureSocket(const char* remote_addr, const char* local_addr, int po
 #endif
 			return E_FATAL;
 		}
+		if (_reuseGroupSize > 1 && _reuseIndex == 0 && _reuseSteering != UDP_REUSEPORT_STEER_HASH)
+			_attachReusePortProgram();
 		if (multicast && _af == AF_INET)
 		{
 			struct ip_mreq group =
@@ -1089,6 +1168,12 @@ int  UDP::closeSocket()
     LOG(" -->");
     if( _sock != INVALID_SOCKET )
     {
+        // The kernel may still send from the buffers given with MSG_ZEROCOPY
+        if (_zeroCopy) {
+            _sendCount = 0;
+            waitSendCompletions();
+        }
+
         // I know it's an UDP socket, but shutdown seems needed, otherwise it not unblock listening socket
         shutdown(_sock, 2);
 
@@ -1106,6 +1191,16 @@ int  UDP::closeSocket()
         }
     }
     _sock = INVALID_SOCKET;
+    _batchCount = 0;
+    _batchIdx = 0;
+    _timestampMode = UDP_TIMESTAMP_NONE;
+    _lastTimestamp = 0;
+    _sendCount = 0;
+    _sendGathered = 0;
+    _zeroCopy = false;
+    _zcSent = 0;
+    _zcCompleted = 0;
+    _txTimeEnabled = false;
 
     LOG(" <--");
     return E_OK;
@@ -1113,6 +1208,10 @@ int  UDP::closeSocket()
 
 int  UDP::readSocket(char *buffer, int *len) 
 {
+    // The receive time comes with recvmmsg()
+    if (_batchSize > 1 || _timestampMode != UDP_TIMESTAMP_NONE)
+        return _readSocketFromBatch(buffer, len);
+
 #ifdef _WIN32
     int size
 #else
@@ -1138,56 +1237,161 @@ int  UDP::readSocket(char *buffer, int *len)
     return result;
 }
 
-/*
- * not completed
- */
-/*
-#define BATCH_SIZE  10
-struct batch {
-    int count;
-    char buf[BATCH_SIZE][1500];
-    struct iovec iovec[BATCH_SIZE][1];
-    struct sockaddr src_addr[BATCH_SIZE];
-    struct mmsghdr datagrams[BATCH_SIZE];
-};
-struct batch _batch;
-
-int  UDP::readSocket2(char *buffer, int *len) 
-{
-    static int init=0;
-    if( init == 0 ) {
-        init = 1;
-        _batch.count=0;
-        for( int i=0; i<BATCH_SIZE; i++) {
-            _batch.iovec[i][0].iov_base=&_batch.buf[i][0];
-            _batch.iovec[i][0].iov_len=1500;
-            _batch.datagrams[i].msg_hdr.msg_name=&_batch.src_addr[i];
-            _batch.datagrams[i].msg_hdr.msg_namelen=sizeof(_batch.src_addr[i]);
-            _batch.datagrams[i].msg_hdr.msg_iov=_batch.iovec[i];
-            _batch.datagrams[i].msg_hdr.msg_iovlen=1;
-            _batch.datagrams[i].msg_hdr.msg_control=0;
-            _batch.datagrams[i].msg_hdr.msg_controllen=0;
+/*!
+* \fn readBatchSocket
+* \brief receive up to count packets with a single system call (recvmmsg). Block until at least one packet
+* is available.
+*
+* \param buffer array of count buffers
+* \param len array of count sizes: size of each buffer as input, size of each packet received as output
+* \param count max number of packets to receive (UDP_BATCH_MAX_SIZE at most)
+* \param timestamp if not NULL, array of count receive times in ns (0 if not available), see setTimestampMode()
+* \return number of packets received, -1 if error
+*/
+int  UDP::readBatchSocket(char **buffer, int *len, int count, long long *timestamp)
+{
+    if (count > UDP_BATCH_MAX_SIZE)
+        count = UDP_BATCH_MAX_SIZE;
+#ifdef _WIN32
+    // No recvmmsg: one packet at a time
+    int result = readSocket(buffer[0], &len[0]);
+    if (timestamp != NULL)
+        timestamp[0] = 0;
+    for (int i = 1; i < count; i++)
+        len[i] = 0;
+    return (result <= 0 ? result : 1);
+#else
+    struct mmsghdr msgs[UDP_BATCH_MAX_SIZE];
+    struct iovec   iov[UDP_BATCH_MAX_SIZE];
+    char           ctrl[UDP_BATCH_MAX_SIZE][CMSG_SPACE(3 * sizeof(struct timespec))];
+
+    if (timestamp != NULL && _timestampMode == UDP_TIMESTAMP_NONE)
+        setTimestampMode(UDP_TIMESTAMP_SOFTWARE);
+    memset(msgs, 0, count * sizeof(struct mmsghdr));
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = buffer[i];
+        iov[i].iov_len  = len[i];
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (timestamp != NULL) {
+            msgs[i].msg_hdr.msg_control = ctrl[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
         }
     }
-
-    if( _batch.count>0 ) {
+    int result = recvmmsg(_sock, msgs, count, MSG_WAITFORONE, NULL);
+    if (result == -1) {
+        LOG_ERROR("error occurred during recvmmsg: '%s'", strerror(errno));
+        return -1;
     }
-    else {
-        LOG("ask for new batch with recvmmsg");
-        _batch.count = recvmmsg(_sock, _batch.datagrams, BATCH_SIZE, MSG_WAITFORONE, NULL);
-        if( _batch.count == -1 ) {
-            LOG_ERROR("error when recvmmsg=%s",strerror(errno));
-        } else {
-            LOG_ERROR("Ok, receive %d datagrams", _batch.count);
+    for (int i = 0; i < count; i++) {
+        len[i] = (i < result ? (int)msgs[i].msg_len : 0);
+        if (i < result && (msgs[i].msg_hdr.msg_flags & MSG_TRUNC))
+            LOG_ERROR("packet truncated to %d bytes", len[i]);
+        if (timestamp == NULL)
+            continue;
+        timestamp[i] = 0;
+        if (i >= result)
+            continue;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+            // SCM_TIMESTAMPING: kernel time, unused, NIC time
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                struct timespec ts[3];
+                memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+                const struct timespec* t = (ts[2].tv_sec != 0 || ts[2].tv_nsec != 0 ? &ts[2] : &ts[0]);
+                timestamp[i] = (long long)t->tv_sec * 1000000000LL + t->tv_nsec;
+            }
         }
     }
-    int result = -1;
-    if( result == -1 ) {
+    LOG("recv %d packets from port %d ", result, _port);
+    return result;
+#endif
+}
+
+/*!
+* \fn setBatchSize
+* \brief set the number of packets received by each system call in readSocket(). The next calls are served
+* from the packets already received, without system call.
+*
+* \param size number of packets, 1 to disable the batch
+*/
+void UDP::setBatchSize(int size)
+{
+#ifdef _WIN32
+    size = 1;
+#endif
+    if (size < 1)
+        size = 1;
+    if (size > UDP_BATCH_MAX_SIZE)
+        size = UDP_BATCH_MAX_SIZE;
+    if (_batchBuffer != NULL)
+        delete[] _batchBuffer;
+    // Also used with a batch of 1 packet by readPacket()
+    _batchBuffer = new char[size * UDP_BATCH_PACKET_SIZE];
+    _batchSize  = size;
+    _batchCount = 0;
+    _batchIdx   = 0;
+    LOG_INFO("receive up to %d packets per system call", _batchSize);
+}
+
+int  UDP::_readSocketFromBatch(char *buffer, int *len)
+{
+    char* packet = NULL;
+    int size = UDP_BATCH_PACKET_SIZE;
+    int result = _readPacketFromBatch(&packet, &size);
+    if (result <= 0) {
         *len = 0;
+        return result;
     }
-    return result;
+    if (size > *len) {
+        LOG_ERROR("packet of %d bytes truncated to %d bytes", size, *len);
+        size = *len;
+    }
+    memcpy(buffer, packet, size);
+    *len = size;
+    return size;
+}
+
+int  UDP::_readPacketFromBatch(char **packet, int *len)
+{
+    if (_batchBuffer == NULL)
+        setBatchSize(_batchSize);
+    if (_batchIdx >= _batchCount) {
+        char* buffers[UDP_BATCH_MAX_SIZE];
+        for (int i = 0; i < _batchSize; i++) {
+            buffers[i] = _batchBuffer + i * UDP_BATCH_PACKET_SIZE;
+            _batchLen[i] = UDP_BATCH_PACKET_SIZE;
+        }
+        _batchIdx = 0;
+        _batchCount = readBatchSocket(buffers, _batchLen, _batchSize, (_timestampMode != UDP_TIMESTAMP_NONE ? _batchTimestamp : NULL));
+        if (_batchCount <= 0) {
+            int result = _batchCount;
+            _batchCount = 0;
+            *len = 0;
+            return result;
+        }
+    }
+    int size = _batchLen[_batchIdx];
+    *packet = _batchBuffer + _batchIdx * UDP_BATCH_PACKET_SIZE;
+    _lastTimestamp = (_timestampMode != UDP_TIMESTAMP_NONE ? _batchTimestamp[_batchIdx] : 0);
+    _batchIdx++;
+    *len = size;
+    if (size == 0)
+        LOG_INFO("the connection has been gracefully closed");
+    return size;
 }
+
+/*!
+* \fn readPacket
+* \brief receive a packet without copying it to a user buffer. The packet stays valid until the next read.
+*
+* \param packet output pointer to the packet
+* \param len output size of the packet
+* \return size of the packet, 0 if the connection is closed, -1 if error
 */
+int  UDP::readPacket(char **packet, int *len)
+{
+    return _readPacketFromBatch(packet, len);
+}
 
 int  UDP::writeSocket(char *buffer, int *len) 
 {
@@ -1213,327 +1417,2629 @@ int  UDP::writeSocket(char *buffer, int *len)
     return result;
 }
 
-int  UDP::writeBatchedSocket(char **buffer, int count, int *len) {
-    int result = 0;
-#ifdef _WIN32
-#else
-/*    struct mmsghdr  datagrams[count];
-    struct iovec    iovec[count];
-    for( int i=0; i<count; i++ ) {
-        memset(&iovec[i], 0, sizeof(iovec[i]));
-        memset(&datagrams[i], 0, sizeof(datagrams[i]));
-        iovec[i].iov_base = buffer[i];
-        iovec[i].iov_len  = *len;
-        datagrams[i].msg_hdr.msg_iov = &iovec[i];
-        datagrams[i].msg_hdr.msg_iovlen = 1;
-        datagrams[i].msg_hdr.msg_name=&_addr4;
-        datagrams[i].msg_hdr.msg_namelen=sizeof( struct sockaddr_in );
-    }
-    result = sendmmsg(_sock, datagrams, count, 0);
-    if( result==-1 ) {
-        LOG_ERROR("failed to send full messages batch, actually %d bytes on %d, error=%s", *len, result, strerror(errno));
-        exit(-1);
-        return -1;
-    }
-    else {
-        LOG("ok to send full messages batch, actually %d bytes on %d", *len, result);
+int  UDP::_writeSingleSocket(char **buffer, int count, int *len)
+{
+    for (int i = 0; i < count; i++) {
+        int size = *len;
+        if (writeSocket(buffer[i], &size) == -1)
+            return (i == 0 ? -1 : i);
     }
-#endif
-    return result;*/
-#endif
-    assert(0);
-    return result;
+    return count;
 }
 
+/*!
+* \fn writeBatchedSocket
+* \brief send count packets of the same size. Depending on the send mode, with one system call per packet
+* (sendto), with one system call per batch (sendmmsg), or with one system call per batch and several packets
+* per message, segmented by the kernel or the NIC (UDP_SEGMENT). Fall back to a simpler mode if the kernel
+* doesn't support the current one.
+*
+* \param buffer array of count packets
+* \param count number of packets to send
+* \param len size of each packet
+* \return number of packets sent, -1 if error
+*/
+int  UDP::writeBatchedSocket(char **buffer, int count, int *len)
+{
+    return _writeMessages(buffer, count, len, NULL);
+}
 
-#ifdef USE_NETMAP
-#include <netinet/if_ether.h>
-#include <netinet/ip.h>
-#include <netinet/udp.h>
-#include <poll.h>
-
-/*
- * Create a netmap socket.
- *
- * @param addr         the destination IP(v4 as of now) address
- * @param port         the destination UDP port
- * @param deviceName   the name of the device
- * @return             0 if successful, -1 in case of an error
- *
- * The netmap socket will act as a regular UDP socket, except that packets
- * will be sent over a netmap interface instead of using the regular kernel API.
- * Such an interface can be a regular NIC or a virtual interface, for fast
- * communication with a packet processing engine (eg VPP)
- * Packets are crafted from scratch, which means that an IP address must be
- * provided for the interface
- *
- * deviceName must have the following format:
- *    netmap-<ip>-<netmap_device_name>
- *         where ip is the IP address to assign to the netmap interface
- *               netmap_device_name is the internal netmap interface name
- * netmap regular devices names are the same as in the kernel ("eth0", etc)
- * netmap local devices names use the following format:
- *    valeXX:YY<flags>
- *         where XX is the switch number and YY the port number inside the switch
- *         flags can be {0 for a master pipe or }0 for a slave pipe
- *
- */
-int Netmap::openSocket(char* addr, int port, char* deviceName=NULL)
+int  UDP::_writeMessages(char **buffer, int count, int *len, const long long *txtime, const struct tSendGather *gather)
 {
-    if (!deviceName) {
-        LOG_ERROR("called with no device name");
-        return -1;
+#ifdef _WIN32
+    return _writeSingleSocket(buffer, count, len);
+#else
+    static const char s_padding[UDP_BATCH_PACKET_SIZE] = { 0 };
+    struct mmsghdr msgs[UDP_BATCH_MAX_SIZE];
+    struct iovec   iov[UDP_BATCH_MAX_SIZE * 3];
+    int            msgPackets[UDP_BATCH_MAX_SIZE];
+    char           ctrl[UDP_BATCH_MAX_SIZE][CMSG_SPACE(sizeof(uint64_t))];
+    int sent = 0;
+    int nbRetry = 0;
+
+    // The kernel sends from the user buffers if they are all given in place (see queueSendPacket())
+    int flags = 0;
+    if (_zeroCopy && gather != NULL) {
+        flags = MSG_ZEROCOPY;
+        for (int i = 0; i < count; i++) {
+            if (gather[i].header == NULL)
+                flags = 0;
+        }
     }
 
-    if (strncmp(deviceName, "netmap-", strlen("netmap-"))) {
-        LOG_ERROR("called with invalid device name");
-        LOG_ERROR("device name must have the following format:");
-        LOG_ERROR("netmap-<ip>-<netmap_device_name>");
-        return -1;
-    }
+    while (sent < count) {
 
-    char *ipStr = deviceName + strlen("netmap-");
-    char *netmapDeviceName;
-    if (!(netmapDeviceName = strchr(ipStr, '-'))) {
-        LOG_ERROR("called with invalid device name");
-        LOG_ERROR("device name must have the following format:");
-        LOG_ERROR("netmap-<ip>-<netmap_device_name>");
-        return -1;
-    }
-    //Replace dash with 0 for inet_addr to work
-    *netmapDeviceName++ = '\0';
-    _my_ip = inet_addr(ipStr);
+        if (_sendMode == UDP_SEND_MODE_SINGLE && gather == NULL) {
+            int result = _writeSingleSocket(buffer + sent, count - sent, len);
+            return (result == -1 ? (sent == 0 ? -1 : sent) : sent + result);
+        }
 
+        // Build the messages: one packet per message, or up to segs packets per message in GSO mode. A launch
+        // time applies to the whole message: no GSO with launch times. A packet queued in place is made of
+        // its header, its payload and the padding.
+        int segs = 1;
+        if (_sendMode == UDP_SEND_MODE_GSO && txtime == NULL)
+            segs = std::max(1, std::min(flags != 0 ? UDP_GSO_ZEROCOPY_MAX_SEGMENTS : UDP_GSO_MAX_SEGMENTS, UDP_GSO_MAX_SIZE / *len));
+        int nbMsgs = 0;
+        int nbPackets = 0;
+        int nbIov = 0;
+        memset(msgs, 0, sizeof(msgs));
+        while (sent + nbPackets < count && nbPackets < UDP_BATCH_MAX_SIZE) {
+            int n = std::min(segs, std::min(count - sent - nbPackets, UDP_BATCH_MAX_SIZE - nbPackets));
+            struct msghdr* hdr = &msgs[nbMsgs].msg_hdr;
+            int firstIov = nbIov;
+            for (int i = 0; i < n; i++) {
+                int index = sent + nbPackets + i;
+                if (gather != NULL && gather[index].header != NULL) {
+                    const struct tSendGather* g = &gather[index];
+                    int padding = *len - g->headerLen - g->payloadLen;
+                    iov[nbIov].iov_base = (void*)g->header;
+                    iov[nbIov++].iov_len = g->headerLen;
+                    if (g->payloadLen > 0) {
+                        iov[nbIov].iov_base = (void*)g->payload;
+                        iov[nbIov++].iov_len = g->payloadLen;
+                    }
+                    if (padding > 0) {
+                        iov[nbIov].iov_base = (void*)s_padding;
+                        iov[nbIov++].iov_len = padding;
+                    }
+                }
+                else {
+                    iov[nbIov].iov_base = buffer[index];
+                    iov[nbIov++].iov_len = *len;
+                }
+            }
+            hdr->msg_iov = &iov[firstIov];
+            hdr->msg_iovlen = nbIov - firstIov;
+            hdr->msg_name = (_af == AF_INET ? (void*)&_remote_addr4 : (void*)&_remote_addr6);
+            hdr->msg_namelen = (_af == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+            if (n > 1) {
+                hdr->msg_control = ctrl[nbMsgs];
+                hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+                struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+                cmsg->cmsg_level = IPPROTO_UDP;
+                cmsg->cmsg_type  = UDP_SEGMENT;
+                cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+                uint16_t segSize = (uint16_t)*len;
+                memcpy(CMSG_DATA(cmsg), &segSize, sizeof(segSize));
+            }
+            else if (txtime != NULL) {
+                hdr->msg_control = ctrl[nbMsgs];
+                hdr->msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+                struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type  = SCM_TXTIME;
+                cmsg->cmsg_len   = CMSG_LEN(sizeof(uint64_t));
+                uint64_t launchTime = (uint64_t)txtime[sent + nbPackets];
+                memcpy(CMSG_DATA(cmsg), &launchTime, sizeof(launchTime));
+            }
+            msgPackets[nbMsgs] = n;
+            nbPackets += n;
+            nbMsgs++;
+        }
 
-    struct nmreq nmr = {};
-    nmr.nr_arg3 = 512;
-    _nmd = nm_open(netmapDeviceName, &nmr, 0, NULL);
-    if (_nmd == NULL) {
-        LOG_ERROR("failed to open netmap device %s: %s", deviceName, strerror(errno));
-        return -1;
+        int result;
+        if (_sendMode == UDP_SEND_MODE_SINGLE) {
+            // One system call per message, as sendmmsg() does
+            result = 0;
+            while (result < nbMsgs && sendmsg(_sock, &msgs[result].msg_hdr, flags) != -1)
+                result++;
+            if (result == 0)
+                result = -1;
+        }
+        else
+            result = sendmmsg(_sock, msgs, nbMsgs, flags);
+        if (result == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS && flags != 0 && nbRetry++ < 100) {
+                // Too many buffers held by the kernel: wait for some of them
+                _readZeroCopyCompletions(1);
+                continue;
+            }
+            if (_sendMode == UDP_SEND_MODE_GSO && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+                LOG_WARNING("UDP segmentation offload not available (error='%s'), use sendmmsg", strerror(errno));
+                _sendMode = UDP_SEND_MODE_MMSG;
+                continue;
+            }
+            if (errno == ENOSYS) {
+                LOG_WARNING("sendmmsg not available, send one packet per system call");
+                _sendMode = UDP_SEND_MODE_SINGLE;
+                continue;
+            }
+            LOG_ERROR("error occurred during sendmmsg: '%s'", strerror(errno));
+            return (sent == 0 ? -1 : sent);
+        }
+        if (result == 0) {
+            LOG_ERROR("failed to send the batch of %d packets", count - sent);
+            return (sent == 0 ? -1 : sent);
+        }
+        if (flags != 0)
+            _zcSent += result;
+        // Some messages may not be sent, retry with the next ones
+        for (int i = 0; i < result; i++)
+            sent += msgPackets[i];
     }
-    _sock = 0;
+    LOG("send %d packets of %d bytes to port %d ", sent, *len, _port);
+    return sent;
+#endif
+}
 
+#ifndef _WIN32
+/*!
+* \fn enableHardwareTimestamps
+* \brief ask a NIC to timestamp all the received packets. The NIC config is shared with the other
+* processes, i.e. ptp4l: its TX timestamping is kept, and the RX filter is only widened to all the
+* packets if needed. If the config can't be read, it is not changed.
+*
+* \param device name of the device
+* \return true if the NIC timestamps the packets
+*/
+static bool enableHardwareTimestamps(const char* device)
+{
+    struct hwtstamp_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+    ifr.ifr_data = (char*)&cfg;
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = (sock == INVALID_SOCKET ? -1 : ioctl(sock, SIOCGHWTSTAMP, &ifr));
+    if (ret == 0 && cfg.rx_filter != HWTSTAMP_FILTER_ALL) {
+        cfg.rx_filter = HWTSTAMP_FILTER_ALL;
+        ret = ioctl(sock, SIOCSHWTSTAMP, &ifr);
+    }
+    int err = errno;
+    if (sock != INVALID_SOCKET)
+        close(sock);
+    if (ret != 0 || cfg.rx_filter == HWTSTAMP_FILTER_NONE) {
+        LOG_WARNING("'%s' can't timestamp the received packets (error='%s'), use the kernel receive time", device, (ret != 0 ? strerror(err) : "no rx filter"));
+        return false;
+    }
+    return true;
+}
+#endif
 
-    //Ethernet header
-    struct ether_header *eth = (struct ether_header *) _headers;
-    memcpy(&eth->ether_shost, "\xde\xad\xbe\xef\x99\x99", ETHER_ADDR_LEN); //XXX
-    memcpy(&eth->ether_dhost, "\xff\xff\xff\xff\xff\xff", ETHER_ADDR_LEN); //XXX
-    eth->ether_type = htons(ETHERTYPE_IP);
+/*!
+* \fn getTimestampModeFromName
+* \brief convert a timestamp mode name ("none", "software" or "hardware") to UDP_TIMESTAMP_xxx
+*
+* \param name timestamp mode name
+* \return timestamp mode, UDP_TIMESTAMP_NONE if unknown
+*/
+int UDP::getTimestampModeFromName(const char* name)
+{
+    if (name == NULL || name[0] == '\0' || strcmp(name, "none") == 0)
+        return UDP_TIMESTAMP_NONE;
+    if (strcmp(name, "software") == 0)
+        return UDP_TIMESTAMP_SOFTWARE;
+    if (strcmp(name, "hardware") == 0)
+        return UDP_TIMESTAMP_HARDWARE;
+    LOG_ERROR("unknown timestamp mode '%s', available modes are none, software and hardware. Use none", name);
+    return UDP_TIMESTAMP_NONE;
+}
 
-    //IP header
-    struct iphdr *ip = (struct iphdr *) (eth + 1);
-    memset(ip, 0, sizeof(*ip));
-    ip->ihl = 5;
-    ip->version = 4;
-    ip->tot_len = 0;
-    _ip_tot_len = &ip->tot_len;
-    ip->ttl = 64;
-    ip->protocol = IPPROTO_UDP;
-    ip->saddr = _my_ip;
-    ip->daddr = inet_addr(addr);
-    _ip_csum = &ip->check;
+/*!
+* \fn setTimestampMode
+* \brief ask the receive time of the packets, given by getLastTimestamp() after each read. The packets are
+* then received with recvmmsg(), even without batch. Must be called once the socket is open.
+*
+* \param mode UDP_TIMESTAMP_xxx
+* \param device for UDP_TIMESTAMP_HARDWARE, the device receiving the packets
+* \return the mode used: the kernel time if the NIC can't timestamp the packets
+*/
+int UDP::setTimestampMode(int mode, const char* device)
+{
+    _lastTimestamp = 0;
+#ifdef _WIN32
+    if (mode != UDP_TIMESTAMP_NONE)
+        LOG_WARNING("receive timestamps not available");
+    _timestampMode = UDP_TIMESTAMP_NONE;
+#else
+    if (mode == UDP_TIMESTAMP_HARDWARE) {
+        if (device == NULL || device[0] == '\0') {
+            LOG_WARNING("hardware timestamps need the interface, use the kernel receive time");
+            mode = UDP_TIMESTAMP_SOFTWARE;
+        }
+        else if (!enableHardwareTimestamps(device))
+            mode = UDP_TIMESTAMP_SOFTWARE;
+    }
+    int flags = 0;
+    if (mode != UDP_TIMESTAMP_NONE)
+        flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (mode == UDP_TIMESTAMP_HARDWARE)
+        flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    if (setsockopt(_sock, SOL_SOCKET, SO_TIMESTAMPING, (void*)&flags, sizeof(flags)) != 0) {
+        LOG_ERROR("setsockopt(SO_TIMESTAMPING) failed, error='%s'", strerror(errno));
+        mode = UDP_TIMESTAMP_NONE;
+    }
+    _timestampMode = mode;
+    if (mode != UDP_TIMESTAMP_NONE)
+        LOG_INFO("receive time taken by the %s", (mode == UDP_TIMESTAMP_HARDWARE ? "NIC" : "kernel"));
+#endif
+    return _timestampMode;
+}
 
-    //UDP header
-    struct udphdr *udp = (struct udphdr *) (ip + 1);
-    udp->source = udp->dest = htons(port);
-    udp->check = 0;
-    udp->len = 0;
-    _udp_len = &udp->len;
-    return 0;
+/*!
+* \fn getReusePortSteeringFromName
+* \brief convert a steering name ("hash", "seq" or "cpu") to UDP_REUSEPORT_STEER_xxx
+*
+* \param name steering name
+* \return steering, UDP_REUSEPORT_STEER_SEQ if unknown
+*/
+int UDP::getReusePortSteeringFromName(const char* name)
+{
+    if (name == NULL || name[0] == '\0' || strcmp(name, "seq") == 0)
+        return UDP_REUSEPORT_STEER_SEQ;
+    if (strcmp(name, "hash") == 0)
+        return UDP_REUSEPORT_STEER_HASH;
+    if (strcmp(name, "cpu") == 0)
+        return UDP_REUSEPORT_STEER_CPU;
+    LOG_ERROR("unknown steering '%s', available steerings are seq, hash and cpu. Use seq", name);
+    return UDP_REUSEPORT_STEER_SEQ;
 }
 
-int Netmap::closeSocket()
+/*!
+* \fn setReusePort
+* \brief make the socket one of a group of sockets bound to the same port with SO_REUSEPORT, the
+* packets being shared between them by the kernel. Must be called before openSocket(), and the
+* sockets of the group must be opened in the order of their index: the kernel numbers them in the
+* order they are bound, and the steering program of the socket 0 gives this number. Only for
+* unicast: each socket of the group gets a copy of the multicast packets.
+*
+* \param groupSize nb of sockets in the group, 1 for a single socket
+* \param index index of this socket in the group
+* \param steering UDP_REUSEPORT_STEER_xxx
+*/
+void UDP::setReusePort(int groupSize, int index, int steering)
 {
-    if (!isValid()) {
-        errno = EINVAL;
-        return -1;
+    _reuseGroupSize = (groupSize < 1 ? 1 : groupSize);
+    _reuseIndex = index;
+    _reuseSteering = steering;
+}
+
+/*!
+* \fn _attachReusePortProgram
+* \brief attach to the group the classic BPF program choosing the socket of each packet. It runs on
+* the UDP payload: the RTP seq number is at offset 2. A result out of the group falls back to the hash.
+*
+* \return E_OK, or E_ERROR if the kernel refused the program
+*/
+int UDP::_attachReusePortProgram()
+{
+#ifdef _WIN32
+    return E_ERROR;
+#else
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 2),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)_reuseGroupSize),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    if (_reuseSteering == UDP_REUSEPORT_STEER_CPU)
+        code[0] = BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU));
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    if (setsockopt(_sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) != 0) {
+        LOG_ERROR("setsockopt(SO_ATTACH_REUSEPORT_CBPF) failed, the packets are shared by the kernel hash: '%s'", strerror(errno));
+        return E_ERROR;
     }
-    nm_close(_nmd);
-    _sock = INVALID_SOCKET;
-    return 0;
+    LOG_INFO("packets of port %d shared between %d sockets by %s", _port,
+        _reuseGroupSize, (_reuseSteering == UDP_REUSEPORT_STEER_CPU ? "receiving cpu" : "RTP seq number"));
+    return E_OK;
+#endif
 }
 
+/*!
+* \fn getSendModeFromName
+* \brief convert a send mode name ("single", "mmsg" or "gso") to UDP_SEND_MODE_xxx
+*
+* \param name send mode name
+* \return send mode, UDP_SEND_MODE_MMSG if unknown
+*/
+int UDP::getSendModeFromName(const char* name)
+{
+    if (name == NULL || strcmp(name, "mmsg") == 0)
+        return UDP_SEND_MODE_MMSG;
+    if (strcmp(name, "single") == 0)
+        return UDP_SEND_MODE_SINGLE;
+    if (strcmp(name, "gso") == 0)
+        return UDP_SEND_MODE_GSO;
+    LOG_ERROR("unknown send mode '%s', available modes are single, mmsg and gso. Use mmsg", name);
+    return UDP_SEND_MODE_MMSG;
+}
 
-int Netmap::readSocketNonBlocking(char *buffer, int *len)
+/*!
+* \fn setSendMode
+* \brief set how the packets queued with queueSendBuffer() are sent: the packets are sent by batch
+* of batchSize packets, or when flushSendBuffer() is called.
+*
+* \param mode UDP_SEND_MODE_xxx
+* \param batchSize max number of packets queued before they are sent
+*/
+void UDP::setSendMode(int mode, int batchSize)
 {
-    int n_rings = _nmd->last_rx_ring - _nmd->first_rx_ring + 1;
-    int i, ring_idx;
-    struct netmap_ring *ring = NULL;
-    struct netmap_slot *slot;
-    char *src_buf;
+#ifdef _WIN32
+    mode = UDP_SEND_MODE_SINGLE;
+#endif
+    if (mode == UDP_SEND_MODE_SINGLE || batchSize < 1)
+        batchSize = 1;
+    if (batchSize > UDP_BATCH_MAX_SIZE)
+        batchSize = UDP_BATCH_MAX_SIZE;
+    if (_sendCount > 0)
+        flushSendBuffer();
+    if (_sendBuffer != NULL && batchSize != _sendBatchSize) {
+        delete[] _sendBuffer;
+        _sendBuffer = NULL;
+    }
+    _sendMode = mode;
+    _sendBatchSize = batchSize;
+    LOG_INFO("send up to %d packets per system call, mode=%d", _sendBatchSize, _sendMode);
+}
 
-    //Find an available non-empty ring
-    for (i = 0, ring_idx = _nmd->cur_rx_ring; i < n_rings; i++, ring_idx++) {
-        if (ring_idx == _nmd->last_rx_ring) {
-            ring_idx = _nmd->first_rx_ring;
-        }
-        ring = NETMAP_RXRING(_nmd->nifp, ring_idx);
-        if (nm_ring_empty(ring)) {
-            continue;
-        }
+/*!
+* \fn getSendBuffer
+* \brief give the buffer where the next packet must be built before queueSendBuffer() is called
+*
+* \return buffer of UDP_BATCH_PACKET_SIZE bytes
+*/
+char* UDP::getSendBuffer()
+{
+    if (_sendBuffer == NULL)
+        _sendBuffer = new char[_sendBatchSize * UDP_BATCH_PACKET_SIZE];
+    return _sendBuffer + _sendCount * UDP_BATCH_PACKET_SIZE;
+}
 
-        break;
+/*!
+* \fn queueSendBuffer
+* \brief queue the packet built in getSendBuffer(). The queued packets are sent when the batch is full.
+*
+* \param len size of the packet
+* \return -1 if error
+*/
+int UDP::queueSendBuffer(int len)
+{
+    int ret = 0;
+    if (len > UDP_BATCH_PACKET_SIZE) {
+        LOG_ERROR("packet of %d bytes too big to be sent (max %d)", len, UDP_BATCH_PACKET_SIZE);
+        return -1;
+    }
+    if (_sendCount > 0 && len != _sendLen) {
+        // A batch contains packets of the same size: send the previous ones first
+        char* packet = _sendBuffer + _sendCount * UDP_BATCH_PACKET_SIZE;
+        ret = flushSendBuffer();
+        memmove(_sendBuffer, packet, len);
     }
+    if (_pacer != NULL)
+        _sendTime[_sendCount] = _pacer->getNextPacketTime();
+    _sendGather[_sendCount].header = NULL;
+    _sendLen = len;
+    _sendCount++;
+    if (_sendCount >= _sendBatchSize && flushSendBuffer() == -1)
+        ret = -1;
+    return ret;
+}
 
-    if (i == n_rings) {
-        //No non-empty rings available, try again later
+/*!
+* \fn queueSendPacket
+* \brief queue a packet made of a header and a payload sent in place, without copying them: they must stay
+* valid until the packet is sent, i.e. until flushSendBuffer(), or until waitSendCompletions() with zero copy.
+* The packet is padded with zeros up to len bytes. If the socket can't send a packet from several buffers
+* (AF_XDP, netmap), the packet is copied in the send buffer.
+*
+* \param header header of the packet
+* \param headerLen size of the header
+* \param payload payload of the packet
+* \param payloadLen size of the payload
+* \param len size of the packet, at least headerLen+payloadLen
+* \return -1 if error
+*/
+int UDP::queueSendPacket(const char* header, int headerLen, const char* payload, int payloadLen, int len)
+{
+    if (len > UDP_BATCH_PACKET_SIZE || headerLen + payloadLen > len) {
+        LOG_ERROR("invalid packet of %d bytes (header=%d, payload=%d, max %d)", len, headerLen, payloadLen, UDP_BATCH_PACKET_SIZE);
         return -1;
     }
+    if (!_gatherSend) {
+        char* packet = getSendBuffer();
+        memcpy(packet, header, headerLen);
+        memcpy(packet + headerLen, payload, payloadLen);
+        memset(packet + headerLen + payloadLen, 0, len - headerLen - payloadLen);
+        return queueSendBuffer(len);
+    }
+    int ret = 0;
+    if (_sendCount > 0 && len != _sendLen)
+        ret = flushSendBuffer();
+    if (_pacer != NULL)
+        _sendTime[_sendCount] = _pacer->getNextPacketTime();
+    _sendGather[_sendCount].header = header;
+    _sendGather[_sendCount].headerLen = headerLen;
+    _sendGather[_sendCount].payload = payload;
+    _sendGather[_sendCount].payloadLen = payloadLen;
+    _sendGathered++;
+    _sendLen = len;
+    _sendCount++;
+    if (_sendCount >= _sendBatchSize && flushSendBuffer() == -1)
+        ret = -1;
+    return ret;
+}
 
-    slot = &ring->slot[ring->cur];
-    if (slot->len < L2_L3_L4_HDR_SIZE) {
-        LOG("got too small packet");
+/*!
+* \fn flushSendBuffer
+* \brief send the packets queued by queueSendBuffer()
+*
+* \return number of packets sent, -1 if error
+*/
+int UDP::flushSendBuffer()
+{
+    if (_sendCount == 0)
+        return 0;
+    char* packets[UDP_BATCH_MAX_SIZE];
+    for (int i = 0; i < _sendCount; i++)
+        packets[i] = _sendBuffer + i * UDP_BATCH_PACKET_SIZE;
+    int len = _sendLen;
+    int count = _sendCount;
+    const struct tSendGather* gather = (_sendGathered > 0 ? _sendGather : NULL);
+    _sendCount = 0;
+    _sendGathered = 0;
+    int result;
+    if (_txTimeEnabled)
+        result = _writeMessages(packets, count, &len, _sendTime, gather);
+    else {
+        // The batch leaves at the launch time of its first packet
+        if (_pacer != NULL)
+            _pacer->waitUntil(_sendTime[0]);
+        if (gather != NULL)
+            result = _writeMessages(packets, count, &len, NULL, gather);
+        else
+            result = (count == 1 ? writeSocket(packets[0], &len) : writeBatchedSocket(packets, count, &len));
+    }
+    if (_pacer != NULL) {
+        long long now = _pacer->getTime();
+        for (int i = 0; i < count; i++)
+            _pacer->onPacketSent(_sendTime[i], now);
+    }
+    if (result == -1 || (count > 1 && result < count)) {
+        LOG_ERROR("failed to send %d packets of %d bytes, result=%d", count, len, result);
         return -1;
     }
-
-    *len = (slot->len - L2_L3_L4_HDR_SIZE < *len) ? slot->len - L2_L3_L4_HDR_SIZE : *len;
-    src_buf = NETMAP_BUF(ring, slot->buf_idx);
-
-    //TODO filter out port and ip here
-    memcpy(buffer, src_buf + L2_L3_L4_HDR_SIZE, *len);
-
-    ring->head = ring->cur = nm_ring_next(ring, ring->cur);
-    _nmd->cur_rx_ring = ring_idx;
-
-    LOG("recv %d bytes from port %d", *len, _port);
-
-    return *len;
-
+    return count;
 }
 
-int Netmap::readSocket(char *buffer, int *len)
+/*!
+* \fn setZeroCopy
+* \brief send the packets queued with queueSendPacket() with MSG_ZEROCOPY: the kernel sends them from the
+* user buffers, which must then stay unchanged until waitSendCompletions(). Must be called once the socket
+* is open.
+*
+* \param enable true to send without copy
+* \return true if zero copy is used
+*/
+bool UDP::setZeroCopy(bool enable)
 {
-    for (int tries = 0; /*tries < 10*/; tries++) {
-        int ret = readSocketNonBlocking(buffer, len);
-        if (ret != -1) {
-            return ret;
-        }
-        LOG("no ring available, polling (try=%d)", tries);
-
-        ioctl(_nmd->fd, NIOCRXSYNC, NULL);
-
+    if (_sendCount > 0)
+        flushSendBuffer();
+    if (!enable) {
+        waitSendCompletions();
+        _zeroCopy = false;
+        return false;
     }
-
-    LOG_ERROR("no ring available, giving up");
-    errno = EAGAIN;
-    return -1;
+#ifdef _WIN32
+    LOG_WARNING("zero copy not available, the packets are copied by the system");
+    return false;
+#else
+    if (!_gatherSend) {
+        LOG_WARNING("zero copy needs a UDP socket, the packets are copied in the send buffer");
+        return false;
+    }
+    int one = 1;
+    if (setsockopt(_sock, SOL_SOCKET, SO_ZEROCOPY, (void*)&one, sizeof(one)) != 0) {
+        LOG_WARNING("SO_ZEROCOPY not available (error='%s'), the packets are copied by the kernel", strerror(errno));
+        return false;
+    }
+    _zeroCopy = true;
+    _zcCopied = false;
+    LOG_INFO("packets sent without copy (MSG_ZEROCOPY)");
+    return true;
+#endif
 }
 
-//http://www.scs.stanford.edu/histar/src/lind/asm-lind/checksum.h
+/*!
+* \fn waitSendCompletions
+* \brief with zero copy, send the queued packets and wait until the kernel releases all the buffers sent,
+* which can then be rewritten. Return at once without zero copy. On timeout the buffers are still held:
+* they must not be rewritten, the next call waits for them again.
+*
+* \param timeoutMs max time to wait
+* \return E_OK, -1 if the kernel still holds buffers after timeoutMs
+*/
+int UDP::waitSendCompletions(int timeoutMs)
+{
+    if (!_zeroCopy)
+        return E_OK;
+    if (_sendCount > 0)
+        flushSendBuffer();
+    int waited = 0;
+    while (_zcCompleted < _zcSent) {
+        if (waited >= timeoutMs) {
+            LOG_ERROR("the kernel still holds %lld messages after %d ms", _zcSent - _zcCompleted, timeoutMs);
+            return -1;
+        }
+        if (_readZeroCopyCompletions(1) == 0)
+            waited++;
+    }
+    return E_OK;
+}
+
+/*!
+* \fn _readZeroCopyCompletions
+* \brief read the notifications of the buffers released by the kernel on the error queue of the socket
+*
+* \param timeoutMs max time to wait for a notification, 0 to return at once
+* \return number of messages released
+*/
+int UDP::_readZeroCopyCompletions(int timeoutMs)
+{
+    int completed = 0;
+#ifndef _WIN32
+    if (timeoutMs > 0) {
+        struct pollfd pfd;
+        pfd.fd = _sock;
+        pfd.events = 0;     // POLLERR is always reported
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeoutMs) <= 0)
+            return 0;
+    }
+    while (true) {
+        char ctrl[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+        if (recvmsg(_sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            break;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+                continue;
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            // The messages [ee_info, ee_data] are released
+            completed += (int)(err.ee_data - err.ee_info + 1);
+            if ((err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && !_zcCopied) {
+                LOG_WARNING("the kernel copies the packets sent with MSG_ZEROCOPY on this interface, no gain");
+                _zcCopied = true;
+            }
+        }
+    }
+    _zcCompleted += completed;
+#endif
+    return completed;
+}
+
+/*!
+* \fn setPacer
+* \brief pace the packets queued with queueSendBuffer(): each packet get a launch time from the pacer, at
+* startFrame() and for each queued packet. A batch is sent at the launch time of its first packet, or, if
+* the pacer use SO_TXTIME, the kernel sends each packet at its launch time. Must be called once the
+* socket is open.
+*
+* \param pacer pacer, NULL to send the packets as fast as possible
+*/
+void UDP::setPacer(CPacer* pacer)
+{
+    if (_sendCount > 0)
+        flushSendBuffer();
+    _pacer = (pacer != NULL && pacer->getModel() != PACING_NONE ? pacer : NULL);
+    _txTimeEnabled = false;
+    if (_pacer == NULL || !_pacer->useTxTime())
+        return;
+#ifndef _WIN32
+    if (_sendMode == UDP_SEND_MODE_SINGLE) {
+        LOG_WARNING("launch time needs sendmmsg, pace the packets with a timer loop");
+        _pacer->disableTxTime();
+        return;
+    }
+    // i.e. an AF_XDP socket: the packets don't go through the qdisc
+    int domain = 0;
+    socklen_t optlen = sizeof(domain);
+    if (getsockopt(_sock, SOL_SOCKET, SO_DOMAIN, &domain, &optlen) == 0 && domain != AF_INET && domain != AF_INET6) {
+        LOG_WARNING("launch time needs a UDP socket, pace the packets with a timer loop");
+        _pacer->disableTxTime();
+        return;
+    }
+    struct tSockTxTime cfg;
+    cfg.clockid = CLOCK_TAI;
+    cfg.flags = 0;
+    if (setsockopt(_sock, SOL_SOCKET, SO_TXTIME, (void*)&cfg, sizeof(cfg)) != 0) {
+        LOG_WARNING("SO_TXTIME not available (error='%s'), pace the packets with a timer loop", strerror(errno));
+        _pacer->disableTxTime();
+        return;
+    }
+    _txTimeEnabled = true;
+    LOG_INFO("packets sent at their launch time by the kernel (SO_TXTIME)");
+#endif
+}
+
+/*!
+* \fn startFrame
+* \brief schedule the packets of the next frame, if the socket is paced (see setPacer())
+*
+* \param nbPackets number of packets of the frame
+* \param frameRate frame rate in Hz, 0 if unknown (no pacing for this frame)
+* \param activeRatio part of the frame period used by the packets in the gapped model
+*/
+void UDP::startFrame(int nbPackets, float frameRate, float activeRatio)
+{
+    if (_pacer != NULL)
+        _pacer->startFrame(nbPackets, frameRate, activeRatio);
+}
+
+/*!
+* \fn createReceiver
+* \brief create the receive socket for an interface name: "netmap-..." for Netmap, "tpacket-..." for
+* PacketRing, "xdp-..." for XdpSocket, a regular UDP socket otherwise
+*
+* \param interfaceName interface property of the pin, can be NULL
+* \return new socket, to delete by the caller
+*/
+UDP* UDP::createReceiver(const char* interfaceName)
+{
+    if (interfaceName == NULL)
+        return new UDP();
+#ifdef USE_TPACKET
+    if (PacketRing::isPacketRingInterface(interfaceName))
+        return new PacketRing(interfaceName);
+#endif
+    return createSender(interfaceName);
+}
+
+/*!
+* \fn createSender
+* \brief create the send socket for an interface name: "netmap-..." for Netmap, "xdp-..." for XdpSocket,
+* a regular UDP socket otherwise
+*
+* \param interfaceName interface property of the pin, can be NULL
+* \return new socket, to delete by the caller
+*/
+UDP* UDP::createSender(const char* interfaceName)
+{
+    if (interfaceName == NULL)
+        return new UDP();
+#ifdef USE_XDP
+    if (XdpSocket::isXdpInterface(interfaceName))
+        return new XdpSocket(interfaceName);
+#endif
+#ifdef USE_NETMAP
+    if (Netmap::isNetmapInterface(interfaceName))
+        return new Netmap(interfaceName);
+#endif
+    return new UDP();
+}
+
+/*!
+* \fn isBypassInterface
+* \brief tell if an interface name selects a socket receiving without the network stack: packet
+* ring, XDP or netmap. Such a socket gets all the packets of the address, it can't share them with
+* other sockets (SO_REUSEPORT).
+*
+* \param interfaceName interface property of the pin, can be NULL
+*/
+bool UDP::isBypassInterface(const char* interfaceName)
+{
+    if (interfaceName == NULL)
+        return false;
+#ifdef USE_TPACKET
+    if (PacketRing::isPacketRingInterface(interfaceName))
+        return true;
+#endif
+#ifdef USE_XDP
+    if (XdpSocket::isXdpInterface(interfaceName))
+        return true;
+#endif
+#ifdef USE_NETMAP
+    if (Netmap::isNetmapInterface(interfaceName))
+        return true;
+#endif
+    return false;
+}
+
+
+#ifndef _WIN32
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <net/if.h>
+
+/*!
+* \fn joinMulticastGroup
+* \brief join a multicast group on a device with a regular socket, for the sockets that bypass the network
+* stack: the socket sends the IGMP reports and must stay open, but is never read
+*
+* \param group multicast address, network order
+* \param ifindex index of the device
+* \return the socket, INVALID_SOCKET if error
+*/
+static SOCKET joinMulticastGroup(uint32_t group, int ifindex)
+{
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == INVALID_SOCKET)
+        return INVALID_SOCKET;
+    struct ip_mreqn mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr.s_addr = group;
+    mreq.imr_ifindex = ifindex;
+    if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+        close(sock);
+        return INVALID_SOCKET;
+    }
+    return sock;
+}
+
+#if defined(USE_NETMAP) || defined(USE_XDP)
+/*!
+* \fn resolveMacAddresses
+* \brief get the MAC addresses of the Ethernet header of the packets sent on a device by the sockets that
+* bypass the network stack. The source is the MAC address of the device. The destination is the multicast
+* one, or the one of the neighbor in the ARP table: the destination must be on the link.
+*
+* \param device name of the kernel device
+* \param dst destination address, network order
+* \param eth Ethernet header: destination then source MAC address
+* \return E_OK if success
+*/
+static int resolveMacAddresses(const char* device, uint32_t dst, unsigned char* eth)
+{
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s == INVALID_SOCKET || ioctl(s, SIOCGIFHWADDR, &ifr) != 0) {
+        LOG_ERROR("can't get the MAC address of '%s', error='%s'", device, strerror(errno));
+        if (s != INVALID_SOCKET)
+            close(s);
+        return E_ERROR;
+    }
+    memcpy(eth + 6, ifr.ifr_hwaddr.sa_data, 6);
+
+    // Destination MAC address
+    if (IN_MULTICAST(ntohl(dst))) {
+        uint32_t group = ntohl(dst);
+        unsigned char mac[6] = { 0x01, 0x00, 0x5E, (unsigned char)((group >> 16) & 0x7F), (unsigned char)(group >> 8), (unsigned char)group };
+        memcpy(eth, mac, 6);
+    }
+    else {
+        // Resolve the neighbor with a datagram sent by the network stack, then read the ARP table
+        struct sockaddr_in to;
+        memset(&to, 0, sizeof(to));
+        to.sin_family = AF_INET;
+        to.sin_addr.s_addr = dst;
+        to.sin_port = htons(9);     // discard
+        setsockopt(s, SOL_SOCKET, SO_BINDTODEVICE, device, strlen(device));
+        bool found = false;
+        for (int tries = 0; tries < 20 && !found; tries++) {
+            if (tries % 5 == 0)
+                sendto(s, "", 0, 0, (struct sockaddr*)&to, sizeof(to));
+            usleep(50000);
+            FILE* f = fopen("/proc/net/arp", "r");
+            char line[256];
+            while (f != NULL && fgets(line, sizeof(line), f) != NULL) {
+                char ipStr[64], macStr[64], dev[64];
+                unsigned int flags, mac[6];
+                if (sscanf(line, "%63s %*s %x %63s %*s %63s", ipStr, &flags, macStr, dev) != 4)
+                    continue;
+                if (inet_addr(ipStr) != dst || strcmp(dev, device) != 0 || (flags & 0x2) == 0)
+                    continue;
+                if (sscanf(macStr, "%x:%x:%x:%x:%x:%x", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) == 6) {
+                    for (int i = 0; i < 6; i++)
+                        eth[i] = (unsigned char)mac[i];
+                    found = true;
+                }
+            }
+            if (f != NULL)
+                fclose(f);
+        }
+        if (!found) {
+            struct in_addr addr;
+            addr.s_addr = dst;
+            LOG_ERROR("can't resolve the MAC address of %s on '%s'", inet_ntoa(addr), device);
+            close(s);
+            return E_ERROR;
+        }
+    }
+    close(s);
+    return E_OK;
+}
+#endif
+#endif
+
+#ifdef USE_NETMAP
+#include <netinet/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <chrono>
+
+/*
+ *
+ *
+ *  NetmapPort
+ *
+ *
+ */
+
+std::mutex NetmapPort::_registryLock;
+std::map<std::string, NetmapPort*> NetmapPort::_registry;
+
+static long long netmapTimeUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*!
+* \fn parseUdpHeaders
+* \brief check that a frame is an IPv4/UDP packet, with or without a VLAN tag, and locate its payload
+*
+* \return true if the frame is an unfragmented UDP packet
+*/
+static bool parseUdpHeaders(const unsigned char* frame, int len, uint32_t* daddr, uint16_t* dport, int* offset, int* payloadLen)
+{
+    int l2 = 14;
+    if (len < L2_L3_L4_HDR_SIZE)
+        return false;
+    uint16_t type = (frame[12] << 8) | frame[13];
+    if (type == ETHERTYPE_VLAN) {
+        l2 += 4;
+        type = (frame[16] << 8) | frame[17];
+    }
+    const unsigned char* ip = frame + l2;
+    int ihl = (ip[0] & 0x0F) * 4;
+    if (type != ETHERTYPE_IP || (ip[0] >> 4) != 4 || ihl < 20 || ip[9] != IPPROTO_UDP || len < l2 + ihl + 8)
+        return false;
+    if ((((ip[6] << 8) | ip[7]) & 0x1FFF) != 0 || (ip[6] & 0x20) != 0)
+        return false;
+    const unsigned char* udp = ip + ihl;
+    memcpy(daddr, ip + 16, 4);
+    memcpy(dport, udp + 2, 2);
+    *offset = l2 + ihl + 8;
+    *payloadLen = std::min((int)((udp[4] << 8) | udp[5]) - 8, len - *offset);
+    return *payloadLen >= 0;
+}
+
+NetmapPort::NetmapPort(const char* name)
+{
+    _name = name;
+    _refCount = 0;
+    _bufBase = NULL;
+    _bufSize = 0;
+    _closing = false;
+    _nextTxRing = 0;
+}
+
+/*!
+* \fn acquire
+* \brief open a netmap device, or give the one already opened by another socket
+*
+* \param name netmap device name, i.e. "netmap:eth0" or "vale0:1"
+* \return the port, NULL if error. Must be released by release().
+*/
+NetmapPort* NetmapPort::acquire(const char* name)
+{
+    std::lock_guard<std::mutex> lock(_registryLock);
+    NetmapPort* port = NULL;
+    auto it = _registry.find(name);
+    if (it != _registry.end())
+        port = it->second;
+    else {
+        port = new NetmapPort(name);
+        if (port->_open() != E_OK) {
+            port->_close();
+            delete port;
+            return NULL;
+        }
+        _registry[name] = port;
+    }
+    port->_refCount++;
+    return port;
+}
+
+void NetmapPort::release(NetmapPort* port)
+{
+    std::lock_guard<std::mutex> lock(_registryLock);
+    if (port == NULL || --port->_refCount > 0)
+        return;
+    _registry.erase(port->_name);
+    port->_close();
+    delete port;
+}
+
+/*!
+* \fn _open
+* \brief bind each hardware ring pair with its own descriptor ("<name>-<ring>"), unless the name already
+* selects the rings, and start a receive thread per descriptor. The spare buffers are the extra buffers
+* allocated with the first descriptor. They are taken before the other rings are opened, so _close() gives
+* them back to the kernel if one of them fails.
+*/
+int NetmapPort::_open()
+{
+    const char* rings = _name.c_str() + (strncmp(_name.c_str(), "netmap:", 7) == 0 ? 7 : 0);
+    bool perRing = (strpbrk(rings, "-*^{}/") == NULL);
+
+    struct nmreq req;
+    memset(&req, 0, sizeof(req));
+    req.nr_arg3 = NETMAP_EXTRA_BUFS;
+    std::string name = (perRing ? _name + "-0" : _name);
+    struct nm_desc* first = nm_open(name.c_str(), &req, NETMAP_NO_TX_POLL, NULL);
+    if (first == NULL) {
+        LOG_ERROR("failed to open netmap device %s: %s", name.c_str(), strerror(errno));
+        return E_ERROR;
+    }
+    int nbRings = (perRing ? (int)first->req.nr_rx_rings : 1);
+    for (int i = 0; i < nbRings; i++) {
+        tRing* ring = new tRing();
+        ring->dropped = 0;
+        ring->nmd = first;
+        if (i > 0) {
+            name = _name + "-" + std::to_string(i);
+            ring->nmd = nm_open(name.c_str(), NULL, NETMAP_NO_TX_POLL | NM_OPEN_NO_MMAP, first);
+        }
+        _rings.push_back(ring);
+        if (ring->nmd == NULL) {
+            LOG_ERROR("failed to open netmap ring %s: %s", name.c_str(), strerror(errno));
+            return E_ERROR;
+        }
+        if (i > 0)
+            continue;
+
+        // The descriptors share the same memory: a buffer index is valid in all the rings
+        struct netmap_ring* ring0 = NETMAP_RXRING(first->nifp, first->first_rx_ring);
+        _bufBase = NETMAP_BUF(ring0, 0);
+        _bufSize = ring0->nr_buf_size;
+        uint32_t idx = first->nifp->ni_bufs_head;
+        while (idx != 0 && ring->spare.size() < first->req.nr_arg3) {
+            ring->spare.push_back(idx);
+            idx = *(uint32_t*)getBuffer(idx);
+        }
+        first->nifp->ni_bufs_head = 0;
+    }
+
+    std::vector<uint32_t> extra;
+    extra.swap(_rings[0]->spare);
+    int nbExtra = (int)extra.size();
+    for (int i = 0; i < nbExtra; i++)
+        _rings[i % nbRings]->spare.push_back(extra[i]);
+    if (nbExtra == 0)
+        LOG_ERROR("%s: no extra buffer, all the received packets will be dropped", _name.c_str());
+
+    for (int i = 0; i < nbRings; i++)
+        _rings[i]->th = std::thread(&NetmapPort::_rxThread, this, i);
+    LOG_INFO("%s: %d rings, %d spare buffers of %d bytes", _name.c_str(), nbRings, nbExtra, _bufSize);
+    return E_OK;
+}
+
+void NetmapPort::_close()
+{
+    _closing = true;
+    for (tRing* ring : _rings) {
+        if (ring->th.joinable())
+            ring->th.join();
+    }
+
+    // Give the spare buffers back: the kernel frees the list of ni_bufs_head on close
+    struct nm_desc* first = (_rings.empty() ? NULL : _rings[0]->nmd);
+    if (first != NULL) {
+        uint32_t head = 0;
+        for (tRing* ring : _rings) {
+            for (uint32_t idx : ring->spare) {
+                *(uint32_t*)getBuffer(idx) = head;
+                head = idx;
+            }
+        }
+        first->nifp->ni_bufs_head = head;
+    }
+    for (int i = (int)_rings.size() - 1; i >= 0; i--) {
+        if (_rings[i]->nmd != NULL)
+            nm_close(_rings[i]->nmd);
+        if (_rings[i]->dropped > 0)
+            LOG_INFO("%s: ring %d dropped %lld packets", _name.c_str(), i, _rings[i]->dropped);
+        delete _rings[i];
+    }
+    _rings.clear();
+}
+
+void NetmapPort::subscribe(Netmap* socket)
+{
+    for (tRing* ring : _rings) {
+        std::lock_guard<std::mutex> lock(ring->lock);
+        ring->sockets.push_back(socket);
+    }
+}
+
+/*!
+* \fn unsubscribe
+* \brief stop to give packets to a socket, and take back the buffers it still has. The socket must not be
+* read anymore.
+*/
+void NetmapPort::unsubscribe(Netmap* socket)
+{
+    for (int i = 0; i < (int)_rings.size(); i++) {
+        tRing* ring = _rings[i];
+        std::lock_guard<std::mutex> lock(ring->lock);
+        ring->sockets.erase(std::remove(ring->sockets.begin(), ring->sockets.end(), socket), ring->sockets.end());
+        socket->drain(i, ring->spare);
+    }
+}
+
+/*!
+* \fn _rxThread
+* \brief receive the packets of a descriptor. The thread busy-waits with NIOCRXSYNC while packets arrive,
+* and sleeps in poll() NETMAP_SPIN_US after the last one.
+*/
+void NetmapPort::_rxThread(int index)
+{
+    struct nm_desc* nmd = _rings[index]->nmd;
+    long long lastPacket = 0;
+    while (!_closing) {
+        int n = _receive(index);
+        long long now = netmapTimeUs();
+        if (n > 0)
+            lastPacket = now;
+        if (now - lastPacket < NETMAP_SPIN_US)
+            ioctl(nmd->fd, NIOCRXSYNC, NULL);
+        else {
+            struct pollfd pfd;
+            pfd.fd = nmd->fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            poll(&pfd, 1, NETMAP_POLL_TIMEOUT);
+        }
+    }
+}
+
+/*!
+* \fn _receive
+* \brief give the packets of the rings to the sockets: the buffer of a packet is swapped with a spare one.
+* A packet is dropped if it's for no socket, or if its socket is full, or if there is no spare buffer.
+*
+* \return number of packets taken from the rings
+*/
+int NetmapPort::_receive(int index)
+{
+    tRing* ring = _rings[index];
+    struct nm_desc* nmd = ring->nmd;
+    std::lock_guard<std::mutex> lock(ring->lock);
+
+    tNetmapBuf buf;
+    for (Netmap* socket : ring->sockets) {
+        while (socket->getFreeQueue(index)->pop(&buf))
+            ring->spare.push_back(buf.idx);
+    }
+
+    int n = 0;
+    for (int r = nmd->first_rx_ring; r <= nmd->last_rx_ring; r++) {
+        struct netmap_ring* rx = NETMAP_RXRING(nmd->nifp, r);
+        while (!nm_ring_empty(rx)) {
+            struct netmap_slot* slot = &rx->slot[rx->cur];
+            const unsigned char* frame = (const unsigned char*)NETMAP_BUF(rx, slot->buf_idx);
+            uint32_t daddr;
+            uint16_t dport;
+            int offset, len;
+            Netmap* target = NULL;
+            if (parseUdpHeaders(frame, slot->len, &daddr, &dport, &offset, &len)) {
+                for (Netmap* socket : ring->sockets) {
+                    if (socket->accept(daddr, dport)) {
+                        target = socket;
+                        break;
+                    }
+                }
+            }
+            if (target != NULL) {
+                buf.idx = slot->buf_idx;
+                buf.offset = (uint16_t)offset;
+                buf.len = (uint16_t)len;
+                if (!ring->spare.empty() && target->deliver(index, buf)) {
+                    slot->buf_idx = ring->spare.back();
+                    slot->flags |= NS_BUF_CHANGED;
+                    ring->spare.pop_back();
+                }
+                else
+                    ring->dropped++;
+            }
+            rx->head = rx->cur = nm_ring_next(rx, rx->cur);
+            n++;
+        }
+    }
+    if (n > 0) {
+        for (Netmap* socket : ring->sockets)
+            socket->wake();
+    }
+    return n;
+}
+
+/*
+ *
+ *
+ *  Netmap
+ *
+ *
+ */
+
+Netmap::Netmap(const char* interfaceName)
+{
+    _device = (interfaceName != NULL ? interfaceName : "");
+    _gatherSend = false;
+    _waiting = false;
+    _closing = false;
+    _reading = false;
+    memset(&_held, 0, sizeof(_held));
+}
+
+bool Netmap::isNetmapInterface(const char* interfaceName)
+{
+    return (interfaceName != NULL && strncmp(interfaceName, NETMAP_INTERFACE_PREFIX, strlen(NETMAP_INTERFACE_PREFIX)) == 0);
+}
+
+/*
+ * Create a netmap socket.
+ *
+ * @param remote_addr  the destination IP(v4 as of now) address, or the multicast group to receive
+ * @param local_addr   the unicast address to receive, if no group
+ * @param port         the destination UDP port
+ * @param modelisten   true to receive, false to send
+ * @param ifname       the name of the device, if not given to the constructor
+ * @return             0 if successful, -1 in case of an error
+ *
+ * The netmap socket will act as a regular UDP socket, except that packets
+ * will be sent over a netmap interface instead of using the regular kernel API.
+ * Such an interface can be a regular NIC or a virtual interface, for fast
+ * communication with a packet processing engine (eg VPP)
+ * Packets are crafted from scratch, which means that an IP address must be
+ * provided for the interface. The received packets are those sent to the
+ * group, or else to the local address, or else to the IP of the interface.
+ * A unicast destination must be on the link of a NIC: its MAC address is
+ * taken from the ARP table of the kernel device.
+ *
+ * deviceName must have the following format:
+ *    netmap-<ip>-<netmap_device_name>
+ *         where ip is the IP address to assign to the netmap interface
+ *               netmap_device_name is the internal netmap interface name
+ * netmap regular devices names are the same as in the kernel ("eth0", etc)
+ * netmap local devices names use the following format:
+ *    valeXX:YY<flags>
+ *         where XX is the switch number and YY the port number inside the switch
+ *         flags can be {0 for a master pipe or }0 for a slave pipe
+ *
+ */
+int Netmap::openSocket(const char* remote_addr, const char* local_addr, int port, bool modelisten, const char* ifname)
+{
+    const char* deviceName = (!_device.empty() ? _device.c_str() : ifname);
+    if (!isNetmapInterface(deviceName)) {
+        LOG_ERROR("called with invalid device name");
+        LOG_ERROR("device name must have the following format:");
+        LOG_ERROR("netmap-<ip>-<netmap_device_name>");
+        return -1;
+    }
+    const char *ipStr = deviceName + strlen(NETMAP_INTERFACE_PREFIX);
+    const char *netmapDeviceName = strchr(ipStr, '-');
+    if (netmapDeviceName == NULL) {
+        LOG_ERROR("called with invalid device name");
+        LOG_ERROR("device name must have the following format:");
+        LOG_ERROR("netmap-<ip>-<netmap_device_name>");
+        return -1;
+    }
+    _my_ip = inet_addr(std::string(ipStr, netmapDeviceName - ipStr).c_str());
+    netmapDeviceName++;
+
+    // Kernel device of a NIC, none for a VALE port or a pipe
+    const char* kernelName = netmapDeviceName + (strncmp(netmapDeviceName, "netmap:", 7) == 0 ? 7 : 0);
+    std::string kernelDevice(kernelName, strcspn(kernelName, "-*^{}/"));
+    int ifindex = (int)if_nametoindex(kernelDevice.c_str());
+
+    // MAC addresses of the sent packets: the ones of the NIC and of the destination on the link. Without
+    // kernel device, a locally administered source address made of the IP, and the group or broadcast
+    // destination address: the VALE switch learns the source addresses.
+    unsigned char macs[2 * ETHER_ADDR_LEN];
+    if (!modelisten) {
+        uint32_t daddr = (remote_addr != NULL ? inet_addr(remote_addr) : INADDR_NONE);
+        uint32_t group = ntohl(daddr);
+        if (ifindex != 0) {
+            if (resolveMacAddresses(kernelDevice.c_str(), daddr, macs) != E_OK)
+                return -1;
+        }
+        else if (IN_MULTICAST(group)) {
+            unsigned char mac[ETHER_ADDR_LEN] = { 0x01, 0x00, 0x5E, (unsigned char)((group >> 16) & 0x7F), (unsigned char)(group >> 8), (unsigned char)group };
+            memcpy(macs, mac, ETHER_ADDR_LEN);
+        }
+        else
+            memset(macs, 0xFF, ETHER_ADDR_LEN);
+        if (ifindex == 0) {
+            macs[ETHER_ADDR_LEN] = 0x02;
+            macs[ETHER_ADDR_LEN + 1] = 0x00;
+            memcpy(macs + ETHER_ADDR_LEN + 2, &_my_ip, 4);
+        }
+    }
+
+    _nmPort = NetmapPort::acquire(netmapDeviceName);
+    if (_nmPort == NULL)
+        return -1;
+    _port = port;
+    _af = AF_INET;
+    _listen = modelisten;
+    _closing = false;
+
+    if (modelisten) {
+        _filterPort = htons((uint16_t)port);
+        if (remote_addr != NULL && remote_addr[0] != '\0')
+            _filterAddr = inet_addr(remote_addr);
+        else if (local_addr != NULL && local_addr[0] != '\0' && strcmp(local_addr, C_INADDR_ANY) != 0 && strcmp(local_addr, C_INADDR_ANY_REUSE) != 0)
+            _filterAddr = inet_addr(local_addr);
+        else
+            _filterAddr = _my_ip;
+        for (int i = 0; i < _nmPort->getRingsNb(); i++) {
+            _rxQueues.push_back(new NetmapBufQueue());
+            _freeQueues.push_back(new NetmapBufQueue());
+        }
+        _heldRing = -1;
+        _nextRing = 0;
+        _nmPort->subscribe(this);
+
+        // A NIC must accept the group: join it on the kernel device, if there is one
+        if (IN_MULTICAST(ntohl(_filterAddr)) && ifindex != 0) {
+            _memberSock = joinMulticastGroup(_filterAddr, ifindex);
+            if (_memberSock == INVALID_SOCKET)
+                LOG_ERROR("can't join the multicast group %s on '%s', error='%s'", remote_addr, kernelDevice.c_str(), strerror(errno));
+        }
+        _sock = _nmPort->getDesc(0)->fd;
+        LOG_INFO("%s: receive port %d on %d rings", netmapDeviceName, port, _nmPort->getRingsNb());
+        return 0;
+    }
+    _txRing = _nmPort->takeTxRing();
+    _sock = _nmPort->getDesc(_txRing)->fd;
+
+    //Ethernet header
+    struct ether_header *eth = (struct ether_header *) _headers;
+    memcpy(&eth->ether_dhost, macs, ETHER_ADDR_LEN);
+    memcpy(&eth->ether_shost, macs + ETHER_ADDR_LEN, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ETHERTYPE_IP);
+
+    //IP header
+    struct iphdr *ip = (struct iphdr *) (eth + 1);
+    memset(ip, 0, sizeof(*ip));
+    ip->ihl = 5;
+    ip->version = 4;
+    ip->tot_len = 0;
+    _ip_tot_len = &ip->tot_len;
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->saddr = _my_ip;
+    ip->daddr = inet_addr(remote_addr);
+    _ip_csum = &ip->check;
+
+    //UDP header
+    struct udphdr *udp = (struct udphdr *) (ip + 1);
+    udp->source = udp->dest = htons(port);
+    udp->check = 0;
+    udp->len = 0;
+    _udp_len = &udp->len;
+    return 0;
+}
+
+int Netmap::closeSocket()
+{
+    if (!isValid()) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Let a blocked read see the close before the buffers are taken back
+    _closing = true;
+    wake();
+    for (int i = 0; i < 2 * NETMAP_POLL_TIMEOUT && _reading; i++)
+        usleep(1000);
+    if (_listen) {
+        _releaseHeld();
+        _nmPort->unsubscribe(this);
+        for (NetmapBufQueue* queue : _rxQueues)
+            delete queue;
+        for (NetmapBufQueue* queue : _freeQueues)
+            delete queue;
+        _rxQueues.clear();
+        _freeQueues.clear();
+    }
+    if (_memberSock != INVALID_SOCKET)
+        close(_memberSock);
+    _memberSock = INVALID_SOCKET;
+    NetmapPort::release(_nmPort);
+    _nmPort = NULL;
+    _txRing = -1;
+    _sock = INVALID_SOCKET;
+    return 0;
+}
+
+/* Called by a ring thread after it gave packets */
+void Netmap::wake()
+{
+    if (_waiting.load()) {
+        std::lock_guard<std::mutex> lock(_waitLock);
+        _waitCv.notify_one();
+    }
+}
+
+/* Take back all the buffers of a ring, called by the port once the socket is not read anymore */
+void Netmap::drain(int ring, std::vector<uint32_t>& spare)
+{
+    tNetmapBuf buf;
+    while (_rxQueues[ring]->pop(&buf))
+        spare.push_back(buf.idx);
+    while (_freeQueues[ring]->pop(&buf))
+        spare.push_back(buf.idx);
+}
+
+void Netmap::_releaseHeld()
+{
+    if (_heldRing >= 0 && !_freeQueues[_heldRing]->push(_held))
+        LOG_ERROR("can't give back the netmap buffer %u", _held.idx);
+    _heldRing = -1;
+}
+
+bool Netmap::_popPacket(char **packet, int *len)
+{
+    int nbRings = (int)_rxQueues.size();
+    for (int i = 0; i < nbRings; i++) {
+        int ring = (_nextRing + i) % nbRings;
+        if (_rxQueues[ring]->pop(&_held)) {
+            _heldRing = ring;
+            _nextRing = ring;
+            *packet = _nmPort->getBuffer(_held.idx) + _held.offset;
+            *len = _held.len;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+* \fn readPacket
+* \brief give the UDP payload of the next packet, in place in its netmap buffer. The packet stays valid
+* until the next read: its buffer is then given back to its ring. Busy-waits NETMAP_SPIN_US, then sleeps
+* until a ring thread gives a packet.
+*
+* \param packet output pointer to the UDP payload
+* \param len output size of the payload
+* \return size of the payload, -1 if error or closed
+*/
+int Netmap::readPacket(char **packet, int *len)
+{
+    if (!_listen || _nmPort == NULL)
+        return -1;
+    _reading = true;
+    _releaseHeld();
+    long long spinStart = 0;
+    while (!_closing) {
+        if (_popPacket(packet, len)) {
+            _reading = false;
+            LOG("recv %d bytes from port %d", *len, _port);
+            return *len;
+        }
+        long long now = netmapTimeUs();
+        if (spinStart == 0)
+            spinStart = now;
+        if (now - spinStart < NETMAP_SPIN_US)
+            continue;
+        std::unique_lock<std::mutex> lock(_waitLock);
+        _waiting = true;
+        _waitCv.wait_for(lock, std::chrono::milliseconds(NETMAP_POLL_TIMEOUT), [&] {
+            if (_closing)
+                return true;
+            for (NetmapBufQueue* queue : _rxQueues) {
+                if (!queue->empty())
+                    return true;
+            }
+            return false;
+        });
+        _waiting = false;
+        spinStart = 0;
+    }
+    _reading = false;
+    errno = EAGAIN;
+    return -1;
+}
+
+int Netmap::readSocket(char *buffer, int *len)
+{
+    char* packet = NULL;
+    int size = 0;
+    int result = readPacket(&packet, &size);
+    if (result <= 0) {
+        *len = 0;
+        return result;
+    }
+    if (size > *len) {
+        LOG_ERROR("packet of %d bytes truncated to %d bytes", size, *len);
+        size = *len;
+    }
+    memcpy(buffer, packet, size);
+    *len = size;
+    return size;
+}
+
+int Netmap::readBatchSocket(char **buffer, int *len, int count, long long *timestamp)
+{
+    int n = 0;
+    char* packet = NULL;
+    int size = 0;
+    while (n < count) {
+        if (n == 0) {
+            int result = readSocket(buffer[0], &len[0]);
+            if (result <= 0)
+                break;
+        }
+        else {
+            _releaseHeld();
+            if (!_popPacket(&packet, &size))
+                break;
+            len[n] = std::min(size, len[n]);
+            memcpy(buffer[n], packet, len[n]);
+        }
+        if (timestamp != NULL)
+            timestamp[n] = 0;
+        n++;
+    }
+    for (int i = n; i < count; i++)
+        len[i] = 0;
+    return (n == 0 ? -1 : n);
+}
+
+//http://www.scs.stanford.edu/histar/src/lind/asm-lind/checksum.h
+/*
+ * Checksums for x86-64
+ * Copyright 2002 by Andi Kleen, SuSE Labs
+ * with some code from asm-i386/checksum.h
+ */
+static inline uint16_t ip_fast_csum(const void *iph, unsigned int ihl)
+{
+    unsigned int sum;
+
+    asm("  movl (%1), %0\n"
+        "  subl $4, %2\n"
+        "  jbe 2f\n"
+        "  addl 4(%1), %0\n"
+        "  adcl 8(%1), %0\n"
+        "  adcl 12(%1), %0\n"
+        "1: adcl 16(%1), %0\n"
+        "  lea 4(%1), %1\n"
+        "  decl %2\n"
+        "  jne      1b\n"
+        "  adcl $0, %0\n"
+        "  movl %0, %2\n"
+        "  shrl $16, %0\n"
+        "  addw %w2, %w0\n"
+        "  adcl $0, %0\n"
+        "  notl %0\n"
+        "2:"
+        /* Since the input registers which are loaded with iph and ih
+            are modified, we must also specify them as outputs, or gcc
+            will assume they contain their original values. */
+        : "=r" (sum), "=r" (iph), "=r" (ihl)
+        : "1" (iph), "2" (ihl)
+            : "memory");
+    return (uint16_t)sum;
+}
+
+/*!
+* \fn setTimestampMode
+* \brief no receive time: the packets don't go through the network stack
+*/
+int Netmap::setTimestampMode(int mode, const char* device)
+{
+    if (mode != UDP_TIMESTAMP_NONE)
+        LOG_WARNING("no receive time on a netmap socket");
+    _timestampMode = UDP_TIMESTAMP_NONE;
+    _lastTimestamp = 0;
+    return _timestampMode;
+}
+
+/*!
+* \fn _writePackets
+* \brief build count packets of the same size in the slots of the send ring, then sync the ring once.
+* Waits in poll() while the ring is full.
+*
+* \return number of packets sent, -1 if none
+*/
+int Netmap::_writePackets(char **buffer, int count, int len)
+{
+    if (_nmPort == NULL || _txRing < 0)
+        return -1;
+    if (len + (int)sizeof(_headers) > _nmPort->getBufferSize()) {
+        LOG_ERROR("packet of %d bytes too big (max %d)", len, _nmPort->getBufferSize() - (int)sizeof(_headers));
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(_nmPort->getTxLock(_txRing));
+    struct nm_desc* nmd = _nmPort->getDesc(_txRing);
+
+    // Same size: the headers are the same for the whole batch
+    *_ip_tot_len = htons(sizeof(struct iphdr) + sizeof(struct udphdr) + len);
+    *_udp_len = htons(sizeof(struct udphdr) + len);
+    *_ip_csum = 0;
+    *_ip_csum = ip_fast_csum(_headers + sizeof(struct ether_header), sizeof(struct iphdr)/4);
+
+    int sent = 0;
+    for (int tries = 0; sent < count && tries < 1000; ) {
+        int queued = 0;
+        for (int r = nmd->first_tx_ring; r <= nmd->last_tx_ring && sent < count; r++) {
+            struct netmap_ring* ring = NETMAP_TXRING(nmd->nifp, r);
+            while (!nm_ring_empty(ring) && sent < count) {
+                struct netmap_slot* slot = &ring->slot[ring->cur];
+                char* dst_buf = NETMAP_BUF(ring, slot->buf_idx);
+                memcpy(dst_buf, _headers, sizeof(_headers));
+                memcpy(dst_buf + sizeof(_headers), buffer[sent], len);
+                slot->len = sizeof(_headers) + len;
+                ring->head = ring->cur = nm_ring_next(ring, ring->cur);
+                sent++;
+                queued++;
+            }
+        }
+        if (sent == count)
+            break;
+        // Ring full: sync, and wait for room if it's still full
+        ioctl(nmd->fd, NIOCTXSYNC, NULL);
+        if (queued == 0 && tries++ > 0) {
+            struct pollfd pfd;
+            pfd.fd = nmd->fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            poll(&pfd, 1, 1);
+        }
+    }
+    ioctl(nmd->fd, NIOCTXSYNC, NULL);
+    if (sent < count)
+        LOG_ERROR("send ring full, %d packets of %d sent", sent, count);
+
+    LOG("sent %d packets of %d bytes to port %d", sent, len, _port);
+    return (sent == 0 ? -1 : sent);
+}
+
+int Netmap::writeSocket(char *buffer, int *len)
+{
+    return (_writePackets(&buffer, 1, *len) == 1 ? *len : -1);
+}
+
+/*
+ * @return the number of packets actually sent
+ */
+int Netmap::writeBatchedSocket(char **buffer, int count, int *len)
+{
+    return _writePackets(buffer, count, *len);
+}
+
+
+
+#endif //USE_NETMAP
+
+#ifdef USE_TPACKET
+
+/*
+ *
+ *
+ *  PacketRing
+ *
+ *
+ */
+
+PacketRing::PacketRing(const char* interfaceName)
+{
+    _device[0] = '\0';
+    _fanoutGroup = -1;
+    _memberSock = INVALID_SOCKET;
+    _ring = NULL;
+    _blockIdx = 0;
+    _pkt = NULL;
+    _pktLeft = 0;
+    _filterAddr = 0;
+    _filterPort = 0;
+    _closing = false;
+    _reading = false;
+    _nPackets = 0;
+    _nDropped = 0;
+
+    // tpacket-<device>[:<fanout group>]
+    if (isPacketRingInterface(interfaceName)) {
+        const char* device = interfaceName + strlen(TPACKET_INTERFACE_PREFIX);
+        const char* group = strchr(device, ':');
+        int len = (int)(group == NULL ? strlen(device) : group - device);
+        len = std::min(len, IFNAMSIZ - 1);
+        memcpy(_device, device, len);
+        _device[len] = '\0';
+        if (group != NULL)
+            _fanoutGroup = atoi(group + 1) & 0xFFFF;
+    }
+}
+
+PacketRing::~PacketRing()
+{
+    if (isValid())
+        closeSocket();
+}
+
+bool PacketRing::isPacketRingInterface(const char* interfaceName)
+{
+    return (interfaceName != NULL && strncmp(interfaceName, TPACKET_INTERFACE_PREFIX, strlen(TPACKET_INTERFACE_PREFIX)) == 0);
+}
+
+/*!
+* \fn _attachFilter
+* \brief keep in the ring only the UDP packets of the address and port: the other packets of the device are
+* dropped by the kernel before being copied. The packets start at the IP header (SOCK_DGRAM).
+*/
+int PacketRing::_attachFilter()
+{
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD  + BPF_B   + BPF_ABS, 9),                           // IP protocol
+        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,   IPPROTO_UDP, 0, 8),
+        BPF_STMT(BPF_LD  + BPF_H   + BPF_ABS, 6),                           // fragment offset, more fragments
+        BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K,  0x3FFF, 6, 0),
+        BPF_STMT(BPF_LD  + BPF_W   + BPF_ABS, 16),                          // destination address
+        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,   ntohl(_filterAddr), 0, 4),
+        BPF_STMT(BPF_LDX + BPF_B   + BPF_MSH, 0),                           // IP header length
+        BPF_STMT(BPF_LD  + BPF_H   + BPF_IND, 2),                           // destination port
+        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,   ntohs(_filterPort), 0, 1),
+        BPF_STMT(BPF_RET + BPF_K,             0x40000),
+        BPF_STMT(BPF_RET + BPF_K,             0),
+    };
+    if (_filterAddr == 0)
+        code[5] = BPF_JUMP(BPF_JMP + BPF_JA, 0, 0, 0);   // any address
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    if (setsockopt(_sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) != 0) {
+        LOG_ERROR("setsockopt(SO_ATTACH_FILTER) failed, error='%s'", strerror(errno));
+        return E_ERROR;
+    }
+    return E_OK;
+}
+
+/*!
+* \fn openSocket
+* \brief open the ring on the device of the interface name, for the packets sent to remote_addr (multicast
+* group, joined on the device) or else local_addr, and to port
+*
+* \param remote_addr multicast group, can be NULL or empty
+* \param local_addr unicast destination address, can be NULL or empty for any address
+* \param port destination port
+* \param modelisten must be true, the ring only receives
+* \param ifname not used, the device is given by the interface name of the constructor
+* \return E_OK if success
+*/
+int PacketRing::openSocket(const char* remote_addr, const char* local_addr, int port, bool modelisten, const char* ifname)
+{
+    if (!modelisten || _device[0] == '\0') {
+        LOG_ERROR("a packet ring only receives, on an interface named %s<device>[:<fanout group>]", TPACKET_INTERFACE_PREFIX);
+        return E_ERROR;
+    }
+    int ifindex = if_nametoindex(_device);
+    if (ifindex == 0) {
+        LOG_ERROR("unknown device '%s': '%s'", _device, strerror(errno));
+        return E_ERROR;
+    }
+    _port = port;
+    _af = AF_INET;
+    _filterPort = htons((uint16_t)port);
+    _filterAddr = 0;
+    bool multicast = false;
+    if (remote_addr != NULL && remote_addr[0] != '\0') {
+        _filterAddr = inet_addr(remote_addr);
+        multicast = IN_MULTICAST(ntohl(_filterAddr));
+    }
+    else if (local_addr != NULL && local_addr[0] != '\0' && strcmp(local_addr, C_INADDR_ANY) != 0 && strcmp(local_addr, C_INADDR_ANY_REUSE) != 0)
+        _filterAddr = inet_addr(local_addr);
+
+    _sock = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (_sock == INVALID_SOCKET) {
+        LOG_ERROR("Failed to create packet socket: '%s' (needs CAP_NET_RAW)", strerror(errno));
+        return E_FATAL;
+    }
+    if (_attachFilter() != E_OK) {
+        closeSocket();
+        return E_FATAL;
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(_sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+        LOG_ERROR("setsockopt(PACKET_VERSION) failed, error='%s'", strerror(errno));
+        closeSocket();
+        return E_FATAL;
+    }
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = TPACKET_BLOCK_SIZE;
+    req.tp_block_nr = TPACKET_BLOCK_NB;
+    req.tp_frame_size = TPACKET_FRAME_SIZE;
+    req.tp_frame_nr = (TPACKET_BLOCK_SIZE / TPACKET_FRAME_SIZE) * TPACKET_BLOCK_NB;
+    req.tp_retire_blk_tov = TPACKET_BLOCK_TIMEOUT;
+    if (setsockopt(_sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+        LOG_ERROR("setsockopt(PACKET_RX_RING) failed, error='%s'", strerror(errno));
+        closeSocket();
+        return E_FATAL;
+    }
+    void* ring = mmap(NULL, (size_t)TPACKET_BLOCK_SIZE * TPACKET_BLOCK_NB, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _sock, 0);
+    if (ring == MAP_FAILED) {
+        LOG_ERROR("mmap of the packet ring failed, error='%s'", strerror(errno));
+        closeSocket();
+        return E_FATAL;
+    }
+    _ring = (char*)ring;
+    _blockIdx = 0;
+    _pkt = NULL;
+    _pktLeft = 0;
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_IP);
+    addr.sll_ifindex = ifindex;
+    if (bind(_sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        LOG_ERROR("bind to device '%s' failed, error='%s'", _device, strerror(errno));
+        closeSocket();
+        return E_FATAL;
+    }
+    if (_fanoutGroup >= 0) {
+        int fanout = _fanoutGroup | (PACKET_FANOUT_HASH << 16);
+        if (setsockopt(_sock, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) != 0)
+            LOG_ERROR("setsockopt(PACKET_FANOUT) failed for group %d, error='%s'", _fanoutGroup, strerror(errno));
+    }
+
+    // The ring doesn't join the multicast group
+    if (multicast) {
+        _memberSock = joinMulticastGroup(_filterAddr, ifindex);
+        if (_memberSock == INVALID_SOCKET)
+            LOG_ERROR("can't join the multicast group %s on '%s', error='%s'", remote_addr, _device, strerror(errno));
+    }
+
+    _closing = false;
+    LOG_INFO("packet ring of %d x %d bytes on '%s' for %s:%d, fanout group=%d", TPACKET_BLOCK_NB, TPACKET_BLOCK_SIZE,
+        _device, (_filterAddr == 0 ? "*" : inet_ntoa(*(struct in_addr*)&_filterAddr)), port, _fanoutGroup);
+    return E_OK;
+}
+
+void PacketRing::_updateStats()
+{
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if (getsockopt(_sock, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+        _nPackets += stats.tp_packets;
+        _nDropped += stats.tp_drops;
+    }
+}
+
+int PacketRing::closeSocket()
+{
+    LOG(" -->");
+    // Let a blocked read see the close before unmapping the ring
+    _closing = true;
+    for (int i = 0; i < 2 * TPACKET_POLL_TIMEOUT && _reading; i++)
+        usleep(1000);
+
+    if (_sock != INVALID_SOCKET) {
+        _updateStats();
+        LOG_INFO("packet ring on '%s': %lld packets, %lld dropped", _device, _nPackets, _nDropped);
+    }
+    if (_ring != NULL)
+        munmap(_ring, (size_t)TPACKET_BLOCK_SIZE * TPACKET_BLOCK_NB);
+    _ring = NULL;
+    _pkt = NULL;
+    if (_memberSock != INVALID_SOCKET)
+        close(_memberSock);
+    _memberSock = INVALID_SOCKET;
+    if (_sock != INVALID_SOCKET)
+        close(_sock);
+    _sock = INVALID_SOCKET;
+    LOG(" <--");
+    return E_OK;
+}
+
+/*!
+* \fn readPacket
+* \brief give the UDP payload of the next packet, in place in the ring. The packet stays valid until the next
+* read: its block is given back to the kernel when all its packets have been read.
+*
+* \param packet output pointer to the UDP payload
+* \param len output size of the payload
+* \return size of the payload, -1 if error or closed
+*/
+int PacketRing::readPacket(char **packet, int *len)
+{
+    if (_ring == NULL)
+        return -1;
+    _reading = true;
+    while (!_closing) {
+        struct tpacket_block_desc* block = (struct tpacket_block_desc*)(_ring + (size_t)_blockIdx * TPACKET_BLOCK_SIZE);
+
+        if (_pkt == NULL) {
+            // Wait for the kernel to give the block
+            if ((block->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+                struct pollfd pfd;
+                pfd.fd = _sock;
+                pfd.events = POLLIN | POLLERR;
+                pfd.revents = 0;
+                poll(&pfd, 1, TPACKET_POLL_TIMEOUT);
+                continue;
+            }
+            __sync_synchronize();
+            _pkt = (char*)block + block->hdr.bh1.offset_to_first_pkt;
+            _pktLeft = block->hdr.bh1.num_pkts;
+        }
+
+        if (_pktLeft == 0) {
+            // All the packets of the block are read: give it back
+            __sync_synchronize();
+            block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            _blockIdx = (_blockIdx + 1) % TPACKET_BLOCK_NB;
+            _pkt = NULL;
+            continue;
+        }
+
+        struct tpacket3_hdr* hdr = (struct tpacket3_hdr*)_pkt;
+        unsigned char* ip = (unsigned char*)_pkt + hdr->tp_net;
+        int caplen = hdr->tp_snaplen;
+        _pkt += hdr->tp_next_offset;
+        _pktLeft--;
+
+        // The filter already checked the addresses, except for the packets received before it was attached
+        int ihl = (ip[0] & 0x0F) * 4;
+        if (caplen < ihl + 8 || ip[9] != IPPROTO_UDP)
+            continue;
+        struct udphdr* udp = (struct udphdr*)(ip + ihl);
+        if (udp->dest != _filterPort || (_filterAddr != 0 && memcmp(ip + 16, &_filterAddr, 4) != 0))
+            continue;
+        int size = std::min((int)ntohs(udp->len), caplen - ihl) - 8;
+        if (size < 0)
+            continue;
+        *packet = (char*)udp + 8;
+        *len = size;
+        _lastTimestamp = (_timestampMode != UDP_TIMESTAMP_NONE ? (long long)hdr->tp_sec * 1000000000LL + hdr->tp_nsec : 0);
+        _reading = false;
+        LOG("recv %d bytes from port %d ", size, _port);
+        return size;
+    }
+    _reading = false;
+    return -1;
+}
+
+/*!
+* \fn setTimestampMode
+* \brief the ring always has the kernel receive time of the packets, or the NIC one if asked (PACKET_TIMESTAMP)
+*/
+int PacketRing::setTimestampMode(int mode, const char* device)
+{
+    _lastTimestamp = 0;
+    if (mode == UDP_TIMESTAMP_HARDWARE) {
+        int req = SOF_TIMESTAMPING_RAW_HARDWARE;
+        if (!enableHardwareTimestamps(_device))
+            mode = UDP_TIMESTAMP_SOFTWARE;
+        else if (setsockopt(_sock, SOL_PACKET, PACKET_TIMESTAMP, (void*)&req, sizeof(req)) != 0) {
+            LOG_WARNING("setsockopt(PACKET_TIMESTAMP) failed, error='%s', use the kernel receive time", strerror(errno));
+            mode = UDP_TIMESTAMP_SOFTWARE;
+        }
+    }
+    _timestampMode = mode;
+    if (mode != UDP_TIMESTAMP_NONE)
+        LOG_INFO("receive time taken by the %s", (mode == UDP_TIMESTAMP_HARDWARE ? "NIC" : "kernel"));
+    return _timestampMode;
+}
+
+int PacketRing::readSocket(char *buffer, int *len)
+{
+    char* packet = NULL;
+    int size = 0;
+    int result = readPacket(&packet, &size);
+    if (result <= 0) {
+        *len = 0;
+        return result;
+    }
+    if (size > *len) {
+        LOG_ERROR("packet of %d bytes truncated to %d bytes", size, *len);
+        size = *len;
+    }
+    memcpy(buffer, packet, size);
+    *len = size;
+    return size;
+}
+
+/*!
+* \fn readBatchSocket
+* \brief copy up to count packets: block for the first one, then take the packets already in the current block
+*/
+int PacketRing::readBatchSocket(char **buffer, int *len, int count, long long *timestamp)
+{
+    if (timestamp != NULL && _timestampMode == UDP_TIMESTAMP_NONE)
+        setTimestampMode(UDP_TIMESTAMP_SOFTWARE);
+    int n = 0;
+    while (n < count && (n == 0 || _pktLeft > 0)) {
+        int size = len[n];
+        int result = readSocket(buffer[n], &size);
+        if (result <= 0)
+            break;
+        len[n] = size;
+        if (timestamp != NULL)
+            timestamp[n] = _lastTimestamp;
+        n++;
+    }
+    for (int i = n; i < count; i++)
+        len[i] = 0;
+    return (n == 0 ? -1 : n);
+}
+#endif // USE_TPACKET
+
+#ifdef USE_XDP
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/bpf.h>
+#include <linux/if_xdp.h>
+#include <linux/if_link.h>      // XDP_FLAGS_xxx
+
 /*
- * Checksums for x86-64
- * Copyright 2002 by Andi Kleen, SuSE Labs
- * with some code from asm-i386/checksum.h
+ *
+ *
+ *  XdpSocket
+ *
+ *
  */
-static inline uint16_t ip_fast_csum(const void *iph, unsigned int ihl)
+
+static int sysBpf(int cmd, union bpf_attr* attr)
 {
-    unsigned int sum;
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
 
-    asm("  movl (%1), %0\n"
-        "  subl $4, %2\n"
-        "  jbe 2f\n"
-        "  addl 4(%1), %0\n"
-        "  adcl 8(%1), %0\n"
-        "  adcl 12(%1), %0\n"
-        "1: adcl 16(%1), %0\n"
-        "  lea 4(%1), %1\n"
-        "  decl %2\n"
-        "  jne      1b\n"
-        "  adcl $0, %0\n"
-        "  movl %0, %2\n"
-        "  shrl $16, %0\n"
-        "  addw %w2, %w0\n"
-        "  adcl $0, %0\n"
-        "  notl %0\n"
-        "2:"
-        /* Since the input registers which are loaded with iph and ih
-            are modified, we must also specify them as outputs, or gcc
-            will assume they contain their original values. */
-        : "=r" (sum), "=r" (iph), "=r" (ihl)
-        : "1" (iph), "2" (ihl)
-            : "memory");
-    return (uint16_t)sum;
+static struct bpf_insn bpfInsn(unsigned char code, unsigned char dst, unsigned char src, short off, int imm)
+{
+    struct bpf_insn insn;
+    insn.code = code;
+    insn.dst_reg = dst;
+    insn.src_reg = src;
+    insn.off = off;
+    insn.imm = imm;
+    return insn;
+}
+
+static int xdpMapRing(SOCKET sock, tXdpRing* ring, const struct xdp_ring_offset* off, off_t pgoff, size_t descSize)
+{
+    ring->mapLen = off->desc + XDP_RING_SIZE * descSize;
+    ring->map = mmap(NULL, ring->mapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sock, pgoff);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return E_ERROR;
+    }
+    char* base = (char*)ring->map;
+    ring->producer = (unsigned int*)(base + off->producer);
+    ring->consumer = (unsigned int*)(base + off->consumer);
+    ring->flags = (unsigned int*)(base + off->flags);
+    ring->descs = base + off->desc;
+    ring->mask = XDP_RING_SIZE - 1;
+    return E_OK;
+}
+
+static void xdpUnmapRing(tXdpRing* ring)
+{
+    if (ring->map != NULL)
+        munmap(ring->map, ring->mapLen);
+    memset(ring, 0, sizeof(tXdpRing));
+}
+
+/* Give a frame to the kernel in the fill ring */
+static bool xdpFill(tXdpRing* ring, unsigned long long addr)
+{
+    unsigned int prod = *ring->producer;
+    if (prod - __atomic_load_n(ring->consumer, __ATOMIC_ACQUIRE) >= XDP_RING_SIZE)
+        return false;
+    ((unsigned long long*)ring->descs)[prod & ring->mask] = addr;
+    __atomic_store_n(ring->producer, prod + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static uint16_t ipChecksum(const unsigned char* hdr, int len)
+{
+    unsigned int sum = 0;
+    for (int i = 0; i < len; i += 2)
+        sum += (hdr[i] << 8) | hdr[i + 1];
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return htons((uint16_t)~sum);
+}
+
+XdpSocket::XdpSocket(const char* interfaceName)
+{
+    _device[0] = '\0';
+    _gatherSend = false;
+    _queue = 0;
+    _ifindex = 0;
+    _umem = NULL;
+    memset(&_fill, 0, sizeof(_fill));
+    memset(&_comp, 0, sizeof(_comp));
+    memset(&_rx, 0, sizeof(_rx));
+    memset(&_tx, 0, sizeof(_tx));
+    _mapFd = -1;
+    _progFd = -1;
+    _linkFd = -1;
+    _memberSock = INVALID_SOCKET;
+    _zeroCopy = false;
+    _driverMode = false;
+    _rxFrame = -1;
+    _filterAddr = 0;
+    _filterPort = 0;
+    memset(_headers, 0, sizeof(_headers));
+    _ipId = 0;
+    _closing = false;
+    _reading = false;
+
+    // xdp-<device>[:<queue>]
+    if (isXdpInterface(interfaceName)) {
+        const char* device = interfaceName + strlen(XDP_INTERFACE_PREFIX);
+        const char* queue = strchr(device, ':');
+        int len = (int)(queue == NULL ? strlen(device) : queue - device);
+        len = std::min(len, IFNAMSIZ - 1);
+        memcpy(_device, device, len);
+        _device[len] = '\0';
+        if (queue != NULL)
+            _queue = atoi(queue + 1);
+    }
+}
+
+XdpSocket::~XdpSocket()
+{
+    if (isValid())
+        closeSocket();
 }
 
-int Netmap::writeSocketNonBlocking(char *buffer, int *len)
+bool XdpSocket::isXdpInterface(const char* interfaceName)
 {
-    int n_rings = _nmd->last_tx_ring - _nmd->first_tx_ring + 1;
-    int i, ring_idx;
-    struct netmap_ring *ring = NULL;
-    struct netmap_slot *slot;
-    char *dst_buf;
+    return (interfaceName != NULL && strncmp(interfaceName, XDP_INTERFACE_PREFIX, strlen(XDP_INTERFACE_PREFIX)) == 0);
+}
+
+/*!
+* \fn _openUmem
+* \brief create the socket, its UMEM and its 4 rings. The first half of the frames is given to the kernel
+* for the receive, the second half is kept for the send.
+*/
+int XdpSocket::_openUmem()
+{
+    size_t size = (size_t)XDP_FRAME_SIZE * XDP_FRAME_NB;
+    void* umem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (umem == MAP_FAILED) {
+        LOG_ERROR("can't allocate the UMEM of %d bytes, error='%s'", (int)size, strerror(errno));
+        return E_FATAL;
+    }
+    _umem = (char*)umem;
 
-    //Find an available non-empty ring
-    for (i = 0, ring_idx = _nmd->cur_tx_ring; i < n_rings; i++, ring_idx++) {
-        if (ring_idx == _nmd->last_tx_ring) {
-            ring_idx = _nmd->first_tx_ring;
+    _sock = socket(AF_XDP, SOCK_RAW, 0);
+    if (_sock == INVALID_SOCKET) {
+        LOG_ERROR("Failed to create AF_XDP socket: '%s'", strerror(errno));
+        return E_FATAL;
+    }
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (unsigned long long)_umem;
+    reg.len = size;
+    reg.chunk_size = XDP_FRAME_SIZE;
+    reg.headroom = 0;
+    if (setsockopt(_sock, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) != 0) {
+        LOG_ERROR("setsockopt(XDP_UMEM_REG) failed, error='%s'", strerror(errno));
+        return E_FATAL;
+    }
+    int ringSize = XDP_RING_SIZE;
+    if (setsockopt(_sock, SOL_XDP, XDP_UMEM_FILL_RING, &ringSize, sizeof(ringSize)) != 0
+        || setsockopt(_sock, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof(ringSize)) != 0
+        || setsockopt(_sock, SOL_XDP, XDP_RX_RING, &ringSize, sizeof(ringSize)) != 0
+        || setsockopt(_sock, SOL_XDP, XDP_TX_RING, &ringSize, sizeof(ringSize)) != 0) {
+        LOG_ERROR("setsockopt(XDP_xxx_RING) failed, error='%s'", strerror(errno));
+        return E_FATAL;
+    }
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(_sock, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0) {
+        LOG_ERROR("getsockopt(XDP_MMAP_OFFSETS) failed, error='%s'", strerror(errno));
+        return E_FATAL;
+    }
+    if (xdpMapRing(_sock, &_fill, &off.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(unsigned long long)) != E_OK
+        || xdpMapRing(_sock, &_comp, &off.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(unsigned long long)) != E_OK
+        || xdpMapRing(_sock, &_rx, &off.rx, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc)) != E_OK
+        || xdpMapRing(_sock, &_tx, &off.tx, XDP_PGOFF_TX_RING, sizeof(struct xdp_desc)) != E_OK) {
+        LOG_ERROR("mmap of the AF_XDP rings failed, error='%s'", strerror(errno));
+        return E_FATAL;
+    }
+    for (int i = 0; i < XDP_FRAME_NB / 2; i++)
+        xdpFill(&_fill, (unsigned long long)i * XDP_FRAME_SIZE);
+    _txFrames.clear();
+    for (int i = XDP_FRAME_NB / 2; i < XDP_FRAME_NB; i++)
+        _txFrames.push_back((unsigned long long)i * XDP_FRAME_SIZE);
+    _rxFrame = -1;
+
+    // Zero-copy if the driver supports it
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = _ifindex;
+    sxdp.sxdp_queue_id = _queue;
+    sxdp.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+    _zeroCopy = true;
+    if (bind(_sock, (struct sockaddr*)&sxdp, sizeof(sxdp)) != 0) {
+        _zeroCopy = false;
+        sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+        if (bind(_sock, (struct sockaddr*)&sxdp, sizeof(sxdp)) != 0) {
+            LOG_ERROR("bind to '%s' queue %d failed, error='%s'", _device, _queue, strerror(errno));
+            return E_FATAL;
         }
-        ring = NETMAP_TXRING(_nmd->nifp, ring_idx);
-        if (nm_ring_empty(ring)) {
-            continue;
+    }
+    return E_OK;
+}
+
+/*!
+* \fn _loadProgram
+* \brief load and attach the XDP program: the IPv4/UDP packets of the address and port are redirected to
+* the socket of their queue, the other ones go to the network stack
+*/
+int XdpSocket::_loadProgram()
+{
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(int);
+    attr.value_size = sizeof(int);
+    attr.max_entries = std::max(64, _queue + 1);
+    _mapFd = sysBpf(BPF_MAP_CREATE, &attr);
+    if (_mapFd < 0) {
+        LOG_ERROR("can't create the XSKMAP, error='%s'", strerror(errno));
+        return E_FATAL;
+    }
+    int sock = _sock;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = _mapFd;
+    attr.key = (unsigned long long)&_queue;
+    attr.value = (unsigned long long)&sock;
+    attr.flags = BPF_ANY;
+    if (sysBpf(BPF_MAP_UPDATE_ELEM, &attr) != 0) {
+        LOG_ERROR("can't add the socket to the XSKMAP, error='%s'", strerror(errno));
+        return E_FATAL;
+    }
+
+    // r2=data, r3=data_end, compare the headers to the filter, then bpf_redirect_map(map, rx_queue_index, XDP_PASS)
+    std::vector<struct bpf_insn> prog;
+    std::vector<int> toPass;
+    prog.push_back(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0));
+    prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0));
+    prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0));
+    prog.push_back(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0));
+    prog.push_back(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, XDP_HDR_SIZE));
+    toPass.push_back((int)prog.size());
+    prog.push_back(bpfInsn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0));
+    prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0));          // ethertype
+    toPass.push_back((int)prog.size());
+    prog.push_back(bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(ETH_P_IP)));
+    prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 14, 0));          // version, no IP options
+    toPass.push_back((int)prog.size());
+    prog.push_back(bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, 0x45));
+    prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 23, 0));          // protocol
+    toPass.push_back((int)prog.size());
+    prog.push_back(bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, IPPROTO_UDP));
+    prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 20, 0));          // fragments: offset or more fragments
+    prog.push_back(bpfInsn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(0x3FFF)));
+    toPass.push_back((int)prog.size());
+    prog.push_back(bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, 0));
+    prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 36, 0));          // destination port
+    toPass.push_back((int)prog.size());
+    prog.push_back(bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, _filterPort));
+    if (_filterAddr != 0) {
+        prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, 30, 0));      // destination address
+        toPass.push_back((int)prog.size());
+        prog.push_back(bpfInsn(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, (int)_filterAddr));
+    }
+    prog.push_back(bpfInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0));
+    prog.push_back(bpfInsn(BPF_LD | BPF_IMM | BPF_DW, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, _mapFd));
+    prog.push_back(bpfInsn(0, 0, 0, 0, 0));
+    prog.push_back(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS));
+    prog.push_back(bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+    prog.push_back(bpfInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+    int pass = (int)prog.size();
+    prog.push_back(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS));
+    prog.push_back(bpfInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+    for (int i : toPass)
+        prog[i].off = (short)(pass - i - 1);
+
+    static char log[65536];
+    const char* license = "Dual BSD/GPL";
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insn_cnt = (unsigned int)prog.size();
+    attr.insns = (unsigned long long)prog.data();
+    attr.license = (unsigned long long)license;
+    attr.expected_attach_type = BPF_XDP;
+    attr.log_buf = (unsigned long long)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    log[0] = '\0';
+    _progFd = sysBpf(BPF_PROG_LOAD, &attr);
+    if (_progFd < 0) {
+        LOG_ERROR("can't load the XDP program, error='%s': %s", strerror(errno), log);
+        return E_FATAL;
+    }
+
+    // Driver mode if the driver supports XDP, otherwise generic mode. The program is detached when the link is closed.
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = _progFd;
+    attr.link_create.target_ifindex = _ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+    _linkFd = sysBpf(BPF_LINK_CREATE, &attr);
+    _driverMode = (_linkFd >= 0);
+    if (_linkFd < 0) {
+        attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+        _linkFd = sysBpf(BPF_LINK_CREATE, &attr);
+    }
+    if (_linkFd < 0) {
+        LOG_ERROR("can't attach the XDP program to '%s' (another program attached?), error='%s'", _device, strerror(errno));
+        return E_FATAL;
+    }
+    return E_OK;
+}
+
+/*!
+* \fn _buildHeaders
+* \brief build the Ethernet, IPv4 and UDP headers of the sent packets. The destination MAC address is the
+* multicast one, or the one of the neighbor in the ARP table: the destination must be on the link.
+*/
+int XdpSocket::_buildHeaders(const char* remote_addr, const char* local_addr, int port)
+{
+    uint32_t dst = (remote_addr != NULL ? inet_addr(remote_addr) : INADDR_NONE);
+    if (dst == INADDR_NONE || dst == 0) {
+        LOG_ERROR("invalid destination address '%s'", (remote_addr != NULL ? remote_addr : "NULL"));
+        return E_ERROR;
+    }
+    unsigned char* eth = (unsigned char*)_headers;
+    unsigned char* ip = eth + 14;
+    unsigned char* udp = ip + 20;
+
+    // Source: MAC and IPv4 address of the device, unless a local address is given
+    uint32_t src = 0;
+    if (local_addr != NULL && local_addr[0] != '\0')
+        src = inet_addr(local_addr);
+    struct ifaddrs* addrs = NULL;
+    if (src == 0 && getifaddrs(&addrs) == 0) {
+        for (struct ifaddrs* a = addrs; a != NULL && src == 0; a = a->ifa_next) {
+            if (a->ifa_addr != NULL && a->ifa_addr->sa_family == AF_INET && strcmp(a->ifa_name, _device) == 0)
+                src = ((struct sockaddr_in*)a->ifa_addr)->sin_addr.s_addr;
         }
+        freeifaddrs(addrs);
+    }
+    if (resolveMacAddresses(_device, dst, eth) != E_OK)
+        return E_ERROR;
+    eth[12] = 0x08;
+    eth[13] = 0x00;
+
+    ip[0] = 0x45;
+    ip[1] = 0;
+    ip[6] = 0x40;           // don't fragment
+    ip[7] = 0;
+    ip[8] = 64;             // ttl
+    ip[9] = IPPROTO_UDP;
+    memcpy(ip + 12, &src, 4);
+    memcpy(ip + 16, &dst, 4);
+    uint16_t p = htons((uint16_t)port);
+    memcpy(udp, &p, 2);
+    memcpy(udp + 2, &p, 2);
+    memcpy(&_remote_addr4.sin_addr.s_addr, &dst, 4);
+    return E_OK;
+}
 
-        break;
+/*!
+* \fn openSocket
+* \brief open the socket on the device and queue of the interface name. To receive: the packets sent to
+* remote_addr (multicast group, joined on the device) or else local_addr, and to port. To send: to
+* remote_addr and port, from local_addr or else the address of the device.
+*
+* \param remote_addr multicast group or destination address
+* \param local_addr unicast destination address to receive, source address to send, can be NULL or empty
+* \param port destination port
+* \param modelisten true to receive, false to send
+* \param ifname not used, the device is given by the interface name of the constructor
+* \return E_OK if success
+*/
+int XdpSocket::openSocket(const char* remote_addr, const char* local_addr, int port, bool modelisten, const char* ifname)
+{
+    if (_device[0] == '\0') {
+        LOG_ERROR("an AF_XDP socket needs an interface named %s<device>[:<queue>]", XDP_INTERFACE_PREFIX);
+        return E_ERROR;
+    }
+    _ifindex = if_nametoindex(_device);
+    if (_ifindex == 0) {
+        LOG_ERROR("unknown device '%s': '%s'", _device, strerror(errno));
+        return E_ERROR;
+    }
+    _port = port;
+    _af = AF_INET;
+    _closing = false;
+    if (_openUmem() != E_OK) {
+        _closeAll();
+        return E_FATAL;
     }
 
-    if (i == n_rings) {
-        //No non-empty rings available, try again later
-        errno = EAGAIN;
-        return -1;
+    int result = E_OK;
+    if (modelisten) {
+        _filterPort = htons((uint16_t)port);
+        _filterAddr = 0;
+        if (remote_addr != NULL && remote_addr[0] != '\0')
+            _filterAddr = inet_addr(remote_addr);
+        else if (local_addr != NULL && local_addr[0] != '\0' && strcmp(local_addr, C_INADDR_ANY) != 0 && strcmp(local_addr, C_INADDR_ANY_REUSE) != 0)
+            _filterAddr = inet_addr(local_addr);
+        result = _loadProgram();
+        if (result == E_OK && IN_MULTICAST(ntohl(_filterAddr))) {
+            _memberSock = joinMulticastGroup(_filterAddr, _ifindex);
+            if (_memberSock == INVALID_SOCKET)
+                LOG_ERROR("can't join the multicast group %s on '%s', error='%s'", remote_addr, _device, strerror(errno));
+        }
+    }
+    else
+        result = _buildHeaders(remote_addr, local_addr, port);
+    if (result != E_OK) {
+        _closeAll();
+        return result;
     }
 
-    slot = &ring->slot[ring->cur];
-    dst_buf = NETMAP_BUF(ring, slot->buf_idx);
-    slot->len = sizeof(_headers) + *len;
+    LOG_INFO("AF_XDP socket on '%s' queue %d to %s port %d: %s mode, %s", _device, _queue, (modelisten ? "receive" : "send"),
+        port, (modelisten ? (_driverMode ? "driver" : "generic") : "tx"), (_zeroCopy ? "zero-copy" : "copy"));
+    return E_OK;
+}
 
-    memcpy(dst_buf, _headers, sizeof(_headers));
-    *_ip_tot_len = htons(sizeof(struct iphdr) + sizeof(struct udphdr) + *len);
-    *_udp_len = htons(sizeof(struct udphdr) + *len);
-    *_ip_csum = 0;
-    *_ip_csum = ip_fast_csum(_headers + sizeof(struct ether_header), sizeof(struct iphdr)/4);
-    memcpy(dst_buf + sizeof(_headers), buffer, *len);
+void XdpSocket::_closeAll()
+{
+    if (_linkFd >= 0)
+        close(_linkFd);
+    if (_progFd >= 0)
+        close(_progFd);
+    if (_mapFd >= 0)
+        close(_mapFd);
+    _linkFd = _progFd = _mapFd = -1;
+    if (_memberSock != INVALID_SOCKET)
+        close(_memberSock);
+    _memberSock = INVALID_SOCKET;
+    xdpUnmapRing(&_fill);
+    xdpUnmapRing(&_comp);
+    xdpUnmapRing(&_rx);
+    xdpUnmapRing(&_tx);
+    if (_sock != INVALID_SOCKET)
+        close(_sock);
+    _sock = INVALID_SOCKET;
+    if (_umem != NULL)
+        munmap(_umem, (size_t)XDP_FRAME_SIZE * XDP_FRAME_NB);
+    _umem = NULL;
+    _rxFrame = -1;
+    _txFrames.clear();
+}
 
-    _nmd->cur_tx_ring = ring_idx;
-    ring->head = ring->cur = nm_ring_next(ring, ring->cur);
+int XdpSocket::closeSocket()
+{
+    LOG(" -->");
+    // Let a blocked read see the close before unmapping the rings
+    _closing = true;
+    for (int i = 0; i < 2 * XDP_POLL_TIMEOUT && _reading; i++)
+        usleep(1000);
+    _closeAll();
+    LOG(" <--");
+    return E_OK;
+}
 
-    LOG("sent %d bytes to port %d", *len, _port);
-    return *len;
+void XdpSocket::_releaseRxFrame()
+{
+    if (_rxFrame >= 0)
+        xdpFill(&_fill, (unsigned long long)_rxFrame);
+    _rxFrame = -1;
 }
 
-int Netmap::writeSocket(char *buffer, int *len)
+/*!
+* \fn readPacket
+* \brief give the UDP payload of the next packet, in place in the UMEM. The packet stays valid until the
+* next read: its frame is then given back to the kernel.
+*
+* \param packet output pointer to the UDP payload
+* \param len output size of the payload
+* \return size of the payload, -1 if error or closed
+*/
+int XdpSocket::readPacket(char **packet, int *len)
 {
-    for (int tries = 0; /*tries < 10*/; tries++) {
-        int ret = writeSocketNonBlocking(buffer, len);
-        if (ret != -1) {
-            return ret;
+    if (_rx.map == NULL)
+        return -1;
+    _reading = true;
+    _releaseRxFrame();
+    while (!_closing) {
+        unsigned int cons = *_rx.consumer;
+        if (cons == __atomic_load_n(_rx.producer, __ATOMIC_ACQUIRE)) {
+            // poll() also wakes the kernel up to fill the ring
+            struct pollfd pfd;
+            pfd.fd = _sock;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            poll(&pfd, 1, XDP_POLL_TIMEOUT);
+            continue;
+        }
+        struct xdp_desc desc = ((struct xdp_desc*)_rx.descs)[cons & _rx.mask];
+        __atomic_store_n(_rx.consumer, cons + 1, __ATOMIC_RELEASE);
+        _rxFrame = (long long)(desc.addr & ~(unsigned long long)(XDP_FRAME_SIZE - 1));
+
+        // The program already checked the headers
+        unsigned char* eth = (unsigned char*)_umem + desc.addr;
+        unsigned char* ip = eth + 14;
+        int caplen = (int)desc.len - 14;
+        int ihl = (ip[0] & 0x0F) * 4;
+        if (caplen < ihl + 8 || ip[9] != IPPROTO_UDP) {
+            _releaseRxFrame();
+            continue;
+        }
+        struct udphdr* udp = (struct udphdr*)(ip + ihl);
+        if (udp->dest != _filterPort || (_filterAddr != 0 && memcmp(ip + 16, &_filterAddr, 4) != 0)) {
+            _releaseRxFrame();
+            continue;
+        }
+        int size = std::min((int)ntohs(udp->len), caplen - ihl) - 8;
+        if (size < 0) {
+            _releaseRxFrame();
+            continue;
         }
-        LOG("no ring available, syncing (try=%d)", tries);
-        ioctl(_nmd->fd, NIOCTXSYNC, NULL);
+        *packet = (char*)udp + 8;
+        *len = size;
+        _reading = false;
+        LOG("recv %d bytes from port %d ", size, _port);
+        return size;
     }
-    LOG_ERROR("no ring available, giving up");
-    errno = EAGAIN;
+    _reading = false;
     return -1;
 }
 
-/*
- * @return the number of packets actually sent
- */
-int Netmap::writeBatchedSocket(char **buffer, int count, int *len)
+int XdpSocket::readSocket(char *buffer, int *len)
 {
-    int i;
-    for (i = 0; i < count; i++) {
-        if (writeSocket(buffer[i], len) < 0) {
-            break;
-        }
+    char* packet = NULL;
+    int size = 0;
+    int result = readPacket(&packet, &size);
+    if (result <= 0) {
+        *len = 0;
+        return result;
     }
-    if (i == 0 && count > 0) {
-        /* no packets sent, indicate an error */
-        i = -1;
+    if (size > *len) {
+        LOG_ERROR("packet of %d bytes truncated to %d bytes", size, *len);
+        size = *len;
     }
-    return i;
+    memcpy(buffer, packet, size);
+    *len = size;
+    return size;
 }
 
+int XdpSocket::readBatchSocket(char **buffer, int *len, int count, long long *timestamp)
+{
+    int n = 0;
+    while (n < count && (n == 0 || *_rx.consumer != __atomic_load_n(_rx.producer, __ATOMIC_ACQUIRE))) {
+        int size = len[n];
+        int result = readSocket(buffer[n], &size);
+        if (result <= 0)
+            break;
+        len[n] = size;
+        if (timestamp != NULL)
+            timestamp[n] = 0;
+        n++;
+    }
+    for (int i = n; i < count; i++)
+        len[i] = 0;
+    return (n == 0 ? -1 : n);
+}
 
+/*!
+* \fn setTimestampMode
+* \brief no receive time: the packets don't go through the network stack
+*/
+int XdpSocket::setTimestampMode(int mode, const char* device)
+{
+    if (mode != UDP_TIMESTAMP_NONE)
+        LOG_WARNING("no receive time on an AF_XDP socket");
+    _timestampMode = UDP_TIMESTAMP_NONE;
+    _lastTimestamp = 0;
+    return _timestampMode;
+}
 
-#endif //USE_NETMAP
+/* Take back the frames of the packets sent */
+void XdpSocket::_reapCompletions()
+{
+    unsigned int cons = *_comp.consumer;
+    unsigned int prod = __atomic_load_n(_comp.producer, __ATOMIC_ACQUIRE);
+    for (; cons != prod; cons++)
+        _txFrames.push_back(((unsigned long long*)_comp.descs)[cons & _comp.mask]);
+    __atomic_store_n(_comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+int XdpSocket::writeSocket(char *buffer, int *len)
+{
+    int result = writeBatchedSocket(&buffer, 1, len);
+    return (result == 1 ? *len : -1);
+}
+
+/*!
+* \fn writeBatchedSocket
+* \brief copy count packets of the same size in frames of the UMEM, behind their headers, queue them in the
+* send ring and wake the kernel up
+*
+* \return number of packets sent, -1 if error
+*/
+int XdpSocket::writeBatchedSocket(char **buffer, int count, int *len)
+{
+    if (_tx.map == NULL)
+        return -1;
+    if (*len + XDP_HDR_SIZE > XDP_FRAME_SIZE) {
+        LOG_ERROR("packet of %d bytes too big (max %d)", *len, XDP_FRAME_SIZE - XDP_HDR_SIZE);
+        return -1;
+    }
+    _reapCompletions();
+    unsigned int prod = *_tx.producer;
+    int sent = 0;
+    while (sent < count) {
+        // Wait for free frames and room in the ring
+        for (int tries = 0; _txFrames.empty() || prod - __atomic_load_n(_tx.consumer, __ATOMIC_ACQUIRE) >= XDP_RING_SIZE; tries++) {
+            __atomic_store_n(_tx.producer, prod, __ATOMIC_RELEASE);
+            sendto(_sock, NULL, 0, MSG_DONTWAIT, NULL, 0);
+            _reapCompletions();
+            if (tries > 1000) {
+                LOG_ERROR("the send ring is full");
+                return (sent == 0 ? -1 : sent);
+            }
+            if (tries > 0) {
+                struct pollfd pfd;
+                pfd.fd = _sock;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                poll(&pfd, 1, 1);
+            }
+        }
+        unsigned long long addr = _txFrames.back();
+        _txFrames.pop_back();
+
+        unsigned char* frame = (unsigned char*)_umem + addr;
+        memcpy(frame, _headers, XDP_HDR_SIZE);
+        unsigned char* ip = frame + 14;
+        uint16_t ipLen = htons((uint16_t)(*len + 28));
+        uint16_t udpLen = htons((uint16_t)(*len + 8));
+        uint16_t id = htons(_ipId++);
+        memcpy(ip + 2, &ipLen, 2);
+        memcpy(ip + 4, &id, 2);
+        uint16_t csum = ipChecksum(ip, 20);
+        memcpy(ip + 10, &csum, 2);
+        memcpy(ip + 24, &udpLen, 2);
+        memcpy(frame + XDP_HDR_SIZE, buffer[sent], *len);
+
+        struct xdp_desc* desc = &((struct xdp_desc*)_tx.descs)[prod & _tx.mask];
+        desc->addr = addr;
+        desc->len = *len + XDP_HDR_SIZE;
+        desc->options = 0;
+        prod++;
+        sent++;
+    }
+    __atomic_store_n(_tx.producer, prod, __ATOMIC_RELEASE);
+    if (__atomic_load_n(_tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)
+        sendto(_sock, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    LOG("send %d packets to port %d ", sent, _port);
+    return sent;
+}
+#endif // USE_XDP
@@ -3,6 +3,8 @@
 
 #ifndef _WIN32
 #define USE_NETMAP
+#define USE_TPACKET
+#define USE_XDP
 #endif
 
 #ifdef _WIN32
@@ -24,6 +26,8 @@
 #define C_INADDR_ANY            "INADDR_ANY"
 #define C_INADDR_ANY_REUSE      "INADDR_ANY_REUSE"      /* Reuse address and port */
 
+class CPacer;
+
 class TCP 
 { 
 private:
@@ -50,6 +54,35 @@ public:
 };  // TCP
 
 
+#define UDP_BATCH_MAX_SIZE      64      /* max nb of packets received by a single call */
+#define UDP_BATCH_DEFAULT_SIZE  16
+#define UDP_BATCH_PACKET_SIZE   9216    /* max size of a packet received on the batch of readSocket() (jumbo frames) */
+
+#define UDP_SEND_MODE_SINGLE    0       /* one system call (sendto) per packet */
+#define UDP_SEND_MODE_MMSG      1       /* one system call (sendmmsg) per batch of packets */
+#define UDP_SEND_MODE_GSO       2       /* sendmmsg, with several packets per message segmented by the kernel (UDP_SEGMENT) */
+#define UDP_GSO_MAX_SEGMENTS    64      /* max nb of packets in a GSO message */
+#define UDP_GSO_MAX_SIZE        65000   /* max size of a GSO message, must fit in an IP datagram */
+#define UDP_GSO_ZEROCOPY_MAX_SEGMENTS 4 /* a zero copy message is in at most 17 page fragments, up to 4 per packet */
+
+#define UDP_ZEROCOPY_TIMEOUT    100     /* ms, max wait for the kernel to release the buffers sent with MSG_ZEROCOPY */
+
+/* Packet queued by queueSendPacket(): a header and a payload sent in place, then zero padding */
+struct tSendGather {
+    const char* header;     /* NULL if the packet is built in the send buffer */
+    int         headerLen;
+    const char* payload;
+    int         payloadLen;
+};
+
+#define UDP_TIMESTAMP_NONE      0       /* no receive time */
+#define UDP_TIMESTAMP_SOFTWARE  1       /* receive time taken by the kernel (SO_TIMESTAMPING) */
+#define UDP_TIMESTAMP_HARDWARE  2       /* receive time taken by the NIC, or by the kernel if the NIC can't */
+
+#define UDP_REUSEPORT_STEER_HASH 0      /* kernel hash of the addresses and ports: each flow on one socket */
+#define UDP_REUSEPORT_STEER_SEQ  1      /* RTP seq number modulo the nb of sockets: one flow spread on all sockets */
+#define UDP_REUSEPORT_STEER_CPU  2      /* CPU receiving the packet, i.e. the NIC queue: the packet stays on its core */
+
 class UDP 
 { 
 protected:
@@ -61,6 +94,45 @@ protected:
     struct sockaddr_in6 _local_addr6;
     struct sockaddr_in _remote_addr4;
     struct sockaddr_in6 _remote_addr6;
+    // Packets received by batch and not yet read, see setBatchSize()
+    int    _batchSize;
+    int    _batchCount;
+    int    _batchIdx;
+    char*  _batchBuffer;
+    int    _batchLen[UDP_BATCH_MAX_SIZE];
+    // Receive time of the packets, see setTimestampMode()
+    int       _timestampMode;
+    long long _batchTimestamp[UDP_BATCH_MAX_SIZE];
+    long long _lastTimestamp;
+    // Packets queued by the packetizers and not yet sent, see setSendMode()
+    int    _sendMode;
+    int    _sendBatchSize;
+    int    _sendCount;
+    int    _sendLen;
+    char*  _sendBuffer;
+    // Packets queued in place by queueSendPacket(), see setZeroCopy()
+    bool   _gatherSend;         // false if the packets must be copied in the send buffer (AF_XDP, netmap)
+    int    _sendGathered;
+    struct tSendGather _sendGather[UDP_BATCH_MAX_SIZE];
+    bool      _zeroCopy;
+    long long _zcSent;          // messages sent with MSG_ZEROCOPY
+    long long _zcCompleted;     // messages whose buffers are released by the kernel
+    bool      _zcCopied;        // the kernel had to copy them anyway
+    // Launch time of the queued packets, see setPacer()
+    CPacer*   _pacer;
+    bool      _txTimeEnabled;
+    long long _sendTime[UDP_BATCH_MAX_SIZE];
+    // Socket of a SO_REUSEPORT group, see setReusePort()
+    int    _reuseGroupSize;
+    int    _reuseIndex;
+    int    _reuseSteering;
+private:
+    int  _readSocketFromBatch(char *buffer, int *len);
+    int  _readPacketFromBatch(char **packet, int *len);
+    int  _writeSingleSocket(char **buffer, int count, int *len);
+    int  _writeMessages(char **buffer, int count, int *len, const long long *txtime, const struct tSendGather *gather = NULL);
+    int  _readZeroCopyCompletions(int timeoutMs);
+    int  _attachReusePortProgram();
 public:
     UDP();
     virtual ~UDP();
@@ -72,10 +144,35 @@ public:
     int  openRawSocket();
     virtual int  closeSocket();
     virtual int  readSocket(char *buffer, int *len);
-    //int  readSocket2(char *buffer, int *len);
+    virtual int  readBatchSocket(char **buffer, int *len, int count, long long *timestamp = NULL);
+    virtual int  readPacket(char **packet, int *len);
+    void setBatchSize(int size);
+    int  getBatchSize() { return _batchSize; };
+    bool hasBatchedPackets() { return _batchIdx < _batchCount; };
+    static int getTimestampModeFromName(const char* name);
+    virtual int setTimestampMode(int mode, const char* device = NULL);
+    int  getTimestampMode() { return _timestampMode; };
+    long long getLastTimestamp() { return _lastTimestamp; };
+    static int getReusePortSteeringFromName(const char* name);
+    void setReusePort(int groupSize, int index, int steering);
     virtual int  writeSocket(char *buffer, int *len);
     virtual int  writeBatchedSocket(char **buffer, int count, int *len);
+    static int getSendModeFromName(const char* name);
+    void setSendMode(int mode, int batchSize);
+    int  getSendMode() { return _sendMode; };
+    char* getSendBuffer();
+    int  queueSendBuffer(int len);
+    int  queueSendPacket(const char* header, int headerLen, const char* payload, int payloadLen, int len);
+    int  flushSendBuffer();
+    bool setZeroCopy(bool enable);
+    bool isZeroCopy() { return _zeroCopy; };
+    int  waitSendCompletions(int timeoutMs = UDP_ZEROCOPY_TIMEOUT);
+    void setPacer(CPacer* pacer);
+    void startFrame(int nbPackets, float frameRate, float activeRatio);
     bool isValid() { return _sock!=INVALID_SOCKET; };
+    static UDP* createReceiver(const char* interfaceName);
+    static UDP* createSender(const char* interfaceName);
+    static bool isBypassInterface(const char* interfaceName);
 };  // UDP
 
 #ifdef USE_NETMAP
@@ -83,32 +180,322 @@ public:
 #define NETMAP_WITH_LIBS
 #define L2_L3_L4_HDR_SIZE (14+20+8)
 #include "netmap_user.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <map>
+#include <string>
+
+#define NETMAP_INTERFACE_PREFIX "netmap-"
+#define NETMAP_EXTRA_BUFS       4096    /* spare buffers swapped with the slots of the received packets */
+#define NETMAP_QUEUE_SIZE       4096    /* packets of a ring waiting to be read by a socket, power of 2 */
+#define NETMAP_SPIN_US          50      /* busy-wait after the last packet before sleeping in poll() */
+#define NETMAP_POLL_TIMEOUT     100     /* ms, to detect the close */
+
+/* A received packet, in a netmap buffer taken out of its ring */
+struct tNetmapBuf {
+    uint32_t idx;       /* netmap buffer index */
+    uint16_t offset;    /* of the UDP payload in the buffer */
+    uint16_t len;       /* of the UDP payload */
+};
 
+/* Buffers passed from one thread to another one, without lock */
+class NetmapBufQueue
+{
+    tNetmapBuf                  _items[NETMAP_QUEUE_SIZE];
+    std::atomic<unsigned int>   _head;      /* next written */
+    std::atomic<unsigned int>   _tail;      /* next read */
+
+public:
+    NetmapBufQueue() : _head(0), _tail(0) {};
+    bool empty() { return _head.load() == _tail.load(std::memory_order_relaxed); };
+    bool push(const tNetmapBuf& buf) {
+        unsigned int head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= NETMAP_QUEUE_SIZE)
+            return false;
+        _items[head & (NETMAP_QUEUE_SIZE - 1)] = buf;
+        _head.store(head + 1);
+        return true;
+    };
+    bool pop(tNetmapBuf* buf) {
+        unsigned int tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+            return false;
+        *buf = _items[tail & (NETMAP_QUEUE_SIZE - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    };
+};
+
+class Netmap;
+
+/**********************************************************************************************
+*
+* NetmapPort
+*
+* A netmap device shared by all the Netmap sockets of the process: a ring is bound only once.
+* Each receive ring has its own thread, which filters the packets on the destination address
+* and port of the sockets and hands them off by swapping their buffer with a spare one. The
+* packets for no socket are dropped.
+*
+***********************************************************************************************/
+class NetmapPort
+{
+    struct tRing {
+        struct nm_desc*         nmd;
+        std::thread             th;
+        std::mutex              lock;           /* sockets and spare buffers of the ring */
+        std::vector<Netmap*>    sockets;
+        std::vector<uint32_t>   spare;
+        std::mutex              txLock;
+        long long               dropped;
+    };
+    std::string             _name;
+    int                     _refCount;
+    std::vector<tRing*>     _rings;
+    char*                   _bufBase;
+    int                     _bufSize;
+    std::atomic<bool>       _closing;
+    std::atomic<int>        _nextTxRing;
+
+    static std::mutex       _registryLock;
+    static std::map<std::string, NetmapPort*> _registry;
+
+    NetmapPort(const char* name);
+    int  _open();
+    void _close();
+    void _rxThread(int index);
+    int  _receive(int index);
+
+public:
+    static NetmapPort* acquire(const char* name);
+    static void release(NetmapPort* port);
+
+    void subscribe(Netmap* socket);
+    void unsubscribe(Netmap* socket);
+    int  getRingsNb() { return (int)_rings.size(); };
+    struct nm_desc* getDesc(int index) { return _rings[index]->nmd; };
+    std::mutex& getTxLock(int index) { return _rings[index]->txLock; };
+    int  takeTxRing() { return (_nextTxRing++) % getRingsNb(); };
+    char* getBuffer(uint32_t idx) { return _bufBase + (size_t)idx * _bufSize; };
+    int  getBufferSize() { return _bufSize; };
+};
+
+/**********************************************************************************************
+*
+* Netmap
+*
+* UDP socket over a netmap device: the packets are crafted from scratch on send, and filtered
+* on their destination address and port on receive, so that several streams can share the
+* device. The interface name has the format:
+*    netmap-<ip>-<netmap_device_name>
+* See Netmap::openSocket().
+*
+***********************************************************************************************/
 class Netmap : public UDP
 {
 private:
-    struct nm_desc *_nmd = NULL;
     char _headers[L2_L3_L4_HDR_SIZE];
     uint16_t *_ip_tot_len = NULL;
     uint16_t *_ip_csum = NULL;
     uint16_t *_udp_len = NULL;
     uint32_t _my_ip = 0;
+    std::string _device;
+    NetmapPort* _nmPort = NULL;
+    int _txRing = -1;
+    bool _listen = false;
+    uint32_t _filterAddr = 0;           /* network order, 0 for any */
+    uint16_t _filterPort = 0;           /* network order */
+    SOCKET _memberSock = INVALID_SOCKET;
+    std::vector<NetmapBufQueue*> _rxQueues;     /* per ring, filled by the ring thread */
+    std::vector<NetmapBufQueue*> _freeQueues;   /* per ring, buffers given back to the ring thread */
+    int _heldRing = -1;                 /* ring of the packet given by readPacket(), -1 if none */
+    tNetmapBuf _held;
+    int _nextRing = 0;
+    std::mutex _waitLock;
+    std::condition_variable _waitCv;
+    std::atomic<bool> _waiting;
+    std::atomic<bool> _closing;
+    std::atomic<bool> _reading;
+
+    void _releaseHeld();
+    bool _popPacket(char **packet, int *len);
+    int  _writePackets(char **buffer, int count, int len);
+
 public:
-    Netmap() {};
+    Netmap(const char* interfaceName = NULL);
     ~Netmap() { if (isValid()) { closeSocket(); } };
 
-    virtual int  openSocket(char* addr, int port, char* bindToDevice);
+    static bool isNetmapInterface(const char* interfaceName);
+
+    virtual int  openSocket(const char* remote_addr, const char* local_addr, int port, bool modelisten, const char* ifname = NULL);
     virtual int  closeSocket();
     virtual int  readSocket(char *buffer, int *len);
+    virtual int  readBatchSocket(char **buffer, int *len, int count, long long *timestamp = NULL);
+    virtual int  readPacket(char **packet, int *len);
+    virtual int  setTimestampMode(int mode, const char* device = NULL);
     virtual int  writeSocket(char *buffer, int *len);
     virtual int  writeBatchedSocket(char **buffer, int count, int *len);
 
+    // Called by the ring threads of the port
+    bool accept(uint32_t daddr, uint16_t dport) { return dport == _filterPort && (_filterAddr == 0 || daddr == _filterAddr); };
+    bool deliver(int ring, const tNetmapBuf& buf) { return _rxQueues[ring]->push(buf); };
+    NetmapBufQueue* getFreeQueue(int ring) { return _freeQueues[ring]; };
+    void wake();
+    void drain(int ring, std::vector<uint32_t>& spare);
+};
+#endif // USE_NETMAP
+
+#ifdef USE_TPACKET
+
+#include <atomic>
+#include <net/if.h>     // IFNAMSIZ
+
+#define TPACKET_INTERFACE_PREFIX    "tpacket-"
+#define TPACKET_BLOCK_SIZE      (1 << 20)   /* a block is given to the user when full, or after the timeout */
+#define TPACKET_BLOCK_NB        32
+#define TPACKET_FRAME_SIZE      2048
+#define TPACKET_BLOCK_TIMEOUT   1           /* ms */
+#define TPACKET_POLL_TIMEOUT    100         /* ms, to detect the close */
+
+/**********************************************************************************************
+*
+* PacketRing
+*
+* Receive the UDP packets of one IPv4 address and port through an AF_PACKET socket with a
+* TPACKET_V3 mmap ring: the kernel fills blocks of packets shared with the user, without a
+* system call per packet nor a copy. The interface name has the format:
+*    tpacket-<device>[:<fanout group>]
+* With a fanout group, the sockets of the group share the packets of the device by flow.
+*
+***********************************************************************************************/
+class PacketRing : public UDP
+{
 private:
-    int readSocketNonBlocking(char *buffer, int *len);
-    int writeSocketNonBlocking(char *buffer, int *len);
+    char      _device[IFNAMSIZ];
+    int       _fanoutGroup;         /* -1: no fanout */
+    int       _memberSock;          /* UDP socket joined to the multicast group, never read */
+    char*     _ring;
+    int       _blockIdx;            /* current block */
+    char*     _pkt;                 /* next packet of the current block, NULL if the block is not owned */
+    int       _pktLeft;             /* packets not read in the current block */
+    uint32_t  _filterAddr;          /* destination address, network order, 0 for any */
+    uint16_t  _filterPort;          /* destination port, network order */
+    std::atomic<bool> _closing;
+    std::atomic<bool> _reading;
+    long long _nPackets;
+    long long _nDropped;
+
+    int  _attachFilter();
+    void _updateStats();
+
+public:
+    PacketRing(const char* interfaceName);
+    ~PacketRing();
 
+    static bool isPacketRingInterface(const char* interfaceName);
+
+    virtual int  openSocket(const char* remote_addr, const char* local_addr, int port, bool modelisten, const char* ifname = NULL);
+    virtual int  closeSocket();
+    virtual int  readSocket(char *buffer, int *len);
+    virtual int  readBatchSocket(char **buffer, int *len, int count, long long *timestamp = NULL);
+    virtual int  readPacket(char **packet, int *len);
+    virtual int  setTimestampMode(int mode, const char* device = NULL);
+    long long getDroppedPacketsNb() { return _nDropped; };
 };
-#endif // USE_NETMAP
+#endif // USE_TPACKET
+
+#ifdef USE_XDP
+
+#include <atomic>
+#include <vector>
+#include <net/if.h>     // IFNAMSIZ
+
+#define XDP_INTERFACE_PREFIX    "xdp-"
+#define XDP_FRAME_SIZE          4096        /* a frame of the UMEM holds one packet */
+#define XDP_FRAME_NB            8192        /* half for the receive, half for the send */
+#define XDP_RING_SIZE           4096
+#define XDP_POLL_TIMEOUT        100         /* ms, to detect the close */
+#define XDP_HDR_SIZE            (14+20+8)   /* Ethernet, IPv4 and UDP headers */
+
+/* A ring shared with the kernel: descriptors between the cached producer and consumer indexes */
+struct tXdpRing {
+    unsigned int* producer;
+    unsigned int* consumer;
+    unsigned int* flags;
+    void*         descs;
+    unsigned int  mask;
+    void*         map;
+    size_t        mapLen;
+};
+
+/**********************************************************************************************
+*
+* XdpSocket
+*
+* Receive and send the UDP packets of one IPv4 address and port through an AF_XDP socket. The
+* packets are exchanged with the driver in a memory area shared with the kernel (UMEM), without
+* the network stack. On receive, a small XDP program redirects to the socket only the packets
+* of the address and port, the others go to the network stack. The interface name has the
+* format:
+*    xdp-<device>[:<queue>]
+* The driver mode and zero-copy are used if the driver supports them, otherwise the generic
+* mode (any device, i.e. lo) and the copy mode.
+*
+***********************************************************************************************/
+class XdpSocket : public UDP
+{
+private:
+    char      _device[IFNAMSIZ];
+    int       _queue;
+    int       _ifindex;
+    char*     _umem;
+    tXdpRing  _fill;
+    tXdpRing  _comp;
+    tXdpRing  _rx;
+    tXdpRing  _tx;
+    int       _mapFd;
+    int       _progFd;
+    int       _linkFd;
+    int       _memberSock;          /* UDP socket joined to the multicast group, never read */
+    bool      _zeroCopy;
+    bool      _driverMode;
+    long long _rxFrame;             /* frame of the packet given by readPacket(), -1 if none */
+    std::vector<unsigned long long> _txFrames;  /* free frames for the send */
+    uint32_t  _filterAddr;          /* network order, 0 for any */
+    uint16_t  _filterPort;          /* network order */
+    char      _headers[XDP_HDR_SIZE];   /* headers of the sent packets */
+    uint16_t  _ipId;
+    std::atomic<bool> _closing;
+    std::atomic<bool> _reading;
+
+    int  _openUmem();
+    int  _loadProgram();
+    int  _buildHeaders(const char* remote_addr, const char* local_addr, int port);
+    void _releaseRxFrame();
+    void _reapCompletions();
+    void _closeAll();
+
+public:
+    XdpSocket(const char* interfaceName);
+    ~XdpSocket();
+
+    static bool isXdpInterface(const char* interfaceName);
+
+    virtual int  openSocket(const char* remote_addr, const char* local_addr, int port, bool modelisten, const char* ifname = NULL);
+    virtual int  closeSocket();
+    virtual int  readSocket(char *buffer, int *len);
+    virtual int  readBatchSocket(char **buffer, int *len, int count, long long *timestamp = NULL);
+    virtual int  readPacket(char **packet, int *len);
+    virtual int  setTimestampMode(int mode, const char* device = NULL);
+    virtual int  writeSocket(char *buffer, int *len);
+    virtual int  writeBatchedSocket(char **buffer, int count, int *len);
+    bool isZeroCopy() { return _zeroCopy; };
+    bool isDriverMode() { return _driverMode; };
+};
+#endif // USE_XDP
 
 #endif // _TCPBASIC_H
 
@@ -24,6 +24,7 @@
 #include "common.h"
 #include "tools.h"
 #include "log.h"
+#include "simd.h"
 
 #include <iostream>
 #include <cctype>
@@ -454,6 +455,10 @@ int tools::getIPAddressFromString(const char* str) {
 
 VMILIBRARY_API_TOOLS int tools::convert10bitsto8bits(unsigned char* in, int in_size, unsigned char* out) {
     try {
+        // Vectorized kernel first, the scalar loop converts the remaining bytes
+        int done = simd::convert10bitsto8bits(in, in_size, out);
+        in += done; in_size -= done;
+        out += done / 5 * 4;
         int w[4];
         while ((in_size - 5) >= 0)
         {
@@ -477,7 +482,9 @@ VMILIBRARY_API_TOOLS int tools::convert10bitsto8bits(unsigned char* in, int in_s
 
 int tools::convert8bitsto10bits(unsigned char* in, int in_size, unsigned char* out) {
     try {
-        for (int i = 0; i < in_size; i++)
+        // Vectorized kernel first, the scalar loop converts the remaining samples
+        int done = simd::convert8bitsto10bits(in, in_size, out);
+        for (int i = done; i < in_size; i++)
             tools::set10bitsWord(out, i, MAX(16, MIN(in[i], !!(i % 2) ? 235 : 240)) << 2);
     }
     catch (...) {
@@ -486,6 +493,31 @@ int tools::convert8bitsto10bits(unsigned char* in, int in_size, unsigned char* o
     return 0;
 }
 
+int tools::convert10bitsto16bits(unsigned char* in, int in_size, unsigned char* out) {
+    // Each sample in a 16 bits little endian word. in and out can't be the same buffer.
+    try {
+        int w[4];
+        while ((in_size - 5) >= 0)
+        {
+            w[0] = ((in[0]) << 2) + ((in[1] & 0b11000000) >> 6);
+            w[1] = ((in[1] & 0b00111111) << 4) + ((in[2] & 0b11110000) >> 4);
+            w[2] = ((in[2] & 0b00001111) << 6) + ((in[3] & 0b11111100) >> 2);
+            w[3] = ((in[3] & 0b00000011) << 8) + ((in[4]));
+            for (int k = 0; k < 4; k++)
+            {
+                out[2 * k] = (unsigned char)(w[k] & 0xFF);
+                out[2 * k + 1] = (unsigned char)(w[k] >> 8);
+            }
+            in += 5; in_size -= 5;
+            out += 8;
+        }
+    }
+    catch (...) {
+        LOG_ERROR("catch exception ...");
+    }
+    return 0;
+}
+
 char* tools::createSHMSegment(int size, int shmkey, 
 #ifndef _WIN32
 
@@ -507,10 +539,16 @@ char* tools::createSHMSegment(int size, int shmkey,
                     // There is a size issue
                     LOG_ERROR("(shm key=%d): Failed to open shmem. It seems there is a size issue", shmkey);
                     LOG_INFO("(shm key=%d): Try to delete it before re-create at correct size", shmkey);
-                    if (shmctl(shmid, IPC_RMID, 0) == -1) {
+                    shmid = shmget(shmkey, 0, 0666);
+                    if (shmid == -1 || shmctl(shmid, IPC_RMID, 0) == -1) {
                         LOG_ERROR("***ERROR*** shmctl failed!!!");
+                        return NULL;
+                    }
+                    shmid = shmget(shmkey, size, IPC_CREAT | IPC_EXCL | 0666);
+                    if (shmid == -1) {
+                        LOG_ERROR("***ERROR*** shmget failed, errno=%s", strerror(errno));
+                        return NULL;
                     }
-
                 }
             }
         }
@@ -605,6 +643,18 @@ void tools::deleteSHMSegment(char* pData,
 #endif
 }
 
+#ifndef _WIN32
+/**
+* \brief Mark the segment to be destroyed when the last process detach it. Its key can be used for a new segment right now.
+*/
+void tools::removeSHMSegment(int shmid) {
+
+    if (shmctl(shmid, IPC_RMID, 0) == -1) {
+        LOG_ERROR("***ERROR*** shmctl with IPC_RMID failed, errno=%s", strerror(errno));
+    }
+}
+#endif
+
 int tools::getSHMSegmentSize(
 #ifndef _WIN32
     int shmid) {
@@ -734,6 +784,20 @@ HANDLE& shmid, bool bForceDeleteIfUnused) {
 }
 
 
+bool tools::isSHMSegmentExist(int shmkey) {
+#ifndef _WIN32
+    return (shmget(shmkey, 0, 0666) != -1);
+#else
+    char shm_name[24];
+    SNPRINTF(shm_name, sizeof(shm_name), "IP2VF_SHM_%i", shmkey);
+    HANDLE shmid = OpenFileMapping(FILE_MAP_READ, false, shm_name);
+    if (shmid == NULL)
+        return false;
+    CloseHandle(shmid);
+    return true;
+#endif
+}
+
 char* tools::getSHMSegment(int size, int shmkey,
 #ifndef _WIN32
 
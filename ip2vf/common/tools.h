@@ -65,14 +65,17 @@ namespace tools
     VMILIBRARY_API_TOOLS int             getIPAddressFromString(const char* str);
     VMILIBRARY_API_TOOLS int             convert10bitsto8bits(unsigned char* in, int in_size, unsigned char* out);
     VMILIBRARY_API_TOOLS int             convert8bitsto10bits(unsigned char* in, int in_size, unsigned char* out);
+    VMILIBRARY_API_TOOLS int             convert10bitsto16bits(unsigned char* in, int in_size, unsigned char* out);
 #ifndef _WIN32
     VMILIBRARY_API_TOOLS char*           createSHMSegment(int size, int shmkey, int& shmid);
     VMILIBRARY_API_TOOLS void            detachSHMSegment(char* pData);
     VMILIBRARY_API_TOOLS void            deleteSHMSegment(char* pData, int shmid);
+    VMILIBRARY_API_TOOLS void            removeSHMSegment(int shmid);
     VMILIBRARY_API_TOOLS int             getSHMSegmentSize(int shmid);
     VMILIBRARY_API_TOOLS int             getSHMSegmentAttachNb(int shmid);
     VMILIBRARY_API_TOOLS char*           createSHMSegment_ext(int size, int& shmkey, int& shmid, bool bForceDeleteIfUnused);
     VMILIBRARY_API_TOOLS char*           getSHMSegment(int size, int shmkey, int& shmid);
+    VMILIBRARY_API_TOOLS bool            isSHMSegmentExist(int shmkey);
 #else
     VMILIBRARY_API_TOOLS char*           createSHMSegment(int size, int shmkey, HANDLE& shmid);
     VMILIBRARY_API_TOOLS void            detachSHMSegment(char* pData);
@@ -81,6 +84,7 @@ namespace tools
     VMILIBRARY_API_TOOLS int             getSHMSegmentAttachNb(HANDLE shmid);
     VMILIBRARY_API_TOOLS char*           createSHMSegment_ext(int size, int& shmkey, HANDLE& shmid, bool bForceDeleteIfUnused);
     VMILIBRARY_API_TOOLS char*           getSHMSegment(int size, int shmkey, HANDLE& shmid);
+    VMILIBRARY_API_TOOLS bool            isSHMSegmentExist(int shmkey);
 #endif
 
     VMILIBRARY_API_TOOLS int inline get10bitsWord(unsigned char* buffer, int pos10bits) {
@@ -5,6 +5,7 @@
 #include "yuv.h"        // for conversion
 #include <fstream>      // for file saving
 #include <iostream>     // for file saving
+#include <mutex>
 #include <thread>
 
 #include "common.h"
@@ -12,9 +13,13 @@
 #include "vmiframe.h"
 #include "rtpframe.h"
 #include "tools.h"
+#include "pacer.h"
 
 using namespace std;
 
+static std::mutex g_bufferProviderLock;                 /* the provider can't be unregistered while it lends a buffer */
+static CFrameBufferProvider* g_bufferProvider = NULL;   /* lend the buffers of the frames, if any */
+
 
 CvMIFrame::CvMIFrame() {
 
@@ -24,6 +29,8 @@ CvMIFrame::CvMIFrame() {
     _frame_size   = 0;
     _media_size   = 0;
     _ref_counter  = 0;
+    _ext_shared   = false;
+    _ext_lent     = false;
 
     // By default, add a reference because of the caller which create this instance
     addRef();
@@ -43,7 +50,9 @@ CvMIFrame::~CvMIFrame() {
 
 void CvMIFrame::_reset() {
 
-    if (_frame_buffer != NULL)
+    if (_ext_release)
+        _release_ext_buffer();
+    else if (_frame_buffer != NULL)
         delete[] _frame_buffer;
     _frame_buffer = NULL;
     _media_buffer = NULL;
@@ -53,26 +62,142 @@ void CvMIFrame::_reset() {
 }
 
 int CvMIFrame::addRef() {
-    std::unique_lock<std::mutex> lock(_mtx);
-    _ref_counter++;
-    return _ref_counter;
+    return _ref_counter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+/**
+* \brief Add a reference only if the frame is still referenced by someone (ref counter > 0).
+* This prevent to resurrect a frame that is being released concurrently.
+*
+* \return the new ref counter, 0 if the frame was not referenced anymore
+*/
+int CvMIFrame::tryAddRef() {
+    int ref = _ref_counter.load(std::memory_order_relaxed);
+    while (ref > 0) {
+        if (_ref_counter.compare_exchange_weak(ref, ref + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return ref + 1;
+    }
+    return 0;
 }
 
 int CvMIFrame::releaseRef() {
-    std::unique_lock<std::mutex> lock(_mtx);
-    _ref_counter--;
-    return _ref_counter;
+    int ret = _ref_counter.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    // No more user for this frame: give back the external buffer to its owner as soon as possible
+    if (ret == 0 && _ext_release)
+        _reset();
+    return ret;
+}
+
+/**
+* \brief Give back an external buffer (not owned by this frame) to its owner.
+*/
+void CvMIFrame::_release_ext_buffer() {
+
+    std::function<void()> release = std::move(_ext_release);
+    _ext_release = nullptr;
+    _ext_shared = false;
+    _ext_lent = false;
+    _frame_buffer = NULL;
+    _media_buffer = NULL;
+    _buffer_size = 0;
+    _frame_size = 0;
+    _media_size = 0;
+    release();
+}
+
+/**
+* \brief Register the provider which lend the buffers of the frames. A frame is built in a lent buffer when
+* it fits in, otherwise in a buffer owned by the frame.
+*
+* \param provider buffer provider
+* \return false if another provider is already registered
+*/
+bool CvMIFrame::registerBufferProvider(CFrameBufferProvider* provider) {
+
+    std::lock_guard<std::mutex> lock(g_bufferProviderLock);
+    if (g_bufferProvider != NULL && g_bufferProvider != provider)
+        return false;
+    g_bufferProvider = provider;
+    return true;
+}
+
+void CvMIFrame::unregisterBufferProvider(CFrameBufferProvider* provider) {
+
+    std::lock_guard<std::mutex> lock(g_bufferProviderLock);
+    if (g_bufferProvider == provider)
+        g_bufferProvider = NULL;
+}
+
+unsigned char* CvMIFrame::_lend_buffer(int framesize, int& buffer_size, std::function<void()>& release) {
+
+    std::lock_guard<std::mutex> lock(g_bufferProviderLock);
+    if (g_bufferProvider == NULL)
+        return NULL;
+    return g_bufferProvider->lendFrameBuffer(framesize, buffer_size, release);
+}
+
+/**
+* \brief Called when the frame is taken back from the pool. Its previous content is not relevant anymore:
+* the buffer owned by the frame is replaced by a lent one, if possible, so that the new frame is built
+* where it will be sent.
+*/
+void CvMIFrame::recycle() {
+
+    if (_frame_buffer == NULL || _ext_release)
+        return;
+    int buffer_size = _frame_size;
+    std::function<void()> release;
+    unsigned char* buffer = _lend_buffer(_frame_size, buffer_size, release);
+    if (buffer == NULL)
+        return;
+    delete[] _frame_buffer;
+    _ext_release = release;
+    _ext_lent = true;
+    _frame_buffer = buffer;
+    _media_buffer = buffer + CFrameHeaders::GetHeadersLength();
+    _buffer_size = buffer_size;
+    _fh.WriteHeaders(_frame_buffer);
+}
+
+/**
+* \brief Called when the lent buffer is sent in place (e.g. a published shmem slot): it is read by others from now,
+* so it is copied before any write (copy on write). It is given back to its owner when the frame is released.
+*
+* \return true if the buffer is lent, and was not yet sent
+*/
+bool CvMIFrame::sealLentBuffer() {
+
+    if (!_ext_lent)
+        return false;
+    _ext_lent = false;
+    _ext_shared = true;
+    return true;
 }
 
 int CvMIFrame::_init_buffer(int framesize) {
 
-    if (_frame_buffer == NULL || framesize > _buffer_size) {
+    // A lent buffer is kept as long as the frame fits in
+    if (_frame_buffer == NULL || framesize > _buffer_size || (_ext_release && !_ext_lent)) {
         unsigned char* old_frame_buffer = NULL;
+        std::function<void()> old_release = std::move(_ext_release);
+        _ext_release = nullptr;
+        _ext_shared = false;
+        _ext_lent = false;
         if (_frame_buffer != NULL)
             old_frame_buffer = _frame_buffer;
-        LOG_INFO("resize frame from %d to %d bytes", _buffer_size, framesize);
-        _buffer_size = framesize;
-        _frame_buffer = (unsigned char*)new unsigned char[_buffer_size];
+        // Build the frame directly where it will be sent, if possible
+        int buffer_size = framesize;
+        _frame_buffer = _lend_buffer(framesize, buffer_size, _ext_release);
+        if (_frame_buffer != NULL) {
+            LOG("use a lent buffer of %d bytes for a frame of %d bytes", buffer_size, framesize);
+            _ext_lent = true;
+        }
+        else {
+            LOG_INFO("resize frame from %d to %d bytes", _buffer_size, framesize);
+            buffer_size = framesize;
+            _frame_buffer = (unsigned char*)new unsigned char[buffer_size];
+        }
+        _buffer_size = buffer_size;
         _media_buffer = (unsigned char*)_frame_buffer + CFrameHeaders::GetHeadersLength();
         if (_frame_buffer == NULL) {
             LOG_ERROR("failed to allocate to %d bytes", _buffer_size);
@@ -81,8 +206,11 @@ int CvMIFrame::_init_buffer(int framesize) {
         }
         if (old_frame_buffer != NULL) {
             // Keep the content of the old mem segment
-            memcpy(_frame_buffer, old_frame_buffer, _frame_size);
-            delete[] old_frame_buffer;
+            memcpy(_frame_buffer, old_frame_buffer, MIN(_frame_size, framesize));
+            if (old_release)
+                old_release();
+            else
+                delete[] old_frame_buffer;
         }
     }
     _frame_size = framesize;
@@ -105,18 +233,23 @@ void CvMIFrame::memset(int val) {
     }
 }
 
-int CvMIFrame::createVideoFromSmpteFrame(CSMPTPFrame* smpteframe, SMPTEFRAME_BUFFERS srcBuffer, int moduleId) {
+int CvMIFrame::createVideoFromSmpteFrame(CSMPTPFrame* smpteframe, SMPTEFRAME_BUFFERS srcBuffer, int moduleId, int depth) {
 
     if (smpteframe == NULL)
         return VMI_E_INVALID_PARAMETER;
 
     int frameNumber = smpteframe->getFrameNumber();
-    int media_size = smpteframe->getFrameWidth() * smpteframe->getFrameHeight() * 2 /*nb components per pixel*/ * smpteframe->getFrameDepth() / 8;
+    int media_size = smpteframe->getFrameWidth() * smpteframe->getFrameHeight() * 2 /*nb components per pixel*/ * depth / 8;
     int frame_size = media_size + CFrameHeaders::GetHeadersLength();
     _init_buffer(frame_size);
     _fh.InitVideoHeadersFromProfile(smpteframe->getProfile());
-    _media_size = smpteframe->extractMediaContent(srcBuffer, (char*)_media_buffer, media_size);
+    // The samples are converted to the wanted depth while extracted from the SMPTE frame
+    _fh.SetDepth(depth);
+    _fh.SetGroupSize(depth / 2);
+    _media_size = smpteframe->extractMediaContent(srcBuffer, (char*)_media_buffer, media_size, depth);
     _fh.SetMediaTimestamp(smpteframe->getTimestamp());
+    _fh.SetFirstPacketTimestamp(smpteframe->getFirstPacketTime());
+    _fh.SetLastPacketTimestamp(smpteframe->getLastPacketTime());
     _fh.SetMediaSize(_media_size);
     _fh.SetFrameNumber(frameNumber);
     _fh.SetModuleId(moduleId);
@@ -136,6 +269,8 @@ int CvMIFrame::createAudioFromSmpteFrame(CSMPTPFrame* smpteframe, SMPTEFRAME_BUF
     _fh.InitAudioHeadersFromSMPTE(AUDIOFMT::L24_PCM, SAMPLERATE::S_48KHz);
     _media_size = smpteframe->extractMediaContent(srcBuffer, (char*)_media_buffer, media_size);
     _fh.SetMediaTimestamp(smpteframe->getTimestamp());
+    _fh.SetFirstPacketTimestamp(smpteframe->getFirstPacketTime());
+    _fh.SetLastPacketTimestamp(smpteframe->getLastPacketTime());
     _fh.SetMediaSize(_media_size);
     _fh.SetFrameNumber(frameNumber);
     _fh.SetModuleId(moduleId);
@@ -162,6 +297,53 @@ int CvMIFrame::createFromMem(unsigned char* buffer, int buffer_size, int moduleI
     _fh.SetModuleId(moduleId);
     _fh.WriteHeaders(_frame_buffer);
 
+    return VMI_E_OK;
+}
+
+/**
+* \brief Create the frame in place on an external buffer (e.g. a shmem slot), without copy. The buffer is not
+* owned by the frame: release() is called as soon as the frame doesn't reference it anymore (last reference
+* released, frame reused or resized).
+*
+* \param buffer pointer to the vMI frame (headers + media)
+* \param buffer_size size of buffer
+* \param moduleId id of the current module
+* \param release function called to give back the buffer
+* \param bShared true if the buffer is read by other processes too. Then the module id is not written in the
+* buffer, and the buffer is copied before any header update (copy on write)
+* \return VMI_E_OK if ok, error code otherwise. On error, release() is called immediately.
+*/
+int CvMIFrame::createFromSharedMem(unsigned char* buffer, int buffer_size, int moduleId, std::function<void()> release, bool bShared) {
+
+    if (buffer == NULL) {
+        release();
+        return VMI_E_INVALID_PARAMETER;
+    }
+
+    CFrameHeaders fh;
+    fh.ReadHeaders(buffer);
+    int frame_size = fh.GetMediaSize() + CFrameHeaders::GetHeadersLength();
+    if (frame_size > buffer_size) {
+        // This must not happen
+        LOG_ERROR("Invalid frame: frame size (%d) is greater than buffer size (%d)", frame_size, buffer_size);
+        release();
+        return VMI_E_INVALID_FRAME;
+    }
+
+    // Drop the previous buffer (own or external)
+    _reset();
+    _ext_release = release;
+    _frame_buffer = buffer;
+    _media_buffer = buffer + CFrameHeaders::GetHeadersLength();
+    _buffer_size = buffer_size;
+    _frame_size = frame_size;
+    _media_size = frame_size - CFrameHeaders::GetHeadersLength();
+    _ext_shared = bShared;
+    _fh = fh;
+    _fh.SetModuleId(moduleId);
+    if (!_ext_shared)
+        _fh.WriteHeaders(_frame_buffer);
+
     return VMI_E_OK;
 }
 
@@ -321,6 +503,22 @@ int CvMIFrame::create(CFrameHeaders* fh) {
 }
 
 
+/**
+* \brief Return the media buffer, to write in it. An external buffer read by other processes too is
+* first copied in a buffer owned by the frame (copy on write), and given back to its owner.
+*
+* \return pointer to the media buffer, NULL if no buffer
+*/
+unsigned char* CvMIFrame::getWritableMediaBuffer() {
+
+    if (_ext_shared) {
+        if (_init_buffer(_frame_size) != VMI_E_OK)
+            return NULL;
+        _fh.WriteHeaders(_frame_buffer);
+    }
+    return _media_buffer;
+}
+
 int CvMIFrame::copyFrameToMem(unsigned char* buffer, int size) {
     //LOG_INFO("size: frame=%d, media=%d, output=%d, buffer=0x%x", _frame_size, _media_size, size, buffer);
     if (size > _frame_size) {
@@ -328,6 +526,8 @@ int CvMIFrame::copyFrameToMem(unsigned char* buffer, int size) {
         return VMI_E_INVALID_PARAMETER;
     }
     memcpy(buffer, _frame_buffer, size);
+    if (_ext_shared && size >= CFrameHeaders::GetHeadersLength())
+        _fh.WriteHeaders(buffer);
     return VMI_E_OK;
 }
 
@@ -345,21 +545,27 @@ int CvMIFrame::sendToRTP(UDP* sock, int mtu, unsigned int& seq) {
 
     if (sock && sock->isValid())
     {
-        char RTPframe[RTP_MAX_FRAME_LENGTH];
         int UDPPacketSize = mtu - IP_HEADERS_LENGTH;
         int RTPPacketSize = UDPPacketSize - UDP_HEADERS_LENGTH;
         int payloadSize = RTPPacketSize - RTP_HEADERS_LENGTH;
 
         char* p = (char*)_frame_buffer;
-        CRTPFrame frame((unsigned char*)RTPframe, RTPPacketSize);
+        CRTPFrame frame;
         int bEndOfFrame = false;
         int remainingLen = _frame_size;
 
+        // Spread the packets of a video frame over the frame period, if the socket is paced
+        bool isVideo = (_fh.GetMediaFormat() == MEDIAFORMAT::VIDEO);
+        sock->startFrame((_frame_size + payloadSize - 1) / payloadSize, (isVideo ? _fh.GetFramerate() : 0.0f),
+            CPacer::getActiveRatio(_fh.GetH()));
+
         while( remainingLen>0 ) {
         
-            int len, result, marker=0;
+            int result, marker=0;
 
-            // First, construct the full RTP frame
+            // First, construct the full RTP frame, directly in the send batch of the socket
+            char* RTPframe = sock->getSendBuffer();
+            frame.setBuffer((unsigned char*)RTPframe, RTPPacketSize);
             int payloadLen = MIN(remainingLen, payloadSize);
             memcpy(RTPframe+RTP_HEADERS_LENGTH, p, payloadLen);
             remainingLen -= payloadLen;
@@ -373,16 +579,15 @@ int CvMIFrame::sendToRTP(UDP* sock, int mtu, unsigned int& seq) {
             }
             //frame.dumpHeader((char*)_RTPframe);
 
-            // Then send UDP packet
-            len = RTPPacketSize;
-            result = sock->writeSocket(RTPframe, &len);
-            if( result != -1 ) {
-                LOG("write (size=%d) to socket, result=%d, RTP packet #%d, payloadlen=%d, remaining=%d",
-                    len, result, frame._seq, payloadLen, remainingLen);
+            // Then queue the UDP packet, the batch is sent when full or at the end of the frame
+            result = sock->queueSendBuffer(RTPPacketSize);
+            if( result != -1 && (remainingLen > 0 || sock->flushSendBuffer() != -1) ) {
+                LOG("write (size=%d) to socket, RTP packet #%d, payloadlen=%d, remaining=%d",
+                    RTPPacketSize, frame._seq, payloadLen, remainingLen);
             }
             else {
-                LOG_ERROR("error write (size=%d) to socket, result=%d, RTP packet #%d, payloadlen=%d, remaining=%d",
-                    len, result, frame._seq, payloadLen, remainingLen);
+                LOG_ERROR("error write (size=%d) to socket, RTP packet #%d, payloadlen=%d, remaining=%d",
+                    RTPPacketSize, frame._seq, payloadLen, remainingLen);
                 return VMI_E_FAILED_TO_SND_SOCKET;
             }
         }
@@ -513,6 +718,10 @@ void CvMIFrame::set_header(MediaHeader header, void* value) {
             _fh.SetInputTimestamp(*static_cast<unsigned long long*>(value)); break;
         case MEDIA_OUT_TIMESTAMP:
             _fh.SetOutputTimestamp(*static_cast<unsigned long long*>(value)); break;
+        case MEDIA_FIRST_PACKET_TIMESTAMP:
+            _fh.SetFirstPacketTimestamp(*static_cast<unsigned long long*>(value)); break;
+        case MEDIA_LAST_PACKET_TIMESTAMP:
+            _fh.SetLastPacketTimestamp(*static_cast<unsigned long long*>(value)); break;
         default:
             break;
         }
@@ -520,6 +729,8 @@ void CvMIFrame::set_header(MediaHeader header, void* value) {
     catch (...) {
 
     }
+    if (_ext_shared)
+        _init_buffer(_frame_size);  // copy on write
     if( _frame_buffer != NULL )
         _fh.WriteHeaders(_frame_buffer);
 }
@@ -562,6 +773,10 @@ void CvMIFrame::get_header(MediaHeader header, void* value) {
             *static_cast<unsigned long long*>(value) = _fh.GetInputTimestamp(); break;
         case MEDIA_OUT_TIMESTAMP:
             *static_cast<unsigned long long*>(value) = _fh.GetOutputTimestamp(); break;
+        case MEDIA_FIRST_PACKET_TIMESTAMP:
+            *static_cast<unsigned long long*>(value) = _fh.GetFirstPacketTimestamp(); break;
+        case MEDIA_LAST_PACKET_TIMESTAMP:
+            *static_cast<unsigned long long*>(value) = _fh.GetLastPacketTimestamp(); break;
         case VIDEO_SMPTEFRMCODE:
             *static_cast<int*>(value) = _fh.GetSmpteframeCode(); break;
         default:
@@ -1,12 +1,27 @@
 #ifndef _VMIFRAME_H
 #define _VMIFRAME_H
 
+#include <atomic>
+#include <functional>
 
 #include "common.h"
 #include "frameheaders.h"
 #include "./pins/st2022/smpteframe.h"
 #include "tcp_basic.h"
 #include "libvMI.h"
+
+/*
+*  Lend the buffers of the frames, so that a frame is built directly where it is sent
+*  (e.g. the slots of a zero-copy shmem output pin)
+*/
+class CFrameBufferProvider
+{
+public:
+    virtual ~CFrameBufferProvider() {};
+
+    /* Return a buffer of at least size bytes, its size in bufferSize, and the function to give it back. NULL if none */
+    virtual unsigned char* lendFrameBuffer(int size, int& bufferSize, std::function<void()>& release) = 0;
+};
 
 /*
 *  Contain a single vMIFrame
@@ -21,8 +36,11 @@ class CvMIFrame
     int            _media_size;
     CFrameHeaders  _fh;
 
-    int            _ref_counter;
-    std::mutex     _mtx;
+    std::atomic<int> _ref_counter;
+
+    std::function<void()> _ext_release;     /* set when the buffer is not owned by the frame (e.g. a shmem slot), called to release it */
+    bool           _ext_shared;             /* external buffer read by other processes too: copy it before any write */
+    bool           _ext_lent;               /* external buffer lent by the buffer provider, not yet sent */
 
 public:
     CvMIFrame();
@@ -30,15 +48,24 @@ public:
     ~CvMIFrame();
 
     void _reset();
+    void _release_ext_buffer();
+    unsigned char* _lend_buffer(int framesize, int& buffer_size, std::function<void()>& release);
     int  _init_buffer(int framesize);
     int  _refresh_from_headers();
     bool _is_sampling_fmt_supported();
     int  _calculate_pixel_size_in_bits();
 
 public:
+    // Buffer provider, at most one per process
+    static bool registerBufferProvider(CFrameBufferProvider* provider);
+    static void unregisterBufferProvider(CFrameBufferProvider* provider);
+    void recycle();
+    bool sealLentBuffer();
+
     // Accesseurs
     unsigned char* getMediaBuffer() { return _media_buffer; };
     unsigned char* getFrameBuffer() { return _frame_buffer; };
+    unsigned char* getWritableMediaBuffer();
     int getMediaSize() { return _media_size; };
     int getFrameSize() { return _media_size + CFrameHeaders::GetHeadersLength(); };
     CFrameHeaders* getMediaHeaders() { return &_fh; };
@@ -46,12 +73,14 @@ public:
 
     // Ref counter management
     int addRef();
+    int tryAddRef();
     int releaseRef();
-    int getRef() { return _ref_counter; };
+    int getRef() { return _ref_counter.load(std::memory_order_acquire); };
 
-    int createVideoFromSmpteFrame(CSMPTPFrame* smpteframe, SMPTEFRAME_BUFFERS srcBuffer, int moduleId);
+    int createVideoFromSmpteFrame(CSMPTPFrame* smpteframe, SMPTEFRAME_BUFFERS srcBuffer, int moduleId, int depth = 10);
     int createAudioFromSmpteFrame(CSMPTPFrame* smpteframe, SMPTEFRAME_BUFFERS srcBuffer, int moduleId);
     int createFromMem(unsigned char* buffer, int buffer_size, int moduleId);
+    int createFromSharedMem(unsigned char* buffer, int buffer_size, int moduleId, std::function<void()> release, bool bShared = false);
     int createUninitialized(int size);
     int createFromTCP(TCP* sock, int moduleId);
     int createFromUDP(UDP* sock, int moduleId);
@@ -0,0 +1,132 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "log.h"
+#include "workerpool.h"
+
+/**********************************************************************************************
+*
+* CWorkerPool
+*
+***********************************************************************************************/
+
+CWorkerPool::CWorkerPool()
+{
+    _generation = 0;
+    _nbRunning = 0;
+    _stop = false;
+    _nbThreads = 1;
+    _firstCpu = -1;
+}
+
+CWorkerPool::~CWorkerPool()
+{
+    stop();
+}
+
+/*!
+* \fn init
+* \brief set the number of threads, before the first run
+*
+* \param nbThreads number of parts of each job, including the calling thread
+* \param firstCpu if >= 0, the worker i is bound to the CPU firstCpu+i (modulo the number of CPUs)
+*/
+void CWorkerPool::init(int nbThreads, int firstCpu)
+{
+    stop();
+    _nbThreads = (nbThreads < 1 ? 1 : nbThreads);
+    _firstCpu = firstCpu;
+}
+
+void CWorkerPool::_start()
+{
+    _stop = false;
+    for (int i = 1; i < _nbThreads; i++)
+        _threads.push_back(std::thread(&CWorkerPool::_worker, this, i, _generation));
+    LOG_INFO("worker pool: %d threads, first cpu=%d", _nbThreads, _firstCpu);
+}
+
+/*!
+* \fn run
+* \brief run a job on all the threads and wait for its end
+*
+* \param job function called with the part index (0..count-1) and the number of parts
+*/
+void CWorkerPool::run(const std::function<void(int index, int count)>& job)
+{
+    std::lock_guard<std::mutex> runLock(_runLock);
+    if (_nbThreads > 1 && _threads.empty())
+        _start();
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _job = job;
+        _nbRunning = _nbThreads - 1;
+        _generation++;
+    }
+    _cvStart.notify_all();
+    job(0, _nbThreads);
+    std::unique_lock<std::mutex> lock(_lock);
+    _cvDone.wait(lock, [=] { return _nbRunning == 0; });
+}
+
+/*!
+* \fn stop
+* \brief stop and join the threads. They are restarted by the next run.
+*/
+void CWorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _stop = true;
+    }
+    _cvStart.notify_all();
+    for (std::thread &t : _threads) {
+        if (t.joinable())
+            t.join();
+    }
+    _threads.clear();
+}
+
+void CWorkerPool::_worker(int index, long long generation)
+{
+    if (_firstCpu >= 0) {
+        int nbCpu = (int)std::thread::hardware_concurrency();
+        int cpu = (_firstCpu + index) % (nbCpu > 0 ? nbCpu : 1);
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+#else
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+        if (ret != 0)
+            LOG_ERROR("worker %d: can't bind to cpu %d: %s", index, cpu, strerror(ret));
+#endif
+    }
+
+    // generation: last job seen, the next one is run
+    while (true) {
+        std::function<void(int, int)> job;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _cvStart.wait(lock, [&] { return _stop || _generation != generation; });
+            if (_stop)
+                return;
+            generation = _generation;
+            job = _job;
+        }
+        job(index, _nbThreads);
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            if (--_nbRunning == 0)
+                _cvDone.notify_one();
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef _WORKERPOOL_H
+#define _WORKERPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/**********************************************************************************************
+*
+* CWorkerPool
+*
+* Long-lived threads running the same job on several parts of a buffer, i.e. one frame. The
+* threads are created on the first run and wait for the next job between two runs, instead
+* of being created and joined for each frame. The calling thread runs the part 0 itself.
+*
+***********************************************************************************************/
+class CWorkerPool
+{
+    std::vector<std::thread>    _threads;
+    std::mutex                  _lock;
+    std::mutex                  _runLock;       /* one run at a time */
+    std::condition_variable     _cvStart;
+    std::condition_variable     _cvDone;
+    std::function<void(int, int)> _job;
+    long long                   _generation;    /* incremented for each run */
+    int                         _nbRunning;     /* threads still running the current job */
+    bool                        _stop;
+    int                         _nbThreads;
+    int                         _firstCpu;      /* -1: no affinity */
+
+public:
+    CWorkerPool();
+    ~CWorkerPool();
+
+public:
+    void init(int nbThreads, int firstCpu = -1);
+    int  getThreadsNb() { return _nbThreads; };
+    void run(const std::function<void(int index, int count)>& job);
+    void stop();
+
+private:
+    void _start();
+    void _worker(int index, long long generation);
+};
+
+#endif //_WORKERPOOL_H
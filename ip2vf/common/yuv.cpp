@@ -9,7 +9,7 @@
  * YCbCr2RGB() maps interleaved YCbCr to RGB (4 bytes -> 2 pixels)
  * conversions are based on standard Y'UV444 to RGB888 conversion formulas.
  * 
- * ALL implementations tested show some (small) overflow in pure white shiny areas.
+ * The fixed point conversions clip the results: no overflow in pure white shiny areas.
  * 
  * ================================================================
  * IMPORTANT!
@@ -21,7 +21,12 @@
  * ===================================================================
  */
 #include <stdio.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>    // for std::fill
+#include "common.h"     // for MAX
 #include "yuv.h"
+#include "simd.h"
 #define CLIP_UCHAR(X)  ((X) > 255 ? 255 : (X) < 0 ? 0 : (X))
 #define CLIP_CHAR(X)  ((X) > 127 ? 127 : (X) < -128 ? -128 : (X))
 
@@ -30,149 +35,210 @@ void initYUVConversion () {
 }
 
 
-/* 
- * yuv422 interleaved -> RGB directly
- * 
- * Y'=0.299* R+0.587* G+0.114* B
- * U=-0.147* R-0.289* G+0.436* B
- * V=0.615* R-0.515* G-0.100* B
- * 
- * 
+/*
+ * yuv422 interleaved -> RGB, fixed point
+ *
+ * R = Y' * ys + Cr' * crR
+ * G = Y' * ys + Cb' * cbG + Cr' * crG
+ * B = Y' * ys + Cb' * cbB
+ *
+ * with Y' = Y - black, Cb' = Cb - 128, Cr' = Cr - 128 (x4 in 10 bits). The coefficients come
+ * from Kr/Kb of the matrix, scaled by 255/219 and 255/224 in limited range. The samples are put at
+ * the 8 bits scale << 7 and multiplied by the Q13 coefficients as pmulhrsw does, so that the
+ * results are the ones of the vectorized kernels (simd.cpp).
  */
-void
-YCbCr2RGB(char* out, const char* in, int npixels)
-{
-    int r, g, b;
-    char u, v, y1, y2;
-    
-    char* yuv = (char*)in;
-    char* rgb = (char*)out;
-    char* end = rgb + 3*npixels;
-    
-    while (rgb < end) {
+struct YCbCrCoefsTable {
+    simd::YCbCrCoefs k[2][2][2];    /* [matrix][range][packed10] */
+};
 
-        /* extract yuv for 2 pixels */
-        u =  *yuv++;
-        y1 = *yuv++;
-        v =  *yuv++;
-        y2 = *yuv++;
-        
-        u -= 128;
-        v -= 128;
-        
-        /* --- first RGB pixel --- */
+static YCbCrCoefsTable buildYCbCrCoefs()
+{
+    YCbCrCoefsTable t;
+    for (int m = 0; m < 2; m++) {
+        double kr = (m == YUV_MATRIX_BT709 ? 0.2126 : 0.299);
+        double kb = (m == YUV_MATRIX_BT709 ? 0.0722 : 0.114);
+        double kg = 1.0 - kr - kb;
+        for (int r = 0; r < 2; r++) {
+            double ys = (r == YUV_RANGE_FULL ? 1.0 : 255.0 / 219.0);
+            double cs = (r == YUV_RANGE_FULL ? 1.0 : 255.0 / 224.0);
+            for (int d = 0; d < 2; d++) {
+                simd::YCbCrCoefs& k = t.k[m][r][d];
+                k.y   = (short)lround(ys * 8192);
+                k.crR = (short)lround(2.0 * (1.0 - kr) * cs * 8192);
+                k.cbG = (short)lround(-2.0 * (1.0 - kb) * kb / kg * cs * 8192);
+                k.crG = (short)lround(-2.0 * (1.0 - kr) * kr / kg * cs * 8192);
+                k.cbB = (short)lround(2.0 * (1.0 - kb) * cs * 8192);
+                k.yOffset = (short)((r == YUV_RANGE_FULL ? 0 : 16) << (d ? 2 : 0));
+                k.cOffset = (short)(128 << (d ? 2 : 0));
+            }
+        }
+    }
+    return t;
+}
 
-        /* yuv444 -> rgb 888 */
-        r = y1 + v + (v >> 2) + (v >> 3) + (v >> 5);
-        g = y1 - ((u>>2) + (u>>4) + (u>>5)) - ((v>>1) + (v >> 3) + (v >> 4) + (v >> 5));
-        b = y1 + u + (u >> 1) + (u >> 2) + (u >> 6);
+static const simd::YCbCrCoefs& yuvToRGBCoefs(int matrix, int range, bool packed10)
+{
+    static const YCbCrCoefsTable table = buildYCbCrCoefs();
+    matrix = (matrix == YUV_MATRIX_BT709 ? 1 : 0);
+    range = (range == YUV_RANGE_FULL ? 1 : 0);
+    return table.k[matrix][range][packed10 ? 1 : 0];
+}
 
-        *rgb++ = (r);
-        *rgb++ = (g);
-        *rgb++ = (b);
+static inline int mulQ13(int a, int c)
+{
+    return (a * c + 0x4000) >> 15;
+}
 
-        /* --- second RGB pixel --- */
-        r = y2 + v + (v >> 2) + (v >> 3) + (v >> 5);
-        g = y2 - ((u>>2) + (u>>4) + (u>>5)) - ((v>>1) + (v >> 3) + (v >> 4) + (v >> 5));
-        b = y2 + u + (u >> 1) + (u >> 2) + (u >> 6);  
+static inline void writePixel(unsigned char* rgb, int y, int cb, int cr, const simd::YCbCrCoefs& k, int depth, bool bgr)
+{
+    int yt = mulQ13(y, k.y);
+    int r = (yt + mulQ13(cr, k.crR) + 16) >> 5;
+    int g = (yt + mulQ13(cb, k.cbG) + mulQ13(cr, k.crG) + 16) >> 5;
+    int b = (yt + mulQ13(cb, k.cbB) + 16) >> 5;
+    rgb[bgr ? 2 : 0] = (unsigned char)CLIP_UCHAR(r);
+    rgb[1] = (unsigned char)CLIP_UCHAR(g);
+    rgb[bgr ? 0 : 2] = (unsigned char)CLIP_UCHAR(b);
+    if (depth == 4)
+        rgb[3] = 255;
+}
 
-        *rgb++ = (r);
-        *rgb++ = (g);
-        *rgb++ = (b);
+static void UYVYToRGB(unsigned char* out, const unsigned char* in, int npixels, bool packed10, int outFormat, int matrix, int range)
+{
+    const simd::YCbCrCoefs& k = yuvToRGBCoefs(matrix, range, packed10);
+    int depth = (outFormat == YUV_OUT_RGB24 ? 3 : 4);
+    bool bgr = (outFormat == YUV_OUT_BGRA);
+
+    int done = simd::convertUYVYtoRGB(in, npixels, packed10, k, out, depth, bgr);
+
+    // The rest, 2 pixels per Cb Y Cr Y
+    int scale = (packed10 ? 32 : 128);   /* 8 bits scale << 7 */
+    for (int x = done; x < npixels; x += 2) {
+        int s[4];
+        if (packed10) {
+            const unsigned char* p = in + x / 2 * 5;
+            s[0] = (p[0] << 2) | (p[1] >> 6);
+            s[1] = ((p[1] & 0x3F) << 4) | (p[2] >> 4);
+            s[2] = ((p[2] & 0x0F) << 6) | (p[3] >> 2);
+            s[3] = ((p[3] & 0x03) << 8) | p[4];
+        }
+        else {
+            for (int i = 0; i < 4; i++)
+                s[i] = in[x * 2 + i];
+        }
+        int cb = (s[0] - k.cOffset) * scale;
+        int cr = (s[2] - k.cOffset) * scale;
+        writePixel(out + x * depth, (s[1] - k.yOffset) * scale, cb, cr, k, depth, bgr);
+        if (x + 1 < npixels)
+            writePixel(out + (x + 1) * depth, (s[3] - k.yOffset) * scale, cb, cr, k, depth, bgr);
     }
 }
 
 void
-YCbCr2RGBA(char* out, const char* in, int npixels)
+UYVY8ToRGB(char* out, const char* in, int npixels, int outFormat, int matrix, int range)
 {
-    int r, g, b;
-    char u, v, y1, y2;
+    UYVYToRGB((unsigned char*)out, (const unsigned char*)in, npixels, false, outFormat, matrix, range);
+}
 
-    char* yuv = (char*)in;
-    char* rgb = out;
-    char* end = rgb + 4 * npixels;
+void
+UYVY10ToRGB(char* out, const char* in, int npixels, int outFormat, int matrix, int range)
+{
+    UYVYToRGB((unsigned char*)out, (const unsigned char*)in, npixels, true, outFormat, matrix, range);
+}
 
-    while (rgb < end) {
+/*
+ * yuv422 interleaved -> RGB thumbnail, area average
+ *
+ * Each thumbnail pixel is the average of its box of source pixels, the box edges being rounded
+ * to the source pixels. The samples of the rows of a box are summed per column (at the 10 bits
+ * scale), then the columns of each box are summed and the averages converted to RGB: the matrix
+ * is linear, averaging YCbCr is averaging RGB. maxRows limits the rows summed per box, evenly
+ * spaced in it: the other rows are not read at all.
+ */
+void
+UYVYDownscaleToRGB(char* out, int dstW, int dstH, const char* in, int srcW, int srcH, bool packed10,
+    int outFormat, int matrix, int range, int maxRows)
+{
+    if (dstW <= 0 || dstH <= 0 || srcW < 2 || srcH <= 0)
+        return;
+
+    const simd::YCbCrCoefs& k = yuvToRGBCoefs(matrix, range, true);
+    int depth = (outFormat == YUV_OUT_RGB24 ? 3 : 4);
+    bool bgr = (outFormat == YUV_OUT_BGRA);
+    int pairs = srcW / 2;
+    int stride = (packed10 ? pairs * 5 : pairs * 4);
+    std::vector<unsigned int> acc(pairs * 4);   /* per pair: Cb, Y, Cr, Y */
+    unsigned char* rgb = (unsigned char*)out;
+
+    for (int y = 0; y < dstH; y++) {
+        int y0 = (int)((long long)y * srcH / dstH);
+        int y1 = MAX(y0 + 1, (int)((long long)(y + 1) * srcH / dstH));
+        int nbRows = y1 - y0;
+        if (maxRows > 0 && nbRows > maxRows)
+            nbRows = maxRows;
+
+        std::fill(acc.begin(), acc.end(), 0);
+        for (int r = 0; r < nbRows; r++) {
+            // centers of nbRows equal parts of the box
+            const unsigned char* p = (const unsigned char*)in + (long long)(y0 + ((2 * r + 1) * (y1 - y0)) / (2 * nbRows)) * stride;
+            unsigned int* a = acc.data();
+            if (packed10) {
+                int done = simd::accumulate10bits(p, stride, a) / 5;
+                p += done * 5;
+                a += done * 4;
+                for (int i = done; i < pairs; i++, p += 5, a += 4) {
+                    unsigned long long v = ((unsigned long long)p[0] << 32) | ((unsigned int)p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+                    a[0] += (unsigned int)(v >> 30);
+                    a[1] += (unsigned int)(v >> 20) & 0x3FF;
+                    a[2] += (unsigned int)(v >> 10) & 0x3FF;
+                    a[3] += (unsigned int)v & 0x3FF;
+                }
+            }
+            else {
+                for (int i = 0; i < pairs * 4; i++)
+                    a[i] += p[i] << 2;
+            }
+        }
 
-        /* extract yuv for 2 pixels */
-        u = *yuv++;
-        y1 = *yuv++;
-        v = *yuv++;
-        y2 = *yuv++;
-
-        u -= 128;
-        v -= 128;
-
-        /* --- first RGB pixel --- */
-
-        /* yuv444 -> rgb 888 */
-        r = y1 + v + (v >> 2) + (v >> 3) + (v >> 5);
-        g = y1 - ((u >> 2) + (u >> 4) + (u >> 5)) - ((v >> 1) + (v >> 3) + (v >> 4) + (v >> 5));
-        b = y1 + u + (u >> 1) + (u >> 2) + (u >> 6);
-
-        *rgb++ = r;
-        *rgb++ = g;
-        *rgb++ = b;
-        *rgb++ = (char)255;
-
-        if (rgb < end) {
-            /* --- second RGB pixel --- */
-            r = y2 + v + (v >> 2) + (v >> 3) + (v >> 5);
-            g = y2 - ((u >> 2) + (u >> 4) + (u >> 5)) - ((v >> 1) + (v >> 3) + (v >> 4) + (v >> 5));
-            b = y2 + u + (u >> 1) + (u >> 2) + (u >> 6);
-
-            *rgb++ = r;
-            *rgb++ = g;
-            *rgb++ = b;
-            *rgb++ = (char)255;
+        for (int x = 0; x < dstW; x++) {
+            int x0 = (int)((long long)x * pairs * 2 / dstW);
+            int x1 = MAX(x0 + 1, (int)((long long)(x + 1) * pairs * 2 / dstW));
+            unsigned long long sy = 0, scb = 0, scr = 0;
+            // pixel i: Y at 2i+1, Cb and Cr of its pair at (2i & ~3) and (2i & ~3) + 2
+            const unsigned int* a = acc.data();
+            for (int i = x0; i < x1; i++) {
+                sy += a[2 * i + 1];
+                scb += a[(2 * i) & ~3];
+                scr += a[((2 * i) & ~3) + 2];
+            }
+            double inv = 1.0 / ((x1 - x0) * nbRows);
+            int yv = (int)(sy * inv + 0.5);
+            int cb = (int)(scb * inv + 0.5);
+            int cr = (int)(scr * inv + 0.5);
+            writePixel(rgb, (yv - k.yOffset) * 32, (cb - k.cOffset) * 32, (cr - k.cOffset) * 32, k, depth, bgr);
+            rgb += depth;
         }
     }
 }
+
+/*
+ * yuv422 interleaved -> RGB directly, BT.601 full range (Y'=0.299* R+0.587* G+0.114* B)
+ */
 void
-YCbCr2BGRA(char* out, const char* in, int npixels)
+YCbCr2RGB(char* out, const char* in, int npixels)
 {
-    int r, g, b;
-    char u, v, y1, y2;
-
-    char* yuv = (char*)in;
-    char* rgb = out;
-    char* end = rgb + 4 * npixels;
+    UYVY8ToRGB(out, in, npixels, YUV_OUT_RGB24, YUV_MATRIX_BT601, YUV_RANGE_FULL);
+}
 
-    while (rgb < end) {
+void
+YCbCr2RGBA(char* out, const char* in, int npixels)
+{
+    UYVY8ToRGB(out, in, npixels, YUV_OUT_RGBA, YUV_MATRIX_BT601, YUV_RANGE_FULL);
+}
 
-        /* extract yuv for 2 pixels */
-        u = *yuv++;
-        y1 = *yuv++;
-        v = *yuv++;
-        y2 = *yuv++;
-
-        u -= 128;
-        v -= 128;
-
-        /* --- first RGB pixel --- */
-
-        /* yuv444 -> rgb 888 */
-        r = y1 + v + (v >> 2) + (v >> 3) + (v >> 5);
-        g = y1 - ((u >> 2) + (u >> 4) + (u >> 5)) - ((v >> 1) + (v >> 3) + (v >> 4) + (v >> 5));
-        b = y1 + u + (u >> 1) + (u >> 2) + (u >> 6);
-
-        *rgb++ = b;
-        *rgb++ = g;
-        *rgb++ = r;
-        *rgb++ = (char)255;
-
-        if (rgb < end) {
-            /* --- second RGB pixel --- */
-            r = y2 + v + (v >> 2) + (v >> 3) + (v >> 5);
-            g = y2 - ((u >> 2) + (u >> 4) + (u >> 5)) - ((v >> 1) + (v >> 3) + (v >> 4) + (v >> 5));
-            b = y2 + u + (u >> 1) + (u >> 2) + (u >> 6);
-
-            *rgb++ = b;
-            *rgb++ = g;
-            *rgb++ = r;
-            *rgb++ = (char)255;
-        }
-    }
+void
+YCbCr2BGRA(char* out, const char* in, int npixels)
+{
+    UYVY8ToRGB(out, in, npixels, YUV_OUT_BGRA, YUV_MATRIX_BT601, YUV_RANGE_FULL);
 }
 // RGB -> YCbCr
 #define CRGB2Y(R, G, B) CLIP((19595 * R + 38470 * G + 7471 * B ) >> 16)
@@ -42,9 +42,26 @@ VMILIBRARY_API_YUV void initYUVConversion ();
 /* yuv422 interleaved -> RGB */
 VMILIBRARY_API_YUV void YCbCr2RGB(char* out, const char* in, int npixels);
 VMILIBRARY_API_YUV void YCbCr2RGBA(char* out, const char* in, int npixels);
+VMILIBRARY_API_YUV void YCbCr2BGRA(char* out, const char* in, int npixels);
 VMILIBRARY_API_YUV void RGB2YUV422_(char* out, const char* in, int npixels);
 VMILIBRARY_API_YUV void RGB2YUV444_(char* out, const char* in, int npixels);
 
+/* yuv422 interleaved (Cb Y Cr Y) 8 bits or packed 10 bits -> RGB, fixed point, vectorized */
+#define YUV_MATRIX_BT601    0
+#define YUV_MATRIX_BT709    1
+#define YUV_RANGE_LIMITED   0   /* Y [16, 235], Cb/Cr [16, 240] (x4 in 10 bits) */
+#define YUV_RANGE_FULL      1
+#define YUV_OUT_RGB24       0
+#define YUV_OUT_RGBA        1   /* alpha=255 */
+#define YUV_OUT_BGRA        2
+VMILIBRARY_API_YUV void UYVY8ToRGB(char* out, const char* in, int npixels, int outFormat, int matrix, int range);
+VMILIBRARY_API_YUV void UYVY10ToRGB(char* out, const char* in, int npixels, int outFormat, int matrix, int range);
+
+/* yuv422 interleaved 8 bits or packed 10 bits -> RGB thumbnail of any size, area average.
+ * maxRows: max source rows read per thumbnail row, 0 for all */
+VMILIBRARY_API_YUV void UYVYDownscaleToRGB(char* out, int dstW, int dstH, const char* in, int srcW, int srcH,
+    bool packed10, int outFormat, int matrix, int range, int maxRows);
+
 /* yuv420 planar -> RGB */
 VMILIBRARY_API_YUV void yuv420ToRGB(char* out, const char* in, int w, int h);
 
@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <cstring>      // strcmp
 #include <set>
+#include <atomic>
 #include <pins/pins.h>
 
 #include "log.h"
@@ -24,23 +25,132 @@
 
 #define MAX_FRAME_IN_LIST   10
 
+/**
+* Frame handle layout: the low LIBVMI_FRAME_SLOT_BITS bits are the index of the slot on g_vMIFramesSlots,
+* the remaining (positive) bits are the generation of the slot. The generation is incremented each time
+* a slot is reused, so that a stale handle (already released) is never resolved to the new frame.
+*/
+#define LIBVMI_FRAME_SLOT_BITS      12
+#define LIBVMI_FRAME_SLOT_MASK      ((1 << LIBVMI_FRAME_SLOT_BITS) - 1)
+#define LIBVMI_FRAME_GEN_MASK       ((1 << (31 - LIBVMI_FRAME_SLOT_BITS)) - 1)
+#define LIBVMI_MAX_FRAME_SLOTS      (1 << LIBVMI_FRAME_SLOT_BITS)
+#define LIBVMI_FRAME_NO_SLOT        (-1)
+
 /**
 * \brief Struct that contains all about a frame
 *
-* This struct contains a unique handle, the pointer to the corresponding object, and a bool to indicate if
-* the frame is free or not.
+* This struct contains the handle currently associated to the slot, the pointer to the corresponding object,
+* the generation counter of the slot and the link to the next free slot.
 * INTERNAL USE ONLY (do not expose this across the API)
 *
 */
-using tFrameItem = std::tuple<  libvMI_frame_handle,    /* Handle associated with this item. Available only if in use (free item flag = LIBVMI_INVALID_HANDLE) */
-                                CvMIFrame*,             /* Pointer to the vMIFrame associated to this item */
-                                bool                    /* free item flag: true if free, false if in used */
-                             >;
+struct tFrameSlot {
+    std::atomic<libvMI_frame_handle> handle;    /* Handle associated with this slot. LIBVMI_INVALID_HANDLE if the slot is free */
+    std::atomic<CvMIFrame*>          frame;     /* Pointer to the vMIFrame associated to this slot */
+    std::atomic<int>                 gen;       /* Generation of the slot, incremented at each reuse */
+    std::atomic<int>                 next;      /* Index of the next free slot when on the free-list */
+};
+
+tFrameSlot g_vMIFramesSlots[LIBVMI_MAX_FRAME_SLOTS];    /* table of all frames processed by this library instance */
+std::atomic<int> g_vMIFramesCount(0);                   /* number of slots in use on g_vMIFramesSlots (i.e. number of frames created) */
+std::atomic<unsigned long long> g_vMIFramesFreeHead(0); /* head of the free-list: tag (high 32 bits) and slot index+1 (low 32 bits) */
+int g_vMIMaxFramesInList = MAX_FRAME_IN_LIST;           /* maximum number of frames in g_vMIFramesSlots. Can be set/get with parameter */
+
+/**
+* INTERNAL USE ONLY. Not exposed across the API.
+*
+* \brief Push a slot on the free-list. The tag avoid the ABA problem when a slot is pop/push concurrently.
+*
+* \param slot index of the slot to push
+*/
+static void _frame_slot_push_free(int slot) {
+
+    unsigned long long head = g_vMIFramesFreeHead.load(std::memory_order_relaxed);
+    unsigned long long newHead;
+    do {
+        g_vMIFramesSlots[slot].next.store((int)(head & 0xFFFFFFFF) - 1, std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | (unsigned long long)(slot + 1);
+    } while (!g_vMIFramesFreeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/**
+* INTERNAL USE ONLY. Not exposed across the API.
+*
+* \brief Pop a slot from the free-list
+*
+* \return index of the slot, LIBVMI_FRAME_NO_SLOT if the free-list is empty
+*/
+static int _frame_slot_pop_free() {
+
+    unsigned long long head = g_vMIFramesFreeHead.load(std::memory_order_acquire);
+    unsigned long long newHead;
+    int slot;
+    do {
+        slot = (int)(head & 0xFFFFFFFF) - 1;
+        if (slot == LIBVMI_FRAME_NO_SLOT)
+            return LIBVMI_FRAME_NO_SLOT;
+        int next = g_vMIFramesSlots[slot].next.load(std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | (unsigned long long)(next + 1);
+    } while (!g_vMIFramesFreeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire));
+    return slot;
+}
+
+/**
+* INTERNAL USE ONLY. Not exposed across the API.
+*
+* \brief Return the slot referenced by a handle, only if the handle is still the one associated to the slot
+*
+* \param hFrame handle to the vMIFrame
+* \return pointer to the slot, NULL if the handle is invalid or outdated
+*/
+static tFrameSlot* _frame_slot_get(const libvMI_frame_handle hFrame) {
+
+    if (hFrame < 0)
+        return NULL;
+    int slot = hFrame & LIBVMI_FRAME_SLOT_MASK;
+    if (slot >= g_vMIFramesCount.load(std::memory_order_acquire))
+        return NULL;
+    tFrameSlot* item = &g_vMIFramesSlots[slot];
+    if (item->handle.load(std::memory_order_acquire) != hFrame)
+        return NULL;
+    return item;
+}
+
+/**
+* INTERNAL USE ONLY. Not exposed across the API.
+*
+* \brief Associate a new handle to a slot, using the next generation of this slot
+*
+* \param slot index of the slot
+* \return the new handle
+*/
+static libvMI_frame_handle _frame_slot_publish(int slot) {
+
+    int gen = (g_vMIFramesSlots[slot].gen.fetch_add(1, std::memory_order_relaxed) + 1) & LIBVMI_FRAME_GEN_MASK;
+    libvMI_frame_handle hFrame = (gen << LIBVMI_FRAME_SLOT_BITS) | slot;
+    g_vMIFramesSlots[slot].handle.store(hFrame, std::memory_order_release);
+    return hFrame;
+}
+
+/**
+* INTERNAL USE ONLY. Not exposed across the API.
+*
+* \brief Dec the ref counter of the frame of a slot. When it goes down to 0, the handle of the slot is
+* invalidated and the slot is given back to the free-list.
+*
+* \param slot index of the slot
+* \return the new ref counter
+*/
+static int _frame_slot_release(int slot) {
 
-std::vector< tFrameItem > g_vMIFramesArray;             /* vector of all frames processed by this library instance */
-std::mutex g_vMIFramesMutex;                            /* mutex used for elementary operation on g_vMIFramesArray*/
-int g_vMIFramesNextHandle = 0;                          /* counter for next handle value */
-int g_vMIMaxFramesInList = MAX_FRAME_IN_LIST;           /* maximum number of frames in g_vMIFramesArray. Can be set/get with parameter */
+    tFrameSlot* item = &g_vMIFramesSlots[slot];
+    int ret = item->frame.load(std::memory_order_relaxed)->releaseRef();
+    if (ret == 0) {
+        item->handle.store(LIBVMI_INVALID_HANDLE, std::memory_order_release);
+        _frame_slot_push_free(slot);
+    }
+    return ret;
+}
 
 /**
 * \brief Search and return a handle to an available vMIFrame. A new frame is created if no available frames.
@@ -50,35 +160,33 @@ int g_vMIMaxFramesInList = MAX_FRAME_IN_LIST;           /* maximum number of fra
 */
 libvMI_frame_handle libvmi_frame_create() {
 
-    std::unique_lock<std::mutex> lock(g_vMIFramesMutex);
-
-    // First, search for a free item on g_vMIFramesArray
-    for (std::vector< tFrameItem >::iterator it = g_vMIFramesArray.begin(); it != g_vMIFramesArray.end(); ++it) {
-        if (std::get<2>(*it)) {
-            // We find a free item on the list
-            std::get<0>(*it) = g_vMIFramesNextHandle++;
-            std::get<1>(*it)->addRef();
-            std::get<2>(*it) = false;
-            LOG("re-use item with new handle [%d], frame array size=%d", std::get<0>(*it), g_vMIFramesArray.size());
-            return std::get<0>(*it);
-        }
+    // First, try to take a free slot
+    int slot = _frame_slot_pop_free();
+    if (slot != LIBVMI_FRAME_NO_SLOT) {
+        CvMIFrame* frame = g_vMIFramesSlots[slot].frame.load(std::memory_order_relaxed);
+        frame->addRef();
+        // Build the new frame in a buffer lent by an output (e.g. zero-copy shmem), if any
+        frame->recycle();
+        libvMI_frame_handle hFrame = _frame_slot_publish(slot);
+        LOG("re-use slot %d with new handle [%d], frame array size=%d", slot, hFrame, g_vMIFramesCount.load());
+        return hFrame;
     }
 
-    if (g_vMIFramesArray.size() >= g_vMIMaxFramesInList) {
-        LOG_ERROR("Error, too much frame in list. Current size is '%d'", g_vMIFramesArray.size());
-        //for (std::vector< tFrameItem >::iterator it = g_vMIFramesArray.begin(); it != g_vMIFramesArray.end(); ++it) {
-        //    LOG_INFO("Frame#%d, ref=%d", std::get<0>(*it), std::get<1>(*it)->getRef());
-        //}
-        //exit(0);
-        return LIBVMI_INVALID_HANDLE;
-    }
+    // At this point, we have no more free slot... reserve a new one, if allowed.
+    int count = g_vMIFramesCount.load(std::memory_order_relaxed);
+    do {
+        if (count >= g_vMIMaxFramesInList || count >= LIBVMI_MAX_FRAME_SLOTS) {
+            LOG_ERROR("Error, too much frame in list. Current size is '%d'", count);
+            return LIBVMI_INVALID_HANDLE;
+        }
+    } while (!g_vMIFramesCount.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+    slot = count;
 
-    // At this point, we have no more free item... create a new one.
     CvMIFrame* newFrame = new CvMIFrame();
-    auto item = std::make_tuple(g_vMIFramesNextHandle++, newFrame, false);
-    g_vMIFramesArray.push_back(item);
-    LOG_INFO("create new item with handle [%d], now frame array size =%d", std::get<0>(item), g_vMIFramesArray.size());
-    return std::get<0>(item);
+    g_vMIFramesSlots[slot].frame.store(newFrame, std::memory_order_relaxed);
+    libvMI_frame_handle hFrame = _frame_slot_publish(slot);
+    LOG_INFO("create new item with handle [%d], now frame array size =%d", hFrame, slot + 1);
+    return hFrame;
 }
 
 /**
@@ -169,28 +277,19 @@ libvMI_frame_handle libvmi_frame_create_ext(struct vMIFrameInitStruct &init) {
 */
 int libvmi_frame_release(const libvMI_frame_handle hFrame) {
 
-    std::unique_lock<std::mutex> lock(g_vMIFramesMutex);
-
-    LOG("release frame handle [%d], current array size=%d", hFrame, g_vMIFramesArray.size());
-    //LOG_COLOR(LOG_COLOR_GREEN, "release frame handle [%d], current array size=%d", hFrame, g_vMIFramesArray.size());
-    for (std::vector< tFrameItem >::iterator it = g_vMIFramesArray.begin(); it != g_vMIFramesArray.end(); ++it) {
-        if (std::get<0>(*it) == hFrame) {
-            int ret = std::get<1>(*it)->releaseRef();
-            if (ret < 0) {
-                // TODO, manage this properly
-                LOG_ERROR("Error, refcount=%d for frame [%d]. This not be happen.", hFrame);
-            }
-            if (ret == 0) {
-                std::get<2>(*it) = true;
-                std::get<0>(*it) = LIBVMI_INVALID_HANDLE;   // Optional, just for clarity...
-            }
-            LOG("refcounter for frame handle [%d] is %d", hFrame, ret);
-            //LOG_COLOR(LOG_COLOR_GREEN, "refcounter for frame handle [%d] is %d", hFrame, ret);
-            return ret;
-        }
+    LOG("release frame handle [%d], current array size=%d", hFrame, g_vMIFramesCount.load());
+    tFrameSlot* item = _frame_slot_get(hFrame);
+    if (item == NULL) {
+        // Not found
+        return -1;
     }
-    // Not found
-    return -1;
+    int ret = _frame_slot_release(hFrame & LIBVMI_FRAME_SLOT_MASK);
+    if (ret < 0) {
+        // TODO, manage this properly
+        LOG_ERROR("Error, refcount=%d for frame [%d]. This not be happen.", ret, hFrame);
+    }
+    LOG("refcounter for frame handle [%d] is %d", hFrame, ret);
+    return ret;
 }
 
 /**
@@ -201,38 +300,41 @@ int libvmi_frame_release(const libvMI_frame_handle hFrame) {
 */
 int libvmi_frame_addref(const libvMI_frame_handle hFrame) {
 
-    std::unique_lock<std::mutex> lock(g_vMIFramesMutex);
-
-    for (std::vector< tFrameItem >::iterator it = g_vMIFramesArray.begin(); it != g_vMIFramesArray.end(); ++it) {
-        if (std::get<0>(*it) == hFrame) {
-            int ret = std::get<1>(*it)->addRef();
-            LOG("refcounter for frame handle [%d] is %d", hFrame, ret);
-            //LOG_COLOR(LOG_COLOR_GREEN, "refcounter for frame handle [%d] is %d", hFrame, ret);
-            return ret;
-        }
+    tFrameSlot* item = _frame_slot_get(hFrame);
+    if (item == NULL) {
+        // Not found
+        return -1;
     }
-    // Not found
-    return -1;
+    CvMIFrame* frame = item->frame.load(std::memory_order_relaxed);
+    int ret = frame->tryAddRef();
+    if (ret == 0) {
+        // Released concurrently
+        return -1;
+    }
+    if (item->handle.load(std::memory_order_acquire) != hFrame) {
+        // The slot has been released then reused with a new handle meanwhile: undo. The new
+        // owner may have released it meanwhile, then the slot is freed here.
+        _frame_slot_release(hFrame & LIBVMI_FRAME_SLOT_MASK);
+        return -1;
+    }
+    LOG("refcounter for frame handle [%d] is %d", hFrame, ret);
+    return ret;
 }
 
 /**
 * Not exposed from the API.
 *
-* \brief Search and return the pointer to the vMIFrame object identified by its handle
+* \brief Return the pointer to the vMIFrame object identified by its handle
 *
 * \param hFrame handle to the vMIFrame
 * \return the pointer, NULL if not found
 */
 CvMIFrame* libvMI_frame_get(const libvMI_frame_handle hFrame) {
 
-    std::unique_lock<std::mutex> lock(g_vMIFramesMutex);
-
-    for (std::vector< tFrameItem >::iterator it = g_vMIFramesArray.begin(); it != g_vMIFramesArray.end(); ++it) {
-        if (std::get<0>(*it) == hFrame)
-            return std::get<1>(*it);
-    }
-    // not found
-    return NULL;    
+    tFrameSlot* item = _frame_slot_get(hFrame);
+    if (item == NULL)
+        return NULL;
+    return item->frame.load(std::memory_order_relaxed);
 }
 
 /**
@@ -252,7 +354,8 @@ int libvMI_frame_getsize(const libvMI_frame_handle hFrame) {
 }
 
 /**
-* \brief Return the pointer to the buffer that contain media content associated to the vMIFrame identified by its handle
+* \brief Return the pointer to the buffer that contain media content associated to the vMIFrame identified by its handle.
+* The content can be written: a buffer shared with other processes is copied first.
 *
 * \param hFrame handle to the vMIFrame
 * \return pointer to the media buffer, NULL if not found
@@ -261,7 +364,24 @@ char* libvMI_get_frame_buffer(const libvMI_frame_handle hFrame) {
 
     CvMIFrame* frame = libvMI_frame_get(hFrame);
     if (frame != NULL) {
-        return (char*)frame->getMediaBuffer();
+        return (char*)frame->getWritableMediaBuffer();
+    }
+    // Error, the frame can't be found
+    return NULL;
+}
+
+/**
+* \brief Return the pointer to the media content of the vMIFrame identified by its handle, without copy. It must
+* not be written.
+*
+* \param hFrame handle to the vMIFrame
+* \return pointer to the media buffer, NULL if not found
+*/
+const char* libvMI_get_frame_buffer_readonly(const libvMI_frame_handle hFrame) {
+
+    CvMIFrame* frame = libvMI_frame_get(hFrame);
+    if (frame != NULL) {
+        return (const char*)frame->getMediaBuffer();
     }
     // Error, the frame can't be found
     return NULL;
@@ -313,7 +433,7 @@ void libvMI_get_parameter(VMIPARAMETER param, void* value) {
         case MAX_FRAMES_IN_LIST:
             *static_cast<int*>(value) = g_vMIMaxFramesInList; break;
         case CUR_FRAMES_IN_LIST:
-            *static_cast<int*>(value) = (int)g_vMIFramesArray.size(); break;
+            *static_cast<int*>(value) = g_vMIFramesCount.load(); break;
         default:
             break;
         }
@@ -335,7 +455,7 @@ void libvMI_set_parameter(VMIPARAMETER param, void* value) {
     try {
         switch (param) {
         case MAX_FRAMES_IN_LIST:
-            g_vMIMaxFramesInList = *static_cast<int*>(value); break;
+            g_vMIMaxFramesInList = MIN(*static_cast<int*>(value), LIBVMI_MAX_FRAME_SLOTS); break;
         default:
             break;
         }
@@ -723,9 +843,9 @@ int libvMI_send(const libvMI_module_handle hModule, const libvMI_pin_handle hOut
 
     // send the frame. Note that frame content are not immediately sent: the vMI frame is enqeue on the output, and
     // output->send(hFrame) return immediately. The frame reference counter will be increased from 1. It will be
-    // decreased only when the frame will be effectively sent
+    // decreased only when the frame will be effectively sent. If the output queue is full, the frame is dropped
     if (libvMI_frame_get(hFrame) != NULL)
-        currentOutput->send(hFrame);
+        return currentOutput->send(hFrame);
     else
         return -1;
 
@@ -24,6 +24,7 @@
                  int libvmi_frame_addref(const libvMI_frame_handle hFrame);
                  int libvMI_frame_getsize(const libvMI_frame_handle hFrame);
                char* libvMI_get_frame_buffer(const libvMI_frame_handle frame);
+         const char* libvMI_get_frame_buffer_readonly(const libvMI_frame_handle frame);
                 void libvMI_get_frame_headers(const libvMI_frame_handle frame, MediaHeader header, int* value);
                 void libvMI_set_frame_headers(const libvMI_frame_handle frame, MediaHeader header, int* value);
                 void libvMI_get_parameter(VMIPARAMETER param, void* value);
@@ -81,6 +82,7 @@ enum OUTPUTPARAMETER {
     SYNC_ENABLED,    
     SYNC_TIMESTAMP,    
     SYNC_CLOCK,
+    QUEUE_SIZE,     /*!< max number of frames waiting to be sent, taken at the next start. When full, libvMI_send() fails */
 };
 
 /**
@@ -109,6 +111,8 @@ enum MediaHeader {
     MEDIA_IN_TIMESTAMP  = 16, /*!< media timestamp */
     MEDIA_OUT_TIMESTAMP = 17, /*!< media timestamp */
     VIDEO_SMPTEFRMCODE  = 18, /*!< media format video only: SAMPLE parameter from the source stream */
+    MEDIA_FIRST_PACKET_TIMESTAMP = 19, /*!< receive time of the first packet of the frame, in ns (kernel or NIC time), 0 if unknown */
+    MEDIA_LAST_PACKET_TIMESTAMP  = 20, /*!< receive time of the last packet of the frame, in ns (kernel or NIC time), 0 if unknown */
 };
 
 /**
@@ -136,6 +140,7 @@ enum SAMPLINGFMT {
     YCbCr_4_2_2 = 6,        /*!< 422 pixel format */
     YCbCr_4_2_0 = 7,        /*!< 420 pixel format */
     YCbCr_4_1_1 = 8,        /*!< 411 pixel format */
+    QOI = 9,                /*!< QOI compressed RGB or RGBA image (see qoi.h), MEDIA_PAYLOAD_SIZE is the size of the image */
 };
 
 /**
@@ -292,11 +297,24 @@ VMILIBRARY_API int libvMI_frame_getsize(const libvMI_frame_handle hFrame);
 *
 * Corresponding frame size is provided from libvMI_frame_getsize()
 *
+* The content can be modified. A frame received in place from a shared memory read by other modules too is
+* first copied in a buffer of its own: use libvMI_get_frame_buffer_readonly() to only read it.
+*
 * \param libvMI_frame_handle hFrame handle of the frame
 * \return A pointer to the frame's data. NULL if not found.
 */
 VMILIBRARY_API char*  libvMI_get_frame_buffer(const libvMI_frame_handle frame);
 
+/**
+* \brief Query the pointer to the media content of a specific vMI frame, to read it only.
+*
+* No copy: the content may be shared with other modules and must not be modified.
+*
+* \param libvMI_frame_handle hFrame handle of the frame
+* \return A pointer to the frame's data. NULL if not found.
+*/
+VMILIBRARY_API const char*  libvMI_get_frame_buffer_readonly(const libvMI_frame_handle frame);
+
 /**
 * \brief Gets header values of a vMI frame
 * value format from MediaHeader:
@@ -319,6 +337,8 @@ VMILIBRARY_API char*  libvMI_get_frame_buffer(const libvMI_frame_handle frame);
 * MEDIA_IN_TIMESTAMP   unsigned long long
 * MEDIA_OUT_TIMESTAMP  unsigned long long
 * VIDEO_SMPTEFRMCODE   int
+* MEDIA_FIRST_PACKET_TIMESTAMP unsigned long long  // receive time of the first packet of the frame, in ns
+* MEDIA_LAST_PACKET_TIMESTAMP  unsigned long long  // receive time of the last packet of the frame, in ns
 *
 * \param libvMI_frame_handle hFrame handle of the frame
 * \param header kind of header to get value. Must be one of MediaHeader enum value
@@ -348,6 +368,8 @@ VMILIBRARY_API void libvMI_get_frame_headers(const libvMI_frame_handle frame, Me
 * MEDIA_IN_TIMESTAMP   unsigned long long
 * MEDIA_OUT_TIMESTAMP  unsigned long long
 * VIDEO_SMPTEFRMCODE   int
+* MEDIA_FIRST_PACKET_TIMESTAMP unsigned long long  // receive time of the first packet of the frame, in ns
+* MEDIA_LAST_PACKET_TIMESTAMP  unsigned long long  // receive time of the last packet of the frame, in ns
 *
 * Note that setting some headers content as VIDEO_DEPTH, MEDIA_PAYLOAD_SIZE, VIDEO_WIDTH and VIDEO_HEIGHT effectively change
 * the size of the media buffer.
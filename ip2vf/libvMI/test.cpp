@@ -4,11 +4,28 @@
 
 #include "log.h"
 #include "libvMI.h"
+#include "rtpframe.h"
+#include "tools.h"
+#include "simd.h"
+#include "workerpool.h"
+#include "tcp_basic.h"
+#include "pins/st2022/smpteframe.h"
+#include "pins/st2022/smptecrc.h"
+#include "yuv.h"
+#include "qoi.h"
+#include "libvMI_int.h"
+#include "pins/pins.h"
 
 #include <signal.h>
+#include <time.h>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <malloc.h>
+#include <cmath>
 
 libvMI_module_handle g_vMIModule = LIBVMI_INVALID_HANDLE;
 std::condition_variable  g_var;
@@ -34,7 +51,7 @@ void signal_handler(int signum) {
 * @param int param (some values returned by libip2vf, not used for now)
 * @return
 */
-void libvMI_callback(const void* user_data, CmdType cmd, int param, libvMI_input_handle in)
+void libvMI_callback(const void* user_data, CmdType cmd, int param, libvMI_pin_handle in, libvMI_frame_handle hFrame)
 {
     LOG("libvMI_callback(): receive %d msg", cmd);
     switch(cmd) {
@@ -45,7 +62,8 @@ void libvMI_callback(const void* user_data, CmdType cmd, int param, libvMI_input
         LOG_INFO("libvMI_callback(): receive CMD_START msg");
         break;
     case CMD_TICK:
-        libvMI_send(g_vMIModule);
+        libvMI_send(g_vMIModule, libvMI_get_output_handle(g_vMIModule, 0), hFrame);
+        libvmi_frame_release(hFrame);
         break;
     case CMD_STOP:
         LOG_INFO("libvMI_callback(): receive CMD_STOP msg");
@@ -63,10 +81,1028 @@ void libvMI_callback(const void* user_data, CmdType cmd, int param, libvMI_input
     }
 }
 
+/**********************************************************************************************
+*
+* Checks and benchmarks of the media code
+*
+* "test check [name]" compares the optimized code with its reference, "test bench [name]" measures
+* it. Without argument, the program runs the module test above.
+*
+***********************************************************************************************/
+
+typedef bool (*CheckFunction)();
+typedef void (*BenchFunction)();
+
+struct tTest {
+    const char*     name;
+    CheckFunction   check;
+    BenchFunction   bench;
+};
+
+static long long getTimeInNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long long getThreadCpuTimeInNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void fillRandom(unsigned char* buffer, int size, unsigned int seed) {
+    for (int i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = (unsigned char)(seed >> 16);
+    }
+}
+
+/*
+* HBRMP headers parsed in place over the packet: the RTP and HBRMP fields read back from packets
+* written by CRTPFrame and CHBRMPFrame, and the payload pointing into the packet
+*/
+#define TEST_HBRMP_PACKET_SIZE  (RTP_HEADERS_LENGTH + HBRMP_HEADERS_LENGTH + 1376)
+
+static void writeHBRMPPacket(unsigned char* packet, int seq, int frcount, unsigned int timestamp) {
+    CRTPFrame rtp;
+    rtp.setBuffer(packet, TEST_HBRMP_PACKET_SIZE);
+    rtp._ssrc = 0;
+    rtp.writeHeader(seq, 0, 98);
+    CHBRMPFrame hbrmp;
+    hbrmp.setBuffer(packet + RTP_HEADERS_LENGTH, TEST_HBRMP_PACKET_SIZE - RTP_HEADERS_LENGTH);
+    hbrmp._ext = 0;
+    hbrmp._f = 1;
+    hbrmp._vsid = 0;
+    hbrmp._r = REFT_NOT_LOCKED;
+    hbrmp._s = 0;
+    hbrmp._fec = 0;
+    hbrmp._cf = CF_148_5_PER_1_001_MHZ;
+    hbrmp._map = 0;
+    hbrmp._frm = 0x20;
+    hbrmp._frate = 0x1A;
+    hbrmp._sample = 0x01;
+    hbrmp.writeHeader(frcount, timestamp);
+}
+
+static bool checkHBRMPHeaders() {
+    std::vector<unsigned char> packet(TEST_HBRMP_PACKET_SIZE);
+    for (int i = 0; i < 1000; i++) {
+        int seq = (i * 7919) & 0xFFFF;
+        writeHBRMPPacket(packet.data(), seq, i, 0x12345678 + i);
+        CRTPFrame rtp(packet.data(), (int)packet.size());
+        CHBRMPFrame hbrmp;
+        rtp.getHBRMPFrame(hbrmp);
+        if (rtp._seq != seq || hbrmp.getFrameCounter() != i % 256 || hbrmp.getTimestamp() != 0x12345678u + i
+            || hbrmp.getVideoSourceFrmFormat() != 0x20 || hbrmp.getVideoSourceRateFormat() != 0x1A
+            || hbrmp.getVideoSourceSampleFormat() != 0x01 || hbrmp.getClockFrequency() != CF_148_5_PER_1_001_MHZ
+            || hbrmp.getPayload() != packet.data() + RTP_HEADERS_LENGTH + HBRMP_HEADERS_LENGTH
+            || hbrmp.getPayloadLen() != TEST_HBRMP_PACKET_SIZE - RTP_HEADERS_LENGTH - HBRMP_HEADERS_LENGTH) {
+            printf("packet %d: seq=%d frcount=%d timestamp=0x%x payload len=%d\n", i, rtp._seq, hbrmp.getFrameCounter(),
+                hbrmp.getTimestamp(), hbrmp.getPayloadLen());
+            return false;
+        }
+    }
+    return true;
+}
+
+static void benchHBRMPHeaders() {
+    const int nbPackets = 4096;
+    const int nbLoops = 1000;
+    std::vector<unsigned char> packets(nbPackets * TEST_HBRMP_PACKET_SIZE);
+    for (int i = 0; i < nbPackets; i++)
+        writeHBRMPPacket(packets.data() + i * TEST_HBRMP_PACKET_SIZE, i, i, i);
+    long long sum = 0;
+    long long start = getTimeInNs();
+    for (int loop = 0; loop < nbLoops; loop++) {
+        for (int i = 0; i < nbPackets; i++) {
+            CRTPFrame rtp(packets.data() + i * TEST_HBRMP_PACKET_SIZE, TEST_HBRMP_PACKET_SIZE);
+            CHBRMPFrame hbrmp;
+            rtp.getHBRMPFrame(hbrmp);
+            sum += rtp._seq + hbrmp.getPayloadLen();
+        }
+    }
+    long long duration = getTimeInNs() - start;
+    printf("RTP+HBRMP headers: %.1f Mpkt/s (%lld)\n", (double)nbPackets * nbLoops * 1000.0 / duration, sum);
+}
+
+/*
+* 8/10 bits conversions: every SIMD level against the scalar code, out of place and in place, for all
+* the sizes up to 700 bytes, with nothing written after the output
+*/
+static const char* g_simdLevelNames[] = { "scalar", "SSSE3", "AVX2", "AVX-512" };
+
+static int getCpuSimdLevel() {
+    simd::setMaxLevel(SIMD_LEVEL_AVX512);
+    return simd::getLevel();
+}
+
+static bool check10to8bits() {
+    int maxLevel = getCpuSimdLevel();
+    const int maxSize = 700;
+    std::vector<unsigned char> in(maxSize), ref(maxSize + 64), out(maxSize + 64);
+    fillRandom(in.data(), maxSize, 9);
+    bool ok = true;
+    for (int size = 0; size <= maxSize && ok; size++) {
+        simd::setMaxLevel(SIMD_LEVEL_NONE);
+        std::fill(ref.begin(), ref.end(), 0xA5);
+        tools::convert10bitsto8bits(in.data(), size, ref.data());
+        for (int level = SIMD_LEVEL_NONE + 1; level <= maxLevel && ok; level++) {
+            simd::setMaxLevel(level);
+            // Out of place, then in place
+            std::fill(out.begin(), out.end(), 0xA5);
+            tools::convert10bitsto8bits(in.data(), size, out.data());
+            if (out != ref) {
+                printf("10->8 bits, %s, %d bytes: differs from the scalar code\n", g_simdLevelNames[level], size);
+                ok = false;
+            }
+            std::fill(out.begin(), out.end(), 0xA5);
+            std::copy(in.begin(), in.begin() + size, out.begin());
+            tools::convert10bitsto8bits(out.data(), size, out.data());
+            if (!std::equal(ref.begin(), ref.begin() + size / 5 * 4, out.begin())) {
+                printf("10->8 bits in place, %s, %d bytes: differs from the scalar code\n", g_simdLevelNames[level], size);
+                ok = false;
+            }
+        }
+    }
+    simd::setMaxLevel(maxLevel);
+    return ok;
+}
+
+static bool check8to10bits() {
+    int maxLevel = getCpuSimdLevel();
+    const int maxSize = 700;
+    std::vector<unsigned char> in(maxSize), ref(maxSize * 5 / 4 + 64), out(maxSize * 5 / 4 + 64);
+    fillRandom(in.data(), maxSize, 10);
+    bool ok = true;
+    for (int size = 0; size <= maxSize && ok; size++) {
+        simd::setMaxLevel(SIMD_LEVEL_NONE);
+        std::fill(ref.begin(), ref.end(), 0);
+        tools::convert8bitsto10bits(in.data(), size, ref.data());
+        for (int level = SIMD_LEVEL_NONE + 1; level <= maxLevel && ok; level++) {
+            simd::setMaxLevel(level);
+            std::fill(out.begin(), out.end(), 0);
+            tools::convert8bitsto10bits(in.data(), size, out.data());
+            if (out != ref) {
+                printf("8->10 bits, %s, %d samples: differs from the scalar code\n", g_simdLevelNames[level], size);
+                ok = false;
+            }
+        }
+    }
+    simd::setMaxLevel(maxLevel);
+    return ok;
+}
+
+static bool check8and10bits() {
+    return check10to8bits() && check8to10bits();
+}
+
+static void bench8and10bits() {
+    // One 1080p 4:2:2 frame
+    const int nbSamples = 1920 * 1080 * 2;
+    const int nbLoops = 20;
+    int maxLevel = getCpuSimdLevel();
+    std::vector<unsigned char> in10(nbSamples * 5 / 4), in8(nbSamples), out(nbSamples * 5 / 4);
+    fillRandom(in10.data(), (int)in10.size(), 11);
+    fillRandom(in8.data(), (int)in8.size(), 12);
+    for (int level = SIMD_LEVEL_NONE; level <= maxLevel; level++) {
+        simd::setMaxLevel(level);
+        long long start = getTimeInNs();
+        for (int loop = 0; loop < nbLoops; loop++)
+            tools::convert10bitsto8bits(in10.data(), (int)in10.size(), out.data());
+        long long t10to8 = getTimeInNs() - start;
+        start = getTimeInNs();
+        for (int loop = 0; loop < nbLoops; loop++)
+            tools::convert8bitsto10bits(in8.data(), (int)in8.size(), out.data());
+        long long t8to10 = getTimeInNs() - start;
+        printf("%-8s 10->8 bits %5.1f GB/s, 8->10 bits %5.1f GB/s\n", g_simdLevelNames[level],
+            (double)in10.size() * nbLoops / t10to8, (double)in8.size() * nbLoops / t8to10);
+    }
+    simd::setMaxLevel(maxLevel);
+}
+
+/*
+* SMPTE 425M level B dual link demux: the two links and the active video against a word by word
+* reference, on the calling thread and on a worker pool whose threads
+* don't get the same number of lines
+*/
+#define TEST_DL_PROFILE     "1080p60 LvlB DL"
+
+// Words w0 w1 w2 w3 of each group of 4 go to the link A (w0 w1) and B (w2 w3)
+static void demux425MBDLReference(unsigned char* frame, int halfFrameSize, unsigned char* half1, unsigned char* half2) {
+    int nbWords = 2 * halfFrameSize * 8 / 10;
+    for (int j = 0; j < nbWords; j++) {
+        int word = tools::get10bitsWord(frame, j);
+        int pos = (j / 4) * 2 + (j % 2);
+        tools::set10bitsWord((j % 4) < 2 ? half1 : half2, pos, word);
+    }
+}
+
+// Active video of a half frame, packed 10 bits
+static void extractActiveReference(CSMPTPProfile* profile, unsigned char* half, unsigned char* out) {
+    int lineSize = profile->getActiveWidth() * profile->getComponentsNb() * profile->getComponentsDepth() / 8;
+    for (int i = 0; i < profile->getActiveHeight(); i++) {
+        unsigned char* in = half + (i + profile->getYOffsetF1()) * profile->getScanlineSize() + profile->getXOffset();
+        memcpy(out + i * lineSize, in, lineSize);
+    }
+}
+
+static bool checkDemux425MBDL() {
+    CSMPTPProfile profile;
+    profile.setProfile(TEST_DL_PROFILE);
+    int halfFrameSize = profile.getFrameSize();
+    int activeSize = profile.getActiveWidth() * profile.getActiveHeight() * profile.getComponentsNb() * profile.getComponentsDepth() / 8;
+    std::vector<unsigned char> frame(2 * halfFrameSize), half1(halfFrameSize), half2(halfFrameSize);
+    std::vector<unsigned char> ref1(activeSize), ref2(activeSize), out(activeSize);
+    fillRandom(frame.data(), (int)frame.size(), 13);
+    demux425MBDLReference(frame.data(), halfFrameSize, half1.data(), half2.data());
+    extractActiveReference(&profile, half1.data(), ref1.data());
+    extractActiveReference(&profile, half2.data(), ref2.data());
+
+    // Without pool, then with a pool whose threads don't get the same number of lines
+    CWorkerPool pool;
+    pool.init(3);
+    bool ok = true;
+    for (int withPool = 0; withPool < 2; withPool++) {
+        CSMPTPFrame smpte;
+        smpte.setProfile(TEST_DL_PROFILE);
+        if (withPool)
+            smpte.setDemuxPool(&pool);
+        smpte.injectFrameData(frame.data(), (int)frame.size());
+        smpte.extractMediaContent(VIDEO_BUFFER_1, (char*)out.data(), activeSize, 10);
+        if (out != ref1) {
+            printf("%s: first half frame differs from the reference\n", withPool ? "pool" : "no pool");
+            ok = false;
+        }
+        smpte.extractMediaContent(VIDEO_BUFFER_2, (char*)out.data(), activeSize, 10);
+        if (out != ref2) {
+            printf("%s: second half frame differs from the reference\n", withPool ? "pool" : "no pool");
+            ok = false;
+        }
+    }
+    pool.stop();
+    return ok;
+}
+
+static void benchDemux425MBDL() {
+    const int nbLoops = 20;
+    CSMPTPProfile profile;
+    profile.setProfile(TEST_DL_PROFILE);
+    int halfFrameSize = profile.getFrameSize();
+    int activeSize = profile.getActiveWidth() * profile.getActiveHeight() * profile.getComponentsNb() * profile.getComponentsDepth() / 8;
+    std::vector<unsigned char> frame(2 * halfFrameSize), out(activeSize);
+    fillRandom(frame.data(), (int)frame.size(), 14);
+
+    // A frame is demultiplexed once: use a new one for each loop, without page faults on its buffers
+    mallopt(M_MMAP_THRESHOLD, 64 * 1024 * 1024);
+    mallopt(M_TRIM_THRESHOLD, 256 * 1024 * 1024);
+    int nbThreads[] = { 0, 1, 2, 4 };
+    for (unsigned int n = 0; n < sizeof(nbThreads) / sizeof(nbThreads[0]); n++) {
+        CWorkerPool pool;
+        if (nbThreads[n] > 0)
+            pool.init(nbThreads[n]);
+        long long demux = 0;
+        for (int loop = 0; loop <= nbLoops; loop++) {
+            CSMPTPFrame smpte;
+            smpte.setProfile(TEST_DL_PROFILE);
+            if (nbThreads[n] > 0)
+                smpte.setDemuxPool(&pool);
+            smpte.injectFrameData(frame.data(), (int)frame.size());
+            // Demux + extraction, minus the extraction alone
+            long long start = getTimeInNs();
+            smpte.extractMediaContent(VIDEO_BUFFER_1, (char*)out.data(), activeSize, 10);
+            long long middle = getTimeInNs();
+            smpte.extractMediaContent(VIDEO_BUFFER_2, (char*)out.data(), activeSize, 10);
+            long long end = getTimeInNs();
+            if (loop > 0)
+                demux += (middle - start) - (end - middle);
+        }
+        pool.stop();
+        if (nbThreads[n] > 0)
+            printf("%s demux, pool of %d threads: %.2f ms per frame\n", TEST_DL_PROFILE, nbThreads[n], demux / 1000000.0 / nbLoops);
+        else
+            printf("%s demux, calling thread: %.2f ms per frame\n", TEST_DL_PROFILE, demux / 1000000.0 / nbLoops);
+    }
+}
+
+/*
+* TPACKET_V3 packet ring: RTP packets sent on the loopback must be received complete and in order across
+* the sequence number wrap, read in place or copied. Skipped when the ring can't be opened (no CAP_NET_RAW)
+*/
+#define TEST_RING_PORT          5200
+#define TEST_RING_PACKET_SIZE   (RTP_HEADERS_LENGTH + 1376)
+
+// Close the socket if the reader is still blocked after the timeout
+class CReadWatchdog
+{
+    std::mutex              _mtx;
+    std::condition_variable _cv;
+    bool                    _done;
+    std::thread             _th;
+
+public:
+    CReadWatchdog(UDP* sock, int timeoutMs) : _done(false) {
+        _th = std::thread([this, sock, timeoutMs] {
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (!_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return _done; }))
+                sock->closeSocket();
+        });
+    };
+    ~CReadWatchdog() {
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _done = true;
+        }
+        _cv.notify_all();
+        _th.join();
+    };
+};
+
+static void sendRTPPackets(UDP* sock, int firstSeq, int nbPackets) {
+    std::vector<unsigned char> packet(TEST_RING_PACKET_SIZE);
+    for (int i = 0; i < nbPackets; i++) {
+        CRTPFrame rtp;
+        rtp.setBuffer(packet.data(), (int)packet.size());
+        rtp._ssrc = 0;
+        rtp.writeHeader((firstSeq + i) & 0xFFFF, 0, 98);
+        int len = (int)packet.size();
+        sock->writeSocket((char*)packet.data(), &len);
+        // Don't overflow the socket buffers of the loopback
+        if (i % 64 == 63)
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+}
+
+// Receive nbPackets in place (readPacket) or copied (readSocket), check their seq and size
+static bool receiveRTPPackets(UDP* sock, bool inPlace, int firstSeq, int nbPackets) {
+    std::vector<char> buffer(TEST_RING_PACKET_SIZE);
+    CReadWatchdog watchdog(sock, 2000);
+    for (int i = 0; i < nbPackets; i++) {
+        char* packet = buffer.data();
+        int len = (int)buffer.size();
+        int result = (inPlace ? sock->readPacket(&packet, &len) : sock->readSocket(packet, &len));
+        if (result <= 0) {
+            printf("%s: %d packets received of %d\n", inPlace ? "readPacket" : "readSocket", i, nbPackets);
+            return false;
+        }
+        CRTPFrame rtp((unsigned char*)packet, result);
+        if (result != TEST_RING_PACKET_SIZE || rtp._seq != ((firstSeq + i) & 0xFFFF)) {
+            printf("%s: packet %d: seq=%d, size=%d\n", inPlace ? "readPacket" : "readSocket", i, rtp._seq, result);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkPacketRing() {
+    UDP* ring = UDP::createReceiver("tpacket-lo");
+    if (ring->openSocket("", "127.0.0.1", TEST_RING_PORT, true) != E_OK) {
+        // Needs CAP_NET_RAW
+        printf("can't open a packet ring on the loopback, skipped\n");
+        delete ring;
+        return true;
+    }
+    UDP sender;
+    sender.openSocket("127.0.0.1", NULL, TEST_RING_PORT, false);
+    bool ok = true;
+    for (int inPlace = 0; inPlace < 2 && ok; inPlace++) {
+        int firstSeq = 65000 + inPlace * 2000;
+        std::thread th([&sender, firstSeq] { sendRTPPackets(&sender, firstSeq, 1000); });
+        ok = receiveRTPPackets(ring, inPlace != 0, firstSeq, 1000);
+        th.join();
+    }
+    sender.closeSocket();
+    if (ring->isValid())
+        ring->closeSocket();
+    delete ring;
+    return ok;
+}
+
+static void benchPacketRing() {
+    const int nbPackets = 200000;
+    const char* interfaces[] = { NULL, "tpacket-lo" };
+    for (int n = 0; n < 2; n++) {
+        UDP* sock = UDP::createReceiver(interfaces[n]);
+        if (sock->openSocket("", "127.0.0.1", TEST_RING_PORT, true) != E_OK) {
+            printf("%s: can't open the socket, skipped\n", interfaces[n] != NULL ? interfaces[n] : "UDP");
+            delete sock;
+            continue;
+        }
+        UDP sender;
+        sender.openSocket("127.0.0.1", NULL, TEST_RING_PORT, false);
+        std::thread th([&sender, nbPackets] { sendRTPPackets(&sender, 0, nbPackets); });
+        // The sender is paced: measure the CPU time of the receiver
+        int received = 0;
+        long long start = getThreadCpuTimeInNs();
+        {
+            CReadWatchdog watchdog(sock, 1000 + nbPackets / 50);
+            std::vector<char> buffer(TEST_RING_PACKET_SIZE);
+            for (; received < nbPackets; received++) {
+                char* packet = buffer.data();
+                int len = (int)buffer.size();
+                if (sock->readPacket(&packet, &len) <= 0)
+                    break;
+            }
+        }
+        long long duration = getThreadCpuTimeInNs() - start;
+        th.join();
+        sender.closeSocket();
+        if (sock->isValid())
+            sock->closeSocket();
+        delete sock;
+        printf("%-10s %d packets of %d received, %.0f kpkt/s per core\n", interfaces[n] != NULL ? interfaces[n] : "UDP",
+            received, nbPackets, received * 1000000.0 / duration);
+    }
+}
+
+/*
+* SMPTE line CRCs: slice-by-4 and word table against the bit by bit CRC, for the luma and chroma
+* words of lines of 0 to 64 words, 1132 and 2200 words
+*/
+
+// CRC(X) = X^18 + X^5 + X^4 + 1, LSB first, of the words start, start+step, ...
+static unsigned int crc18Reference(unsigned char* buffer, int nbWords, int start, int step) {
+    unsigned int crc = 0;
+    for (int i = 0; i < nbWords; i++) {
+        int word = tools::get10bitsWord(buffer, start + i * step);
+        for (int b = 0; b < 10; b++) {
+            unsigned int feedback = (crc ^ (word >> b)) & 1;
+            crc = (crc >> 1) ^ (feedback ? 0x23000 : 0);
+        }
+    }
+    return crc;
+}
+
+static bool checkCRC18() {
+    const int maxWords = 2 * 2200;
+    std::vector<unsigned char> line(maxWords * 10 / 8 + 16);
+    fillRandom(line.data(), (int)line.size(), 15);
+    // Short lines for the tails of the slices, then a 1080 line
+    for (int n = 0; n <= 2200; n = (n < 64 ? n + 1 : n + 1068)) {
+        unsigned int refC = crc18Reference(line.data(), n, 0, 2);
+        unsigned int refY = crc18Reference(line.data(), n, 1, 2);
+        CSMPTPCrc wordC, wordY, sliceC, sliceY;
+        unsigned int c = wordC.compute_crc18_scanline(line.data(), n, 0, 2);
+        unsigned int y = wordY.compute_crc18_scanline(line.data(), n, 1, 2);
+        CSMPTPCrc::compute_crc18_scanline_cy(line.data(), n, &sliceC, &sliceY);
+        if (c != refC || y != refY) {
+            printf("%d words: word table CRC C=0x%05x Y=0x%05x, reference C=0x%05x Y=0x%05x\n", n, c, y, refC, refY);
+            return false;
+        }
+        if (sliceC.getCRC0() != wordC.getCRC0() || sliceC.getCRC1() != wordC.getCRC1()
+            || sliceY.getCRC0() != wordY.getCRC0() || sliceY.getCRC1() != wordY.getCRC1()) {
+            printf("%d words: slice-by-4 CRC differs from the word table CRC\n", n);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void benchCRC18() {
+    // C and Y CRCs of the 1125 lines of a 1080 frame
+    const int nbLines = 1125;
+    const int nbWords = 2200;
+    const int lineSize = 2 * nbWords * 10 / 8;
+    const int nbLoops = 5;
+    std::vector<unsigned char> frame(nbLines * lineSize);
+    fillRandom(frame.data(), (int)frame.size(), 16);
+    unsigned int sum = 0;
+    long long start = getTimeInNs();
+    for (int loop = 0; loop < nbLoops; loop++) {
+        for (int i = 0; i < nbLines; i++) {
+            CSMPTPCrc crcC, crcY;
+            sum += crcC.compute_crc18_scanline(frame.data() + i * lineSize, nbWords, 0, 2);
+            sum += crcY.compute_crc18_scanline(frame.data() + i * lineSize, nbWords, 1, 2);
+        }
+    }
+    long long tWord = getTimeInNs() - start;
+    start = getTimeInNs();
+    for (int loop = 0; loop < nbLoops; loop++) {
+        for (int i = 0; i < nbLines; i++) {
+            CSMPTPCrc crcC, crcY;
+            CSMPTPCrc::compute_crc18_scanline_cy(frame.data() + i * lineSize, nbWords, &crcC, &crcY);
+            sum += crcC.getCRC0() + crcY.getCRC0();
+        }
+    }
+    long long tSlice = getTimeInNs() - start;
+    printf("1080 frame CRCs: word table %.2f ms, slice-by-4 %.2f ms (%u)\n", tWord / 1000000.0 / nbLoops,
+        tSlice / 1000000.0 / nbLoops, sum);
+}
+
+/*
+* 4:2:2 to RGB: every SIMD level against the scalar code, and the scalar code against a floating
+* point conversion, for every output format, matrix and range
+*/
+static const char* g_rgbFormatNames[] = { "RGB24", "RGBA", "BGRA" };
+
+static void convertUYVYToRGB(bool packed10, unsigned char* out, const unsigned char* in, int npixels, int outFormat, int matrix, int range) {
+    if (packed10)
+        UYVY10ToRGB((char*)out, (const char*)in, npixels, outFormat, matrix, range);
+    else
+        UYVY8ToRGB((char*)out, (const char*)in, npixels, outFormat, matrix, range);
+}
+
+// Difference between a RGB pixel and the floating point conversion of Y, Cb, Cr (8 bits scale)
+static double getPixelError(const unsigned char* pixel, double y, double cb, double cr, int outFormat, int matrix, int range) {
+    double kr = (matrix == YUV_MATRIX_BT709 ? 0.2126 : 0.299);
+    double kb = (matrix == YUV_MATRIX_BT709 ? 0.0722 : 0.114);
+    double kg = 1.0 - kr - kb;
+    double ys = (range == YUV_RANGE_FULL ? 1.0 : 255.0 / 219.0);
+    double cs = (range == YUV_RANGE_FULL ? 1.0 : 255.0 / 224.0);
+    double black = (range == YUV_RANGE_FULL ? 0.0 : 16.0);
+    y = (y - black) * ys;
+    cb = (cb - 128.0) * cs;
+    cr = (cr - 128.0) * cs;
+    double rgb[3] = { y + 2.0 * (1.0 - kr) * cr, y - 2.0 * (1.0 - kb) * kb / kg * cb - 2.0 * (1.0 - kr) * kr / kg * cr,
+        y + 2.0 * (1.0 - kb) * cb };
+    double error = 0.0;
+    for (int c = 0; c < 3; c++) {
+        double ref = std::min(255.0, std::max(0.0, rgb[c]));
+        int index = (outFormat == YUV_OUT_BGRA ? 2 - c : c);
+        error = std::max(error, std::fabs(pixel[index] - ref));
+    }
+    return error;
+}
+
+// Max difference between the RGB pixels and a floating point conversion of the samples
+static double getRGBError(const unsigned char* rgb, const int* samples, int npixels, int outFormat, int matrix, int range, double scale) {
+    int depth = (outFormat == YUV_OUT_RGB24 ? 3 : 4);
+    double maxError = 0.0;
+    for (int x = 0; x < npixels; x++) {
+        const int* s = samples + x / 2 * 4;
+        maxError = std::max(maxError, getPixelError(rgb + x * depth, s[x % 2 ? 3 : 1] / scale, s[0] / scale, s[2] / scale,
+            outFormat, matrix, range));
+    }
+    return maxError;
+}
+
+static bool checkUYVYToRGB() {
+    int maxLevel = getCpuSimdLevel();
+    const int maxPixels = 1920;
+    std::vector<unsigned char> in(maxPixels * 5 / 2), ref(maxPixels * 4 + 64), out(maxPixels * 4 + 64);
+    std::vector<int> samples(maxPixels * 2);
+    fillRandom(in.data(), (int)in.size(), 17);
+    bool ok = true;
+    for (int packed10 = 0; packed10 < 2 && ok; packed10++) {
+        for (int i = 0; i < maxPixels * 2; i++)
+            samples[i] = (packed10 ? tools::get10bitsWord(in.data(), i) : in[i]);
+        for (int outFormat = YUV_OUT_RGB24; outFormat <= YUV_OUT_BGRA && ok; outFormat++) {
+            for (int matrix = YUV_MATRIX_BT601; matrix <= YUV_MATRIX_BT709 && ok; matrix++) {
+                for (int range = YUV_RANGE_LIMITED; range <= YUV_RANGE_FULL && ok; range++) {
+                    // All the sizes up to 100 pixels for the tails of the kernels, odd ones included, then a 1080 line
+                    for (int npixels = 1; npixels <= maxPixels && ok; npixels = (npixels < 100 ? npixels + 1 : npixels < maxPixels ? maxPixels : maxPixels + 1)) {
+                        simd::setMaxLevel(SIMD_LEVEL_NONE);
+                        std::fill(ref.begin(), ref.end(), 0xA5);
+                        convertUYVYToRGB(packed10 != 0, ref.data(), in.data(), npixels, outFormat, matrix, range);
+                        double error = getRGBError(ref.data(), samples.data(), npixels, outFormat, matrix, range, packed10 ? 4.0 : 1.0);
+                        if (error >= 1.0) {
+                            printf("%d bits to %s, matrix %d, range %d, %d pixels: error of %.2f against the floating point conversion\n",
+                                packed10 ? 10 : 8, g_rgbFormatNames[outFormat], matrix, range, npixels, error);
+                            ok = false;
+                        }
+                        for (int level = SIMD_LEVEL_NONE + 1; level <= maxLevel && ok; level++) {
+                            simd::setMaxLevel(level);
+                            std::fill(out.begin(), out.end(), 0xA5);
+                            convertUYVYToRGB(packed10 != 0, out.data(), in.data(), npixels, outFormat, matrix, range);
+                            if (out != ref) {
+                                printf("%d bits to %s, matrix %d, range %d, %s, %d pixels: differs from the scalar code\n",
+                                    packed10 ? 10 : 8, g_rgbFormatNames[outFormat], matrix, range, g_simdLevelNames[level], npixels);
+                                ok = false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    simd::setMaxLevel(maxLevel);
+    return ok;
+}
+
+static void benchUYVYToRGB() {
+    // One 1080 frame to RGBA
+    const int npixels = 1920 * 1080;
+    const int nbLoops = 10;
+    int maxLevel = getCpuSimdLevel();
+    std::vector<unsigned char> in(npixels * 5 / 2), out(npixels * 4);
+    fillRandom(in.data(), (int)in.size(), 18);
+    for (int level = SIMD_LEVEL_NONE; level <= maxLevel; level++) {
+        simd::setMaxLevel(level);
+        long long t[2];
+        for (int packed10 = 0; packed10 < 2; packed10++) {
+            long long start = getTimeInNs();
+            for (int loop = 0; loop < nbLoops; loop++)
+                convertUYVYToRGB(packed10 != 0, out.data(), in.data(), npixels, YUV_OUT_RGBA, YUV_MATRIX_BT709, YUV_RANGE_LIMITED);
+            t[packed10] = getTimeInNs() - start;
+        }
+        printf("%-8s 1080 frame to RGBA: 8 bits %.2f ms, 10 bits %.2f ms\n", g_simdLevelNames[level],
+            t[0] / 1000000.0 / nbLoops, t[1] / 1000000.0 / nbLoops);
+    }
+    simd::setMaxLevel(maxLevel);
+}
+
+/*
+* Thumbnails: the 10 bits accumulation of every SIMD level against the scalar code, 8 and 10 bits
+* input of the same image, and the thumbnail against a floating point area average
+*/
+static bool checkAccumulate10bits() {
+    int maxLevel = getCpuSimdLevel();
+    const int maxSize = 400;
+    std::vector<unsigned char> in(maxSize);
+    std::vector<unsigned int> init(maxSize / 5 * 4 + 16), ref, acc;
+    fillRandom(in.data(), (int)in.size(), 19);
+    for (size_t i = 0; i < init.size(); i++)
+        init[i] = (unsigned int)(i * 2654435761u) >> 12;
+    bool ok = true;
+    for (int size = 0; size <= maxSize && ok; size += 5) {
+        ref = init;
+        for (int i = 0; i < size / 5 * 4; i++)
+            ref[i] += tools::get10bitsWord(in.data(), i);
+        for (int level = SIMD_LEVEL_NONE + 1; level <= maxLevel && ok; level++) {
+            simd::setMaxLevel(level);
+            acc = init;
+            int done = simd::accumulate10bits(in.data(), size, acc.data());
+            if (done % 5 != 0 || done > size) {
+                printf("accumulate10bits, %s, %d bytes: %d bytes processed\n", g_simdLevelNames[level], size, done);
+                ok = false;
+                break;
+            }
+            for (int i = done / 5 * 4; i < size / 5 * 4; i++)
+                acc[i] += tools::get10bitsWord(in.data(), i);
+            if (acc != ref) {
+                printf("accumulate10bits, %s, %d bytes: differs from the scalar code\n", g_simdLevelNames[level], size);
+                ok = false;
+            }
+        }
+    }
+    simd::setMaxLevel(maxLevel);
+    return ok;
+}
+
+// Max difference between a thumbnail of all the rows and the area average of the 8 bits samples
+static double getThumbnailError(const unsigned char* rgb, const unsigned char* in, int dstW, int dstH, int srcW, int srcH,
+    int outFormat, int matrix, int range) {
+    int depth = (outFormat == YUV_OUT_RGB24 ? 3 : 4);
+    int width = srcW / 2 * 2;
+    double maxError = 0.0;
+    for (int y = 0; y < dstH; y++) {
+        int y0 = (int)((long long)y * srcH / dstH);
+        int y1 = std::max(y0 + 1, (int)((long long)(y + 1) * srcH / dstH));
+        for (int x = 0; x < dstW; x++) {
+            int x0 = (int)((long long)x * width / dstW);
+            int x1 = std::max(x0 + 1, (int)((long long)(x + 1) * width / dstW));
+            double sy = 0.0, scb = 0.0, scr = 0.0;
+            for (int j = y0; j < y1; j++) {
+                const unsigned char* line = in + (long long)j * width * 2;
+                for (int i = x0; i < x1; i++) {
+                    sy += line[2 * i + 1];
+                    scb += line[(2 * i) & ~3];
+                    scr += line[((2 * i) & ~3) + 2];
+                }
+            }
+            double n = (double)(x1 - x0) * (y1 - y0);
+            maxError = std::max(maxError, getPixelError(rgb + (y * dstW + x) * depth, sy / n, scb / n, scr / n, outFormat, matrix, range));
+        }
+    }
+    return maxError;
+}
+
+static bool checkDownscale() {
+    // srcW, srcH, dstW, dstH: odd widths, boxes of one pixel, more thumbnail rows than source rows
+    static const int sizes[][4] = { { 1920, 1080, 240, 135 }, { 1921, 31, 17, 5 }, { 37, 11, 5, 3 }, { 2, 1, 1, 1 },
+        { 101, 7, 13, 7 }, { 64, 64, 64, 64 }, { 16, 4, 8, 8 }, { 130, 9, 3, 2 } };
+    int maxLevel = getCpuSimdLevel();
+    bool ok = true;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && ok; s++) {
+        int srcW = sizes[s][0], srcH = sizes[s][1], dstW = sizes[s][2], dstH = sizes[s][3];
+        int samples = srcW / 2 * 4 * srcH;
+        // Same image in 8 bits and in packed 10 bits
+        std::vector<unsigned char> in8(samples), in10(samples / 4 * 5), ref(dstW * dstH * 4 + 64), out(ref.size());
+        fillRandom(in8.data(), (int)in8.size(), 20 + (int)s);
+        for (int i = 0; i < samples; i++)
+            tools::set10bitsWord(in10.data(), i, in8[i] << 2);
+        for (int outFormat = YUV_OUT_RGB24; outFormat <= YUV_OUT_BGRA && ok; outFormat++) {
+            for (int maxRows = 0; maxRows <= 2 && ok; maxRows += 2) {
+                int matrix = (outFormat == YUV_OUT_RGB24 ? YUV_MATRIX_BT601 : YUV_MATRIX_BT709);
+                int range = (outFormat == YUV_OUT_BGRA ? YUV_RANGE_FULL : YUV_RANGE_LIMITED);
+                simd::setMaxLevel(SIMD_LEVEL_NONE);
+                std::fill(ref.begin(), ref.end(), 0xA5);
+                UYVYDownscaleToRGB((char*)ref.data(), dstW, dstH, (const char*)in10.data(), srcW, srcH, true, outFormat, matrix, range, maxRows);
+                if (maxRows == 0) {
+                    double error = getThumbnailError(ref.data(), in8.data(), dstW, dstH, srcW, srcH, outFormat, matrix, range);
+                    if (error >= 1.0) {
+                        printf("%dx%d to %dx%d %s: error of %.2f against the area average\n", srcW, srcH, dstW, dstH,
+                            g_rgbFormatNames[outFormat], error);
+                        ok = false;
+                    }
+                }
+                for (int level = SIMD_LEVEL_NONE; level <= maxLevel && ok; level++) {
+                    simd::setMaxLevel(level);
+                    for (int packed10 = 0; packed10 < 2 && ok; packed10++) {
+                        std::fill(out.begin(), out.end(), 0xA5);
+                        UYVYDownscaleToRGB((char*)out.data(), dstW, dstH, (const char*)(packed10 ? in10.data() : in8.data()), srcW, srcH,
+                            packed10 != 0, outFormat, matrix, range, maxRows);
+                        if (out != ref) {
+                            printf("%dx%d to %dx%d %s, %d bits, %d rows, %s: differs from the 10 bits scalar code\n", srcW, srcH, dstW, dstH,
+                                g_rgbFormatNames[outFormat], packed10 ? 10 : 8, maxRows, g_simdLevelNames[level]);
+                            ok = false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    simd::setMaxLevel(maxLevel);
+    return ok && checkAccumulate10bits();
+}
+
+static void benchDownscale() {
+    // 1080 frame to a 240x135 thumbnail
+    const int srcW = 1920, srcH = 1080, dstW = 240, dstH = 135;
+    const int nbLoops = 20;
+    int maxLevel = getCpuSimdLevel();
+    std::vector<unsigned char> in(srcW * srcH * 5 / 2), out(dstW * dstH * 4);
+    fillRandom(in.data(), (int)in.size(), 21);
+    // 10 bits all rows, 8 bits all rows, 10 bits 2 rows per thumbnail row
+    static const int modes[3][2] = { { 1, 0 }, { 0, 0 }, { 1, 2 } };
+    for (int level = SIMD_LEVEL_NONE; level <= maxLevel; level++) {
+        simd::setMaxLevel(level);
+        long long t[3];
+        for (int m = 0; m < 3; m++) {
+            long long start = getTimeInNs();
+            for (int loop = 0; loop < nbLoops; loop++)
+                UYVYDownscaleToRGB((char*)out.data(), dstW, dstH, (const char*)in.data(), srcW, srcH, modes[m][0] != 0,
+                    YUV_OUT_RGBA, YUV_MATRIX_BT709, YUV_RANGE_LIMITED, modes[m][1]);
+            t[m] = getTimeInNs() - start;
+        }
+        printf("%-8s 1080 frame to 240x135: 10 bits %.2f ms, 8 bits %.2f ms, 10 bits 2 rows %.2f ms\n", g_simdLevelNames[level],
+            t[0] / 1000000.0 / nbLoops, t[1] / 1000000.0 / nbLoops, t[2] / 1000000.0 / nbLoops);
+    }
+    simd::setMaxLevel(maxLevel);
+}
+
+/*
+* QOI: encode then decode must give back the image, for noise and for synthetic images using the
+* runs, the index and the differences, decoded with the same and with the other number of channels
+*/
+static void fillQOIImage(unsigned char* pixels, int w, int h, int channels, int pattern, int seed) {
+    fillRandom(pixels, w * h * channels, seed);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            unsigned char* px = pixels + (y * w + x) * channels;
+            switch (pattern) {
+            case 1:     // flat with a few random pixels: runs, longer than 62 pixels
+                if (px[0] > 8)
+                    px[0] = px[1] = px[2] = 40;
+                break;
+            case 2:     // gradients with low noise: small and luma differences
+                px[0] = (unsigned char)(x + (px[0] & 3));
+                px[1] = (unsigned char)(y + x / 4 + (px[1] & 15));
+                px[2] = (unsigned char)(x * 3 - y);
+                break;
+            case 3:     // colors from a small palette: index
+                px[1] = (unsigned char)((px[0] & 7) * 37);
+                px[2] = (unsigned char)((px[0] & 7) * 91);
+                px[0] &= 7;
+                break;
+            default:    // noise
+                break;
+            }
+            if (channels == 4 && pattern != 0)
+                px[3] = (px[3] < 16 ? px[3] : 255);
+        }
+    }
+}
+
+static bool checkQOI() {
+    static const int sizes[][2] = { { 1, 1 }, { 1, 130 }, { 130, 1 }, { 7, 5 }, { 64, 64 }, { 333, 77 }, { 1920, 1080 } };
+    static const char* patterns[] = { "noise", "flat", "gradient", "palette" };
+    bool ok = true;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && ok; s++) {
+        int w = sizes[s][0], h = sizes[s][1];
+        for (int channels = 3; channels <= 4 && ok; channels++) {
+            for (int pattern = 0; pattern < 4 && ok; pattern++) {
+                std::vector<unsigned char> pixels(w * h * channels), encoded(qoi::getMaxSize(w, h, channels)), decoded(w * h * 4 + 64, 0xA5);
+                fillQOIImage(pixels.data(), w, h, channels, pattern, 30 + pattern);
+                int size = qoi::encode(pixels.data(), w, h, channels, encoded.data(), (int)encoded.size());
+                int dw = 0, dh = 0;
+                int decodedSize = (size > 0 ? qoi::decode(encoded.data(), size, decoded.data(), w * h * channels, channels, &dw, &dh) : size);
+                bool same = (decodedSize == w * h * channels && dw == w && dh == h
+                    && std::equal(pixels.begin(), pixels.end(), decoded.begin()) && decoded[w * h * channels] == 0xA5);
+                // Decoded with the other number of channels: the alpha is added (255) or dropped
+                int otherChannels = 7 - channels;
+                std::fill(decoded.begin(), decoded.end(), 0xA5);
+                if (same && qoi::decode(encoded.data(), size, decoded.data(), w * h * otherChannels, otherChannels, &dw, &dh) == w * h * otherChannels) {
+                    for (int i = 0; i < w * h && same; i++) {
+                        same = (memcmp(&pixels[i * channels], &decoded[i * otherChannels], 3) == 0
+                            && (otherChannels == 3 || decoded[i * 4 + 3] == 255));
+                    }
+                    same = same && decoded[w * h * otherChannels] == 0xA5;
+                }
+                else
+                    same = false;
+                if (!same) {
+                    printf("%dx%d %s, %d channels: %d bytes encoded, %d bytes decoded, %dx%d, differs from the image\n",
+                        w, h, patterns[pattern], channels, size, decodedSize, dw, dh);
+                    ok = false;
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+static void benchQOI() {
+    // 1080 RGBA frames: noise, and gradients with low noise
+    const int w = 1920, h = 1080, channels = 4;
+    const int nbLoops = 10;
+    static const char* patterns[] = { "noise", "gradient" };
+    std::vector<unsigned char> pixels(w * h * channels), encoded(qoi::getMaxSize(w, h, channels)), decoded(pixels.size());
+    for (int p = 0; p < 2; p++) {
+        fillQOIImage(pixels.data(), w, h, channels, p * 2, 40);
+        int size = 0, dw, dh;
+        long long start = getTimeInNs();
+        for (int loop = 0; loop < nbLoops; loop++)
+            size = qoi::encode(pixels.data(), w, h, channels, encoded.data(), (int)encoded.size());
+        long long tEncode = getTimeInNs() - start;
+        start = getTimeInNs();
+        for (int loop = 0; loop < nbLoops; loop++)
+            qoi::decode(encoded.data(), size, decoded.data(), (int)decoded.size(), channels, &dw, &dh);
+        long long tDecode = getTimeInNs() - start;
+        printf("1080 RGBA %-8s: %.1f%% of the size, encode %.2f ms, decode %.2f ms\n", patterns[p],
+            100.0 * size / pixels.size(), tEncode / 1000000.0 / nbLoops, tDecode / 1000000.0 / nbLoops);
+    }
+}
+
+/*
+* Shmem zero-copy: a frame built in a slot lent by the output is published in place, a frame built in its
+* own buffer is copied, and a frame written after it was sent is copied first (copy on write). The receiver
+* reads all of them intact.
+*/
+static libvMI_frame_handle createShmemFrame(int nb) {
+    struct vMIFrameInitStruct init = { MEDIAFORMAT::VIDEO, 0, 640, 360, 8, SAMPLINGFMT::YCbCr_4_2_2 };
+    libvMI_frame_handle hFrame = libvmi_frame_create_ext(init);
+    if (hFrame != LIBVMI_INVALID_HANDLE) {
+        libvMI_set_frame_headers(hFrame, MEDIA_FRAME_NB, &nb);
+        fillRandom((unsigned char*)libvMI_get_frame_buffer(hFrame), libvMI_frame_getsize(hFrame), nb);
+    }
+    return hFrame;
+}
+
+static bool isShmemFrame(CvMIFrame* frame, int nb) {
+    std::vector<unsigned char> media(frame->getMediaSize());
+    fillRandom(media.data(), (int)media.size(), nb);
+    int frameNb = -1;
+    frame->get_header(MEDIA_FRAME_NB, &frameNb);
+    return frameNb == nb && memcmp(frame->getMediaBuffer(), media.data(), media.size()) == 0;
+}
+
+static bool checkShmemZeroCopy() {
+    CModuleConfiguration cfg("id=0,name=shmem_test,out_type=shmem,control=5990,zerocopy=1,in_type=shmem,control=5990");
+    COutMem* out = (COutMem*)CPinFactory::getInstance()->createOutputPin("shmem", &cfg, 0);
+    CIn* in = CPinFactory::getInstance()->createInputPin("shmem", &cfg, 0);
+    bool ok = true;
+
+    // The segment is created by the first frame sent, then the receiver registers
+    libvMI_frame_handle hFrame = createShmemFrame(0);
+    out->send(libvMI_frame_get(hFrame));
+    libvmi_frame_release(hFrame);
+    in->start();
+    std::vector<CvMIFrame*> received;
+    std::thread reader([&]() {
+        while (received.size() < 3) {
+            CvMIFrame* frame = new CvMIFrame();
+            if (in->read(frame) != VMI_E_OK) {
+                delete frame;
+                break;
+            }
+            received.push_back(frame);
+        }
+    });
+    for (int retry = 0; retry < 200 && out->_ring->getReadersNb() == 0; retry++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // Built in a slot, and published in place
+    libvMI_frame_handle hLent = createShmemFrame(1);
+    int slot = out->_ring->getSlotIndex(libvMI_frame_get(hLent)->getFrameBuffer());
+    out->send(libvMI_frame_get(hLent));
+    if (slot < 0 || out->_ring->getSlotIndex(libvMI_frame_get(hLent)->getFrameBuffer()) != slot) {
+        printf("frame #1 is not built in a slot (%d)\n", slot);
+        ok = false;
+    }
+
+    // Built in its own buffer, and copied
+    CvMIFrame::unregisterBufferProvider(out);
+    hFrame = createShmemFrame(2);
+    CvMIFrame::registerBufferProvider(out);
+    if (out->_ring->getSlotIndex(libvMI_frame_get(hFrame)->getFrameBuffer()) >= 0) {
+        printf("frame #2 is built in a slot\n");
+        ok = false;
+    }
+    out->send(libvMI_frame_get(hFrame));
+    libvmi_frame_release(hFrame);
+
+    // Written after it was sent: the receiver still reads the frame #1
+    int nb = 3;
+    libvMI_set_frame_headers(hLent, MEDIA_FRAME_NB, &nb);
+    fillRandom((unsigned char*)libvMI_get_frame_buffer(hLent), libvMI_frame_getsize(hLent), nb);
+    out->send(libvMI_frame_get(hLent));
+    libvmi_frame_release(hLent);
+
+    for (int retry = 0; retry < 200 && received.size() < 3; retry++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    in->stop();
+    reader.join();
+    if (received.size() != 3) {
+        printf("%d frames received instead of 3\n", (int)received.size());
+        ok = false;
+    }
+    for (size_t i = 0; i < received.size(); i++) {
+        if (!isShmemFrame(received[i], (int)i + 1)) {
+            printf("frame #%d received differs from the frame sent\n", (int)i + 1);
+            ok = false;
+        }
+        delete received[i];
+    }
+    delete in;
+    delete out;
+    return ok;
+}
+
+static void benchShmemZeroCopy() {
+    // 1080 10 bits frames built in a slot, then in their own buffer, without receiver
+    CModuleConfiguration cfg("id=0,name=shmem_test,out_type=shmem,control=5990,zerocopy=1");
+    COutMem* out = (COutMem*)CPinFactory::getInstance()->createOutputPin("shmem", &cfg, 0);
+    struct vMIFrameInitStruct init = { MEDIAFORMAT::VIDEO, 0, 1920, 1080, 10, SAMPLINGFMT::YCbCr_4_2_2 };
+    const int nbLoops = 100;
+    static const char* modes[] = { "built in a slot", "copied" };
+    for (int m = 0; m < 2; m++) {
+        if (m == 1)
+            CvMIFrame::unregisterBufferProvider(out);
+        long long duration = 0;
+        for (int loop = 0; loop <= nbLoops; loop++) {
+            libvMI_frame_handle hFrame = libvmi_frame_create_ext(init);
+            libvMI_get_frame_buffer(hFrame)[0] = (char)loop;
+            long long start = getTimeInNs();
+            out->send(libvMI_frame_get(hFrame));
+            // The first one creates the segment
+            if (loop > 0)
+                duration += getTimeInNs() - start;
+            libvmi_frame_release(hFrame);
+        }
+        printf("1080 10 bits %-16s: send %.3f ms\n", modes[m], duration / 1000000.0 / nbLoops);
+    }
+    delete out;
+}
+
+static tTest g_tests[] = {
+    { "hbrmp",      checkHBRMPHeaders,      benchHBRMPHeaders },
+    { "10bits",     check8and10bits,        bench8and10bits },
+    { "demux",      checkDemux425MBDL,      benchDemux425MBDL },
+    { "tpacket",    checkPacketRing,        benchPacketRing },
+    { "crc",        checkCRC18,             benchCRC18 },
+    { "rgb",        checkUYVYToRGB,         benchUYVYToRGB },
+    { "thumbnail",  checkDownscale,         benchDownscale },
+    { "qoi",        checkQOI,               benchQOI },
+    { "shmem",      checkShmemZeroCopy,     benchShmemZeroCopy },
+};
+
+/*!
+* \fn runTests
+* \brief run the checks or the benchmarks
+*
+* \param bench true to run the benchmarks, false to run the checks
+* \param name name of the only test to run, NULL for all
+* \return 0 if all the checks succeed, 1 otherwise
+*/
+static int runTests(bool bench, const char* name) {
+    int nbFailed = 0;
+    int nbRun = 0;
+    for (unsigned int i = 0; i < sizeof(g_tests) / sizeof(g_tests[0]); i++) {
+        if (name != NULL && strcmp(name, g_tests[i].name) != 0)
+            continue;
+        nbRun++;
+        if (bench) {
+            g_tests[i].bench();
+            continue;
+        }
+        bool ok = g_tests[i].check();
+        printf("%-12s %s\n", g_tests[i].name, ok ? "ok" : "FAILED");
+        if (!ok)
+            nbFailed++;
+    }
+    if (nbRun == 0)
+        printf("unknown test '%s'\n", name);
+    return (nbFailed > 0 || nbRun == 0 ? 1 : 0);
+}
+
 int main(int argc, char* argv[])
 {
     int port = 5010;
 
+    if (argc > 1 && (strcmp(argv[1], "check") == 0 || strcmp(argv[1], "bench") == 0)) {
+        setLogLevel(LOG_LEVEL_ERROR);
+        return runTests(strcmp(argv[1], "bench") == 0, argc > 2 ? argv[2] : NULL);
+    }
+
     setLogLevel((LogLevel)1);
 
     LOG("-->");
@@ -78,7 +1114,8 @@ int main(int argc, char* argv[])
         LOG_ERROR("can't catch SIGTERM");
 
     std::unique_lock<std::mutex> lock(g_mtx);
-    g_vMIModule = libvMI_init(port, &libvMI_callback, g_config);
+    g_vMIModule = libvMI_create_module(port, &libvMI_callback, g_config);
+    libvMI_start_module(g_vMIModule);
     g_var.wait(lock);
     LOG_INFO("close-->");
     //libvMI_close(g_vMIModule);
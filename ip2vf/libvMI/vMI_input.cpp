@@ -183,6 +183,9 @@ void *CvMIInput::_process(void *context)
 
         LOG_WARNING("[%d] need to reenable: m_counter.tick(m_config._name)", m_handle);
         // notify the processing node
+        m_counter.setCRCErrorsNb(m_input->getCRCErrorsNb());
+        S2022_7Stats stats;
+        m_counter.set2022_7Stats(m_input->get2022_7Stats(&stats) ? &stats : NULL);
         m_counter.tick("");
         callbackFunction(CMD_TICK, m_moduleHandle, hFrame);
     }
@@ -9,7 +9,8 @@
 CvMIOutput::CvMIOutput(const std::string &configurationString,
         libvMI_pin_handle handle, const void* user_data) :
         m_handle(handle), m_preconfig(configurationString), m_userData(
-                user_data), m_state(STATE_NOTINIT), m_inSync(false), m_syncTimestamp(0), m_syncClock(148500000)
+                user_data), m_state(STATE_NOTINIT), m_frameQueue(VMI_OUTPUT_QUEUE_SIZE), m_queueSize(VMI_OUTPUT_QUEUE_SIZE),
+                m_inSync(false), m_syncTimestamp(0), m_syncClock(148500000)
 {
     m_Outframefactory = new CFrameHeaders();
 }
@@ -43,8 +44,12 @@ void CvMIOutput::WriteFrameHeaders(unsigned char *buffer)
 int CvMIOutput::send(libvMI_frame_handle hFrame)
 {
     libvmi_frame_addref(hFrame);
-    auto newVal = std::make_pair(false, hFrame);
-    m_frameQueue.push(newVal);
+    if (!m_frameQueue.tryPush(hFrame)) {
+        // The output can't keep up: drop the frame instead of queuing it without limit
+        LOG_ERROR("[%d] output queue full (%d frames), frame [%d] dropped", m_handle, m_frameQueue.getCapacity(), hFrame);
+        libvmi_frame_release(hFrame);
+        return -1;
+    }
     return 0;
 }
 
@@ -64,6 +69,9 @@ void CvMIOutput::setParameter(OUTPUTPARAMETER param, void* value) {
     case SYNC_CLOCK:
         m_syncClock = *static_cast<unsigned int*>(value);
         break;
+    case QUEUE_SIZE:
+        m_queueSize = MAX(1, *static_cast<int*>(value));
+        break;
     default:
         break;
     }
@@ -141,6 +149,10 @@ void CvMIOutput::start()
         return;
     }
     m_quit_process = false;
+    // The frames sent before the first start are kept
+    if (m_queueSize != m_frameQueue.getCapacity() && m_frameQueue.size() == 0)
+        m_frameQueue.init(m_queueSize);
+    m_frameQueue.resetCounters();
     m_th_process = std::thread( [this] { _process(); } );
 
     m_state = STATE_STARTED;
@@ -168,18 +180,16 @@ void CvMIOutput::_process()
     {
         LOG("[%d] iterate, c=%d", m_handle, count);
 
-        auto res = m_frameQueue.pop();
-        if (res.first)
-        {
-            break;
-        }
+        libvMI_frame_handle hFrame = LIBVMI_INVALID_HANDLE;
+        if (!m_frameQueue.pop(&hFrame, VMI_OUTPUT_WAIT_TIMEOUT_MS))
+            continue;
         else
         {
-            if (res.second == LIBVMI_INVALID_HANDLE) {
+            if (hFrame == LIBVMI_INVALID_HANDLE) {
                 LOG_ERROR("Invalid handle...");
                 break;
             }
-            CvMIFrame* frame = libvMI_frame_get(res.second);
+            CvMIFrame* frame = libvMI_frame_get(hFrame);
             if (frame) {
                 if (m_inSync) {
 
@@ -219,9 +229,9 @@ void CvMIOutput::_process()
                     m_oldClockTimestamp = curTimestamp;
                     m_oldFrameTimestamp = frameTimestamp;
                 }
-                LOG("[%d] send frame [%d] frame ptr=0x%x, queue size=%d", m_handle, res.second, frame, m_frameQueue.size());
+                LOG("[%d] send frame [%d] frame ptr=0x%x, queue size=%d", m_handle, hFrame, frame, m_frameQueue.size());
                 m_output->send(frame);
-                libvmi_frame_release(res.second);
+                libvmi_frame_release(hFrame);
             }
         }
 
@@ -241,8 +251,7 @@ void CvMIOutput::stop()
         return;
     }
     m_quit_process = true;
-    auto newVal = std::make_pair(true, LIBVMI_INVALID_HANDLE);
-    m_frameQueue.push(newVal);
+    m_frameQueue.wakeUp();
 
     if (m_th_process.joinable())
     {
@@ -250,6 +259,16 @@ void CvMIOutput::stop()
     }
     m_state=STATE_STOPPED;
 
+    // The frames not sent are released
+    libvMI_frame_handle hFrame;
+    int nbPending = 0;
+    while (m_frameQueue.tryPop(&hFrame)) {
+        libvmi_frame_release(hFrame);
+        nbPending++;
+    }
+    LOG_INFO("[%d] output queue: max %d/%d frames, %lld dropped when full, %d not sent", m_handle,
+        m_frameQueue.getHighWater(), m_frameQueue.getCapacity(), m_frameQueue.getOverflowsNb(), nbPending);
+
 }
 
 void CvMIOutput::_enable_sync(bool flag) {
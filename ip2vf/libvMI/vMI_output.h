@@ -5,12 +5,15 @@
 #include <string>
 #include <pins/pins.h>
 #include "common.h"
-#include "queue.h"
+#include "ringqueue.h"
 #include "moduleconfiguration.h"
 #include "tools.h"
 
 #include "libvMI.h"
 
+#define VMI_OUTPUT_QUEUE_SIZE       64
+#define VMI_OUTPUT_WAIT_TIMEOUT_MS  100
+
 class CvMIOutput {
     int                    m_id;
     libvMI_pin_handle      m_handle;
@@ -23,7 +26,8 @@ class CvMIOutput {
     State                  m_state;
     bool                   m_quit_process = false;
     std::thread            m_th_process;
-    CQueue<std::pair <bool, libvMI_frame_handle> > m_frameQueue;
+    CMpscQueue<libvMI_frame_handle> m_frameQueue;  // frames sent by any thread of the module, bounded
+    int                    m_queueSize;     // capacity of m_frameQueue at the next start
     bool                   m_inSync;
     unsigned int           m_syncTimestamp;
     unsigned int           m_syncClock;     // In MHz
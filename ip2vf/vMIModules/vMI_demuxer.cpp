@@ -102,7 +102,7 @@ void libvMI_callback(const void* user_data, CmdType cmd, int param, libvMI_pin_h
                 * A new frame is available: firstly, get the buffer address
                 */
                 int size = 0, fmt = 0;
-                char* pInFrameBuffer = libvMI_get_frame_buffer(hFrame);
+                const char* pInFrameBuffer = libvMI_get_frame_buffer_readonly(hFrame);
                 libvMI_get_frame_headers(hFrame, MEDIA_PAYLOAD_SIZE, &size);
                 libvMI_get_frame_headers(hFrame, MEDIA_FORMAT, &fmt);
 
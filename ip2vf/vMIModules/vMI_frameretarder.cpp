@@ -10,7 +10,7 @@
 #include "log.h"
 #include "tools.h"
 #include "libvMI.h"
-#include "queue.h"
+#include "ringqueue.h"
 
 #ifdef _WIN32
 
@@ -47,7 +47,7 @@ libvMI_module_handle     g_vMIModule = LIBVMI_INVALID_HANDLE;
 std::condition_variable  g_var;
 std::mutex               g_mtx;
 int                      g_nbFrameToDelay = NB_FRAME_TO_DELAY;
-CQueue<libvMI_frame_handle>     g_q;
+CSpscQueue<libvMI_frame_handle> g_q;    /* delay line, sized in main() */
 
 
 /**
@@ -96,10 +96,14 @@ void libvMI_callback(const void* user_data, CmdType cmd, int param, libvMI_pin_h
 
                 if (fmt == MEDIAFORMAT::VIDEO && bitdepth == 8) {
 
-                    g_q.push(hFrame);
-                    if (g_q.size() > g_nbFrameToDelay) {
+                    if (!g_q.tryPush(hFrame)) {
+                        LOG_ERROR("delay line full, frame #%d dropped", hFrame);
+                        libvmi_frame_release(hFrame);
+                        break;
+                    }
+                    libvMI_frame_handle hFrmToSend = LIBVMI_INVALID_HANDLE;
+                    if (g_q.size() > g_nbFrameToDelay && g_q.tryPop(&hFrmToSend)) {
 
-                        libvMI_frame_handle hFrmToSend = g_q.pop();
                         // Send the frame to all output
                         int nb_output = libvMI_get_output_count(g_vMIModule);
                         for (int i = 0; i < nb_output; i++) {
@@ -167,6 +171,7 @@ int main(int argc, char* argv[]) {
 
     LOG("-->");
     LOG_INFO("Nb frame to delay: %d", g_nbFrameToDelay);
+    g_q.init(g_nbFrameToDelay + 1);
 
     // set signal handler    
     if (signal(SIGINT, signal_handler) == SIG_ERR)
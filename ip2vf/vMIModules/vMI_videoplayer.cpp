@@ -4,6 +4,7 @@
 #include <iostream>
 #include <fstream>
 #include <mutex>
+#include <vector>
 #include <signal.h>
 #include <unistd.h>     // usleep
 
@@ -12,6 +13,7 @@
 
 #include "log.h"
 #include "tools.h"
+#include "qoi.h"
 #include "libvMI.h"
 
 using namespace std;
@@ -33,6 +35,7 @@ int                 g_frame_depth = 0;
 unsigned int        g_frame_size = 0;
 int                 g_sampling_fmt = 0;
 bool                g_bExit = false;
+std::vector<unsigned char> g_qoiBuffer;    // decoded QOI thumbnail
 
 /**
 * Description: create a X window
@@ -152,7 +155,7 @@ void libvMI_callback(const void* user_data, CmdType cmd, int param, libvMI_pin_h
         /*
         * A new frame is available: firstly, get the buffer address, then retreive wanted headers
         */
-        unsigned char* pInFrameBuffer = (unsigned char*)libvMI_get_frame_buffer(hFrame);
+        const unsigned char* pInFrameBuffer = (const unsigned char*)libvMI_get_frame_buffer_readonly(hFrame);
         int size = 0, media_fmt = 0, w = 0, h = 0, sampling_fmt = 0;
         libvMI_get_frame_headers(hFrame, MEDIA_PAYLOAD_SIZE, &size);
         libvMI_get_frame_headers(hFrame, MEDIA_FORMAT, &fmt);
@@ -162,6 +165,21 @@ void libvMI_callback(const void* user_data, CmdType cmd, int param, libvMI_pin_h
 
         LOG("receive buffer 0x%x on input[%d], fmt=%d, size=%d bytes (%dx%d, %dbpp)", pInFrameBuffer, in, fmt, size, w, h, sampling_fmt * 8);
 
+        // Compressed thumbnails: display the decoded RGBA image
+        if (fmt == MEDIAFORMAT::VIDEO && sampling_fmt == SAMPLINGFMT::QOI) {
+            int qw = 0, qh = 0;
+            g_qoiBuffer.resize((size_t)w * h * 4);
+            if (w <= 0 || h <= 0 || qoi::decode(pInFrameBuffer, size, g_qoiBuffer.data(), (int)g_qoiBuffer.size(), 4, &qw, &qh) < 0
+                || qw != w || qh != h) {
+                LOG_ERROR("can't decode the %dx%d QOI image of %d bytes", w, h, size);
+                libvmi_frame_release(hFrame);
+                break;
+            }
+            pInFrameBuffer = g_qoiBuffer.data();
+            size = w * h * 4;
+            sampling_fmt = SAMPLINGFMT::RGBA;
+        }
+
         if (g_frame_size != size || g_frame_width != w || g_frame_height != h || g_sampling_fmt != sampling_fmt || g_inBuffer==NULL || g_xbuffer==NULL) {
             g_frame_size = size;
             g_frame_width = w;